@@ -0,0 +1,568 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Net/Core/DvDevice.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Functor.h>
+#include <OpenHome/Os.h>
+
+#include "../OhmSender.h"
+#include "../OhmReceiver.h"
+#include "../OhmPacer.h"
+
+#include <atomic>
+#include <new>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define CDECL __cdecl
+#else
+#define CDECL
+#endif
+
+// Checks that audio passes through a sender and a receiver without allocating
+//
+// An OhmSender fed by an OhmPacer, as WavSender's is, sends to an OhmReceiver in the same process.
+// Once the receiver is playing and a warm up has passed, the allocations made on the two threads
+// every frame passes through (the pacer thread that builds and sends it, and the receiver thread
+// that hands it to the driver) are counted while the stream runs. Any allocation there fails the
+// check. Allocations made meanwhile by the process's other threads are reported as well.
+//
+// The allocations made by control plane operations (a new track, metatext, latency, disabling and
+// enabling the sender, stopping and restarting the receiver) are then counted over a settling
+// time after each, next to those of an idle period of the same length.
+//
+// On glibc malloc, calloc, realloc and free are interposed and forwarded to glibc's own, so every
+// allocation in the process is seen. Elsewhere the global operator new and delete are replaced,
+// which sees C++ allocations only.
+
+static const unsigned kThreadOther = 0;
+static const unsigned kThreadSender = 1;
+static const unsigned kThreadReceiver = 2;
+static const unsigned kThreadKinds = 3;
+
+static std::atomic<unsigned long long> gAllocs[kThreadKinds];
+static thread_local unsigned tThreadKind = kThreadOther; // set by the audio threads on their first frame
+
+static inline void CountAlloc()
+{
+	gAllocs[tThreadKind].fetch_add(1, std::memory_order_relaxed);
+}
+
+#ifdef __GLIBC__
+
+extern "C" {
+
+void* __libc_malloc(size_t aBytes);
+void* __libc_calloc(size_t aCount, size_t aBytes);
+void* __libc_realloc(void* aPtr, size_t aBytes);
+void __libc_free(void* aPtr);
+
+void* malloc(size_t aBytes) __THROW
+{
+	CountAlloc();
+	return (__libc_malloc(aBytes));
+}
+
+void* calloc(size_t aCount, size_t aBytes) __THROW
+{
+	CountAlloc();
+	return (__libc_calloc(aCount, aBytes));
+}
+
+void* realloc(void* aPtr, size_t aBytes) __THROW
+{
+	CountAlloc();
+	return (__libc_realloc(aPtr, aBytes));
+}
+
+void free(void* aPtr) __THROW
+{
+	__libc_free(aPtr);
+}
+
+} // extern "C"
+
+#else
+
+void* operator new(size_t aBytes)
+{
+	CountAlloc();
+	void* ptr = malloc(aBytes > 0 ? aBytes : 1);
+	if (ptr == 0) {
+		throw std::bad_alloc();
+	}
+	return (ptr);
+}
+
+void* operator new[](size_t aBytes)
+{
+	return (operator new(aBytes));
+}
+
+void operator delete(void* aPtr) noexcept
+{
+	free(aPtr);
+}
+
+void operator delete[](void* aPtr) noexcept
+{
+	free(aPtr);
+}
+
+#endif // __GLIBC__
+
+namespace OpenHome {
+namespace Av {
+
+static TUint64 Allocs(TUint aKind)
+{
+	return (gAllocs[aKind].load(std::memory_order_relaxed));
+}
+
+static TUint64 AllocsAll()
+{
+	TUint64 allocs = 0;
+
+	for (TUint i = 0; i < kThreadKinds; i++) {
+		allocs += Allocs(i);
+	}
+
+	return (allocs);
+}
+
+// CheckSender sends a fixed frame of audio each period from its pacer thread
+
+class CheckSender : public IOhmPacerHandler
+{
+	static const TUint kSampleRate = 48000;
+	static const TUint kChannels = 2;
+	static const TUint kBitDepth = 16;
+
+public:
+	static const TUint kMaxFrameBytes = 4096;
+
+public:
+	CheckSender(OhmSenderDriver& aDriver, TUint aFrameBytes);
+	void Start();
+	void Stop();
+	TUint64 Frames() const;
+
+private:
+	// IOhmPacerHandler
+	virtual void Pace();
+
+private:
+	OhmSenderDriver& iDriver;
+	TUint iFrameBytes;
+	OhmPacer iPacer;
+	std::atomic<TUint64> iFrames;
+	TByte iAudio[kMaxFrameBytes];
+};
+
+CheckSender::CheckSender(OhmSenderDriver& aDriver, TUint aFrameBytes)
+	: iDriver(aDriver)
+	, iFrameBytes(aFrameBytes)
+	, iPacer("ACHK", *this, kPriorityHigh)
+	, iFrames(0)
+{
+	// not silence, so each frame carries its samples however the driver is set
+
+	for (TUint i = 0; i < kMaxFrameBytes; i++) {
+		iAudio[i] = (TByte)(i * 7 + 1);
+	}
+
+	iPacer.SetRole(eOhmThreadSend);
+	iPacer.SetPeriod(iFrameBytes / (kChannels * kBitDepth / 8), kSampleRate);
+}
+
+void CheckSender::Start()
+{
+	iDriver.SetAudioFormat(kSampleRate, kSampleRate * kChannels * kBitDepth, kChannels, kBitDepth, true, Brn("WAV"));
+	iPacer.Start();
+}
+
+void CheckSender::Stop()
+{
+	iPacer.Stop();
+}
+
+TUint64 CheckSender::Frames() const
+{
+	return (iFrames.load());
+}
+
+void CheckSender::Pace()
+{
+	tThreadKind = kThreadSender;
+	iDriver.SendAudio(iAudio, iFrameBytes);
+	iFrames++;
+}
+
+// CheckReceiverDriver counts the audio frames it is given and returns every msg at once
+
+class CheckReceiverDriver : public IOhmReceiverDriver, public IOhmMsgProcessor
+{
+public:
+	CheckReceiverDriver();
+	TBool IsPlaying() const;
+	TBool WaitPlaying(TUint aTimeoutMs) const;
+	TUint64 Frames() const;
+
+private:
+	// IOhmReceiverDriver
+	virtual void Add(OhmMsg& aMsg);
+	virtual void Timestamp(OhmMsg& aMsg);
+	virtual void Started();
+	virtual void Connected();
+	virtual void Playing();
+	virtual void Disconnected();
+	virtual void Stopped();
+
+	// IOhmMsgProcessor
+	virtual void Process(OhmMsgAudio& aMsg);
+	virtual void Process(OhmMsgTrack& aMsg);
+	virtual void Process(OhmMsgMetatext& aMsg);
+
+private:
+	std::atomic<TBool> iPlaying;
+	std::atomic<TUint64> iFrames;
+};
+
+CheckReceiverDriver::CheckReceiverDriver()
+	: iPlaying(false)
+	, iFrames(0)
+{
+}
+
+TBool CheckReceiverDriver::IsPlaying() const
+{
+	return (iPlaying.load());
+}
+
+TBool CheckReceiverDriver::WaitPlaying(TUint aTimeoutMs) const
+{
+	static const TUint kPollMs = 10;
+
+	for (TUint waited = 0; waited < aTimeoutMs; waited += kPollMs) {
+		if (IsPlaying()) {
+			return (true);
+		}
+		Thread::Sleep(kPollMs);
+	}
+
+	return (IsPlaying());
+}
+
+TUint64 CheckReceiverDriver::Frames() const
+{
+	return (iFrames.load());
+}
+
+void CheckReceiverDriver::Add(OhmMsg& aMsg)
+{
+	tThreadKind = kThreadReceiver;
+	aMsg.Process(*this);
+	aMsg.RemoveRef();
+}
+
+void CheckReceiverDriver::Timestamp(OhmMsg& /*aMsg*/)
+{
+}
+
+void CheckReceiverDriver::Started()
+{
+}
+
+void CheckReceiverDriver::Connected()
+{
+}
+
+void CheckReceiverDriver::Playing()
+{
+	iPlaying = true;
+}
+
+void CheckReceiverDriver::Disconnected()
+{
+	iPlaying = false;
+}
+
+void CheckReceiverDriver::Stopped()
+{
+	iPlaying = false;
+}
+
+void CheckReceiverDriver::Process(OhmMsgAudio& /*aMsg*/)
+{
+	iFrames++;
+}
+
+void CheckReceiverDriver::Process(OhmMsgTrack& /*aMsg*/)
+{
+}
+
+void CheckReceiverDriver::Process(OhmMsgMetatext& /*aMsg*/)
+{
+}
+
+// ControlPlane counts the allocations each control plane operation makes in the whole process
+
+class ControlPlane
+{
+	static const TUint kPlayTimeoutMs = 10000;
+
+public:
+	ControlPlane(OhmSender& aSender, OhmReceiver& aReceiver, CheckReceiverDriver& aDriver, const Brx& aUri, TUint aSettleMs);
+	void Run();
+
+private:
+	void Measure(const TChar* aName, Functor aOperation);
+	void Idle();
+	void SetTrack();
+	void SetMetatext();
+	void SetLatency();
+	void Disable();
+	void Enable();
+	void Stop();
+	void Play();
+
+private:
+	OhmSender& iSender;
+	OhmReceiver& iReceiver;
+	CheckReceiverDriver& iDriver;
+	Brhz iUri;
+	TUint iSettleMs;
+	TUint iTrack;
+};
+
+ControlPlane::ControlPlane(OhmSender& aSender, OhmReceiver& aReceiver, CheckReceiverDriver& aDriver, const Brx& aUri, TUint aSettleMs)
+	: iSender(aSender)
+	, iReceiver(aReceiver)
+	, iDriver(aDriver)
+	, iUri(aUri)
+	, iSettleMs(aSettleMs)
+	, iTrack(0)
+{
+}
+
+void ControlPlane::Run()
+{
+	printf("\n%-16s %12s\n", "operation", "allocations");
+
+	Measure("idle", MakeFunctor(*this, &ControlPlane::Idle));
+	Measure("track", MakeFunctor(*this, &ControlPlane::SetTrack));
+	Measure("metatext", MakeFunctor(*this, &ControlPlane::SetMetatext));
+	Measure("latency", MakeFunctor(*this, &ControlPlane::SetLatency));
+	Measure("disable", MakeFunctor(*this, &ControlPlane::Disable));
+	Measure("enable", MakeFunctor(*this, &ControlPlane::Enable));
+	Measure("stop", MakeFunctor(*this, &ControlPlane::Stop));
+	Measure("play", MakeFunctor(*this, &ControlPlane::Play));
+
+	if (!iDriver.WaitPlaying(kPlayTimeoutMs)) {
+		printf("receiver did not play again\n");
+	}
+}
+
+void ControlPlane::Measure(const TChar* aName, Functor aOperation)
+{
+	TUint64 before = AllocsAll();
+
+	aOperation();
+	Thread::Sleep(iSettleMs);
+
+	printf("%-16s %12d\n", aName, (TUint)(AllocsAll() - before));
+}
+
+void ControlPlane::Idle()
+{
+}
+
+void ControlPlane::SetTrack()
+{
+	Bws<OhmSender::kMaxTrackUriBytes> uri("http://allocheck/track/");
+	uri.Append(Brn(iTrack++ % 2 == 0 ? "a" : "b"));
+	iSender.SetTrack(uri, Brn("<DIDL-Lite></DIDL-Lite>"), 0, 0);
+}
+
+void ControlPlane::SetMetatext()
+{
+	iSender.SetMetatext(Brn("<DIDL-Lite><item><dc:title>AllocCheck</dc:title></item></DIDL-Lite>"));
+}
+
+void ControlPlane::SetLatency()
+{
+	iSender.SetLatency(150);
+}
+
+void ControlPlane::Disable()
+{
+	iSender.SetEnabled(false);
+}
+
+void ControlPlane::Enable()
+{
+	iSender.SetEnabled(true);
+}
+
+void ControlPlane::Stop()
+{
+	iReceiver.Stop();
+}
+
+void ControlPlane::Play()
+{
+	iReceiver.Play(iUri);
+}
+
+static Net::DvDeviceStandard* CreateDevice(Net::DvStack& aDvStack)
+{
+	Net::DvDeviceStandard* device = new Net::DvDeviceStandard(aDvStack, Brn("AllocCheck"));
+
+	device->SetAttribute("Upnp.Domain", "av.openhome.org");
+	device->SetAttribute("Upnp.Type", "Sender");
+	device->SetAttribute("Upnp.Version", "1");
+	device->SetAttribute("Upnp.FriendlyName", "AllocCheck");
+	device->SetAttribute("Upnp.Manufacturer", "Openhome");
+	device->SetAttribute("Upnp.ModelName", "Openhome AllocCheck");
+
+	return (device);
+}
+
+static void Report(const TChar* aName, TUint64 aFrames, TUint64 aAllocs)
+{
+	TUint perThousand = (aFrames > 0) ? (TUint)(aAllocs * 1000 / aFrames) : 0;
+	printf("%-16s %10d %12d %14d\n", aName, (TUint)aFrames, (TUint)aAllocs, perThousand);
+}
+
+} // namespace Av
+} // namespace OpenHome
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+    OptionParser parser;
+    OptionUint optionAdapter("-a", "--adapter", 0, "[adapter] index of network adapter to use");
+    OptionUint optionBytes("-b", "--bytes", 960, "Bytes of audio in each frame");
+    OptionUint optionWarmup("-w", "--warmup", 2000, "Milliseconds of audio after the receiver starts playing before counting");
+    OptionUint optionTime("-t", "--time", 5000, "Milliseconds of audio over which allocations are counted");
+    OptionUint optionSettle("-s", "--settle", 500, "Milliseconds over which each control plane operation's allocations are counted");
+    OptionBool optionMulticast("-m", "--multicast", "[multicast] send the stream multicast rather than unicast");
+    parser.AddOption(&optionAdapter);
+    parser.AddOption(&optionBytes);
+    parser.AddOption(&optionWarmup);
+    parser.AddOption(&optionTime);
+    parser.AddOption(&optionSettle);
+    parser.AddOption(&optionMulticast);
+    if (!parser.Parse(aArgc, aArgv)) {
+        return (1);
+    }
+
+    InitialisationParams* initParams = InitialisationParams::Create();
+
+	Library* lib = new Library(initParams);
+
+    std::vector<NetworkAdapter*>* subnetList = lib->CreateSubnetList();
+    if (subnetList->size() <= optionAdapter.Value()) {
+		printf("adapter %d doesn't exist\n", optionAdapter.Value());
+		return (1);
+    }
+    TIpAddress subnet = (*subnetList)[optionAdapter.Value()]->Subnet();
+    TIpAddress adapter = (*subnetList)[optionAdapter.Value()]->Address();
+    Library::DestroySubnetList(subnetList);
+    lib->SetCurrentSubnet(subnet);
+
+	TUint bytes = optionBytes.Value();
+
+	bytes -= bytes % 4;
+
+	if (bytes < 4) {
+		bytes = 4;
+	}
+
+	if (bytes > CheckSender::kMaxFrameBytes) {
+		bytes = CheckSender::kMaxFrameBytes;
+	}
+
+    DvStack* dvStack = lib->StartDv();
+
+    DvDeviceStandard* device = CreateDevice(*dvStack);
+
+    OhmSenderDriver* driver = new OhmSenderDriver(lib->Env());
+
+	OhmSender* sender = new OhmSender(lib->Env(), *device, *driver, Brn("AllocCheck"), 0, adapter, 1, 100, optionMulticast.Value(), true, Brx::Empty(), Brn("image/png"), 0);
+
+    device->SetEnabled();
+
+	CheckSender* check = new CheckSender(*driver, bytes);
+
+	CheckReceiverDriver* receiverDriver = new CheckReceiverDriver();
+
+	OhmReceiver* receiver = new OhmReceiver(lib->Env(), adapter, 1, *receiverDriver);
+
+	Brhz uri(sender->SenderUri());
+
+	printf("%s, %d bytes a frame\n", uri.CString(), bytes);
+
+	check->Start();
+	receiver->Play(uri);
+
+	TBool pass = receiverDriver->WaitPlaying(10000);
+
+	if (!pass) {
+		printf("receiver did not play\n");
+	}
+	else {
+		Thread::Sleep(optionWarmup.Value());
+
+		TUint64 sentFrames = check->Frames();
+		TUint64 receivedFrames = receiverDriver->Frames();
+		TUint64 sentAllocs = Allocs(kThreadSender);
+		TUint64 receivedAllocs = Allocs(kThreadReceiver);
+		TUint64 otherAllocs = Allocs(kThreadOther);
+
+		Thread::Sleep(optionTime.Value());
+
+		sentFrames = check->Frames() - sentFrames;
+		receivedFrames = receiverDriver->Frames() - receivedFrames;
+		sentAllocs = Allocs(kThreadSender) - sentAllocs;
+		receivedAllocs = Allocs(kThreadReceiver) - receivedAllocs;
+		otherAllocs = Allocs(kThreadOther) - otherAllocs;
+
+		printf("\n%-16s %10s %12s %14s\n", "thread", "frames", "allocations", "per 1000 frames");
+		Report("sender audio", sentFrames, sentAllocs);
+		Report("receiver audio", receivedFrames, receivedAllocs);
+		Report("other", sentFrames, otherAllocs);
+
+		pass = (sentFrames > 0 && receivedFrames > 0 && sentAllocs == 0 && receivedAllocs == 0);
+
+		printf("\n%s\n", pass ? "PASS: no allocations per audio frame" : "FAIL: audio frames allocated or did not flow");
+
+		ControlPlane controlPlane(*sender, *receiver, *receiverDriver, uri, optionSettle.Value());
+		controlPlane.Run();
+	}
+
+	receiver->Stop();
+	check->Stop();
+
+	delete (receiver);
+	delete (receiverDriver);
+	delete (check);
+	delete (sender);
+	delete (driver);
+	delete (device);
+
+	delete lib;
+
+	printf("\n");
+
+    return (pass ? 0 : 1);
+}
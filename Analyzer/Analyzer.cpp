@@ -0,0 +1,1181 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Private/Ascii.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Private/Fifo.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Os.h>
+
+#include <map>
+#include <vector>
+#include <stdio.h>
+
+#include "../Ohm.h"
+#include "../OhmCapture.h"
+
+#ifdef _WIN32
+
+#pragma warning(disable:4355) // use of 'this' in ctor lists safe in this case
+
+#define CDECL __cdecl
+
+#else
+
+#define CDECL
+
+#endif
+
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+// Offline analysis of Ohm/Ohz traffic in a capture (see OhmCapture.h)
+//
+// Datagrams are read on the main thread into a fixed pool and handed to worker threads,
+// each of which owns a subset of the streams (one stream per channel endpoint), so memory
+// use is independent of capture size and streams are analysed in parallel.
+//
+// A channel is identified by the endpoint audio is sent to (multicast) or from (unicast).
+
+static const TUint kDatagramPoolCount = 64;
+
+static void PrintEndpoint(const Endpoint& aEndpoint)
+{
+	Endpoint::EndpointBuf buf;
+	aEndpoint.AppendEndpoint(buf);
+	Brhz endpoint(buf);
+	printf("%s", endpoint.CString());
+}
+
+static TBool IsMulticast(TIpAddress aAddress)
+{
+	// TIpAddress is held in network byte order
+	const TByte* ptr = (const TByte*)&aAddress;
+	return (ptr[0] >= 224 && ptr[0] <= 239);
+}
+
+static TUint64 Key(const Endpoint& aEndpoint)
+{
+	return (((TUint64)aEndpoint.Address() << 16) | aEndpoint.Port());
+}
+
+// Histogram with power of two buckets: bucket 0 holds 0, bucket n holds [2^(n-1), 2^n)
+
+class Histogram
+{
+	static const TUint kBuckets = 32;
+
+public:
+	Histogram();
+	void Add(TUint64 aValue);
+	TUint64 Count() const {return (iCount);}
+	TUint64 Max() const {return (iMax);}
+	TUint64 Mean() const;
+	TUint64 Percentile(TUint aPercent) const; // upper bound of the bucket containing the percentile
+	void PrintBuckets() const;
+
+private:
+	TUint64 iBuckets[kBuckets];
+	TUint64 iCount;
+	TUint64 iTotal;
+	TUint64 iMax;
+};
+
+Histogram::Histogram()
+	: iCount(0)
+	, iTotal(0)
+	, iMax(0)
+{
+	for (TUint i = 0; i < kBuckets; i++) {
+		iBuckets[i] = 0;
+	}
+}
+
+void Histogram::Add(TUint64 aValue)
+{
+	TUint bucket = 0;
+
+	while (bucket < kBuckets - 1 && aValue >= (1ull << bucket)) {
+		bucket++;
+	}
+
+	iBuckets[bucket]++;
+	iCount++;
+	iTotal += aValue;
+
+	if (aValue > iMax) {
+		iMax = aValue;
+	}
+}
+
+TUint64 Histogram::Mean() const
+{
+	return ((iCount == 0) ? 0 : iTotal / iCount);
+}
+
+TUint64 Histogram::Percentile(TUint aPercent) const
+{
+	TUint64 target = (iCount * aPercent + 99) / 100;
+	TUint64 count = 0;
+
+	for (TUint i = 0; i < kBuckets; i++) {
+		count += iBuckets[i];
+		if (count >= target && count > 0) {
+			TUint64 bound = (i == 0) ? 0 : (1ull << i) - 1;
+			return ((bound < iMax) ? bound : iMax);
+		}
+	}
+
+	return (iMax);
+}
+
+void Histogram::PrintBuckets() const
+{
+	for (TUint i = 0; i < kBuckets; i++) {
+		if (iBuckets[i] == 0) {
+			continue;
+		}
+		if (i == 0) {
+			printf(" 0:%llu", (unsigned long long)iBuckets[i]);
+		}
+		else if (i == 1) {
+			printf(" 1:%llu", (unsigned long long)iBuckets[i]);
+		}
+		else {
+			printf(" %llu-%llu:%llu", 1ull << (i - 1), (1ull << i) - 1, (unsigned long long)iBuckets[i]);
+		}
+	}
+}
+
+// ChannelStats
+
+class ChannelStats
+{
+	static const TUint kWindowFrames = 4096; // a frame not seen by the time it leaves this window is lost
+	static const TUint kMaxPendingResends = 1024;
+	static const TUint kMaxSlaveCount = 16;
+	static const TUint kFrameNotSeen = 0xffffffff;
+
+public:
+	ChannelStats(const Endpoint& aChannel);
+	void Audio(TUint64 aTime, const Endpoint& aSender, const OhmHeaderAudio& aHeader);
+	void Resend(TUint64 aTime, IReader& aReader, const OhmHeaderResend& aHeader);
+	void Resend(TUint64 aTime, IReader& aReader, const OhmHeaderResendRange& aHeader);
+	void Slave(IReader& aReader, const OhmHeaderSlave& aHeader);
+	void Join() {iJoins++;}
+	void Listen() {iListens++;}
+	void Leave() {iLeaves++;}
+	void Track() {iTracks++;}
+	void Metatext() {iMetatexts++;}
+	void Finish();
+	void Print() const;
+
+private:
+	void Restart(TUint aFrame);
+	void Fulfil(TUint64 aTime, TUint aFrame);
+	void ResendFrame(TUint64 aTime, TUint aFrame);
+	void Time(TUint64 aTime);
+
+private:
+	struct PendingResend
+	{
+		TUint iFrame;
+		TUint64 iTime;
+	};
+
+private:
+	Endpoint iChannel;
+	Endpoint iSender;
+	TUint iSenders;
+	TUint64 iFirstTime;
+	TUint64 iLastTime;
+	TBool iStarted;
+	TUint iFirst;           // first frame of the current run
+	TUint iHighest;         // highest frame seen in the current run
+	TUint64 iExpected;      // frames expected across all runs
+	TUint64 iReceived;      // distinct frames received
+	TUint64 iLost;
+	TUint64 iLate;          // arrived too far behind to account for
+	TUint64 iRestarts;
+	TUint64 iRecovered;     // arrived after a later frame
+	TUint64 iDuplicates;
+	TUint64 iDuplicateResends;
+	TUint64 iSilent;        // frames sent as silence, without their samples
+	TUint iSeen[kWindowFrames];
+	Histogram iBursts;
+	TUint64 iLastArrival;
+	TUint iLastSamples;
+	TUint iSampleRate;
+	TUint iBitRate;
+	TUint iBitDepth;
+	TUint iChannels;
+	TUint iLatencyMs;
+	TInt64 iJitter;         // RFC 3550 interarrival jitter in us, scaled by 16
+	Histogram iTransit;     // absolute deviation from the expected interarrival time in us
+	TUint64 iResendRequests;
+	TUint64 iResendBytes;
+	TUint64 iResendFrames;
+	TUint64 iResendRepeats;
+	TUint64 iResendFulfilled;
+	PendingResend iPending[kMaxPendingResends];
+	Histogram iResendLatency;
+	TUint64 iJoins;
+	TUint64 iListens;
+	TUint64 iLeaves;
+	TUint64 iTracks;
+	TUint64 iMetatexts;
+	TUint64 iSlaveMsgs;
+	TUint64 iSlaveChanges;
+	TUint iSlaveCount;
+	Endpoint iSlaves[kMaxSlaveCount];
+};
+
+ChannelStats::ChannelStats(const Endpoint& aChannel)
+	: iChannel(aChannel)
+	, iSenders(0)
+	, iFirstTime(0)
+	, iLastTime(0)
+	, iStarted(false)
+	, iFirst(0)
+	, iHighest(0)
+	, iExpected(0)
+	, iReceived(0)
+	, iLost(0)
+	, iLate(0)
+	, iRestarts(0)
+	, iRecovered(0)
+	, iDuplicates(0)
+	, iDuplicateResends(0)
+	, iSilent(0)
+	, iLastArrival(0)
+	, iLastSamples(0)
+	, iSampleRate(0)
+	, iBitRate(0)
+	, iBitDepth(0)
+	, iChannels(0)
+	, iLatencyMs(0)
+	, iJitter(0)
+	, iResendRequests(0)
+	, iResendBytes(0)
+	, iResendFrames(0)
+	, iResendRepeats(0)
+	, iResendFulfilled(0)
+	, iJoins(0)
+	, iListens(0)
+	, iLeaves(0)
+	, iTracks(0)
+	, iMetatexts(0)
+	, iSlaveMsgs(0)
+	, iSlaveChanges(0)
+	, iSlaveCount(0)
+{
+	for (TUint i = 0; i < kWindowFrames; i++) {
+		iSeen[i] = kFrameNotSeen;
+	}
+
+	for (TUint i = 0; i < kMaxPendingResends; i++) {
+		iPending[i].iFrame = kFrameNotSeen;
+		iPending[i].iTime = 0;
+	}
+}
+
+void ChannelStats::Time(TUint64 aTime)
+{
+	if (iFirstTime == 0) {
+		iFirstTime = aTime;
+	}
+
+	iLastTime = aTime;
+}
+
+void ChannelStats::Restart(TUint aFrame)
+{
+	if (iStarted) {
+		Finish();
+		iRestarts++;
+	}
+
+	for (TUint i = 0; i < kWindowFrames; i++) {
+		iSeen[i] = kFrameNotSeen;
+	}
+
+	iStarted = true;
+	iFirst = aFrame;
+	iHighest = aFrame;
+	iSeen[aFrame % kWindowFrames] = aFrame;
+	iExpected++;
+	iReceived++;
+}
+
+void ChannelStats::Fulfil(TUint64 aTime, TUint aFrame)
+{
+	PendingResend& pending = iPending[aFrame % kMaxPendingResends];
+
+	if (pending.iFrame == aFrame) {
+		iResendLatency.Add(aTime - pending.iTime);
+		iResendFulfilled++;
+		pending.iFrame = kFrameNotSeen;
+	}
+}
+
+void ChannelStats::Audio(TUint64 aTime, const Endpoint& aSender, const OhmHeaderAudio& aHeader)
+{
+	Time(aTime);
+
+	if (!iSender.Equals(aSender)) {
+		iSender.Replace(aSender);
+		iSenders++;
+	}
+
+	iSampleRate = aHeader.SampleRate();
+	iBitRate = aHeader.BitRate();
+	iBitDepth = aHeader.BitDepth();
+	iChannels = aHeader.Channels();
+
+	if (aHeader.MediaLatency() != 0) {
+		TUint multiplier = ((iSampleRate % 441) == 0) ? 44100 * 256 : 48000 * 256;
+		iLatencyMs = (TUint)((TUint64)aHeader.MediaLatency() * 1000 / multiplier);
+	}
+
+	TUint frame = aHeader.Frame();
+
+	if (aHeader.Silence() && !aHeader.Resent()) {
+		iSilent++;
+	}
+
+	Fulfil(aTime, frame);
+
+	if (!iStarted) {
+		Restart(frame);
+		iLastArrival = aTime;
+		iLastSamples = aHeader.Samples();
+		return;
+	}
+
+	TInt diff = frame - iHighest;
+
+	if (diff > (TInt)kWindowFrames || diff < -(TInt)(2 * kWindowFrames)) {
+		// sender restarted or jumped; start a new run
+		Restart(frame);
+		iLastArrival = aTime;
+		iLastSamples = aHeader.Samples();
+		return;
+	}
+
+	if (diff > 0) {
+		// new highest frame; frames skipped over are a loss burst (unless they arrive later)
+
+		if (diff > 1) {
+			iBursts.Add(diff - 1);
+		}
+		else if (!aHeader.Resent() && iSampleRate != 0 && iLastSamples != 0) {
+			// consecutive frames: compare interarrival time with the audio time of the previous frame
+			TInt64 expected = (TInt64)iLastSamples * 1000000 / iSampleRate;
+			TInt64 deviation = (TInt64)(aTime - iLastArrival) - expected;
+			if (deviation < 0) {
+				deviation = -deviation;
+			}
+			iJitter += deviation - ((iJitter + 8) >> 4);
+			iTransit.Add(deviation);
+		}
+
+		for (TUint i = 1; i <= (TUint)diff; i++) {
+			TUint f = iHighest + i;
+			TUint slot = f % kWindowFrames;
+			TUint old = f - kWindowFrames;
+			TInt age = old - iFirst;
+			if (age >= 0 && iSeen[slot] != old) {
+				iLost++;
+			}
+			iSeen[slot] = (f == frame) ? frame : kFrameNotSeen;
+		}
+
+		iExpected += diff;
+		iReceived++;
+		iHighest = frame;
+		iLastArrival = aTime;
+		iLastSamples = aHeader.Samples();
+		return;
+	}
+
+	// at or behind the highest frame seen
+
+	TInt age = iHighest - frame;
+	TInt start = frame - iFirst;
+
+	if (age >= (TInt)kWindowFrames || start < 0) {
+		iLate++;
+		return;
+	}
+
+	TUint slot = frame % kWindowFrames;
+
+	if (iSeen[slot] == frame) {
+		iDuplicates++;
+		if (aHeader.Resent()) {
+			iDuplicateResends++;
+		}
+		return;
+	}
+
+	iSeen[slot] = frame;
+	iReceived++;
+	iRecovered++;
+}
+
+void ChannelStats::Resend(TUint64 aTime, IReader& aReader, const OhmHeaderResend& aHeader)
+{
+	Time(aTime);
+
+	ReaderBinary reader(aReader);
+
+	iResendRequests++;
+	iResendBytes += OhmHeader::kHeaderBytes + aHeader.MsgBytes();
+
+	for (TUint i = 0; i < aHeader.FramesCount(); i++) {
+		ResendFrame(aTime, reader.ReadUintBe(4));
+	}
+}
+
+void ChannelStats::Resend(TUint64 aTime, IReader& aReader, const OhmHeaderResendRange& aHeader)
+{
+	Time(aTime);
+
+	ReaderBinary reader(aReader);
+
+	iResendRequests++;
+	iResendBytes += OhmHeader::kHeaderBytes + aHeader.MsgBytes();
+
+	for (TUint i = 0; i < aHeader.BitmapBytes(); i++) {
+		TUint bits = reader.ReadUintBe(1);
+
+		for (TUint bit = 0; bit < 8; bit++) {
+			if (bits & (1 << bit)) {
+				ResendFrame(aTime, aHeader.First() + i * 8 + bit);
+			}
+		}
+	}
+}
+
+void ChannelStats::ResendFrame(TUint64 aTime, TUint aFrame)
+{
+	PendingResend& pending = iPending[aFrame % kMaxPendingResends];
+
+	iResendFrames++;
+
+	if (pending.iFrame == aFrame) {
+		iResendRepeats++; // keep the time of the first request
+	}
+	else {
+		pending.iFrame = aFrame;
+		pending.iTime = aTime;
+	}
+}
+
+void ChannelStats::Slave(IReader& aReader, const OhmHeaderSlave& aHeader)
+{
+	ReaderBinary reader(aReader);
+
+	iSlaveMsgs++;
+
+	TUint count = aHeader.SlaveCount();
+
+	if (count > kMaxSlaveCount) {
+		count = kMaxSlaveCount;
+	}
+
+	Endpoint slaves[kMaxSlaveCount];
+
+	for (TUint i = 0; i < count; i++) {
+		TIpAddress address = reader.ReadUintBe(4);
+		TUint port = reader.ReadUintBe(2);
+		slaves[i].Replace(Endpoint(port, address));
+	}
+
+	// count slaves added and removed since the last list
+
+	for (TUint i = 0; i < count; i++) {
+		TBool found = false;
+		for (TUint j = 0; j < iSlaveCount; j++) {
+			if (slaves[i].Equals(iSlaves[j])) {
+				found = true;
+				break;
+			}
+		}
+		if (!found) {
+			iSlaveChanges++;
+		}
+	}
+
+	for (TUint j = 0; j < iSlaveCount; j++) {
+		TBool found = false;
+		for (TUint i = 0; i < count; i++) {
+			if (slaves[i].Equals(iSlaves[j])) {
+				found = true;
+				break;
+			}
+		}
+		if (!found) {
+			iSlaveChanges++;
+		}
+	}
+
+	for (TUint i = 0; i < count; i++) {
+		iSlaves[i].Replace(slaves[i]);
+	}
+
+	iSlaveCount = count;
+}
+
+void ChannelStats::Finish()
+{
+	// frames still in the window that never arrived are lost
+
+	if (!iStarted) {
+		return;
+	}
+
+	TUint window = iHighest - iFirst + 1;
+
+	if (window > kWindowFrames) {
+		window = kWindowFrames;
+	}
+
+	for (TUint i = 0; i < window; i++) {
+		TUint frame = iHighest - i;
+		if (iSeen[frame % kWindowFrames] != frame) {
+			iLost++;
+		}
+	}
+
+	iStarted = false;
+}
+
+void ChannelStats::Print() const
+{
+	printf("Channel ");
+	PrintEndpoint(iChannel);
+	printf(IsMulticast(iChannel.Address()) ? " (multicast)" : " (unicast)");
+
+	if (iSenders > 0) {
+		printf(" sender ");
+		PrintEndpoint(iSender);
+		if (iSenders > 1) {
+			printf(" (%d senders seen)", iSenders);
+		}
+	}
+
+	printf("\n");
+
+	TUint64 duration = iLastTime - iFirstTime;
+
+	printf("  Duration          %llu.%03llu s\n", (unsigned long long)(duration / 1000000), (unsigned long long)((duration / 1000) % 1000));
+
+	if (iExpected > 0) {
+		printf("  Format            %d Hz, %d bit, %d channels, %d kbps, latency %d ms\n", iSampleRate, iBitDepth, iChannels, iBitRate / 1000, iLatencyMs);
+		printf("  Frames            expected %llu, received %llu, lost %llu (%llu.%02llu%%), recovered %llu, late %llu, restarts %llu\n",
+			(unsigned long long)iExpected,
+			(unsigned long long)iReceived,
+			(unsigned long long)iLost,
+			(unsigned long long)(iLost * 100 / iExpected),
+			(unsigned long long)((iLost * 10000 / iExpected) % 100),
+			(unsigned long long)iRecovered,
+			(unsigned long long)iLate,
+			(unsigned long long)iRestarts);
+		printf("  Loss bursts      ");
+		iBursts.PrintBuckets();
+		printf("\n");
+		printf("  Jitter            %llu us (RFC 3550), deviation p50 %llu us, p99 %llu us, max %llu us\n",
+			(unsigned long long)(iJitter >> 4),
+			(unsigned long long)iTransit.Percentile(50),
+			(unsigned long long)iTransit.Percentile(99),
+			(unsigned long long)iTransit.Max());
+		printf("  Duplicates        %llu (%llu resent)\n", (unsigned long long)iDuplicates, (unsigned long long)iDuplicateResends);
+		printf("  Silence           %llu frames\n", (unsigned long long)iSilent);
+	}
+
+	TUint64 seconds = duration / 1000000;
+
+	printf("  Resend requests   %llu (%llu/s), %llu bytes, %llu frames, %llu repeated\n",
+		(unsigned long long)iResendRequests,
+		(unsigned long long)((seconds == 0) ? iResendRequests : iResendRequests / seconds),
+		(unsigned long long)iResendBytes,
+		(unsigned long long)iResendFrames,
+		(unsigned long long)iResendRepeats);
+
+	if (iResendLatency.Count() > 0) {
+		printf("  Resend fulfilment %llu frames, latency mean %llu us, p50 %llu us, p99 %llu us, max %llu us\n",
+			(unsigned long long)iResendFulfilled,
+			(unsigned long long)iResendLatency.Mean(),
+			(unsigned long long)iResendLatency.Percentile(50),
+			(unsigned long long)iResendLatency.Percentile(99),
+			(unsigned long long)iResendLatency.Max());
+	}
+
+	printf("  Receivers         %llu joins, %llu listens, %llu leaves\n", (unsigned long long)iJoins, (unsigned long long)iListens, (unsigned long long)iLeaves);
+	printf("  Track/Metatext    %llu/%llu\n", (unsigned long long)iTracks, (unsigned long long)iMetatexts);
+
+	if (iSlaveMsgs > 0) {
+		printf("  Slave lists       %llu msgs, %llu changes\n", (unsigned long long)iSlaveMsgs, (unsigned long long)iSlaveChanges);
+	}
+}
+
+// ZoneStats
+
+class ZoneStats
+{
+	static const TUint kMaxZones = 64;
+	static const TUint kMaxPresets = 64;
+	static const TUint kMaxZoneBytes = 100;
+
+public:
+	ZoneStats();
+	void Process(const OhmCaptureDatagram& aDatagram);
+	void Print() const;
+
+private:
+	struct PendingZone
+	{
+		Bws<kMaxZoneBytes> iZone;
+		TUint64 iTime;
+		TBool iPending;
+	};
+
+	struct PendingPreset
+	{
+		TUint iPreset;
+		TUint64 iTime;
+		TBool iPending;
+	};
+
+private:
+	TUint64 iZoneQueries;
+	TUint64 iZoneUris;
+	TUint64 iPresetQueries;
+	TUint64 iPresetInfos;
+	TUint64 iZoneSuppressed;  // queries repeated while already outstanding
+	TUint64 iFirstTime;
+	TUint64 iLastTime;
+	Histogram iZoneLatency;
+	Histogram iPresetLatency;
+	TUint iZoneCount;
+	PendingZone iZones[kMaxZones];
+	TUint iPresetCount;
+	PendingPreset iPresets[kMaxPresets];
+};
+
+ZoneStats::ZoneStats()
+	: iZoneQueries(0)
+	, iZoneUris(0)
+	, iPresetQueries(0)
+	, iPresetInfos(0)
+	, iZoneSuppressed(0)
+	, iFirstTime(0)
+	, iLastTime(0)
+	, iZoneCount(0)
+	, iPresetCount(0)
+{
+}
+
+void ZoneStats::Process(const OhmCaptureDatagram& aDatagram)
+{
+	ReaderBuffer reader(aDatagram.Data());
+
+	TUint64 time = aDatagram.Time();
+
+	if (iFirstTime == 0) {
+		iFirstTime = time;
+	}
+
+	iLastTime = time;
+
+	OhzHeader header;
+	header.Internalise(reader);
+
+	switch (header.MsgType())
+	{
+	case OhzHeader::kMsgTypeZoneQuery:
+		{
+			OhzHeaderZoneQuery headerZoneQuery;
+			headerZoneQuery.Internalise(reader, header);
+			Brn zone = reader.Read(headerZoneQuery.ZoneBytes());
+
+			iZoneQueries++;
+
+			TUint i;
+			for (i = 0; i < iZoneCount; i++) {
+				if (iZones[i].iZone == zone) {
+					break;
+				}
+			}
+			if (i == iZoneCount) {
+				if (iZoneCount == kMaxZones || zone.Bytes() > kMaxZoneBytes) {
+					break;
+				}
+				iZones[i].iZone.Replace(zone);
+				iZones[i].iPending = false;
+				iZoneCount++;
+			}
+			if (iZones[i].iPending) {
+				iZoneSuppressed++;
+			}
+			else {
+				iZones[i].iPending = true;
+				iZones[i].iTime = time;
+			}
+		}
+		break;
+	case OhzHeader::kMsgTypeZoneUri:
+		{
+			OhzHeaderZoneUri headerZoneUri;
+			headerZoneUri.Internalise(reader, header);
+			Brn zone = reader.Read(headerZoneUri.ZoneBytes());
+
+			iZoneUris++;
+
+			for (TUint i = 0; i < iZoneCount; i++) {
+				if (iZones[i].iZone == zone) {
+					if (iZones[i].iPending) {
+						iZoneLatency.Add(time - iZones[i].iTime);
+						iZones[i].iPending = false;
+					}
+					break;
+				}
+			}
+		}
+		break;
+	case OhzHeader::kMsgTypePresetQuery:
+		{
+			OhzHeaderPresetQuery headerPresetQuery;
+			headerPresetQuery.Internalise(reader, header);
+
+			iPresetQueries++;
+
+			TUint i;
+			for (i = 0; i < iPresetCount; i++) {
+				if (iPresets[i].iPreset == headerPresetQuery.Preset()) {
+					break;
+				}
+			}
+			if (i == iPresetCount) {
+				if (iPresetCount == kMaxPresets) {
+					break;
+				}
+				iPresets[i].iPreset = headerPresetQuery.Preset();
+				iPresets[i].iPending = false;
+				iPresetCount++;
+			}
+			if (!iPresets[i].iPending) {
+				iPresets[i].iPending = true;
+				iPresets[i].iTime = time;
+			}
+		}
+		break;
+	case OhzHeader::kMsgTypePresetInfo:
+		{
+			OhzHeaderPresetInfo headerPresetInfo;
+			headerPresetInfo.Internalise(reader, header);
+
+			iPresetInfos++;
+
+			for (TUint i = 0; i < iPresetCount; i++) {
+				if (iPresets[i].iPreset == headerPresetInfo.Preset()) {
+					if (iPresets[i].iPending) {
+						iPresetLatency.Add(time - iPresets[i].iTime);
+						iPresets[i].iPending = false;
+					}
+					break;
+				}
+			}
+		}
+		break;
+	}
+}
+
+void ZoneStats::Print() const
+{
+	if (iZoneQueries + iZoneUris + iPresetQueries + iPresetInfos == 0) {
+		return;
+	}
+
+	TUint64 seconds = (iLastTime - iFirstTime) / 1000000;
+
+	if (seconds == 0) {
+		seconds = 1;
+	}
+
+	TUint unanswered = 0;
+
+	for (TUint i = 0; i < iZoneCount; i++) {
+		if (iZones[i].iPending) {
+			unanswered++;
+		}
+	}
+
+	printf("Ohz\n");
+	printf("  Zone queries      %llu (%llu/s), %llu while outstanding, %d zones, %d unanswered\n",
+		(unsigned long long)iZoneQueries,
+		(unsigned long long)(iZoneQueries / seconds),
+		(unsigned long long)iZoneSuppressed,
+		iZoneCount,
+		unanswered);
+	printf("  Zone uris         %llu (%llu/s)\n", (unsigned long long)iZoneUris, (unsigned long long)(iZoneUris / seconds));
+
+	if (iZoneLatency.Count() > 0) {
+		printf("  Zone latency      mean %llu us, p50 %llu us, p99 %llu us, max %llu us\n",
+			(unsigned long long)iZoneLatency.Mean(),
+			(unsigned long long)iZoneLatency.Percentile(50),
+			(unsigned long long)iZoneLatency.Percentile(99),
+			(unsigned long long)iZoneLatency.Max());
+	}
+
+	printf("  Preset queries    %llu, infos %llu\n", (unsigned long long)iPresetQueries, (unsigned long long)iPresetInfos);
+
+	if (iPresetLatency.Count() > 0) {
+		printf("  Preset latency    mean %llu us, p50 %llu us, p99 %llu us, max %llu us\n",
+			(unsigned long long)iPresetLatency.Mean(),
+			(unsigned long long)iPresetLatency.Percentile(50),
+			(unsigned long long)iPresetLatency.Percentile(99),
+			(unsigned long long)iPresetLatency.Max());
+	}
+}
+
+// AnalyzerWorker owns the statistics for the channels hashed to it
+
+class AnalyzerWorker
+{
+	static const TUint kThreadStackBytes = 64 * 1024;
+
+public:
+	AnalyzerWorker(TUint aIndex, Fifo<OhmCaptureDatagram*>& aFree);
+	void Queue(OhmCaptureDatagram* aDatagram, TUint64 aChannel); // aDatagram 0 to finish
+	void Print() const;
+	~AnalyzerWorker();
+
+private:
+	struct Job
+	{
+		OhmCaptureDatagram* iDatagram;
+		TUint64 iChannel;
+	};
+
+private:
+	void Run();
+	void Process(const OhmCaptureDatagram& aDatagram, TUint64 aChannel);
+	ChannelStats& Channel(TUint64 aChannel);
+
+private:
+	Fifo<OhmCaptureDatagram*>& iFree;
+	Fifo<Job> iQueue;
+	std::map<TUint64, ChannelStats*> iChannels;
+	ZoneStats iZone;
+	ThreadFunctor* iThread;
+	Semaphore iFinished;
+	TUint64 iErrors;
+};
+
+AnalyzerWorker::AnalyzerWorker(TUint aIndex, Fifo<OhmCaptureDatagram*>& aFree)
+	: iFree(aFree)
+	, iQueue(kDatagramPoolCount)
+	, iFinished("ANLF", 0)
+	, iErrors(0)
+{
+	Bws<16> name("AN");
+	Ascii::AppendDec(name, aIndex);
+	Brhz thread(name);
+	iThread = new ThreadFunctor(thread.CString(), MakeFunctor(*this, &AnalyzerWorker::Run), kPriorityNormal, kThreadStackBytes);
+	iThread->Start();
+}
+
+void AnalyzerWorker::Queue(OhmCaptureDatagram* aDatagram, TUint64 aChannel)
+{
+	Job job;
+	job.iDatagram = aDatagram;
+	job.iChannel = aChannel;
+	iQueue.Write(job);
+
+	if (aDatagram == 0) {
+		iFinished.Wait();
+	}
+}
+
+void AnalyzerWorker::Run()
+{
+	for (;;) {
+		Job job = iQueue.Read();
+
+		if (job.iDatagram == 0) {
+			break;
+		}
+
+		try {
+			Process(*job.iDatagram, job.iChannel);
+		}
+		catch (OhmError&) {
+			iErrors++;
+		}
+		catch (OhzError&) {
+			iErrors++;
+		}
+		catch (ReaderError&) {
+			iErrors++;
+		}
+
+		iFree.Write(job.iDatagram);
+	}
+
+	std::map<TUint64, ChannelStats*>::iterator it = iChannels.begin();
+
+	while (it != iChannels.end()) {
+		it->second->Finish();
+		it++;
+	}
+
+	iFinished.Signal();
+}
+
+ChannelStats& AnalyzerWorker::Channel(TUint64 aChannel)
+{
+	std::map<TUint64, ChannelStats*>::iterator it = iChannels.find(aChannel);
+
+	if (it != iChannels.end()) {
+		return (*it->second);
+	}
+
+	ChannelStats* channel = new ChannelStats(Endpoint((TUint)(aChannel & 0xffff), (TIpAddress)(aChannel >> 16)));
+	iChannels[aChannel] = channel;
+	return (*channel);
+}
+
+void AnalyzerWorker::Process(const OhmCaptureDatagram& aDatagram, TUint64 aChannel)
+{
+	if (aDatagram.Data().Split(0, 4) == OhzHeader::kOhz) {
+		iZone.Process(aDatagram);
+		return;
+	}
+
+	ReaderBuffer reader(aDatagram.Data());
+
+	OhmHeader header;
+	header.Internalise(reader);
+
+	ChannelStats& channel = Channel(aChannel);
+
+	switch (header.MsgType())
+	{
+	case OhmHeader::kMsgTypeJoin:
+		channel.Join();
+		break;
+	case OhmHeader::kMsgTypeListen:
+		channel.Listen();
+		break;
+	case OhmHeader::kMsgTypeLeave:
+		channel.Leave();
+		break;
+	case OhmHeader::kMsgTypeAudio:
+		{
+			OhmHeaderAudio headerAudio;
+			headerAudio.Internalise(reader, header);
+			channel.Audio(aDatagram.Time(), aDatagram.Sender(), headerAudio);
+		}
+		break;
+	case OhmHeader::kMsgTypeTrack:
+		channel.Track();
+		break;
+	case OhmHeader::kMsgTypeMetatext:
+		channel.Metatext();
+		break;
+	case OhmHeader::kMsgTypeSlave:
+		{
+			OhmHeaderSlave headerSlave;
+			headerSlave.Internalise(reader, header);
+			channel.Slave(reader, headerSlave);
+		}
+		break;
+	case OhmHeader::kMsgTypeResend:
+		{
+			OhmHeaderResend headerResend;
+			headerResend.Internalise(reader, header);
+			channel.Resend(aDatagram.Time(), reader, headerResend);
+		}
+		break;
+	case OhmHeader::kMsgTypeResendRange:
+		{
+			OhmHeaderResendRange headerResendRange;
+			headerResendRange.Internalise(reader, header);
+			channel.Resend(aDatagram.Time(), reader, headerResendRange);
+		}
+		break;
+	}
+}
+
+void AnalyzerWorker::Print() const
+{
+	std::map<TUint64, ChannelStats*>::const_iterator it = iChannels.begin();
+
+	while (it != iChannels.end()) {
+		it->second->Print();
+		printf("\n");
+		it++;
+	}
+
+	iZone.Print();
+
+	if (iErrors > 0) {
+		printf("Malformed datagrams: %llu\n", (unsigned long long)iErrors);
+	}
+}
+
+AnalyzerWorker::~AnalyzerWorker()
+{
+	delete (iThread);
+
+	std::map<TUint64, ChannelStats*>::iterator it = iChannels.begin();
+
+	while (it != iChannels.end()) {
+		delete (it->second);
+		it++;
+	}
+}
+
+// Channel key for a datagram: messages from a sender are keyed on their destination if it
+// is a multicast group and on their source otherwise; messages to a sender on their destination
+
+static TBool Classify(const OhmCaptureDatagram& aDatagram, TUint64& aChannel)
+{
+	const Brx& data = aDatagram.Data();
+
+	if (data.Bytes() < OhmHeader::kHeaderBytes) {
+		return (false);
+	}
+
+	Brn magic = data.Split(0, 4);
+
+	if (magic == OhzHeader::kOhz) {
+		aChannel = 0;
+		return (true);
+	}
+
+	if (magic != OhmHeader::kOhm) {
+		return (false);
+	}
+
+	const Endpoint& destination = aDatagram.Destination();
+
+	switch (data[5])
+	{
+	case OhmHeader::kMsgTypeAudio:
+	case OhmHeader::kMsgTypeTrack:
+	case OhmHeader::kMsgTypeMetatext:
+	case OhmHeader::kMsgTypeSlave:
+		aChannel = Key(IsMulticast(destination.Address()) ? destination : aDatagram.Sender());
+		break;
+	default:
+		aChannel = Key(destination);
+		break;
+	}
+
+	return (true);
+}
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+    OptionParser parser;
+
+    OptionString optionFile("-f", "--file", Brn(""), "[file] capture (or pcap) file to analyse");
+    parser.AddOption(&optionFile);
+
+    OptionUint optionThreads("-t", "--threads", 4, "[threads] number of analysis threads");
+    parser.AddOption(&optionThreads);
+
+    if (!parser.Parse(aArgc, aArgv)) {
+        return (1);
+    }
+
+    InitialisationParams* initParams = InitialisationParams::Create();
+
+	Library* lib = new Library(initParams);
+
+	OhmCaptureReader* reader;
+
+	try {
+		reader = new OhmCaptureReader(optionFile.Value());
+	}
+	catch (OhmCaptureError&) {
+		Brhz file(optionFile.Value());
+		printf("Unable to read capture file %s\n", file.CString());
+		delete lib;
+		return (1);
+	}
+
+	TUint threads = optionThreads.Value();
+
+	if (threads == 0) {
+		threads = 1;
+	}
+
+	Fifo<OhmCaptureDatagram*> free(kDatagramPoolCount);
+
+	for (TUint i = 0; i < kDatagramPoolCount; i++) {
+		free.Write(new OhmCaptureDatagram());
+	}
+
+	std::vector<AnalyzerWorker*> workers;
+
+	for (TUint i = 0; i < threads; i++) {
+		workers.push_back(new AnalyzerWorker(i, free));
+	}
+
+	TUint64 start = OsTimeInUs(lib->Env().OsCtx());
+	TUint64 count = 0;
+	TUint64 ignored = 0;
+
+	for (;;) {
+		OhmCaptureDatagram* datagram = free.Read();
+
+		if (!reader->Read(*datagram)) {
+			free.Write(datagram);
+			break;
+		}
+
+		TUint64 channel;
+
+		if (!Classify(*datagram, channel)) {
+			ignored++;
+			free.Write(datagram);
+			continue;
+		}
+
+		count++;
+
+		workers[(TUint)((channel ^ (channel >> 16)) % threads)]->Queue(datagram, channel);
+	}
+
+	for (TUint i = 0; i < threads; i++) {
+		workers[i]->Queue(0, 0);
+	}
+
+	TUint64 elapsed = OsTimeInUs(lib->Env().OsCtx()) - start;
+
+	for (TUint i = 0; i < threads; i++) {
+		workers[i]->Print();
+		delete (workers[i]);
+	}
+
+	printf("Analysed %llu datagrams (%llu ignored) in %llu ms\n", (unsigned long long)count, (unsigned long long)ignored, (unsigned long long)(elapsed / 1000));
+
+	for (TUint i = 0; i < kDatagramPoolCount; i++) {
+		delete (free.Read());
+	}
+
+	delete (reader);
+
+	delete lib;
+
+    return (0);
+}
+
@@ -1,41 +1,85 @@
 objects_sender   = $(objdir)Ohm.$(objext) \
                    $(objdir)OhmMsg.$(objext) \
+                   $(objdir)OhmRealtime.$(objext) \
                    $(objdir)OhmSocket.$(objext) \
+                   $(objdir)OhmUring.$(objext) \
+                   $(objdir)OhmTrace.$(objext) \
+                   $(objdir)OhmPacer.$(objext) \
+                   $(objdir)OhmRepair.$(objext) \
+                   $(objdir)OhmSilence.$(objext) \
                    $(objdir)OhmSender.$(objext) \
                    $(ohnetgenerateddir)DvAvOpenhomeOrgSender1.$(objext)
 
 headers_sender   = Ohm.h \
                    OhmMsg.h \
+                   OhmRealtime.h \
 				   OhmSocket.h \
+				   OhmUring.h \
+                   OhmTrace.h \
+                   OhmPacer.h \
+                   OhmRepair.h \
+                   OhmSilence.h \
                    OhmSenderDriver.h \
                    OhmSender.h
 
 objects_receiver = $(objdir)Ohm.$(objext) \
                    $(objdir)OhmMsg.$(objext) \
+                   $(objdir)OhmRealtime.$(objext) \
                    $(objdir)OhmSocket.$(objext) \
+                   $(objdir)OhmUring.$(objext) \
+                   $(objdir)OhmTrace.$(objext) \
+                   $(objdir)OhmZone.$(objext) \
                    $(objdir)OhmReceiver.$(objext) \
 				   $(objdir)OhmProtocolMulticast.$(objext) \
 				   $(objdir)OhmProtocolUnicast.$(objext) \
+                   $(objdir)OhmCapture.$(objext) \
                    $(ohnetgenerateddir)DvAvOpenhomeOrgReceiver1.$(objext)
 
 headers_receiver = Ohm.h \
                    OhmMsg.h \
+                   OhmRealtime.h \
 				   OhmSocket.h \
-                   OhmReceiver.h
+				   OhmUring.h \
+                   OhmTrace.h \
+                   OhmRepair.h \
+                   OhmZone.h \
+                   OhmReceiver.h \
+                   OhmCapture.h
 
 $(objdir)Ohm.$(objext) : Ohm.cpp Ohm.h
 	$(compiler)Ohm.$(objext) -c $(cflags) $(includes) Ohm.cpp
 
-$(objdir)OhmMsg.$(objext) : OhmMsg.cpp OhmMsg.h
+$(objdir)OhmMsg.$(objext) : OhmMsg.cpp OhmMsg.h OhmRealtime.h
 	$(compiler)OhmMsg.$(objext) -c $(cflags) $(includes) OhmMsg.cpp
 
-$(objdir)OhmSocket.$(objext) : OhmSocket.cpp OhmSocket.h
+$(objdir)OhmRealtime.$(objext) : OhmRealtime.cpp OhmRealtime.h
+	$(compiler)OhmRealtime.$(objext) -c $(cflags) $(includes) OhmRealtime.cpp
+
+$(objdir)OhmSocket.$(objext) : OhmSocket.cpp OhmSocket.h OhmUring.h
 	$(compiler)OhmSocket.$(objext) -c $(cflags) $(includes) OhmSocket.cpp
 
-$(objdir)OhmSender.$(objext) : OhmSender.cpp OhmSender.h
+$(objdir)OhmUring.$(objext) : OhmUring.cpp OhmUring.h
+	$(compiler)OhmUring.$(objext) -c $(cflags) $(includes) OhmUring.cpp
+
+$(objdir)OhmTrace.$(objext) : OhmTrace.cpp OhmTrace.h
+	$(compiler)OhmTrace.$(objext) -c $(cflags) $(includes) OhmTrace.cpp
+
+$(objdir)OhmPacer.$(objext) : OhmPacer.cpp OhmPacer.h OhmRealtime.h
+	$(compiler)OhmPacer.$(objext) -c $(cflags) $(includes) OhmPacer.cpp
+
+$(objdir)OhmRepair.$(objext) : OhmRepair.cpp OhmRepair.h
+	$(compiler)OhmRepair.$(objext) -c $(cflags) $(includes) OhmRepair.cpp
+
+$(objdir)OhmSilence.$(objext) : OhmSilence.cpp OhmSilence.h
+	$(compiler)OhmSilence.$(objext) -c $(cflags) $(includes) OhmSilence.cpp
+
+$(objdir)OhmSender.$(objext) : OhmSender.cpp OhmSender.h OhmRealtime.h OhmRepair.h OhmSilence.h OhmTrace.h
 	$(compiler)OhmSender.$(objext) -c $(cflags) $(includes) OhmSender.cpp
 
-$(objdir)OhmReceiver.$(objext) : OhmReceiver.cpp OhmReceiver.h
+$(objdir)OhmZone.$(objext) : OhmZone.cpp OhmZone.h Ohm.h
+	$(compiler)OhmZone.$(objext) -c $(cflags) $(includes) OhmZone.cpp
+
+$(objdir)OhmReceiver.$(objext) : OhmReceiver.cpp OhmReceiver.h OhmRealtime.h OhmRepair.h OhmTrace.h OhmZone.h
 	$(compiler)OhmReceiver.$(objext) -c $(cflags) $(includes) OhmReceiver.cpp
 
 $(objdir)OhmProtocolMulticast.$(objext) : OhmProtocolMulticast.cpp OhmReceiver.h
@@ -44,6 +88,9 @@ $(objdir)OhmProtocolMulticast.$(objext) : OhmProtocolMulticast.cpp OhmReceiver.h
 $(objdir)OhmProtocolUnicast.$(objext) : OhmProtocolUnicast.cpp OhmReceiver.h
 	$(compiler)OhmProtocolUnicast.$(objext) -c $(cflags) $(includes) OhmProtocolUnicast.cpp
 
+$(objdir)OhmCapture.$(objext) : OhmCapture.cpp OhmCapture.h OhmReceiver.h OhmSocket.h
+	$(compiler)OhmCapture.$(objext) -c $(cflags) $(includes) OhmCapture.cpp
+
 objects_topology = $(ohnetgenerateddir)CpAvOpenhomeOrgProduct1.$(objext) \
                    $(ohnetgenerateddir)CpAvOpenhomeOrgVolume1.$(objext) \
                    $(ohnetgenerateddir)CpAvOpenhomeOrgReceiver1.$(objext) \
@@ -54,7 +101,8 @@ objects_topology = $(ohnetgenerateddir)CpAvOpenhomeOrgProduct1.$(objext) \
 
 headers_topology = ohSongcast$(dirsep)ReceiverManager1.h \
                    ohSongcast$(dirsep)ReceiverManager2.h \
-                   ohSongcast$(dirsep)ReceiverManager3.h
+                   ohSongcast$(dirsep)ReceiverManager3.h \
+                   ohSongcast$(dirsep)ReceiverRegistry.h
 
 $(objdir)ReceiverManager1.$(objext) : ohSongcast$(dirsep)ReceiverManager1.cpp $(headers_topology)
 	$(compiler)ReceiverManager1.$(objext) -c $(cflags) $(includes) ohSongcast$(dirsep)ReceiverManager1.cpp
@@ -78,7 +126,7 @@ objects_netmon   = $(ohnetmondir)NetworkMonitor.$(objext) \
                    $(ohnetgenerateddir)DvAvOpenhomeOrgNetworkMonitor1.$(objext)
 
 
-all_common_native : TestReceiverManager1 TestReceiverManager2 TestReceiverManager3 ZoneWatcher WavSender Receiver
+all_common_native : TestReceiverManager1 TestReceiverManager2 TestReceiverManager2Jobs TestReceiverManager3 TestReceiverRegistry ZoneWatcher ZoneFlood WavSender Receiver Replay Analyzer SocketBench RepairBench ResendBench FanoutBench SilenceBench RealtimeBench AllocCheck TestFastStart TestZoneSwitch
 all_common_cs : $(objdir)ohSongcast.net.dll $(objdir)TestSongcastCs.$(exeext)
 
 TestReceiverManager1 : $(objdir)TestReceiverManager1.$(exeext)
@@ -92,17 +140,32 @@ $(objdir)TestReceiverManager2.$(exeext) : ohSongcast$(dirsep)TestReceiverManager
 	$(compiler)TestReceiverManager2.$(objext) -c $(cflags) $(includes) ohSongcast$(dirsep)TestReceiverManager2.cpp
 	$(link) $(linkoutput)$(objdir)TestReceiverManager2.$(exeext) $(objdir)TestReceiverManager2.$(objext) $(objects_topology) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
 
+TestReceiverManager2Jobs : $(objdir)TestReceiverManager2Jobs.$(exeext)
+$(objdir)TestReceiverManager2Jobs.$(exeext) : ohSongcast$(dirsep)TestReceiverManager2Jobs.cpp $(headers_topology) $(objects_topology)
+	$(compiler)TestReceiverManager2Jobs.$(objext) -c $(cflags) $(includes) ohSongcast$(dirsep)TestReceiverManager2Jobs.cpp
+	$(link) $(linkoutput)$(objdir)TestReceiverManager2Jobs.$(exeext) $(objdir)TestReceiverManager2Jobs.$(objext) $(objects_topology) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
 
 TestReceiverManager3 : $(objdir)TestReceiverManager3.$(exeext)
 $(objdir)TestReceiverManager3.$(exeext) : ohSongcast$(dirsep)TestReceiverManager3.cpp  $(headers_topology) $(objects_topology)
 	$(compiler)TestReceiverManager3.$(objext) -c $(cflags) $(includes) ohSongcast$(dirsep)TestReceiverManager3.cpp
 	$(link) $(linkoutput)$(objdir)TestReceiverManager3.$(exeext) $(objdir)TestReceiverManager3.$(objext) $(objects_topology) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
 
+TestReceiverRegistry : $(objdir)TestReceiverRegistry.$(exeext)
+$(objdir)TestReceiverRegistry.$(exeext) : ohSongcast$(dirsep)TestReceiverRegistry.cpp $(headers_topology)
+	$(compiler)TestReceiverRegistry.$(objext) -c $(cflags) $(includes) ohSongcast$(dirsep)TestReceiverRegistry.cpp
+	$(link) $(linkoutput)$(objdir)TestReceiverRegistry.$(exeext) $(objdir)TestReceiverRegistry.$(objext) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
 ZoneWatcher : $(objdir)ZoneWatcher.$(exeext)
 $(objdir)ZoneWatcher.$(exeext) : ZoneWatcher$(dirsep)ZoneWatcher.cpp  $(headers_sender)  $(objects_sender)
 	$(compiler)ZoneWatcher.$(objext) -c $(cflags) $(includes) ZoneWatcher$(dirsep)ZoneWatcher.cpp
 	$(link) $(linkoutput)$(objdir)ZoneWatcher.$(exeext) $(objdir)ZoneWatcher.$(objext) $(objects_sender) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
 
+ZoneFlood : $(objdir)ZoneFlood.$(exeext)
+$(objdir)ZoneFlood.$(exeext) : ZoneFlood$(dirsep)ZoneFlood.cpp Ohm.h OhmZone.h $(objdir)Ohm.$(objext) $(objdir)OhmZone.$(objext)
+	$(compiler)ZoneFlood.$(objext) -c $(cflags) $(includes) ZoneFlood$(dirsep)ZoneFlood.cpp
+	$(link) $(linkoutput)$(objdir)ZoneFlood.$(exeext) $(objdir)ZoneFlood.$(objext) $(objdir)Ohm.$(objext) $(objdir)OhmZone.$(objext) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
 WavSender : $(objdir)WavSender.$(exeext)
 $(objdir)WavSender.$(exeext) : WavSender$(dirsep)WavSender.cpp $(headers_sender) $(objects_sender)
 	$(compiler)WavSender.$(objext) -c $(cflags) $(includes) WavSender$(dirsep)WavSender.cpp
@@ -113,6 +176,61 @@ $(objdir)Receiver.$(exeext) : Receiver$(dirsep)Receiver.cpp $(headers_receiver)
 	$(compiler)Receiver.$(objext) -c $(cflags) $(includes) Receiver$(dirsep)Receiver.cpp
 	$(link) $(linkoutput)$(objdir)Receiver.$(exeext) $(objdir)Receiver.$(objext) $(objects_receiver) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
 
+Replay : $(objdir)Replay.$(exeext) 
+$(objdir)Replay.$(exeext) : Replay$(dirsep)Replay.cpp $(headers_receiver) $(objects_receiver)
+	$(compiler)Replay.$(objext) -c $(cflags) $(includes) Replay$(dirsep)Replay.cpp
+	$(link) $(linkoutput)$(objdir)Replay.$(exeext) $(objdir)Replay.$(objext) $(objects_receiver) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
+Analyzer : $(objdir)Analyzer.$(exeext) 
+$(objdir)Analyzer.$(exeext) : Analyzer$(dirsep)Analyzer.cpp $(headers_receiver) $(objects_receiver)
+	$(compiler)Analyzer.$(objext) -c $(cflags) $(includes) Analyzer$(dirsep)Analyzer.cpp
+	$(link) $(linkoutput)$(objdir)Analyzer.$(exeext) $(objdir)Analyzer.$(objext) $(objects_receiver) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
+SocketBench : $(objdir)SocketBench.$(exeext) 
+$(objdir)SocketBench.$(exeext) : SocketBench$(dirsep)SocketBench.cpp $(headers_receiver) $(objects_receiver)
+	$(compiler)SocketBench.$(objext) -c $(cflags) $(includes) SocketBench$(dirsep)SocketBench.cpp
+	$(link) $(linkoutput)$(objdir)SocketBench.$(exeext) $(objdir)SocketBench.$(objext) $(objects_receiver) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
+RepairBench : $(objdir)RepairBench.$(exeext)
+$(objdir)RepairBench.$(exeext) : RepairBench$(dirsep)RepairBench.cpp OhmRepair.h
+	$(compiler)RepairBench.$(objext) -c $(cflags) $(includes) RepairBench$(dirsep)RepairBench.cpp
+	$(link) $(linkoutput)$(objdir)RepairBench.$(exeext) $(objdir)RepairBench.$(objext) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
+ResendBench : $(objdir)ResendBench.$(exeext)
+$(objdir)ResendBench.$(exeext) : ResendBench$(dirsep)ResendBench.cpp Ohm.h OhmRepair.h $(objdir)Ohm.$(objext) $(objdir)OhmRepair.$(objext)
+	$(compiler)ResendBench.$(objext) -c $(cflags) $(includes) ResendBench$(dirsep)ResendBench.cpp
+	$(link) $(linkoutput)$(objdir)ResendBench.$(exeext) $(objdir)ResendBench.$(objext) $(objdir)Ohm.$(objext) $(objdir)OhmRepair.$(objext) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
+FanoutBench : $(objdir)FanoutBench.$(exeext)
+$(objdir)FanoutBench.$(exeext) : FanoutBench$(dirsep)FanoutBench.cpp $(headers_sender) $(objects_sender)
+	$(compiler)FanoutBench.$(objext) -c $(cflags) $(includes) FanoutBench$(dirsep)FanoutBench.cpp
+	$(link) $(linkoutput)$(objdir)FanoutBench.$(exeext) $(objdir)FanoutBench.$(objext) $(objects_sender) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
+SilenceBench : $(objdir)SilenceBench.$(exeext)
+$(objdir)SilenceBench.$(exeext) : SilenceBench$(dirsep)SilenceBench.cpp $(headers_sender) $(objects_sender)
+	$(compiler)SilenceBench.$(objext) -c $(cflags) $(includes) SilenceBench$(dirsep)SilenceBench.cpp
+	$(link) $(linkoutput)$(objdir)SilenceBench.$(exeext) $(objdir)SilenceBench.$(objext) $(objects_sender) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
+RealtimeBench : $(objdir)RealtimeBench.$(exeext)
+$(objdir)RealtimeBench.$(exeext) : RealtimeBench$(dirsep)RealtimeBench.cpp OhmPacer.h OhmRealtime.h $(objdir)OhmPacer.$(objext) $(objdir)OhmRealtime.$(objext)
+	$(compiler)RealtimeBench.$(objext) -c $(cflags) $(includes) RealtimeBench$(dirsep)RealtimeBench.cpp
+	$(link) $(linkoutput)$(objdir)RealtimeBench.$(exeext) $(objdir)RealtimeBench.$(objext) $(objdir)OhmPacer.$(objext) $(objdir)OhmRealtime.$(objext) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
+AllocCheck : $(objdir)AllocCheck.$(exeext)
+$(objdir)AllocCheck.$(exeext) : AllocCheck$(dirsep)AllocCheck.cpp $(headers_sender) $(headers_receiver) $(objects_sender) $(objdir)OhmZone.$(objext) $(objdir)OhmReceiver.$(objext) $(objdir)OhmProtocolMulticast.$(objext) $(objdir)OhmProtocolUnicast.$(objext) $(objdir)OhmCapture.$(objext)
+	$(compiler)AllocCheck.$(objext) -c $(cflags) $(includes) AllocCheck$(dirsep)AllocCheck.cpp
+	$(link) $(linkoutput)$(objdir)AllocCheck.$(exeext) $(objdir)AllocCheck.$(objext) $(objects_sender) $(objdir)OhmZone.$(objext) $(objdir)OhmReceiver.$(objext) $(objdir)OhmProtocolMulticast.$(objext) $(objdir)OhmProtocolUnicast.$(objext) $(objdir)OhmCapture.$(objext) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
+TestFastStart : $(objdir)TestFastStart.$(exeext)
+$(objdir)TestFastStart.$(exeext) : TestFastStart$(dirsep)TestFastStart.cpp $(headers_sender) $(headers_receiver) $(objects_sender) $(objdir)OhmZone.$(objext) $(objdir)OhmReceiver.$(objext) $(objdir)OhmProtocolMulticast.$(objext) $(objdir)OhmProtocolUnicast.$(objext) $(objdir)OhmCapture.$(objext)
+	$(compiler)TestFastStart.$(objext) -c $(cflags) $(includes) TestFastStart$(dirsep)TestFastStart.cpp
+	$(link) $(linkoutput)$(objdir)TestFastStart.$(exeext) $(objdir)TestFastStart.$(objext) $(objects_sender) $(objdir)OhmZone.$(objext) $(objdir)OhmReceiver.$(objext) $(objdir)OhmProtocolMulticast.$(objext) $(objdir)OhmProtocolUnicast.$(objext) $(objdir)OhmCapture.$(objext) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
+TestZoneSwitch : $(objdir)TestZoneSwitch.$(exeext)
+$(objdir)TestZoneSwitch.$(exeext) : TestZoneSwitch$(dirsep)TestZoneSwitch.cpp $(headers_sender) $(headers_receiver) $(objects_sender) $(objdir)OhmZone.$(objext) $(objdir)OhmReceiver.$(objext) $(objdir)OhmProtocolMulticast.$(objext) $(objdir)OhmProtocolUnicast.$(objext) $(objdir)OhmCapture.$(objext)
+	$(compiler)TestZoneSwitch.$(objext) -c $(cflags) $(includes) TestZoneSwitch$(dirsep)TestZoneSwitch.cpp
+	$(link) $(linkoutput)$(objdir)TestZoneSwitch.$(exeext) $(objdir)TestZoneSwitch.$(objext) $(objects_sender) $(objdir)OhmZone.$(objext) $(objdir)OhmReceiver.$(objext) $(objdir)OhmProtocolMulticast.$(objext) $(objdir)OhmProtocolUnicast.$(objext) $(objdir)OhmCapture.$(objext) $(ohnetdir)$(libprefix)ohNetCore.$(libext) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
 
 $(objdir)ohSongcast.net.dll : $(objdir)$(dllprefix)ohSongcast.$(dllext) ohSongcast$(dirsep)Songcast.cs $(ohnetdir)ohNet.net.dll
 	$(copyfile) $(ohnetdir)ohNet.net.dll $(objdir)
@@ -0,0 +1,269 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Private/Network.h>
+#include <OpenHome/Os.h>
+
+#include "../OhmSender.h"
+
+#include <vector>
+#include <stdio.h>
+
+#ifdef __linux__
+# include <sys/resource.h>
+#endif
+
+#ifdef _WIN32
+#define CDECL __cdecl
+#else
+#define CDECL
+#endif
+
+// Compares publishing one stream on several interfaces from one OhmSenderDriver with running an
+// OhmSenderDriver for each
+//
+// Every output sends to a socket of its own on the loopback interface, which is never read. Audio
+// is handed over as fast as the drivers take it; the one driver builds each frame once for all its
+// outputs, while each independent driver builds its own. Reported are the CPU time the sending
+// thread used for each frame of stream and the memory the drivers and their frames hold.
+//
+// A hybrid stream is then sent to its endpoint and to a growing number of unicast receivers, and
+// the CPU time each receiver adds to a frame is reported.
+// CPU time is only measured on Linux.
+
+namespace OpenHome {
+namespace Av {
+
+static TUint64 ThreadCpuUs()
+{
+#ifdef __linux__
+	struct rusage usage;
+	if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+		return ((TUint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+	}
+#endif
+	return (0);
+}
+
+static const TUint kSampleRate = 48000;
+static const TUint kChannels = 2;
+static const TUint kBitDepth = 16;
+static const TUint kBitRate = kSampleRate * kChannels * kBitDepth;
+
+static TUint DriverBytes()
+{
+	return (sizeof(OhmSenderDriver) + OhmSenderDriverOutput::kMaxHistoryFrames * sizeof(OhmMsgAudio) + 10 * sizeof(OhmMsgTrack) + 10 * sizeof(OhmMsgMetatext));
+}
+
+static void Start(IOhmSenderDriver& aOutput, SocketUdp& aSink, TIpAddress aLoopback)
+{
+	aOutput.SetEndpoint(Endpoint(aSink.Port(), aLoopback), aLoopback);
+	aOutput.SetEnabled(true);
+	aOutput.SetActive(true);
+}
+
+static void Stop(IOhmSenderDriver& aOutput)
+{
+	aOutput.SetActive(false);
+	aOutput.SetEnabled(false);
+}
+
+static void Report(const TChar* aName, TUint64 aCpuUs, TUint aFrames, TUint aBytes)
+{
+	printf("%-12s %10d %10d\n", aName, (TUint)(aCpuUs * 1000 / aFrames), aBytes / 1024);
+}
+
+static void BenchShared(Environment& aEnv, TUint aOutputs, TUint aFrames, const Brx& aAudio, TIpAddress aLoopback)
+{
+	std::vector<SocketUdp*> sinks;
+
+	OhmSenderDriver* driver = new OhmSenderDriver(aEnv);
+	driver->SetAudioFormat(kSampleRate, kBitRate, kChannels, kBitDepth, true, Brn("WAV"));
+
+	std::vector<IOhmSenderDriver*> outputs;
+
+	outputs.push_back(driver);
+
+	for (TUint i = 1; i < aOutputs; i++) {
+		outputs.push_back(&driver->AddOutput());
+	}
+
+	for (TUint i = 0; i < aOutputs; i++) {
+		sinks.push_back(new SocketUdp(aEnv, 0, aLoopback));
+		Start(*outputs[i], *sinks[i], aLoopback);
+	}
+
+	TUint64 start = ThreadCpuUs();
+
+	for (TUint f = 0; f < aFrames; f++) {
+		driver->SendAudio(aAudio.Ptr(), aAudio.Bytes());
+	}
+
+	TUint64 cpuUs = ThreadCpuUs() - start;
+
+	for (TUint i = 0; i < aOutputs; i++) {
+		Stop(*outputs[i]);
+		delete (sinks[i]);
+	}
+
+	delete (driver);
+
+	Report("shared", cpuUs, aFrames, DriverBytes() + (aOutputs - 1) * sizeof(OhmSenderDriverOutput));
+}
+
+static void BenchIndependent(Environment& aEnv, TUint aOutputs, TUint aFrames, const Brx& aAudio, TIpAddress aLoopback)
+{
+	std::vector<SocketUdp*> sinks;
+	std::vector<OhmSenderDriver*> drivers;
+
+	for (TUint i = 0; i < aOutputs; i++) {
+		drivers.push_back(new OhmSenderDriver(aEnv));
+		drivers[i]->SetAudioFormat(kSampleRate, kBitRate, kChannels, kBitDepth, true, Brn("WAV"));
+		sinks.push_back(new SocketUdp(aEnv, 0, aLoopback));
+		Start(*drivers[i], *sinks[i], aLoopback);
+	}
+
+	TUint64 start = ThreadCpuUs();
+
+	for (TUint f = 0; f < aFrames; f++) {
+		for (TUint i = 0; i < aOutputs; i++) {
+			drivers[i]->SendAudio(aAudio.Ptr(), aAudio.Bytes());
+		}
+	}
+
+	TUint64 cpuUs = ThreadCpuUs() - start;
+
+	for (TUint i = 0; i < aOutputs; i++) {
+		Stop(*drivers[i]);
+		delete (sinks[i]);
+		delete (drivers[i]);
+	}
+
+	Report("independent", cpuUs, aFrames, aOutputs * DriverBytes());
+}
+
+static TUint64 BenchUnicast(Environment& aEnv, TUint aUnicasts, TUint aFrames, const Brx& aAudio, TIpAddress aLoopback)
+{
+	std::vector<SocketUdp*> sinks;
+
+	OhmSenderDriver* driver = new OhmSenderDriver(aEnv);
+	driver->SetAudioFormat(kSampleRate, kBitRate, kChannels, kBitDepth, true, Brn("WAV"));
+
+	IOhmSenderDriver& output = *driver;
+
+	for (TUint i = 0; i <= aUnicasts; i++) {
+		sinks.push_back(new SocketUdp(aEnv, 0, aLoopback));
+	}
+
+	Start(output, *sinks[0], aLoopback);
+
+	for (TUint i = 1; i <= aUnicasts; i++) {
+		output.AddUnicast(Endpoint(sinks[i]->Port(), aLoopback));
+	}
+
+	TUint64 start = ThreadCpuUs();
+
+	for (TUint f = 0; f < aFrames; f++) {
+		driver->SendAudio(aAudio.Ptr(), aAudio.Bytes());
+	}
+
+	TUint64 cpuUs = ThreadCpuUs() - start;
+
+	Stop(output);
+
+	delete (driver);
+
+	for (TUint i = 0; i <= aUnicasts; i++) {
+		delete (sinks[i]);
+	}
+
+	return (cpuUs * 1000 / aFrames);
+}
+
+} // namespace Av
+} // namespace OpenHome
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+	InitialisationParams* initParams = InitialisationParams::Create();
+
+    OptionParser parser;
+    OptionUint optionOutputs("-n", "--outputs", 2, "Number of interfaces the stream is published on");
+    OptionUint optionFrames("-f", "--frames", 20000, "Number of frames sent");
+    OptionUint optionBytes("-b", "--bytes", 960, "Bytes of audio in each frame");
+    OptionUint optionUnicasts("-u", "--unicasts", 8, "Most unicast receivers added to a hybrid stream");
+    parser.AddOption(&optionOutputs);
+    parser.AddOption(&optionFrames);
+    parser.AddOption(&optionBytes);
+    parser.AddOption(&optionUnicasts);
+    if (!parser.Parse(aArgc, aArgv)) {
+        return (1);
+    }
+
+    Library* lib = new Library(initParams);
+
+	TUint outputs = optionOutputs.Value();
+	TUint frames = optionFrames.Value();
+	TUint bytes = optionBytes.Value();
+	TUint unicasts = optionUnicasts.Value();
+
+	if (outputs == 0) {
+		outputs = 1;
+	}
+
+	if (outputs > 4) {
+		outputs = 4;
+	}
+
+	if (frames == 0) {
+		frames = 1;
+	}
+
+	if (unicasts > 8) {
+		unicasts = 8;
+	}
+
+	TUint frameBytes = kChannels * kBitDepth / 8;
+
+	bytes -= bytes % frameBytes;
+
+	if (bytes < frameBytes) {
+		bytes = frameBytes;
+	}
+
+	if (bytes > OhmMsgAudio::kMaxSampleBytes) {
+		bytes = OhmMsgAudio::kMaxSampleBytes;
+	}
+
+	TIpAddress loopback = Endpoint(0, Brn("127.0.0.1")).Address();
+
+	std::vector<TByte> audio(bytes, 0);
+
+	printf("%d outputs, %d frames of %d bytes\n\n", outputs, frames, bytes);
+	printf("%-12s %10s %10s\n", "drivers", "ns/frame", "KB");
+
+	BenchShared(lib->Env(), outputs, frames, Brn(&audio[0], bytes), loopback);
+	BenchIndependent(lib->Env(), outputs, frames, Brn(&audio[0], bytes), loopback);
+
+	printf("\n%-12s %10s %10s\n", "unicasts", "ns/frame", "ns added");
+
+	TUint64 base = BenchUnicast(lib->Env(), 0, frames, Brn(&audio[0], bytes), loopback);
+
+	printf("%-12d %10d %10s\n", 0, (TUint)base, "-");
+
+	for (TUint i = 1; i <= unicasts; i++) {
+		TUint64 ns = BenchUnicast(lib->Env(), i, frames, Brn(&audio[0], bytes), loopback);
+		printf("%-12d %10d %10d\n", i, (TUint)ns, (TInt)((TInt64)(ns - base) / (TInt64)i));
+	}
+
+	delete lib;
+
+	return (0);
+}
@@ -38,7 +38,7 @@ void OhmHeader::Internalise(IReader& aReader)
 
     iMsgType  = reader.ReadUintBe(1);
 
-    if(iMsgType > kMsgTypeResend) {
+    if(iMsgType > kMsgTypeResendRange) {
         THROW(OhmError);
     }
 
@@ -59,6 +59,39 @@ void OhmHeader::Externalise(IWriter& aWriter) const
     writer.WriteUint16Be(iBytes);
 }
 
+// OhmHeaderJoin
+
+OhmHeaderJoin::OhmHeaderJoin()
+    : iFlags(0)
+{
+}
+
+OhmHeaderJoin::OhmHeaderJoin(TUint aFlags)
+    : iFlags(aFlags)
+{
+}
+
+void OhmHeaderJoin::Internalise(IReader& aReader, const OhmHeader& aHeader)
+{
+    ASSERT (aHeader.MsgType() == OhmHeader::kMsgTypeJoin);
+
+    if (aHeader.MsgBytes() < kHeaderBytes) {
+        iFlags = 0;
+        return;
+    }
+
+    ReaderBinary readerBinary(aReader);
+
+    iFlags = readerBinary.ReadUintBe(4);
+}
+
+void OhmHeaderJoin::Externalise(IWriter& aWriter) const
+{
+    WriterBinary writer(aWriter);
+
+    writer.WriteUint32Be(iFlags);
+}
+
 // OhmMsgAudio
 
 
@@ -88,6 +121,7 @@ OhmHeaderAudio::OhmHeaderAudio(TBool aHalt,
     , iLossless(aLossless)
     , iTimestamped(aTimestamped)
 	, iResent(aResent)
+	, iSilence(false)
     , iSamples(aSamples)
     , iFrame(aFrame)
     , iNetworkTimestamp(aNetworkTimestamp)
@@ -122,6 +156,7 @@ void OhmHeaderAudio::Internalise(IReader& aReader, const OhmHeader& aHeader)
     iLossless = false;
 	iTimestamped = false;
 	iResent = false;
+	iSilence = false;
 
     TUint flags = readerBinary.ReadUintBe(1);
     
@@ -141,6 +176,10 @@ void OhmHeaderAudio::Internalise(IReader& aReader, const OhmHeader& aHeader)
         iResent = true;
     }
 
+    if (flags & kFlagSilence) {
+        iSilence = true;
+    }
+
     iSamples = readerBinary.ReadUintBe(2);
     iFrame = readerBinary.ReadUintBe(4);
     iNetworkTimestamp = readerBinary.ReadUintBe(4);
@@ -193,6 +232,10 @@ void OhmHeaderAudio::Externalise(IWriter& aWriter) const
 	if (iResent) {
 		flags |= kFlagResent;
 	}
+
+	if (iSilence) {
+		flags |= kFlagSilence;
+	}
     
     writer.WriteUint8(kHeaderBytes);
     writer.WriteUint8(flags);
@@ -342,6 +385,43 @@ void OhmHeaderResend::Externalise(IWriter& aWriter) const
 
     writer.WriteUint32Be(iFramesCount);
 }
+
+// OhmHeaderResendRange
+
+OhmHeaderResendRange::OhmHeaderResendRange()
+    : iFirst(0)
+    , iFramesCount(0)
+{
+}
+
+OhmHeaderResendRange::OhmHeaderResendRange(TUint aFirst, TUint aFramesCount)
+    : iFirst(aFirst)
+    , iFramesCount(aFramesCount)
+{
+    ASSERT(iFramesCount <= kMaxFramesCount);
+}
+
+void OhmHeaderResendRange::Internalise(IReader& aReader, const OhmHeader& aHeader)
+{
+    ASSERT (aHeader.MsgType() == OhmHeader::kMsgTypeResendRange);
+
+    ReaderBinary readerBinary(aReader);
+
+    iFirst = readerBinary.ReadUintBe(4);
+    iFramesCount = readerBinary.ReadUintBe(4);
+
+    if (iFramesCount > kMaxFramesCount || aHeader.MsgBytes() < MsgBytes()) {
+        THROW(OhmError);
+    }
+}
+
+void OhmHeaderResendRange::Externalise(IWriter& aWriter) const
+{
+    WriterBinary writer(aWriter);
+
+    writer.WriteUint32Be(iFirst);
+    writer.WriteUint32Be(iFramesCount);
+}
     
     
 
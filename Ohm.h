@@ -38,6 +38,7 @@ public:
     static const TUint kMsgTypeMetatext = 5;
     static const TUint kMsgTypeSlave = 6;
     static const TUint kMsgTypeResend = 7;
+    static const TUint kMsgTypeResendRange = 8;
 
 public:
     OhmHeader();
@@ -61,6 +62,31 @@ private:
     //6         2                       Total Bytes (Absolutely all bytes in the entire frame)
 };
 
+// Joins from older receivers carry no flags, so their header is optional
+
+class OhmHeaderJoin
+{
+public:
+    static const TUint kHeaderBytes = 4;
+    static const TUint kFlagFastStart = 0x01;
+
+public:
+    OhmHeaderJoin();
+    OhmHeaderJoin(TUint aFlags);
+
+    void Internalise(IReader& aReader, const OhmHeader& aHeader);
+    void Externalise(IWriter& aWriter) const;
+
+    TBool FastStart() const {return ((iFlags & kFlagFastStart) != 0);}
+    TUint MsgBytes() const {return (kHeaderBytes);}
+
+private:
+    //Offset    Bytes                   Desc
+    //0         4                       Flags (bit 0 = send the history needed to fill the receiver's latency)
+
+    TUint iFlags;
+};
+
 class OhmHeaderAudio
 {
 public:
@@ -70,6 +96,8 @@ public:
     static const TUint kFlagLossless = 2;
     static const TUint kFlagTimestamped = 4;
     static const TUint kFlagResent = 8;
+    static const TUint kFlagResendRange = 16;
+    static const TUint kFlagSilence = 32;
 
 public:
     OhmHeaderAudio();
@@ -99,6 +127,7 @@ public:
     TBool Lossless() const {return (iLossless);}
     TBool Timestamped() const {return (iTimestamped);}
     TBool Resent() const {return (iResent);}
+    TBool Silence() const {return (iSilence);}
     TUint Samples() const {return (iSamples);}
     TUint Frame() const {return (iFrame);}
     TUint NetworkTimestamp() const {return (iNetworkTimestamp);}
@@ -119,7 +148,7 @@ public:
 private:
     //Offset    Bytes                   Desc
     //0         1                       Msg Header Bytes (without the codec name)
-    //1         1                       Flags (lsb first: halt flag, lossless flag, timestamped flag all other bits 0)
+    //1         1                       Flags (lsb first: halt flag, lossless flag, timestamped flag, resent flag, resend range flag, silence flag all other bits 0)
     //2         2                       Samples in this msg
     //4         4                       Frame
     //8         4                       Network timestamp
@@ -136,11 +165,13 @@ private:
     //49        1                       Codec Name Bytes
     //50        n                       Codec Name
     //50 + n    Msg Total Bytes - Msg Header Bytes - Code Name Bytes (Sample data in big endian, channels interleaved, packed)
+    //          A silence msg carries no sample data; it stands for Samples in this msg of zeros
 
     TBool iHalt;
     TBool iLossless;
     TBool iTimestamped;
 	TBool iResent;
+	TBool iSilence;
     TUint iSamples;
     TUint iFrame;
     TUint iNetworkTimestamp;
@@ -259,6 +290,38 @@ private:
     TUint iFramesCount;
 };
 
+// A resend request for the frames marked in a bitmap of the n frames from the first frame, sent in
+// place of OhmHeaderResend to senders whose audio carries OhmHeaderAudio::kFlagResendRange
+
+class OhmHeaderResendRange
+{
+public:
+    static const TUint kHeaderBytes = 8;
+    static const TUint kMaxFramesCount = 256;
+    static const TUint kMaxBitmapBytes = kMaxFramesCount / 8;
+
+public:
+    OhmHeaderResendRange();
+    OhmHeaderResendRange(TUint aFirst, TUint aFramesCount);
+
+    void Internalise(IReader& aReader, const OhmHeader& aHeader);
+    void Externalise(IWriter& aWriter) const;
+
+    TUint First() const {return (iFirst);}
+    TUint FramesCount() const {return (iFramesCount);}
+    TUint BitmapBytes() const {return ((iFramesCount + 7) / 8);}
+    TUint MsgBytes() const {return (kHeaderBytes + BitmapBytes());}
+
+private:
+    //Offset    Bytes                   Desc
+    //0         4                       First frame
+    //4         4                       Frames count (n), at most 256
+    //8         (n + 7) / 8             Bitmap (lsb first: bit i set to resend frame first + i)
+
+    TUint iFirst;
+    TUint iFramesCount;
+};
+
 class OhzHeader
 {
 public:
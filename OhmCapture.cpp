@@ -0,0 +1,531 @@
+#include "OhmCapture.h"
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Os.h>
+
+#include <string.h>
+
+using namespace OpenHome;
+using namespace OpenHome::Av;
+
+static void WriteAddress(WriterBinary& aWriter, TIpAddress aAddress)
+{
+    // TIpAddress is held in network byte order
+    const TByte* ptr = (const TByte*)&aAddress;
+    aWriter.Write(Brn(ptr, 4));
+}
+
+// OhmCaptureDatagram
+
+OhmCaptureDatagram::OhmCaptureDatagram()
+    : iTime(0)
+{
+}
+
+void OhmCaptureDatagram::Set(TUint64 aTime, const Endpoint& aSender, const Endpoint& aDestination)
+{
+    iTime = aTime;
+    iSender.Replace(aSender);
+    iDestination.Replace(aDestination);
+}
+
+Bwx& OhmCaptureDatagram::Buffer()
+{
+    return (iData);
+}
+
+// OhmCaptureWriter
+
+const Brn OhmCaptureWriter::kMagic("OhmC");
+
+OhmCaptureWriter::OhmCaptureWriter(Environment& aEnv, const Brx& aFilename)
+    : iEnv(aEnv)
+    , iMutex("OHCW")
+    , iCount(0)
+{
+    Brhz filename(aFilename);
+
+    iFile = fopen(filename.CString(), "wb");
+
+    if (iFile == 0) {
+        THROW(OhmCaptureError);
+    }
+
+    Bws<8> header;
+    WriterBuffer buffer(header);
+    WriterBinary writer(buffer);
+    writer.Write(kMagic);
+    writer.WriteUint32Be(kVersion);
+
+    fwrite(header.Ptr(), 1, header.Bytes(), iFile);
+}
+
+TUint OhmCaptureWriter::Count() const
+{
+    AutoMutex mutex(iMutex);
+    return (iCount);
+}
+
+void OhmCaptureWriter::Datagram(const Brx& aBuffer, const Endpoint& aSender, const Endpoint& aDestination)
+{
+    TUint64 now = OsTimeInUs(iEnv.OsCtx());
+
+    AutoMutex mutex(iMutex);
+
+    iHeader.SetBytes(0);
+
+    WriterBuffer buffer(iHeader);
+    WriterBinary writer(buffer);
+    writer.WriteUint64Be(now);
+    WriteAddress(writer, aSender.Address());
+    writer.WriteUint16Be(aSender.Port());
+    WriteAddress(writer, aDestination.Address());
+    writer.WriteUint16Be(aDestination.Port());
+    writer.WriteUint16Be(aBuffer.Bytes());
+
+    fwrite(iHeader.Ptr(), 1, iHeader.Bytes(), iFile);
+    fwrite(aBuffer.Ptr(), 1, aBuffer.Bytes(), iFile);
+
+    iCount++;
+}
+
+OhmCaptureWriter::~OhmCaptureWriter()
+{
+    fclose(iFile);
+}
+
+// OhmCaptureReader
+
+static const TUint kPcapMagic = 0xa1b2c3d4;
+static const TUint kPcapMagicNanoseconds = 0xa1b23c4d;
+static const TUint kPcapHeaderBytes = 24;
+static const TUint kPcapRecordHeaderBytes = 16;
+
+static const TUint kLinkTypeNull = 0;
+static const TUint kLinkTypeEthernet = 1;
+static const TUint kLinkTypeRaw = 101;
+static const TUint kLinkTypeLinuxSll = 113;
+
+static const TUint kEtherTypeIpv4 = 0x0800;
+static const TUint kEtherTypeVlan = 0x8100;
+static const TUint kIpProtocolUdp = 17;
+
+OhmCaptureReader::OhmCaptureReader(const Brx& aFilename)
+    : iSwapped(false)
+    , iNanoseconds(false)
+    , iLinkType(0)
+    , iFrame(kMaxFrameBytes)
+    , iFragments(0)
+    , iFragmentAge(0)
+{
+    Brhz filename(aFilename);
+
+    iFile = fopen(filename.CString(), "rb");
+
+    if (iFile == 0) {
+        THROW(OhmCaptureError);
+    }
+
+    Bws<kPcapHeaderBytes> header;
+
+    if (!ReadBytes(header, 8)) {
+        fclose(iFile);
+        THROW(OhmCaptureError);
+    }
+
+    if (header.Split(0, 4) == OhmCaptureWriter::kMagic) {
+        TUint version = (header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7];
+
+        if (version != OhmCaptureWriter::kVersion) {
+            fclose(iFile);
+            THROW(OhmCaptureError);
+        }
+
+        iFormat = eOhmCapture;
+        return;
+    }
+
+    TUint magic = (header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+    TUint swapped = (header[3] << 24) | (header[2] << 16) | (header[1] << 8) | header[0];
+
+    if (magic == kPcapMagic || magic == kPcapMagicNanoseconds) {
+        iNanoseconds = (magic == kPcapMagicNanoseconds);
+    }
+    else if (swapped == kPcapMagic || swapped == kPcapMagicNanoseconds) {
+        iSwapped = true;
+        iNanoseconds = (swapped == kPcapMagicNanoseconds);
+    }
+    else {
+        fclose(iFile);
+        THROW(OhmCaptureError);
+    }
+
+    if (!ReadBytes(header, kPcapHeaderBytes - 8)) {
+        fclose(iFile);
+        THROW(OhmCaptureError);
+    }
+
+    iFormat = ePcap;
+    iLinkType = PcapUint(header.Ptr() + 20, 4) & 0xffff;
+    iFragments = new Fragments[kMaxFragmentedDatagrams];
+
+    for (TUint i = 0; i < kMaxFragmentedDatagrams; i++) {
+        iFragments[i].iUsed = false;
+    }
+}
+
+TBool OhmCaptureReader::Read(OhmCaptureDatagram& aDatagram)
+{
+    if (iFormat == eOhmCapture) {
+        return (ReadOhmCapture(aDatagram));
+    }
+
+    return (ReadPcap(aDatagram));
+}
+
+TBool OhmCaptureReader::ReadBytes(Bwx& aBuffer, TUint aBytes)
+{
+    // appends aBytes to aBuffer
+    ASSERT(aBuffer.Bytes() + aBytes <= aBuffer.MaxBytes());
+
+    TUint bytes = (TUint)fread((void*)(aBuffer.Ptr() + aBuffer.Bytes()), 1, aBytes, iFile);
+
+    aBuffer.SetBytes(aBuffer.Bytes() + bytes);
+
+    return (bytes == aBytes);
+}
+
+TBool OhmCaptureReader::ReadOhmCapture(OhmCaptureDatagram& aDatagram)
+{
+    Bws<OhmCaptureWriter::kRecordHeaderBytes> header;
+
+    if (!ReadBytes(header, OhmCaptureWriter::kRecordHeaderBytes)) {
+        return (false);
+    }
+
+    const TByte* ptr = header.Ptr();
+
+    TUint64 time = ((TUint64)((ptr[0] << 24) | (ptr[1] << 16) | (ptr[2] << 8) | ptr[3]) << 32) | (TUint)((ptr[4] << 24) | (ptr[5] << 16) | (ptr[6] << 8) | ptr[7]);
+    Endpoint sender(Uint16(ptr + 12), Address(ptr + 8));
+    Endpoint destination(Uint16(ptr + 18), Address(ptr + 14));
+    TUint bytes = Uint16(ptr + 20);
+
+    aDatagram.Set(time, sender, destination);
+
+    Bwx& data = aDatagram.Buffer();
+    data.SetBytes(0);
+
+    return (ReadBytes(data, bytes));
+}
+
+TBool OhmCaptureReader::ReadPcap(OhmCaptureDatagram& aDatagram)
+{
+    for (;;) {
+        Bws<kPcapRecordHeaderBytes> header;
+
+        if (!ReadBytes(header, kPcapRecordHeaderBytes)) {
+            return (false);
+        }
+
+        TUint64 seconds = PcapUint(header.Ptr(), 4);
+        TUint fraction = PcapUint(header.Ptr() + 4, 4);
+        TUint bytes = PcapUint(header.Ptr() + 8, 4);
+
+        TUint64 time = seconds * 1000000 + (iNanoseconds ? fraction / 1000 : fraction);
+
+        iFrame.SetBytes(0);
+
+        if (bytes > iFrame.MaxBytes()) {
+            if (fseek(iFile, bytes, SEEK_CUR) != 0) {
+                return (false);
+            }
+            continue;
+        }
+
+        if (!ReadBytes(iFrame, bytes)) {
+            return (false);
+        }
+
+        const TByte* ptr = iFrame.Ptr();
+        TUint offset = 0;
+
+        switch (iLinkType)
+        {
+        case kLinkTypeNull:
+            offset = 4;
+            break;
+        case kLinkTypeEthernet:
+            {
+                if (bytes < 14) {
+                    continue;
+                }
+                offset = 12;
+                TUint type = Uint16(ptr + offset);
+                while (type == kEtherTypeVlan && offset + 6 <= bytes) {
+                    offset += 4;
+                    type = Uint16(ptr + offset);
+                }
+                if (type != kEtherTypeIpv4) {
+                    continue;
+                }
+                offset += 2;
+            }
+            break;
+        case kLinkTypeLinuxSll:
+            if (bytes < 16 || Uint16(ptr + 14) != kEtherTypeIpv4) {
+                continue;
+            }
+            offset = 16;
+            break;
+        case kLinkTypeRaw:
+            offset = 0;
+            break;
+        default:
+            return (false);
+        }
+
+        if (offset >= bytes) {
+            continue;
+        }
+
+        if (ProcessIp(time, iFrame.Split(offset), aDatagram)) {
+            return (true);
+        }
+    }
+}
+
+TUint OhmCaptureReader::PcapUint(const TByte* aPtr, TUint aBytes) const
+{
+    TUint value = 0;
+
+    for (TUint i = 0; i < aBytes; i++) {
+        if (iSwapped) {
+            value |= aPtr[i] << (8 * i);
+        }
+        else {
+            value = (value << 8) | aPtr[i];
+        }
+    }
+
+    return (value);
+}
+
+TBool OhmCaptureReader::ProcessIp(TUint64 aTime, const Brx& aPacket, OhmCaptureDatagram& aDatagram)
+{
+    TUint bytes = aPacket.Bytes();
+
+    if (bytes < 20) {
+        return (false);
+    }
+
+    const TByte* ptr = aPacket.Ptr();
+
+    if ((ptr[0] >> 4) != 4 || ptr[9] != kIpProtocolUdp) {
+        return (false);
+    }
+
+    TUint headerBytes = (ptr[0] & 0x0f) * 4;
+    TUint totalBytes = Uint16(ptr + 2);
+
+    if (headerBytes < 20 || totalBytes < headerBytes || totalBytes > bytes) {
+        return (false);
+    }
+
+    Brn packet(ptr, totalBytes);
+
+    TUint flags = Uint16(ptr + 6);
+    TBool moreFragments = (flags & 0x2000) != 0;
+    TUint fragmentOffset = (flags & 0x1fff) * 8;
+
+    if (moreFragments || fragmentOffset != 0) {
+        return (Reassemble(aTime, packet, headerBytes, aDatagram));
+    }
+
+    return (ProcessUdp(aTime, Address(ptr + 12), Address(ptr + 16), packet.Split(headerBytes), aDatagram));
+}
+
+TBool OhmCaptureReader::ProcessUdp(TUint64 aTime, TIpAddress aSender, TIpAddress aDestination, const Brx& aSegment, OhmCaptureDatagram& aDatagram)
+{
+    if (aSegment.Bytes() < 8) {
+        return (false);
+    }
+
+    const TByte* ptr = aSegment.Ptr();
+
+    TUint bytes = Uint16(ptr + 4);
+
+    if (bytes < 8 || bytes > aSegment.Bytes()) {
+        return (false);
+    }
+
+    aDatagram.Set(aTime, Endpoint(Uint16(ptr), aSender), Endpoint(Uint16(ptr + 2), aDestination));
+    aDatagram.Buffer().Replace(ptr + 8, bytes - 8);
+
+    return (true);
+}
+
+TBool OhmCaptureReader::Reassemble(TUint64 aTime, const Brx& aPacket, TUint aHeaderBytes, OhmCaptureDatagram& aDatagram)
+{
+    const TByte* ptr = aPacket.Ptr();
+
+    TIpAddress sender = Address(ptr + 12);
+    TIpAddress destination = Address(ptr + 16);
+    TUint id = Uint16(ptr + 4);
+    TUint flags = Uint16(ptr + 6);
+    TBool moreFragments = (flags & 0x2000) != 0;
+    TUint offset = (flags & 0x1fff) * 8;
+    Brn payload = aPacket.Split(aHeaderBytes);
+
+    if (offset + payload.Bytes() > sizeof(iFragments[0].iData)) {
+        return (false);
+    }
+
+    // find the datagram this fragment belongs to, or recycle the oldest slot
+
+    Fragments* slot = 0;
+    Fragments* oldest = &iFragments[0];
+
+    for (TUint i = 0; i < kMaxFragmentedDatagrams; i++) {
+        Fragments& fragments = iFragments[i];
+        if (fragments.iUsed && fragments.iId == id && fragments.iSender == sender && fragments.iDestination == destination) {
+            slot = &fragments;
+            break;
+        }
+        if (!fragments.iUsed || (oldest->iUsed && fragments.iAge < oldest->iAge)) {
+            oldest = &fragments;
+        }
+    }
+
+    if (slot == 0) {
+        slot = oldest;
+        slot->iUsed = true;
+        slot->iSender = sender;
+        slot->iDestination = destination;
+        slot->iId = id;
+        slot->iReceived = 0;
+        slot->iTotal = 0;
+    }
+
+    slot->iAge = ++iFragmentAge;
+
+    memcpy(slot->iData + offset, payload.Ptr(), payload.Bytes());
+    slot->iReceived += payload.Bytes();
+
+    if (!moreFragments) {
+        slot->iTotal = offset + payload.Bytes();
+    }
+
+    if (slot->iTotal == 0 || slot->iReceived < slot->iTotal) {
+        return (false);
+    }
+
+    slot->iUsed = false;
+
+    return (ProcessUdp(aTime, sender, destination, Brn(slot->iData, slot->iTotal), aDatagram));
+}
+
+TIpAddress OhmCaptureReader::Address(const TByte* aPtr)
+{
+    // TIpAddress is held in network byte order
+    TIpAddress address;
+    memcpy(&address, aPtr, 4);
+    return (address);
+}
+
+TUint OhmCaptureReader::Uint16(const TByte* aPtr)
+{
+    return ((aPtr[0] << 8) | aPtr[1]);
+}
+
+OhmCaptureReader::~OhmCaptureReader()
+{
+    delete [] iFragments;
+    fclose(iFile);
+}
+
+// OhmReplayer
+
+OhmReplayer::OhmReplayer(Environment& aEnv, IOhmReceiver& aReceiver)
+    : iEnv(aEnv)
+    , iReceiver(aReceiver)
+    , iFactory(kMaxAudioMsgs, kMaxTrackMsgs, kMaxMetatextMsgs)
+    , iFilter(false)
+{
+}
+
+void OhmReplayer::SetSender(const Endpoint& aEndpoint)
+{
+    iSender.Replace(aEndpoint);
+    iFilter = true;
+}
+
+TUint OhmReplayer::Replay(OhmCaptureReader& aReader, TBool aRealTime)
+{
+    TUint count = 0;
+    TUint64 captureStart = 0;
+    TUint64 replayStart = 0;
+
+    while (aReader.Read(iDatagram)) {
+        if (iFilter && !iDatagram.Sender().Equals(iSender)) {
+            continue;
+        }
+
+        if (aRealTime) {
+            TUint64 now = OsTimeInUs(iEnv.OsCtx());
+
+            if (count == 0) {
+                captureStart = iDatagram.Time();
+                replayStart = now;
+            }
+            else {
+                TUint64 due = replayStart + (iDatagram.Time() - captureStart);
+
+                if (due > now + 1000) {
+                    Thread::Sleep((TUint)((due - now) / 1000));
+                }
+            }
+        }
+
+        if (Inject(iDatagram)) {
+            count++;
+        }
+    }
+
+    return (count);
+}
+
+TBool OhmReplayer::Inject(const OhmCaptureDatagram& aDatagram)
+{
+    ReaderBuffer reader(aDatagram.Data());
+
+    OhmHeader header;
+
+    try {
+        header.Internalise(reader);
+
+        switch (header.MsgType())
+        {
+        case OhmHeader::kMsgTypeAudio:
+            iReceiver.Add(iFactory.CreateAudio(reader, header));
+            return (true);
+        case OhmHeader::kMsgTypeTrack:
+            iReceiver.Add(iFactory.CreateTrack(reader, header));
+            return (true);
+        case OhmHeader::kMsgTypeMetatext:
+            iReceiver.Add(iFactory.CreateMetatext(reader, header));
+            return (true);
+        case OhmHeader::kMsgTypeResendRange:
+        case OhmHeader::kMsgTypeResend:
+            iReceiver.ResendSeen();
+            return (true);
+        default:
+            break;
+        }
+    }
+    catch (OhmError&) {
+    }
+    catch (ReaderError&) {
+    }
+
+    return (false);
+}
+
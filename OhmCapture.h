@@ -0,0 +1,171 @@
+#ifndef HEADER_OHM_CAPTURE
+#define HEADER_OHM_CAPTURE
+
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/Network.h>
+
+#include "Ohm.h"
+#include "OhmMsg.h"
+#include "OhmSocket.h"
+#include "OhmReceiver.h"
+
+#include <stdio.h>
+
+EXCEPTION(OhmCaptureError);
+
+namespace OpenHome {
+class Environment;
+namespace Av {
+
+// Capture file format (all fields big endian)
+//
+// Offset    Bytes                   Desc
+// 0         4                       "OhmC"
+// 4         4                       Version (1)
+//
+// followed by any number of records
+//
+// 0         8                       Capture time in microseconds (monotonic, arbitrary origin)
+// 8         4                       Sender address
+// 12        2                       Sender port
+// 14        4                       Destination address
+// 18        2                       Destination port
+// 20        2                       Datagram bytes (n)
+// 22        n                       Datagram
+
+class OhmCaptureDatagram
+{
+public:
+    static const TUint kMaxBytes = 64 * 1024;
+
+public:
+    OhmCaptureDatagram();
+    void Set(TUint64 aTime, const Endpoint& aSender, const Endpoint& aDestination);
+    Bwx& Buffer();
+    TUint64 Time() const {return (iTime);}
+    const Endpoint& Sender() const {return (iSender);}
+    const Endpoint& Destination() const {return (iDestination);}
+    const Brx& Data() const {return (iData);}
+
+private:
+    TUint64 iTime;
+    Endpoint iSender;
+    Endpoint iDestination;
+    Bws<kMaxBytes> iData;
+};
+
+// OhmCaptureWriter is a socket tap that records every datagram to a capture file
+
+class OhmCaptureWriter : public IOhmSocketTap, public INonCopyable
+{
+public:
+    static const Brn kMagic;
+    static const TUint kVersion = 1;
+    static const TUint kRecordHeaderBytes = 22;
+
+public:
+    OhmCaptureWriter(Environment& aEnv, const Brx& aFilename); // throws OhmCaptureError
+    TUint Count() const;
+    ~OhmCaptureWriter();
+
+private:
+    // IOhmSocketTap
+    virtual void Datagram(const Brx& aBuffer, const Endpoint& aSender, const Endpoint& aDestination);
+
+private:
+    Environment& iEnv;
+    mutable Mutex iMutex;
+    FILE* iFile;
+    TUint iCount;
+    Bws<kRecordHeaderBytes> iHeader;
+};
+
+// OhmCaptureReader reads capture files written by OhmCaptureWriter or classic libpcap files.
+// From pcap it extracts IPv4 UDP payloads (Ethernet, Linux cooked, BSD loopback and raw IP link types),
+// reassembling fragmented datagrams in a small fixed table, so memory use is constant regardless of file size
+
+class OhmCaptureReader : public INonCopyable
+{
+    static const TUint kMaxFragmentedDatagrams = 4;
+    static const TUint kMaxFrameBytes = 64 * 1024 + 64;
+
+    enum EFormat
+    {
+        eOhmCapture,
+        ePcap,
+    };
+
+public:
+    OhmCaptureReader(const Brx& aFilename); // throws OhmCaptureError, including for an unknown capture version
+    TBool Read(OhmCaptureDatagram& aDatagram); // false at end of file
+    ~OhmCaptureReader();
+
+private:
+    TBool ReadOhmCapture(OhmCaptureDatagram& aDatagram);
+    TBool ReadPcap(OhmCaptureDatagram& aDatagram);
+    TBool ReadBytes(Bwx& aBuffer, TUint aBytes);
+    TUint PcapUint(const TByte* aPtr, TUint aBytes) const;
+    TBool ProcessIp(TUint64 aTime, const Brx& aPacket, OhmCaptureDatagram& aDatagram);
+    TBool ProcessUdp(TUint64 aTime, TIpAddress aSender, TIpAddress aDestination, const Brx& aSegment, OhmCaptureDatagram& aDatagram);
+    TBool Reassemble(TUint64 aTime, const Brx& aPacket, TUint aHeaderBytes, OhmCaptureDatagram& aDatagram);
+
+    static TIpAddress Address(const TByte* aPtr);
+    static TUint Uint16(const TByte* aPtr);
+
+private:
+    struct Fragments
+    {
+        TBool iUsed;
+        TIpAddress iSender;
+        TIpAddress iDestination;
+        TUint iId;
+        TUint iReceived;
+        TUint iTotal; // 0 until last fragment seen
+        TUint64 iAge;
+        TByte iData[64 * 1024];
+    };
+
+private:
+    FILE* iFile;
+    EFormat iFormat;
+    TBool iSwapped;
+    TBool iNanoseconds;
+    TUint iLinkType;
+    Bwh iFrame;
+    Fragments* iFragments;
+    TUint64 iFragmentAge;
+};
+
+// OhmReplayer injects the Ohm messages in a capture into a receiver, either at the pace they
+// were captured or as fast as the receiver will accept them
+
+class OhmReplayer : public INonCopyable
+{
+    static const TUint kMaxAudioMsgs = 500;
+    static const TUint kMaxTrackMsgs = 10;
+    static const TUint kMaxMetatextMsgs = 10;
+
+public:
+    OhmReplayer(Environment& aEnv, IOhmReceiver& aReceiver);
+    void SetSender(const Endpoint& aEndpoint); // only replay messages from this sender (default any)
+    TUint Replay(OhmCaptureReader& aReader, TBool aRealTime); // returns number of messages injected
+
+private:
+    TBool Inject(const OhmCaptureDatagram& aDatagram);
+
+private:
+    Environment& iEnv;
+    IOhmReceiver& iReceiver;
+    OhmMsgFactory iFactory;
+    Endpoint iSender;
+    TBool iFilter;
+    OhmCaptureDatagram iDatagram;
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+#endif // HEADER_OHM_CAPTURE
+
@@ -1,4 +1,5 @@
 #include "OhmMsg.h"
+#include "OhmRealtime.h"
 
 using namespace OpenHome;
 using namespace OpenHome::Av;
@@ -115,6 +116,8 @@ void OhmMsgAudio::Create(IReader& aReader, const OhmHeader& aHeader)
     iLossless = false;
 	iTimestamped = false;
 	iResent = false;
+	iResendRange = false;
+	iSilence = false;
 
     TUint flags = reader.ReadUintBe(1);
     
@@ -134,6 +137,14 @@ void OhmMsgAudio::Create(IReader& aReader, const OhmHeader& aHeader)
         iResent = true;
     }
 
+    if (flags & kFlagResendRange) {
+        iResendRange = true;
+    }
+
+    if (flags & kFlagSilence) {
+        iSilence = true;
+    }
+
     iSamples = reader.ReadUintBe(2);
     iFrame = reader.ReadUintBe(4);
     iNetworkTimestamp = reader.ReadUintBe(4);
@@ -163,6 +174,19 @@ void OhmMsgAudio::Create(IReader& aReader, const OhmHeader& aHeader)
     TUint audio = aHeader.MsgBytes() - kHeaderBytes - codec;
 
 	reader.ReadReplace(audio, iAudio);
+
+	if (iSilence) {
+		// synthesise the zeros the sender left out
+
+		TUint bytes = iSamples * iChannels * iBitDepth / 8;
+
+		if (bytes > kMaxSampleBytes) {
+			bytes = kMaxSampleBytes;
+		}
+
+		iAudio.SetBytes(bytes);
+		iAudio.Fill(0);
+	}
 }
 
 void OhmMsgAudio::Create(TBool aHalt, TBool aLossless, TBool aTimestamped, TBool aResent, TUint aSamples, TUint aFrame, TUint aNetworkTimestamp, TUint aMediaLatency, TUint aMediaTimestamp, TUint64 aSampleStart, TUint64 aSamplesTotal, TUint aSampleRate, TUint aBitRate, TUint aVolumeOffset, TUint aBitDepth, TUint aChannels,  const Brx& aCodec, const Brx& aAudio)
@@ -173,6 +197,8 @@ void OhmMsgAudio::Create(TBool aHalt, TBool aLossless, TBool aTimestamped, TBool
 	iLossless = aLossless;
 	iTimestamped = aTimestamped;
 	iResent = aResent;
+	iResendRange = false;
+	iSilence = false;
 	iSamples = aSamples;
 	iFrame = aFrame;
 	iNetworkTimestamp = aNetworkTimestamp;
@@ -209,6 +235,11 @@ TBool OhmMsgAudio::Resent() const
 	return (iResent);
 }
 
+TBool OhmMsgAudio::ResendRange() const
+{
+	return (iResendRange);
+}
+
 TUint OhmMsgAudio::Samples() const
 {
 	return (iSamples);
@@ -279,11 +310,26 @@ const Brx& OhmMsgAudio::Audio() const
 	return (iAudio);
 }
 
+TBool OhmMsgAudio::Silence() const
+{
+	return (iSilence);
+}
+
 void OhmMsgAudio::SetResent(TBool aValue)
 {
 	iResent = aValue;
 }
 
+void OhmMsgAudio::SetResendRange(TBool aValue)
+{
+	iResendRange = aValue;
+}
+
+void OhmMsgAudio::SetSilence(TBool aValue)
+{
+	iSilence = aValue;
+}
+
 void OhmMsgAudio::Process(IOhmMsgProcessor& aProcessor)
 {
 	aProcessor.Process(*this);
@@ -291,7 +337,9 @@ void OhmMsgAudio::Process(IOhmMsgProcessor& aProcessor)
 
 void OhmMsgAudio::Externalise(IWriter& aWriter)
 {
-	OhmHeader header(OhmHeader::kMsgTypeAudio, kHeaderBytes + iCodec.Bytes() + iAudio.Bytes());
+	TUint audio = iSilence ? 0 : iAudio.Bytes();
+
+	OhmHeader header(OhmHeader::kMsgTypeAudio, kHeaderBytes + iCodec.Bytes() + audio);
 	
 	header.Externalise(aWriter);
 
@@ -314,6 +362,14 @@ void OhmMsgAudio::Externalise(IWriter& aWriter)
 	if (iResent) {
 		flags |= kFlagResent;
 	}
+
+	if (iResendRange) {
+		flags |= kFlagResendRange;
+	}
+
+	if (iSilence) {
+		flags |= kFlagSilence;
+	}
     
     writer.WriteUint8(kHeaderBytes);
     writer.WriteUint8(flags);
@@ -337,7 +393,9 @@ void OhmMsgAudio::Externalise(IWriter& aWriter)
         writer.Write(iCodec);
     }
 
-	writer.Write(iAudio);
+	if (!iSilence) {
+		writer.Write(iAudio);
+	}
 
 	aWriter.WriteFlush();
 }
@@ -549,6 +607,37 @@ OhmMsgMetatext& OhmMsgFactory::CreateMetatext(TUint aSequence, const Brx& aMetat
 	return (*msg);
 }
 
+void OhmMsgFactory::Prefault()
+{
+	Lock();
+
+	TUint count = iFifoAudio.SlotsUsed();
+
+	for (TUint i = 0; i < count; i++) {
+		OhmMsgAudio* msg = iFifoAudio.Read();
+		OhmRealtime::Prefault(msg, sizeof(OhmMsgAudio));
+		iFifoAudio.Write(msg);
+	}
+
+	count = iFifoTrack.SlotsUsed();
+
+	for (TUint i = 0; i < count; i++) {
+		OhmMsgTrack* msg = iFifoTrack.Read();
+		OhmRealtime::Prefault(msg, sizeof(OhmMsgTrack));
+		iFifoTrack.Write(msg);
+	}
+
+	count = iFifoMetatext.SlotsUsed();
+
+	for (TUint i = 0; i < count; i++) {
+		OhmMsgMetatext* msg = iFifoMetatext.Read();
+		OhmRealtime::Prefault(msg, sizeof(OhmMsgMetatext));
+		iFifoMetatext.Write(msg);
+	}
+
+	Unlock();
+}
+
 void OhmMsgFactory::Lock()
 {
 	iMutex.Wait();
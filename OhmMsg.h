@@ -71,12 +71,16 @@ private:
     static const TUint kFlagLossless = 2;
     static const TUint kFlagTimestamped = 4;
     static const TUint kFlagResent = 8;
+    static const TUint kFlagResendRange = 16;
+    static const TUint kFlagSilence = 32;
 
 public:
     TBool Halt() const;
     TBool Lossless() const;
     TBool Timestamped() const;
 	TBool Resent() const;
+	TBool ResendRange() const; // the sender accepts OhmHeaderResendRange requests
+	TBool Silence() const; // sent without its samples, which are all zero
     TUint Samples() const;
     TUint Frame() const;
     TUint NetworkTimestamp() const;
@@ -93,6 +97,8 @@ public:
 	const Brx& Audio() const;
 
 	void SetResent(TBool aValue);
+	void SetResendRange(TBool aValue);
+	void SetSilence(TBool aValue); // only for audio that is all zero
 
 	virtual void Process(IOhmMsgProcessor& aProcessor);
 	virtual void Externalise(IWriter& aWriter);
@@ -107,6 +113,8 @@ private:
     TBool iLossless;
     TBool iTimestamped;
 	TBool iResent;
+	TBool iResendRange;
+	TBool iSilence;
     TUint iSamples;
     TUint iFrame;
     TUint iNetworkTimestamp;
@@ -204,6 +212,7 @@ public:
 	virtual OhmMsgAudio& CreateAudio(TBool aHalt, TBool aLossless, TBool aTimestamped, TBool aResent, TUint aSamples, TUint aFrame, TUint aNetworkTimestamp, TUint aMediaLatency, TUint aMediaTimestamp, TUint64 aSampleStart, TUint64 aSamplesTotal, TUint aSampleRate, TUint aBitRate, TUint aVolumeOffset, TUint aBitDepth, TUint aChannels,  const Brx& aCodec, const Brx& aAudio);
 	virtual OhmMsgTrack& CreateTrack(TUint aSequence, const Brx& aUri, const Brx& aMetadata);
 	virtual OhmMsgMetatext& CreateMetatext(TUint aSequence, const Brx& aMetatext);
+	void Prefault(); // touch every msg in the pools if memory is locked (see OhmRealtime)
 	~OhmMsgFactory();
 
 private:
@@ -0,0 +1,221 @@
+#include "OhmPacer.h"
+
+#include <stdio.h>
+
+#ifdef __linux__
+# include <time.h>
+# include <errno.h>
+#else
+# include <chrono>
+# include <thread>
+#endif
+
+using namespace OpenHome;
+using namespace OpenHome::Av;
+
+// OhmPacer
+
+OhmPacer::OhmPacer(const TChar* aName, IOhmPacerHandler& aHandler, TUint aPriority)
+	: iName(aName)
+	, iHandler(aHandler)
+	, iPriority(aPriority)
+	, iRole(eOhmThreadNone)
+	, iThread(0)
+	, iMutex("OPAC")
+	, iUnits(5000)
+	, iUnitsPerSecond(1000000)
+	, iRebase(false)
+	, iStop(false)
+{
+	ResetStats();
+}
+
+TUint64 OhmPacer::TimeInNs()
+{
+#ifdef __linux__
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((TUint64)now.tv_sec * 1000000000 + now.tv_nsec);
+#else
+	return ((TUint64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+void OhmPacer::SleepUntil(TUint64 aTimeNs)
+{
+#ifdef __linux__
+	struct timespec deadline;
+	deadline.tv_sec = (time_t)(aTimeNs / 1000000000);
+	deadline.tv_nsec = (long)(aTimeNs % 1000000000);
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, 0) == EINTR) {
+	}
+#else
+	std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(aTimeNs))));
+#endif
+}
+
+void OhmPacer::SetPeriod(TUint64 aUnits, TUint64 aUnitsPerSecond)
+{
+	ASSERT(aUnits > 0 && aUnitsPerSecond > 0);
+
+	AutoMutex mutex(iMutex);
+	iUnits = aUnits;
+	iUnitsPerSecond = aUnitsPerSecond;
+	iRebase = true;
+}
+
+void OhmPacer::SetRole(EOhmThreadRole aRole)
+{
+	ASSERT(iThread == 0);
+	iRole = aRole;
+}
+
+void OhmPacer::Start()
+{
+	ASSERT(iThread == 0);
+	iStop = false;
+	iThread = new ThreadFunctor(iName, MakeFunctor(*this, &OhmPacer::Run), iPriority, kThreadStackBytes);
+	iThread->Start();
+}
+
+void OhmPacer::Stop()
+{
+	if (iThread != 0) {
+		iStop = true;
+		delete (iThread); // joins once the current period has been paced
+		iThread = 0;
+	}
+}
+
+void OhmPacer::ResetStats()
+{
+	AutoMutex mutex(iMutex);
+
+	iPeriods = 0;
+	iLatePeriods = 0;
+	iResyncs = 0;
+	iLatenessTotalUs = 0;
+	iLatenessMaxUs = 0;
+
+	for (TUint i = 0; i < kJitterBuckets; i++) {
+		iJitter[i] = 0;
+	}
+}
+
+void OhmPacer::PrintStats()
+{
+	AutoMutex mutex(iMutex);
+
+	TUint64 periodNs = iUnits * 1000000000 / iUnitsPerSecond;
+
+	printf("pacer: period %llu ns, %llu periods, %llu late, %llu resyncs, lateness mean %llu us, max %llu us\n",
+		(unsigned long long)periodNs,
+		(unsigned long long)iPeriods,
+		(unsigned long long)iLatePeriods,
+		(unsigned long long)iResyncs,
+		(unsigned long long)((iPeriods == 0) ? 0 : iLatenessTotalUs / iPeriods),
+		(unsigned long long)iLatenessMaxUs);
+
+	for (TUint i = 0; i < kJitterBuckets; i++) {
+		if (iJitter[i] == 0) {
+			continue;
+		}
+
+		char label[32];
+
+		if (i == 0) {
+			sprintf(label, "<1us");
+		}
+		else if (i == kJitterBuckets - 1) {
+			sprintf(label, ">=%lluus", 1ull << (i - 1));
+		}
+		else {
+			sprintf(label, "%llu-%lluus", 1ull << (i - 1), (1ull << i) - 1);
+		}
+
+		printf("  %-16s%llu\n", label, (unsigned long long)iJitter[i]);
+	}
+}
+
+void OhmPacer::Run()
+{
+	OhmRealtime::Apply(iRole);
+
+	TUint64 base = TimeInNs();
+	TUint64 count = 0;
+	TUint64 units;
+	TUint64 unitsPerSecond;
+
+	iMutex.Wait();
+	units = iUnits;
+	unitsPerSecond = iUnitsPerSecond;
+	iRebase = false;
+	iMutex.Signal();
+
+	TUint64 deadline = base;
+
+	while (!iStop) {
+		count++;
+
+		// split the product to avoid overflow over long runs
+
+		TUint64 elapsed = count * units;
+		TUint64 next = base + (elapsed / unitsPerSecond) * 1000000000 + ((elapsed % unitsPerSecond) * 1000000000) / unitsPerSecond;
+
+		SleepUntil(next);
+
+		deadline = next;
+
+		TUint64 now = TimeInNs();
+		TUint64 latenessUs = (now > deadline) ? (now - deadline) / 1000 : 0;
+		TUint64 periodUs = units * 1000000 / unitsPerSecond;
+
+		TUint bucket = 0;
+
+		while (bucket < kJitterBuckets - 1 && latenessUs >= (1ull << bucket)) {
+			bucket++;
+		}
+
+		iMutex.Wait();
+
+		iPeriods++;
+		iJitter[bucket]++;
+		iLatenessTotalUs += latenessUs;
+
+		if (latenessUs > iLatenessMaxUs) {
+			iLatenessMaxUs = latenessUs;
+		}
+
+		if (latenessUs > periodUs) {
+			iLatePeriods++;
+		}
+
+		if (latenessUs > periodUs * kMaxLatePeriods) {
+			// too far behind to catch up without a burst: restart the schedule from now
+			iResyncs++;
+			base = now;
+			count = 0;
+		}
+
+		if (iRebase) {
+			units = iUnits;
+			unitsPerSecond = iUnitsPerSecond;
+			iRebase = false;
+			if (count != 0) {
+				base = deadline;
+				count = 0;
+			}
+		}
+
+		iMutex.Signal();
+
+		iHandler.Pace();
+	}
+}
+
+OhmPacer::~OhmPacer()
+{
+	Stop();
+}
+
@@ -0,0 +1,82 @@
+#ifndef HEADER_OHM_PACER
+#define HEADER_OHM_PACER
+
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Private/Thread.h>
+
+#include "OhmRealtime.h"
+
+#include <atomic>
+
+namespace OpenHome {
+namespace Av {
+
+// IOhmPacerHandler is called on the pacer thread at each deadline
+
+class IOhmPacerHandler
+{
+public:
+	virtual void Pace() = 0;
+	virtual ~IOhmPacerHandler() {}
+};
+
+// OhmPacer calls its handler on absolute deadlines spaced by a fixed period, so that lateness in
+// one period is not carried into the next and the long term rate is exact (deadline n is computed
+// from n rather than accumulated). Periods may be well under a millisecond.
+//
+// On Linux the pacer thread sleeps with clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME);
+// elsewhere it uses std::this_thread::sleep_until on the steady clock, whose resolution is
+// platform dependent (typically 1ms on Windows).
+//
+// The lateness of each call relative to its deadline is recorded in a histogram of
+// power of two microsecond buckets
+//
+// The pacer thread takes the scheduling of a role set before Start (see OhmRealtime)
+
+class OhmPacer : public INonCopyable
+{
+public:
+	static const TUint kJitterBuckets = 20;     // <1us, 1us, 2-3us, 4-7us ... >= 262ms
+	static const TUint kMaxLatePeriods = 10;    // further behind than this and deadlines restart from now rather than catching up
+	static const TUint kThreadStackBytes = 64 * 1024;
+
+public:
+	OhmPacer(const TChar* aName, IOhmPacerHandler& aHandler, TUint aPriority); // aName must outlive the pacer
+	void SetPeriod(TUint64 aUnits, TUint64 aUnitsPerSecond); // e.g. (samples per frame, sample rate) or (period in us, 1000000)
+	void SetRole(EOhmThreadRole aRole); // before Start
+	void Start();
+	void Stop(); // not from the handler
+	void ResetStats();
+	void PrintStats();
+	~OhmPacer();
+
+	static TUint64 TimeInNs(); // monotonic
+
+private:
+	void Run();
+	static void SleepUntil(TUint64 aTimeNs);
+
+private:
+	const TChar* iName;
+	IOhmPacerHandler& iHandler;
+	TUint iPriority;
+	EOhmThreadRole iRole;
+	ThreadFunctor* iThread;
+	Mutex iMutex;
+	TUint64 iUnits;
+	TUint64 iUnitsPerSecond;
+	TBool iRebase;
+	std::atomic<TBool> iStop;
+	TUint64 iPeriods;
+	TUint64 iLatePeriods;   // called after the following deadline had passed
+	TUint64 iResyncs;
+	TUint64 iLatenessTotalUs;
+	TUint64 iLatenessMaxUs;
+	TUint64 iJitter[kJitterBuckets];
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+#endif // HEADER_OHM_PACER
+
@@ -46,6 +46,9 @@ OhmProtocolMulticast::OhmProtocolMulticast(Environment& aEnv, IOhmReceiver& aRec
     , iReadBuffer(iSocket)
     , iTimerJoin(aEnv, MakeFunctor(*this, &OhmProtocolMulticast::SendJoin), "OhmProtocolMulticastJoin")
     , iTimerListen(aEnv, MakeFunctor(*this, &OhmProtocolMulticast::SendListen), "OhmProtocolMulticastListen")
+	, iMutex("OHMM")
+	, iOpen(false)
+	, iSwitching(false)
 {
 }
 
@@ -71,118 +74,229 @@ void OhmProtocolMulticast::RequestResend(const Brx& aFrames)
 	}
 }
 
+void OhmProtocolMulticast::RequestResendRange(TUint aFirst, TUint aFramesCount, const Brx& aBitmap)
+{
+	Bws<OhmHeader::kHeaderBytes + OhmHeaderResendRange::kHeaderBytes + OhmHeaderResendRange::kMaxBitmapBytes> buffer;
+
+	WriterBuffer writer(buffer);
+
+	OhmHeaderResendRange headerResendRange(aFirst, aFramesCount);
+
+	OhmHeader header(OhmHeader::kMsgTypeResendRange, headerResendRange.MsgBytes());
+
+	header.Externalise(writer);
+	headerResendRange.Externalise(writer);
+	writer.Write(aBitmap);
+
+	iSocket.Send(buffer, iEndpoint);
+}
+
 void OhmProtocolMulticast::Play(TIpAddress aInterface, TUint aTtl, const Endpoint& aEndpoint)
 {
-	iEndpoint.Replace(aEndpoint);
+	iMutex.Wait();
+
+	TBool switched = iSwitching; // before we got here
+
+	iEndpoint.Replace(switched ? iEndpointNext : aEndpoint);
+	iSwitching = false;
 
 	iSocket.OpenMulticast(aInterface, aTtl, iEndpoint);
+	iOpen = true;
 
-    try {
-        OhmHeader header;
-
-        SendJoin();
-
-		// Phase 1, periodically send join until Track and Metatext have been received
-
-		TBool joinComplete = false;
-		TBool receivedTrack = false;
-		TBool receivedMetatext = false;
-
-		while (!joinComplete) {
-            try {
-                header.Internalise(iReadBuffer);
-
-				switch(header.MsgType()) {
-				case OhmHeader::kMsgTypeJoin:
-				case OhmHeader::kMsgTypeListen:
-				case OhmHeader::kMsgTypeLeave:
-				case OhmHeader::kMsgTypeSlave:
-					break;
-				case OhmHeader::kMsgTypeAudio:
-					iReceiver->Add(iFactory->CreateAudio(iReadBuffer, header));
-					break;
-				case OhmHeader::kMsgTypeTrack:
-					iReceiver->Add(iFactory->CreateTrack(iReadBuffer, header));
-					receivedTrack = true;
-					joinComplete = receivedMetatext;
-					break;
-				case OhmHeader::kMsgTypeMetatext:
-					iReceiver->Add(iFactory->CreateMetatext(iReadBuffer, header));
-					receivedMetatext = true;
-					joinComplete = receivedTrack;
-					break;
-				case OhmHeader::kMsgTypeResend:
-					iReceiver->ResendSeen();
-					break;
-				}
+	iMutex.Signal();
+
+	if (switched) {
+		iReceiver->Switched();
+	}
+
+	do {
+	    try {
+	        OhmHeader header;
+
+	        SendJoin();
 
-                iReadBuffer.ReadFlush();
+			// Phase 1, periodically send join until Track and Metatext have been received
+
+			TBool joinComplete = false;
+			TBool receivedTrack = false;
+			TBool receivedMetatext = false;
+
+			while (!joinComplete) {
+	            try {
+	                header.Internalise(iReadBuffer);
+
+					switch(header.MsgType()) {
+					case OhmHeader::kMsgTypeJoin:
+					case OhmHeader::kMsgTypeListen:
+					case OhmHeader::kMsgTypeLeave:
+					case OhmHeader::kMsgTypeSlave:
+						break;
+					case OhmHeader::kMsgTypeAudio:
+						iReceiver->Add(iFactory->CreateAudio(iReadBuffer, header));
+						break;
+					case OhmHeader::kMsgTypeTrack:
+						iReceiver->Add(iFactory->CreateTrack(iReadBuffer, header));
+						receivedTrack = true;
+						joinComplete = receivedMetatext;
+						break;
+					case OhmHeader::kMsgTypeMetatext:
+						iReceiver->Add(iFactory->CreateMetatext(iReadBuffer, header));
+						receivedMetatext = true;
+						joinComplete = receivedTrack;
+						break;
+					case OhmHeader::kMsgTypeResendRange:
+					case OhmHeader::kMsgTypeResend:
+						iReceiver->ResendSeen();
+						break;
+					}
+
+	                iReadBuffer.ReadFlush();
+				}
+	            catch (OhmError&) {
+	            }
 			}
-            catch (OhmError&) {
-            }
-		}
             
-		iTimerJoin.Cancel();
+			iTimerJoin.Cancel();
 
-		// Phase 2, periodically send listen if required
+			// Phase 2, periodically send listen if required
 
-	    iTimerListen.FireIn((kTimerListenTimeoutMs >> 2) - iEnv.Random(kTimerListenTimeoutMs >> 3)); // listen primary timeout
+		    iTimerListen.FireIn((kTimerListenTimeoutMs >> 2) - iEnv.Random(kTimerListenTimeoutMs >> 3)); // listen primary timeout
 	    
-        for (;;) {
-            try {
-                header.Internalise(iReadBuffer);
-
-				switch(header.MsgType()) {
-				case OhmHeader::kMsgTypeJoin:
-				case OhmHeader::kMsgTypeLeave:
-				case OhmHeader::kMsgTypeSlave:
-					break;
-				case OhmHeader::kMsgTypeListen:
-                    iTimerListen.FireIn((kTimerListenTimeoutMs >> 1) - iEnv.Random(kTimerListenTimeoutMs >> 3)); // listen secondary timeout
-					break;
-				case OhmHeader::kMsgTypeAudio:
-					iReceiver->Add(iFactory->CreateAudio(iReadBuffer, header));
-					break;
-				case OhmHeader::kMsgTypeTrack:
-					iReceiver->Add(iFactory->CreateTrack(iReadBuffer, header));
-					break;
-				case OhmHeader::kMsgTypeMetatext:
-					iReceiver->Add(iFactory->CreateMetatext(iReadBuffer, header));
-					break;
-				case OhmHeader::kMsgTypeResend:
-					iReceiver->ResendSeen();
-					break;
-				}
+	        for (;;) {
+	            try {
+	                header.Internalise(iReadBuffer);
 
-                iReadBuffer.ReadFlush();
+					switch(header.MsgType()) {
+					case OhmHeader::kMsgTypeJoin:
+					case OhmHeader::kMsgTypeLeave:
+					case OhmHeader::kMsgTypeSlave:
+						break;
+					case OhmHeader::kMsgTypeListen:
+	                    iTimerListen.FireIn((kTimerListenTimeoutMs >> 1) - iEnv.Random(kTimerListenTimeoutMs >> 3)); // listen secondary timeout
+						break;
+					case OhmHeader::kMsgTypeAudio:
+						iReceiver->Add(iFactory->CreateAudio(iReadBuffer, header));
+						break;
+					case OhmHeader::kMsgTypeTrack:
+						iReceiver->Add(iFactory->CreateTrack(iReadBuffer, header));
+						break;
+					case OhmHeader::kMsgTypeMetatext:
+						iReceiver->Add(iFactory->CreateMetatext(iReadBuffer, header));
+						break;
+					case OhmHeader::kMsgTypeResendRange:
+					case OhmHeader::kMsgTypeResend:
+						iReceiver->ResendSeen();
+						break;
+					}
+
+	                iReadBuffer.ReadFlush();
+				}
+	            catch (OhmError&) {
+	            }
 			}
-            catch (OhmError&) {
-            }
-		}
-    }
-    catch (ReaderError&) {
-    }
+	    }
+	    catch (ReaderError&) {
+	    }
     
-    iReadBuffer.ReadFlush();
-   	iTimerJoin.Cancel();
-    iTimerListen.Cancel();
+	    iReadBuffer.ReadFlush();
+	   	iTimerJoin.Cancel();
+	    iTimerListen.Cancel();
+	} while (Switched());
+
 	iSocket.Close();
 }
 
+// Switching opens the new channel's socket, then interrupts the read of the old one. The protocol
+// thread swaps the sockets and joins the new channel, so nothing waits on the thread to stop.
+
+void OhmProtocolMulticast::Switch(const Endpoint& aEndpoint)
+{
+	AutoMutex mutex(iMutex);
+
+	iEndpointNext.Replace(aEndpoint);
+	iSwitching = true;
+
+	if (iOpen) {
+		iSocket.PrepareMulticast(aEndpoint);
+		iReadBuffer.ReadInterrupt();
+	}
+}
+
+TBool OhmProtocolMulticast::Switched()
+{
+	iMutex.Wait();
+
+	if (!iSwitching) {
+		iOpen = false;
+		iMutex.Signal();
+		return (false);
+	}
+
+	iSocket.Switch();
+	iEndpoint.Replace(iEndpointNext);
+	iSwitching = false;
+
+	iMutex.Signal();
+
+	iReceiver->Switched();
+
+	return (true);
+}
+
 void OhmProtocolMulticast::Stop()
 {
+	AutoMutex mutex(iMutex);
+	iSwitching = false;
     iReadBuffer.ReadInterrupt();
 }
 
+// The receive buffer is sized to the stream once its format is known (see OhmSocket::BufBytes)
+
+void OhmProtocolMulticast::SetRecvBufBytes(TUint aBytes)
+{
+	iSocket.SetRecvBufBytes(aBytes);
+}
+
+TUint OhmProtocolMulticast::KernelDrops()
+{
+	AutoMutex mutex(iMutex);
+
+	if (!iOpen) {
+		return (0);
+	}
+
+	return (iSocket.KernelDrops());
+}
+
+void OhmProtocolMulticast::SetTap(IOhmSocketTap* aTap)
+{
+    iSocket.SetTap(aTap);
+}
+
 void OhmProtocolMulticast::SendListen()
 {
     Send(OhmHeader::kMsgTypeListen);
     iTimerListen.FireIn((kTimerListenTimeoutMs >> 2) - iEnv.Random(kTimerListenTimeoutMs >> 3)); // listen primary timeout
 }
 
+// Joins ask for a fast start: a sender that offers it replies with the recent audio needed to fill
+// our latency, so playback need not wait for that much audio to arrive in real time. Receivers
+// already listening discard the frames as duplicates; older senders ignore the flag. Live frames
+// can reach us before the burst, so OhmReceiver holds its first ones until the burst catches up.
+
 void OhmProtocolMulticast::SendJoin()
 {
-    Send(OhmHeader::kMsgTypeJoin);
+    Bws<OhmHeader::kHeaderBytes + OhmHeaderJoin::kHeaderBytes> buffer;
+    WriterBuffer writer(buffer);
+
+    OhmHeaderJoin headerJoin(OhmHeaderJoin::kFlagFastStart);
+    OhmHeader header(OhmHeader::kMsgTypeJoin, headerJoin.MsgBytes());
+
+    header.Externalise(writer);
+    headerJoin.Externalise(writer);
+
+    iSocket.Send(buffer, iEndpoint);
+
     iTimerJoin.FireIn(kTimerJoinTimeoutMs);
 }
 
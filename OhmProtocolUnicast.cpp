@@ -22,6 +22,9 @@ OhmProtocolUnicast::OhmProtocolUnicast(Environment& aEnv, IOhmReceiver& aReceive
     , iTimerJoin(aEnv, MakeFunctor(*this, &OhmProtocolUnicast::SendJoin), "OhmProtocolUnicastJoin")
     , iTimerListen(aEnv, MakeFunctor(*this, &OhmProtocolUnicast::SendListen), "OhmProtocolUnicastListen")
     , iTimerLeave(aEnv, MakeFunctor(*this, &OhmProtocolUnicast::TimerLeaveExpired), "OhmProtocolUnicastLeave")
+	, iMutex("OHMU")
+	, iOpen(false)
+	, iSwitching(false)
 {
 }
 
@@ -85,6 +88,23 @@ void OhmProtocolUnicast::RequestResend(const Brx& aFrames)
 	}
 }
 
+void OhmProtocolUnicast::RequestResendRange(TUint aFirst, TUint aFramesCount, const Brx& aBitmap)
+{
+	Bws<OhmHeader::kHeaderBytes + OhmHeaderResendRange::kHeaderBytes + OhmHeaderResendRange::kMaxBitmapBytes> buffer;
+
+	WriterBuffer writer(buffer);
+
+	OhmHeaderResendRange headerResendRange(aFirst, aFramesCount);
+
+	OhmHeader header(OhmHeader::kMsgTypeResendRange, headerResendRange.MsgBytes());
+
+	header.Externalise(writer);
+	headerResendRange.Externalise(writer);
+	writer.Write(aBitmap);
+
+	iSocket.Send(buffer, iEndpoint);
+}
+
 void OhmProtocolUnicast::Broadcast(OhmMsg& aMsg)
 {
 	if (iSlaveCount > 0)
@@ -109,123 +129,209 @@ void OhmProtocolUnicast::Play(TIpAddress aInterface, TUint aTtl, const Endpoint&
 
 	iSlaveCount = 0;
 
-	iEndpoint.Replace(aEndpoint);
+	iMutex.Wait();
+
+	TBool switched = iSwitching; // before we got here
+
+	iEndpoint.Replace(switched ? iEndpointNext : aEndpoint);
+	iSwitching = false;
 
 	iSocket.OpenUnicast(aInterface, aTtl);
+	iOpen = true;
 
-    try {
-        OhmHeader header;
-
-        SendJoin();
-
-		// Phase 1, periodically send join until Track and Metatext have been received
-
-		TBool joinComplete = false;
-		TBool receivedTrack = false;
-		TBool receivedMetatext = false;
-
-		while (!joinComplete) {
-			try {
-                header.Internalise(iReadBuffer);
-
-				switch(header.MsgType()) {
-				case OhmHeader::kMsgTypeJoin:
-				case OhmHeader::kMsgTypeListen:
-				case OhmHeader::kMsgTypeLeave:
-					break;
-				case OhmHeader::kMsgTypeAudio:
-					HandleAudio(header);
-					break;
-				case OhmHeader::kMsgTypeTrack:
-					HandleTrack(header);
-					receivedTrack = true;
-					joinComplete = receivedMetatext;
-					break;
-				case OhmHeader::kMsgTypeMetatext:
-					HandleMetatext(header);
-					receivedMetatext = true;
-					joinComplete = receivedTrack;
-					break;
-				case OhmHeader::kMsgTypeSlave:
-					HandleSlave(header);
-					break;
-				case OhmHeader::kMsgTypeResend:
-					iReceiver->ResendSeen();
-					break;
-				}
+	iMutex.Signal();
+
+	if (switched) {
+		iReceiver->Switched();
+	}
 
-                iReadBuffer.ReadFlush();
+	do {
+	    try {
+	        OhmHeader header;
+
+	        SendJoin();
+
+			// Phase 1, periodically send join until Track and Metatext have been received
+
+			TBool joinComplete = false;
+			TBool receivedTrack = false;
+			TBool receivedMetatext = false;
+
+			while (!joinComplete) {
+				try {
+	                header.Internalise(iReadBuffer);
+
+					switch(header.MsgType()) {
+					case OhmHeader::kMsgTypeJoin:
+					case OhmHeader::kMsgTypeListen:
+					case OhmHeader::kMsgTypeLeave:
+						break;
+					case OhmHeader::kMsgTypeAudio:
+						HandleAudio(header);
+						break;
+					case OhmHeader::kMsgTypeTrack:
+						HandleTrack(header);
+						receivedTrack = true;
+						joinComplete = receivedMetatext;
+						break;
+					case OhmHeader::kMsgTypeMetatext:
+						HandleMetatext(header);
+						receivedMetatext = true;
+						joinComplete = receivedTrack;
+						break;
+					case OhmHeader::kMsgTypeSlave:
+						HandleSlave(header);
+						break;
+					case OhmHeader::kMsgTypeResendRange:
+					case OhmHeader::kMsgTypeResend:
+						iReceiver->ResendSeen();
+						break;
+					}
+
+	                iReadBuffer.ReadFlush();
+				}
+	            catch (OhmError&) {
+	            }
 			}
-            catch (OhmError&) {
-            }
-		}
             
-		iTimerJoin.Cancel();
+			iTimerJoin.Cancel();
 
-		// Phase 2, periodically send listen if required
+			// Phase 2, periodically send listen if required
 
-	    iTimerListen.FireIn((kTimerListenTimeoutMs >> 2) - iEnv.Random(kTimerListenTimeoutMs >> 3)); // listen primary timeout
+		    iTimerListen.FireIn((kTimerListenTimeoutMs >> 2) - iEnv.Random(kTimerListenTimeoutMs >> 3)); // listen primary timeout
 	    
-        for (;;) {
-			try {
-                header.Internalise(iReadBuffer);
-
-				switch(header.MsgType()) {
-				case OhmHeader::kMsgTypeJoin:
-				case OhmHeader::kMsgTypeLeave:
-					break;
-				case OhmHeader::kMsgTypeListen:
-                    iTimerListen.FireIn((kTimerListenTimeoutMs >> 1) - iEnv.Random(kTimerListenTimeoutMs >> 3)); // listen secondary timeout
-					break;
-				case OhmHeader::kMsgTypeAudio:
-					HandleAudio(header);
-					break;
-				case OhmHeader::kMsgTypeTrack:
-					HandleTrack(header);
-					break;
-				case OhmHeader::kMsgTypeMetatext:
-					HandleMetatext(header);
-					break;
-				case OhmHeader::kMsgTypeSlave:
-					HandleSlave(header);
-					break;
-				case OhmHeader::kMsgTypeResend:
-					iReceiver->ResendSeen();
-					break;
+	        for (;;) {
+				try {
+	                header.Internalise(iReadBuffer);
+
+					switch(header.MsgType()) {
+					case OhmHeader::kMsgTypeJoin:
+					case OhmHeader::kMsgTypeLeave:
+						break;
+					case OhmHeader::kMsgTypeListen:
+	                    iTimerListen.FireIn((kTimerListenTimeoutMs >> 1) - iEnv.Random(kTimerListenTimeoutMs >> 3)); // listen secondary timeout
+						break;
+					case OhmHeader::kMsgTypeAudio:
+						HandleAudio(header);
+						break;
+					case OhmHeader::kMsgTypeTrack:
+						HandleTrack(header);
+						break;
+					case OhmHeader::kMsgTypeMetatext:
+						HandleMetatext(header);
+						break;
+					case OhmHeader::kMsgTypeSlave:
+						HandleSlave(header);
+						break;
+					case OhmHeader::kMsgTypeResendRange:
+					case OhmHeader::kMsgTypeResend:
+						iReceiver->ResendSeen();
+						break;
+					}
+
+	                iReadBuffer.ReadFlush();
 				}
-
-                iReadBuffer.ReadFlush();
+	            catch (OhmError&) {
+	            }
 			}
-            catch (OhmError&) {
-            }
-		}
-    }
-    catch (ReaderError&) {
-    }
+	    }
+	    catch (ReaderError&) {
+	    }
     
-    iReadBuffer.ReadFlush();
+	    iReadBuffer.ReadFlush();
+
+	   	iTimerJoin.Cancel();
+	    iTimerListen.Cancel();
+		iTimerLeave.Cancel();
+	} while (Switched());
 
 	iLeaving = false;
 
-   	iTimerJoin.Cancel();
-    iTimerListen.Cancel();
-	iTimerLeave.Cancel();
-    
 	iSocket.Close();
 }
 
+// Switching opens a socket on a new port, then interrupts the read of the old one. The protocol
+// thread leaves the old sender, swaps the sockets and joins the new sender; audio still on its
+// way from the old sender arrives at the old port and is dropped with it.
+
+void OhmProtocolUnicast::Switch(const Endpoint& aEndpoint)
+{
+	AutoMutex mutex(iMutex);
+
+	iEndpointNext.Replace(aEndpoint);
+	iSwitching = true;
+
+	if (iOpen) {
+		iSocket.PrepareUnicast();
+		iReadBuffer.ReadInterrupt();
+	}
+}
+
+TBool OhmProtocolUnicast::Switched()
+{
+	iMutex.Wait();
+
+	if (!iSwitching) {
+		iOpen = false;
+		iMutex.Signal();
+		return (false);
+	}
+
+	SendLeave();
+
+	iSocket.Switch();
+	iEndpoint.Replace(iEndpointNext);
+	iSlaveCount = 0;
+	iSwitching = false;
+
+	iMutex.Signal();
+
+	iReceiver->Switched();
+
+	return (true);
+}
+
 void OhmProtocolUnicast::Stop()
 {
+	AutoMutex mutex(iMutex);
+	iSwitching = false;
     iLeaving = true;
     iTimerLeave.FireIn(kTimerLeaveTimeoutMs);
 }
 
 void OhmProtocolUnicast::EmergencyStop()
 {
+	iMutex.Wait();
+	iSwitching = false;
+	iMutex.Signal();
+
 	SendLeave();
 	TimerLeaveExpired();
 }
 
+// The receive buffer is sized to the stream once its format is known (see OhmSocket::BufBytes)
+
+void OhmProtocolUnicast::SetRecvBufBytes(TUint aBytes)
+{
+	iSocket.SetRecvBufBytes(aBytes);
+}
+
+TUint OhmProtocolUnicast::KernelDrops()
+{
+	AutoMutex mutex(iMutex);
+
+	if (!iOpen) {
+		return (0);
+	}
+
+	return (iSocket.KernelDrops());
+}
+
+void OhmProtocolUnicast::SetTap(IOhmSocketTap* aTap)
+{
+    iSocket.SetTap(aTap);
+}
+
 void OhmProtocolUnicast::SendJoin()
 {
     Send(OhmHeader::kMsgTypeJoin);
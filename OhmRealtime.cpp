@@ -0,0 +1,192 @@
+#include "OhmRealtime.h"
+#include <OpenHome/Standard.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+# include <pthread.h>
+# include <sched.h>
+# include <unistd.h>
+# include <sys/mman.h>
+#endif
+
+using namespace OpenHome;
+using namespace OpenHome::Av;
+
+// OhmRealtime
+
+TUint OhmRealtime::iFifoPriority[kRoleCount] = {0};
+TUint64 OhmRealtime::iCpuMask[kRoleCount] = {0};
+TBool OhmRealtime::iLockMemory = false;
+std::atomic<TUint> OhmRealtime::iRefusals(0);
+
+void OhmRealtime::SetRole(EOhmThreadRole aRole, TUint aFifoPriority, TUint64 aCpuMask)
+{
+	ASSERT(aRole != eOhmThreadNone && aRole < kRoleCount);
+
+	if (aFifoPriority > kMaxFifoPriority) {
+		aFifoPriority = kMaxFifoPriority;
+	}
+
+	iFifoPriority[aRole] = aFifoPriority;
+	iCpuMask[aRole] = aCpuMask;
+}
+
+TBool OhmRealtime::SetLockMemory(TBool aValue)
+{
+	iLockMemory = aValue;
+
+#ifdef __linux__
+	if (aValue) {
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+			iRefusals++;
+			return (false);
+		}
+	}
+	else {
+		munlockall();
+	}
+
+	return (true);
+#else
+	if (aValue) {
+		iRefusals++;
+	}
+
+	return (!aValue);
+#endif
+}
+
+TBool OhmRealtime::LockMemory()
+{
+	return (iLockMemory);
+}
+
+TBool OhmRealtime::Apply(EOhmThreadRole aRole)
+{
+	if (aRole == eOhmThreadNone) {
+		return (true);
+	}
+
+	ASSERT(aRole < kRoleCount);
+
+	TBool applied = true;
+
+#ifdef __linux__
+	if (iCpuMask[aRole] != 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+
+		for (TUint i = 0; i < 64 && i < CPU_SETSIZE; i++) {
+			if (iCpuMask[aRole] & (1ull << i)) {
+				CPU_SET(i, &cpus);
+			}
+		}
+
+		if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+			applied = false;
+		}
+	}
+
+	if (iFifoPriority[aRole] != 0) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = (int)iFifoPriority[aRole];
+
+		if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+			applied = false;
+		}
+	}
+#else
+	if (iFifoPriority[aRole] != 0 || iCpuMask[aRole] != 0) {
+		applied = false;
+	}
+#endif
+
+	if (!applied) {
+		iRefusals++;
+	}
+
+	if (iLockMemory) {
+		PrefaultStack();
+	}
+
+	return (applied);
+}
+
+void OhmRealtime::Prefault(void* aPtr, TUint aBytes)
+{
+	if (!iLockMemory || aBytes == 0) {
+		return;
+	}
+
+#ifdef __linux__
+	TUint page = (TUint)sysconf(_SC_PAGESIZE);
+#else
+	TUint page = 4096;
+#endif
+
+	volatile TByte* bytes = (volatile TByte*)aPtr;
+
+	for (TUint i = 0; i < aBytes; i += page) {
+		bytes[i] = bytes[i];
+	}
+
+	bytes[aBytes - 1] = bytes[aBytes - 1];
+}
+
+void OhmRealtime::PrefaultStack()
+{
+	volatile TByte stack[kPrefaultStackBytes];
+
+	for (TUint i = 0; i < kPrefaultStackBytes; i += 256) {
+		stack[i] = 0;
+	}
+
+	(void)stack[0];
+}
+
+TUint OhmRealtime::Refusals()
+{
+	return (iRefusals);
+}
+
+const TChar* OhmRealtime::RoleName(EOhmThreadRole aRole)
+{
+	switch (aRole) {
+	case eOhmThreadNone:
+		return ("none");
+	case eOhmThreadNetworkRx:
+		return ("network rx");
+	case eOhmThreadRepair:
+		return ("repair");
+	case eOhmThreadSend:
+		return ("send");
+	case eOhmThreadZone:
+		return ("zone");
+	}
+
+	return ("unknown");
+}
+
+void OhmRealtime::PrintConfig()
+{
+	for (TUint i = eOhmThreadNetworkRx; i < kRoleCount; i++) {
+		if (iFifoPriority[i] == 0) {
+			printf("%-12s time shared", RoleName((EOhmThreadRole)i));
+		}
+		else {
+			printf("%-12s fifo %u", RoleName((EOhmThreadRole)i), iFifoPriority[i]);
+		}
+
+		if (iCpuMask[i] == 0) {
+			printf(", any cpu\n");
+		}
+		else {
+			printf(", cpus 0x%llx\n", (unsigned long long)iCpuMask[i]);
+		}
+	}
+
+	printf("memory       %s, %u refusals\n", iLockMemory ? "locked" : "not locked", Refusals());
+}
@@ -0,0 +1,67 @@
+#ifndef HEADER_OHM_REALTIME
+#define HEADER_OHM_REALTIME
+
+#include <OpenHome/OhNetTypes.h>
+
+#include <atomic>
+
+namespace OpenHome {
+namespace Av {
+
+// The roles the threads of senders and receivers take for scheduling
+
+enum EOhmThreadRole
+{
+	eOhmThreadNone,			// left as created
+	eOhmThreadNetworkRx,	// a receiver's thread reading audio from the network
+	eOhmThreadRepair,		// a sender's threads answering joins and resend requests
+	eOhmThreadSend,			// the thread handing audio to an OhmSenderDriver
+	eOhmThreadZone			// zone query and answer threads
+};
+
+// OhmRealtime holds the scheduling each thread role is given and whether memory is locked, for
+// appliances where audio must not wait on housekeeping or on first-touch page faults.
+//
+// A role may be given a SCHED_FIFO priority, ahead of every time-shared thread, and a set of CPUs
+// to run on. Each thread of a role applies them to itself as it starts, and touches the first part
+// of its stack so that it is resident. With memory locked, every page the process has and comes
+// to have is held in RAM, and the message pools and buffers of senders and receivers created
+// afterwards are touched as they are created.
+//
+// Configure before creating any sender or receiver; the settings are not guarded. A receiver's
+// resend requests go from ohNet's timer thread, which is shared and so takes no role; the repair
+// role covers the sender threads that answer them. Scheduling and locking are only supported on
+// Linux, and need CAP_SYS_NICE and a sufficient RLIMIT_MEMLOCK; refusals are counted and
+// otherwise ignored, so a misconfigured appliance still plays.
+
+class OhmRealtime
+{
+public:
+	static const TUint kRoleCount = eOhmThreadZone + 1;
+	static const TUint kMaxFifoPriority = 99;
+	static const TUint kPrefaultStackBytes = 16 * 1024; // of the 64KB stacks the threads are created with
+
+public:
+	static void SetRole(EOhmThreadRole aRole, TUint aFifoPriority, TUint64 aCpuMask); // 0 priority to leave time shared, 0 mask for any cpu
+	static TBool SetLockMemory(TBool aValue); // false if the pages could not be locked; touching still follows
+	static TBool LockMemory();
+	static TBool Apply(EOhmThreadRole aRole); // on the thread taking the role; false if refused
+	static void Prefault(void* aPtr, TUint aBytes); // if memory is locked, writing each page back as it was
+	static TUint Refusals(); // of scheduling or locking, since start
+	static const TChar* RoleName(EOhmThreadRole aRole);
+	static void PrintConfig();
+
+private:
+	static void PrefaultStack();
+
+private:
+	static TUint iFifoPriority[kRoleCount];
+	static TUint64 iCpuMask[kRoleCount];
+	static TBool iLockMemory;
+	static std::atomic<TUint> iRefusals;
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+#endif // HEADER_OHM_REALTIME
@@ -1,8 +1,11 @@
 #include "OhmReceiver.h"
+#include "OhmTrace.h"
+#include "OhmRealtime.h"
 #include <OpenHome/Private/Ascii.h>
 #include <OpenHome/Private/Arch.h>
 #include <OpenHome/Private/Debug.h>
 #include <OpenHome/Private/Env.h>
+#include <OpenHome/Os.h>
 #include "Debug.h"
 
 #include <stdio.h>
@@ -22,11 +25,16 @@ OhmReceiver::OhmReceiver(Environment& aEnv, TIpAddress aInterface, TUint aTtl, I
 	, iDriver(&aDriver)
 	, iMutexMode("OHRM")
 	, iMutexTransport("OHRT")
+	, iMutexZone("OHRQ")
 	, iPlaying("OHRP", 0)
 	, iZoning("OHRZ", 0)
 	, iStopped("OHRS", 0)
 	, iNullStop("OHRN", 0)
 	, iLatency(0)
+	, iSwitching(false)
+	, iSwitchUs(0)
+	, iRecvBufBytes(0)
+	, iRecvBufResize(false)
 	, iTransportState(eStopped)
 	, iPlayMode(eNone)
 	, iZoneMode(false)
@@ -35,12 +43,25 @@ OhmReceiver::OhmReceiver(Environment& aEnv, TIpAddress aInterface, TUint aTtl, I
     , iSocketZone(aEnv)
 	, iRxZone(iSocketZone)
     , iTimerZoneQuery(aEnv, MakeFunctor(*this, &OhmReceiver::SendZoneQuery), "OhmReceiverZoneQuery")
+	, iZoneQueryBackoff(aEnv)
+	, iZoneAnswered(true)
 	, iFactory(500, 10, 10)
 	, iRepairing(false)
+	, iResendRange(false)
     , iTimerRepair(aEnv, MakeFunctor(*this, &OhmReceiver::TimerRepairExpired), "OhmReceiverRepair")
+	, iStarting(false)
+	, iStartResent(false)
+	, iStartEarliest(0)
+    , iTimerStart(aEnv, MakeFunctor(*this, &OhmReceiver::TimerStartExpired), "OhmReceiverStart")
 {
 	iProtocolMulticast = new OhmProtocolMulticast(aEnv, *this, iFactory);
 	iProtocolUnicast = new OhmProtocolUnicast(aEnv, *this, iFactory);
+
+	iFactory.Prefault();
+	OhmRealtime::Prefault(this, sizeof(OhmReceiver));
+	OhmRealtime::Prefault(iProtocolMulticast, sizeof(OhmProtocolMulticast));
+	OhmRealtime::Prefault(iProtocolUnicast, sizeof(OhmProtocolUnicast));
+
     iThread = new ThreadFunctor("OHRT", MakeFunctor(*this, &OhmReceiver::Run), kThreadPriority, kThreadStackBytes);
     iThread->Start();
     iThreadZone = new ThreadFunctor("OHRZ", MakeFunctor(*this, &OhmReceiver::RunZone), kThreadZonePriority, kThreadZoneStackBytes);
@@ -176,6 +197,11 @@ void OhmReceiver::Play(const Brx& aUri)
 {
 	iMutexTransport.Wait();
 
+	if (PlaySwitchLocked(aUri)) {
+		iMutexTransport.Signal();
+		return;
+	}
+
 	StopLocked();
 
 	iTransportState = eStarted;
@@ -258,6 +284,23 @@ void OhmReceiver::PlayZoneMode(const Brx& aUri)
 		return;
 	}
 
+	// switch the running protocol in place; only a change of scheme stops and restarts it
+
+	iMutexTransport.Wait();
+
+	if (SwitchLocked(uri, endpoint)) {
+		if (iTransportState != eStarted) {
+			iTransportState = eStarted;
+			iDriver->Started();
+		}
+
+		iMutexMode.Signal();
+		iMutexTransport.Signal();
+		return;
+	}
+
+	iMutexTransport.Signal();
+
 	switch (iPlayMode)
 	{
 	case eNone:
@@ -318,6 +361,81 @@ void OhmReceiver::PlayZoneMode(const Brx& aUri)
 	iMutexTransport.Signal();
 }
 
+// Moving from one channel to another of the same kind switches the protocol in place rather than
+// stopping and restarting it; the driver sees the same stop and start as before
+
+TBool OhmReceiver::PlaySwitchLocked(const Brx& aUri)
+{
+	if (iTransportState == eStopped) {
+		return (false);
+	}
+
+	OpenHome::Uri uri;
+
+	try {
+		uri.Replace(aUri);
+	}
+	catch (UriError&) {
+		return (false);
+	}
+
+	Endpoint endpoint(uri.Port(), uri.Host());
+
+	iMutexMode.Wait();
+
+	TBool switched = !iZoneMode && SwitchLocked(uri, endpoint);
+
+	if (switched) {
+		iTransportState = eStopped;
+		iDriver->Stopped();
+		iTransportState = eStarted;
+		iDriver->Started();
+	}
+
+	iMutexMode.Signal();
+
+	return (switched);
+}
+
+TBool OhmReceiver::SwitchLocked(const OpenHome::Uri& aUri, const Endpoint& aEndpoint)
+{
+	if (aEndpoint.Equals(iEndpointNull)) {
+		return (false);
+	}
+
+	switch (iPlayMode)
+	{
+	case eMulticast:
+		if (aUri.Scheme() != Brn("ohm")) {
+			return (false);
+		}
+		break;
+	case eUnicast:
+		if (aUri.Scheme() != Brn("ohu")) {
+			return (false);
+		}
+		break;
+	default:
+		return (false);
+	}
+
+	Reset();
+
+	iSwitching = true;
+	iSwitchUs = OsTimeInUs(iEnv.OsCtx());
+
+	iEndpoint.Replace(aEndpoint);
+
+	if (iPlayMode == eMulticast) {
+		iProtocolMulticast->Switch(aEndpoint);
+	}
+	else {
+		iProtocolUnicast->Switch(aEndpoint);
+	}
+
+	return (true);
+}
+
 void OhmReceiver::Stop()
 {
 	iMutexTransport.Wait();
@@ -327,6 +445,41 @@ void OhmReceiver::Stop()
 	iMutexTransport.Signal();
 }
 
+void OhmReceiver::SetTap(IOhmSocketTap* aTap)
+{
+	iMutexTransport.Wait();
+
+	ASSERT(iTransportState == eStopped);
+
+	iProtocolMulticast->SetTap(aTap);
+	iProtocolUnicast->SetTap(aTap);
+	iSocketZone.SetTap(aTap);
+
+	iMutexTransport.Signal();
+}
+
+// Reads the socket's entry in /proc, so it takes the mode mutex rather than holding up the audio
+// path on the transport mutex
+
+TUint OhmReceiver::KernelDrops() const
+{
+	AutoMutex mutex(iMutexMode);
+	return (KernelDropsLocked());
+}
+
+TUint OhmReceiver::KernelDropsLocked() const
+{
+	switch (iPlayMode)
+	{
+	case eMulticast:
+		return (iProtocolMulticast->KernelDrops());
+	case eUnicast:
+		return (iProtocolUnicast->KernelDrops());
+	default:
+		return (0);
+	}
+}
+
 void OhmReceiver::StopLocked()
 {
 	if (iTransportState == eStopped)
@@ -373,6 +526,8 @@ void OhmReceiver::StopLocked()
 
 void OhmReceiver::Run()
 {
+	OhmRealtime::Apply(eOhmThreadNetworkRx);
+
 	for (;;) {
 		iThread->Wait();
 
@@ -405,8 +560,18 @@ void OhmReceiver::Run()
 	}
 }
 
+// Queries back off, and another receiver's query for the same zone stands in for ours,
+// so a house of receivers started together asks a handful of times rather than ten times a second each
+
 void OhmReceiver::SendZoneQuery()
 {
+	iMutexZone.Wait();
+
+	if (iZoneAnswered) {
+		iMutexZone.Signal();
+		return;
+	}
+
 	OhzHeaderZoneQuery headerZoneQuery(iZone);
 	OhzHeader header(OhzHeader::kMsgTypeZoneQuery, headerZoneQuery.MsgBytes());
 
@@ -419,11 +584,42 @@ void OhmReceiver::SendZoneQuery()
 
 	iSocketZone.Send(iTxZone);
 
-	iTimerZoneQuery.FireIn(kTimerZoneQueryDelayMs);
+	TUint delay = iZoneQueryBackoff.Queried();
+
+	iMutexZone.Signal();
+
+	iTimerZoneQuery.FireIn(delay);
+}
+
+void OhmReceiver::ZoneQueryOverheard()
+{
+	iMutexZone.Wait();
+
+	if (iZoneAnswered) {
+		iMutexZone.Signal();
+		return;
+	}
+
+	TUint delay = iZoneQueryBackoff.Queried();
+
+	iMutexZone.Signal();
+
+	iTimerZoneQuery.FireIn(delay);
+}
+
+void OhmReceiver::ZoneQueryAnswered()
+{
+	iMutexZone.Wait();
+	iZoneAnswered = true;
+	iMutexZone.Signal();
+
+	iTimerZoneQuery.Cancel();
 }
 
 void OhmReceiver::RunZone()
 {
+	OhmRealtime::Apply(eOhmThreadZone);
+
     for (;;) {
         iThreadZone->Wait();
 
@@ -433,7 +629,21 @@ void OhmReceiver::RunZone()
 
 		iSocketZone.Open(iInterface, iTtl);
 		iZoning.Signal();
-		SendZoneQuery();
+
+		Bws<Ohm::kMaxUriBytes> cached;
+		TBool found = iZoneCache.Find(iZone, cached);
+
+		iMutexZone.Wait();
+		iZoneAnswered = false;
+		TUint delay = iZoneQueryBackoff.Start(found);
+		iMutexZone.Signal();
+
+		iTimerZoneQuery.FireIn(delay);
+
+		if (found) {
+			// play what the zone last announced; the query still due verifies it
+			PlayZoneMode(cached);
+		}
 
 		try {
 			for (;;) {
@@ -456,12 +666,25 @@ void OhmReceiver::RunZone()
 					Brn msgZone = iRxZone.Read(headerZoneUri.ZoneBytes());
 					Brn msgUri = iRxZone.Read(headerZoneUri.UriBytes());
 
+					iZoneCache.Set(msgZone, msgUri);
+
 					if (msgZone == iZone)
 					{
-						iTimerZoneQuery.Cancel();
+						ZoneQueryAnswered();
 						PlayZoneMode(msgUri);
 					}
 				}
+				else if (header.MsgType() == OhzHeader::kMsgTypeZoneQuery) {
+					OhzHeaderZoneQuery headerZoneQuery;
+					headerZoneQuery.Internalise(iRxZone, header);
+
+					Brn msgZone = iRxZone.Read(headerZoneQuery.ZoneBytes());
+
+					if (msgZone == iZone && !iSocketZone.SenderIsThis())
+					{
+						ZoneQueryOverheard();
+					}
+				}
 
 				iRxZone.ReadFlush();
 			}
@@ -470,7 +693,7 @@ void OhmReceiver::RunZone()
 		}
 
 		iRxZone.ReadFlush();
-		iTimerZoneQuery.Cancel();
+		ZoneQueryAnswered();
 		iSocketZone.Close();
         iStopped.Signal();
 	}
@@ -504,234 +727,277 @@ TUint OhmReceiver::Latency(OhmMsgAudio& aMsg)
 void OhmReceiver::Reset()
 {
 	iTimerRepair.Cancel();
+	iTimerStart.Cancel();
 
-	if (iRepairing) {
-
-		iRepairFirst->RemoveRef();
+	if (iRepairing || iStarting) {
+		OhmMsgAudio* msg;
 
-		while (iFifoRepair.SlotsUsed() > 0) {
-			iFifoRepair.Read()->RemoveRef();
+		while ((msg = iRepairWindow.Remove()) != 0) {
+			msg->RemoveRef();
 		}
 	}
 
 	iRepairing = false;
+	iStarting = false;
+	iSwitching = false;
+	iSwitchUs = 0;
+	iRecvBufBytes = 0;
+	iRecvBufResize = false;
 
 	iLatency = 0;
 }
 
-TBool OhmReceiver::RepairBegin(OhmMsgAudio& aMsg)
-{
-	LOG(kMedia, "BEGIN ON %d\n", aMsg.Frame());
-
-	iRepairFirst = &aMsg;
-
-    iTimerRepair.FireIn(iEnv.Random(kInitialRepairTimeoutMs)); 
+// A receive buffer holding a latency's worth of stream rides out the reading thread being held up
+// without the kernel dropping datagrams, which would otherwise have to be repaired. The first frame
+// can be delivered on the start timer's thread, so the size is applied to the socket by Add, on
+// the protocol thread that owns it.
 
-	return (true);
-}
-
-void  OhmReceiver::RepairReset()
+void OhmReceiver::UpdateRecvBufBytes(OhmMsgAudio& aMsg)
 {
-	LOG(kMedia, "RESET\n");
+	TUint bytesPerSecond = aMsg.BitRate() / 8;
 
-	iTimerRepair.Cancel();
+	if (bytesPerSecond == 0) {
+		bytesPerSecond = aMsg.SampleRate() * aMsg.Channels() * aMsg.BitDepth() / 8;
+	}
 
-	iRepairFirst->RemoveRef();
+	TUint bytes = OhmSocket::BufBytes(bytesPerSecond, iLatency);
 
-	while (iFifoRepair.SlotsUsed() > 0) {
-		iFifoRepair.Read()->RemoveRef();
+	if (bytes == iRecvBufBytes) {
+		return;
 	}
 
-	iTransportState = eDisconnected;
-	iDriver->Disconnected();
+	iRecvBufBytes = bytes;
 
-	iLatency = 0;
+	LOG(kMedia, "RECEIVE BUFFER %d\n", bytes);
+
+	iRecvBufResize = true;
 }
 
-TBool OhmReceiver::Repair(OhmMsgAudio& aMsg)
+void OhmReceiver::ApplyRecvBufBytes()
 {
-	// get the incoming frame number
-
-	TUint frame = aMsg.Frame();
-
-	LOG(kMedia, "GOT %d\n", frame);
-
-	// get difference between this and the last frame send down the pipeline
-
-	TInt diff = frame - iFrame;
-
-	if (diff == 1) {
-		// incoming frame is one greater than the last frame sent down the pipeline, so send this ...
+	iRecvBufResize = false;
 
-		iFrame++;
+	switch (iPlayMode) {
+	case eMulticast:
+		iProtocolMulticast->SetRecvBufBytes(iRecvBufBytes);
+		break;
+	case eUnicast:
+		iProtocolUnicast->SetRecvBufBytes(iRecvBufBytes);
+		break;
+	default:
+		break;
+	}
+}
 
-		iDriver->Add(aMsg);
+TBool OhmReceiver::RepairBegin(OhmMsgAudio& aMsg)
+{
+	LOG(kMedia, "BEGIN ON %d\n", aMsg.Frame());
 
-		// ... and see if the current first waiting frame is now also ready to be sent
+	iRepairWindow.Begin(iFrame + 1);
 
-		while (iRepairFirst->Frame() == iFrame + 1) {
-			// ... yes, it is, so send it
+	if (iRepairWindow.Add(aMsg) == eOhmRepairBeyond) {
+		// too far ahead to be repaired in time, so start again
 
-			iFrame++;
+		OhmTrace::Record(eOhmTraceDropped, aMsg.Frame());
+		aMsg.RemoveRef();
+		RepairReset();
+		return (false);
+	}
 
-			iDriver->Add(*iRepairFirst);
+    iTimerRepair.FireIn(iEnv.Random(kInitialRepairTimeoutMs));
 
-			// ... and see if there are further messages waiting in the fifo
+	return (true);
+}
 
-			if (iFifoRepair.SlotsUsed() == 0) {
-				// ... no, so we have completed the repair
+void OhmReceiver::PlayFirst(OhmMsgAudio& aMsg)
+{
+	iFrame = aMsg.Frame();
+	iLatency = Latency(aMsg);
+	UpdateRecvBufBytes(aMsg);
+	iTransportState = ePlaying;
+	iDriver->Playing();
+	OhmTrace::Record(eOhmTraceDelivered, iFrame);
+	iDriver->Add(aMsg);
+}
 
-				LOG(kMedia, "END\n");
+// A sender answers our join with a burst of the frames before its next live one (see
+// OhmSenderDriverOutput::FastStart). Joining a stream that is already playing, live frames can
+// arrive before the burst, so the first ones are held in the repair window, with room for the burst
+// before them, until the burst has joined up with them or kStartTimeoutMs has passed. Playing
+// then starts from the earliest frame held.
 
-				return (false);
-			}
+void OhmReceiver::StartBegin(OhmMsgAudio& aMsg)
+{
+	iStarting = true;
+	iStartResent = false;
+	iStartEarliest = aMsg.Frame();
 
-			// ... yes, so update the current first waiting frame and continue testing to see if this can also be sent
+	iRepairWindow.Begin(aMsg.Frame() - kMaxStartFrames);
+	iRepairWindow.Add(aMsg);
 
-			iRepairFirst = iFifoRepair.Read();
-		}
+	iTimerStart.FireIn(kStartTimeoutMs);
+}
 
-		// ... we're done
+void OhmReceiver::StartAdd(OhmMsgAudio& aMsg)
+{
+	TUint frame = aMsg.Frame();
+	TBool resent = aMsg.Resent();
 
-		return (true);
+	if ((TInt)(frame - iRepairWindow.First()) < 0) {
+		OhmTrace::Record(eOhmTraceDuplicate, frame);
+		aMsg.RemoveRef();
+		return;
 	}
 
-	if (diff < 1) {
-		// incoming frames is equal to or earlier than the last frame sent down the pipeline
-		// in other words, it's a duplicate, so so discard it and continue
-
+	switch (iRepairWindow.Add(aMsg)) {
+	case eOhmRepairAdded:
+		break;
+	case eOhmRepairDuplicate:
+		OhmTrace::Record(eOhmTraceDuplicate, frame);
 		aMsg.RemoveRef();
-
-		return (true);
+		return;
+	case eOhmRepairBeyond:
+		OhmTrace::Record(eOhmTraceDropped, frame);
+		aMsg.RemoveRef();
+		StartEnd();
+		return;
 	}
 
-	// Ok, its a frame that needs to be put into the backlog, but where?
-
-	// compare it to the current first waiting frame
+	if ((TInt)(frame - iStartEarliest) < 0) {
+		iStartEarliest = frame;
+	}
 
-	diff = frame - iRepairFirst->Frame();
+	if (resent) {
+		iStartResent = true;
+	}
 
-	if (diff < 0) {
-		// it's earlier than the current first waiting message, so it should become the new current first waiting frame
-		// and the old first waiting frame needs to be injected into the start of the backlog, so inject it into the end
-		// and rotate the others (if there is space to add another frame)
+	// the burst ends just before the first live frame, so once it has come and nothing between the
+	// earliest and latest frames held is missing there is no more to wait for
 
-		TUint count = iFifoRepair.SlotsUsed();
+	if (iStartResent && iRepairWindow.Last() - iStartEarliest + 1 == iRepairWindow.Count()) {
+		StartEnd();
+	}
+}
 
-		if (count == kMaxRepairBacklogFrames) {
-			// can't put another frame into the backlog
+void OhmReceiver::StartEnd()
+{
+	iTimerStart.Cancel();
 
-			RepairReset();
+	iStarting = false;
 
-			return (false);
-		}
+	LOG(kMedia, "START FROM %d (%d held)\n", iStartEarliest, iRepairWindow.Count());
 
-		iFifoRepair.Write(iRepairFirst);
+	PlayFirst(*iRepairWindow.Remove());
 
-		if (count == 0) {
-			iRepairLast = iRepairFirst->Frame();
-		}
+	OhmMsgAudio* msg;
 
-		for (TUint i = 0; i < count; i++) {
-			iFifoRepair.Write(iFifoRepair.Read());
-		}
-
-		// replace the currently waiting message with this new one
+	while ((msg = iRepairWindow.Next()) != 0) {
+		iFrame++;
+		OhmTrace::Record(eOhmTraceDelivered, iFrame);
+		iDriver->Add(*msg);
+	}
 
-		iRepairFirst = &aMsg;
+	if (iRepairWindow.Count() > 0) {
+		// frames are missing between those held, so repair them as any other gap
 
-		return (true);
+		iRepairing = true;
+		iTimerRepair.FireIn(iEnv.Random(kInitialRepairTimeoutMs));
 	}
+}
 
-	if (diff == 0) {
-		// it's equal to the currently first waiting frame, so discard it - it's a duplicate
-
-		aMsg.RemoveRef();
+void OhmReceiver::TimerStartExpired()
+{
+	iMutexTransport.Wait();
 
-		return (true);
+	if (iStarting) {
+		StartEnd();
 	}
 
-	// ok, it's after the currently first waiting frame, so it needs to go into the backlog
-
-	// first check if the backlog is empty
+	iMutexTransport.Signal();
+}
 
-	if (iFifoRepair.SlotsUsed() == 0) {
-		// ... yes, so just inject it
+void  OhmReceiver::RepairReset()
+{
+	LOG(kMedia, "RESET\n");
 
-		iFifoRepair.Write(&aMsg);
+	iTimerRepair.Cancel();
 
-		// ... and always keep track of the latest frame in the backlog
-		iRepairLast = frame;
+	OhmMsgAudio* msg;
 
-		return (true);
+	while ((msg = iRepairWindow.Remove()) != 0) {
+		OhmTrace::Record(eOhmTraceDropped, msg->Frame());
+		msg->RemoveRef();
 	}
 
-	// ok, so the backlog is not empty
+	iTransportState = eDisconnected;
+	iDriver->Disconnected();
 
-	// is the incoming frame later than the last one currently in the backlog?
+	iLatency = 0;
+}
 
-	diff = frame - iRepairLast;
+// Frames arriving while repairing are held in the repair window, which gives them back in order
+// as the gaps before them are filled
+
+TBool OhmReceiver::Repair(OhmMsgAudio& aMsg)
+{
+	// get the incoming frame number
 
-	if (diff > 0) {
-		// ... yes, so, again, just inject it (if there is space)
+	TUint frame = aMsg.Frame();
 
-		TUint count = iFifoRepair.SlotsUsed();
+	LOG(kMedia, "GOT %d\n", frame);
 
-		if (count == kMaxRepairBacklogFrames) {
-			// can't put another frame into the backlog
-			RepairReset();
+	// get difference between this and the last frame send down the pipeline
 
-			return (false);
-		}
+	TInt diff = frame - iFrame;
 
-		iFifoRepair.Write(&aMsg);
+	if (diff < 1) {
+		// incoming frames is equal to or earlier than the last frame sent down the pipeline
+		// in other words, it's a duplicate, so so discard it and continue
 
-		// ... and update the record of the last frame in the backlog
+		OhmTrace::Record(eOhmTraceDuplicate, frame);
 
-		iRepairLast = frame;
+		aMsg.RemoveRef();
 
 		return (true);
 	}
 
-	// is it a duplicate of the last frame in the backlog?
-
-	if (diff == 0) {
-		// ... yes, so discard
+	switch (iRepairWindow.Add(aMsg)) {
+	case eOhmRepairAdded:
+		break;
+	case eOhmRepairDuplicate:
+		OhmTrace::Record(eOhmTraceDuplicate, frame);
 		aMsg.RemoveRef();
-
 		return (true);
+	case eOhmRepairBeyond:
+		// can't put another frame into the backlog
+		OhmTrace::Record(eOhmTraceDropped, frame);
+		aMsg.RemoveRef();
+		RepairReset();
+		return (false);
 	}
 
-	// ... no, so it has to go somewhere in the middle of the backlog, so iterate through and inject it at the right place (if there is space)
+	if (diff == 1) {
+		OhmTrace::Record(eOhmTraceRepaired, frame);
+	}
 
-	TUint count = iFifoRepair.SlotsUsed();
+	// send down the pipeline whatever is now in order
 
-	TBool found = false;
+	OhmMsgAudio* msg;
 
-	for (TUint i = 0; i < count; i++) {
-		OhmMsgAudio* msg = iFifoRepair.Read();
-					
-		if (!found) {
-			diff = frame - msg->Frame();
+	while ((msg = iRepairWindow.Next()) != 0) {
+		iFrame++;
 
-			if (diff < 0) {
-				if (count == kMaxRepairBacklogFrames) {
-					// can't put another frame into the backlog
-					iFifoRepair.Write(&aMsg);
-					RepairReset();
-					return (false);
-				}
+		OhmTrace::Record(eOhmTraceDelivered, iFrame);
 
-				iFifoRepair.Write(&aMsg);
-				found = true;
-			}
-			else if (diff == 0) {
-				aMsg.RemoveRef();
-				found = true;
-			}
-		}
+		iDriver->Add(*msg);
+	}
+
+	if (iRepairWindow.Count() == 0) {
+		// ... nothing left waiting, so we have completed the repair
+
+		LOG(kMedia, "END\n");
 
-		iFifoRepair.Write(msg);
+		return (false);
 	}
 
 	return (true);
@@ -745,58 +1011,66 @@ void OhmReceiver::TimerRepairExpired()
 	if (iRepairing) {
 		LOG(kMedia, "REQUEST RESEND");
 
-		Bws<kMaxRepairMissedFrames * 4> missed;
-		WriterBuffer buffer(missed);
-		WriterBinary writer(buffer);
+		// the frames between the last sent down the pipeline and the latest waiting
 
-		TUint count = 0;
+		TUint frames[kMaxRepairMissedFrames];
+		TUint count = iRepairWindow.Missed(frames, kMaxRepairMissedFrames);
 
-		TUint start = iFrame + 1;
-		TUint end = iRepairFirst->Frame();
+		for (TUint i = 0; i < count; i++) {
+			OhmTrace::Record(eOhmTraceResendRequested, frames[i]);
+			LOG(kMedia, " %d", frames[i]);
+		}
 
-		// phase 1 - request the frames between the last sent down the pipeline and the first waiting frame
+		LOG(kMedia, "\n");
 
-		for (TUint i = start; i < end; i++) {
-			writer.WriteUint32Be(i);
-			LOG(kMedia, " %d", i);
-			if (++count == kMaxRepairMissedFrames) {
-				break;
-			}
-		}
+		if (count > 0) {
+			// as a bitmap from the first frame missed if the sender takes one and it is the shorter,
+			// which the repair window keeps in range
 
-		// phase 2 - if there is room add the missing frames in the backlog
-
-		if (count < kMaxRepairMissedFrames) {
-			TUint slots = iFifoRepair.SlotsUsed();
-
-			for (TUint j = 0; j < slots; j++) {
-				OhmMsgAudio* msg = iFifoRepair.Read();
-				if (count < kMaxRepairMissedFrames) {
-					start = end + 1;
-					end = msg->Frame();
-					for (TUint i = start; i < end; i++) {
-						writer.WriteUint32Be(i);
-						LOG(kMedia, " %d", i);
-						if (++count == kMaxRepairMissedFrames) {
-							break;
-						}
-					}
+			TUint first = frames[0];
+			TUint range = frames[count - 1] - first + 1;
+
+			if (iResendRange && OhmHeaderResendRange(first, range).MsgBytes() < OhmHeaderResend(count).MsgBytes()) {
+				Bws<OhmHeaderResendRange::kMaxBitmapBytes> bitmap;
+				bitmap.SetBytes((range + 7) / 8);
+				bitmap.Fill(0);
+
+				for (TUint i = 0; i < count; i++) {
+					TUint bit = frames[i] - first;
+					bitmap[bit >> 3] |= (1 << (bit & 7));
+				}
+
+				switch (iPlayMode) {
+				case eMulticast:
+					iProtocolMulticast->RequestResendRange(first, range, bitmap);
+					break;
+				case eUnicast:
+					iProtocolUnicast->RequestResendRange(first, range, bitmap);
+					break;
+				default:
+					break;
 				}
-				iFifoRepair.Write(msg);
 			}
-		}
+			else {
+				Bws<kMaxRepairMissedFrames * 4> missed;
+				WriterBuffer buffer(missed);
+				WriterBinary writer(buffer);
 
-		LOG(kMedia, "\n");
+				for (TUint i = 0; i < count; i++) {
+					writer.WriteUint32Be(frames[i]);
+				}
 
-		switch (iPlayMode) {
-		case eMulticast:
-			iProtocolMulticast->RequestResend(missed);
-			break;
-		case eUnicast:
-			iProtocolUnicast->RequestResend(missed);
-			break;
-		default:
-			break;
+				switch (iPlayMode) {
+				case eMulticast:
+					iProtocolMulticast->RequestResend(missed);
+					break;
+				case eUnicast:
+					iProtocolUnicast->RequestResend(missed);
+					break;
+				default:
+					break;
+				}
+			}
 		}
 
 		// iTimerRepair.FireIn(iEnv.Random(iLatency >> 1)); // check again a random time 1/2 of the audio latency
@@ -816,6 +1090,10 @@ void OhmReceiver::Add(OhmMsg& aMsg)
 
 	aMsg.Process(*this);
 
+	if (iRecvBufResize) {
+		ApplyRecvBufBytes();
+	}
+
 	iMutexTransport.Signal();
 }
 
@@ -831,18 +1109,48 @@ void OhmReceiver::ResendSeen()
 	iMutexTransport.Signal();
 }
 
+void OhmReceiver::Switched()
+{
+	iMutexTransport.Wait();
+	iSwitching = false;
+	iMutexTransport.Signal();
+}
+
 // IOhmMsgProcessor
 
 void OhmReceiver::Process(OhmMsgAudio& aMsg)
 {
+	if (iSwitching) {
+		aMsg.RemoveRef();
+		return;
+	}
+
+	OhmTrace::Record(aMsg.Resent() ? eOhmTraceResendReceived : eOhmTraceRx, aMsg.Frame());
+
+	iResendRange = aMsg.ResendRange();
+
 	if (iLatency == 0) {
-		iFrame = aMsg.Frame();
-		iLatency = Latency(aMsg);
-		iTransportState = ePlaying;
-		iDriver->Playing();
-		iDriver->Add(aMsg);
+		if (iStarting) {
+			StartAdd(aMsg);
+			return;
+		}
+
+		if (iSwitchUs != 0) {
+			LOG(kMedia, "SWITCH %d us to first frame\n", (TUint)(OsTimeInUs(iEnv.OsCtx()) - iSwitchUs));
+			iSwitchUs = 0;
+		}
+
+		if (aMsg.Resent()) {
+			PlayFirst(aMsg); // a fast start burst that came ahead of the live frames
+		}
+		else {
+			StartBegin(aMsg);
+		}
+
 		return;
 	}
+
+	UpdateRecvBufBytes(aMsg); // the format can change within a stream
 	
 	if (iRepairing) {
 		iRepairing = Repair(aMsg);
@@ -853,18 +1161,26 @@ void OhmReceiver::Process(OhmMsgAudio& aMsg)
 
 	if (diff == 1) {
 		iFrame++;
+		OhmTrace::Record(eOhmTraceDelivered, iFrame);
 		iDriver->Add(aMsg);
 	}
 	else if (diff < 1) {
+		OhmTrace::Record(eOhmTraceDuplicate, aMsg.Frame());
 		aMsg.RemoveRef();
 	}
 	else {
+		OhmTrace::Record(eOhmTraceGap, aMsg.Frame());
 		iRepairing = RepairBegin(aMsg);
 	}
 }
 
 void OhmReceiver::Process(OhmMsgTrack& aMsg)
 {
+	if (iSwitching) {
+		aMsg.RemoveRef();
+		return;
+	}
+
 	if (iTransportState == eStarted) {
 		iTransportState = eConnected;
 		iDriver->Connected();
@@ -875,6 +1191,11 @@ void OhmReceiver::Process(OhmMsgTrack& aMsg)
 
 void OhmReceiver::Process(OhmMsgMetatext& aMsg)
 {
+	if (iSwitching) {
+		aMsg.RemoveRef();
+		return;
+	}
+
 	if (iTransportState == eStarted) {
 		iTransportState = eConnected;
 		iDriver->Connected();
@@ -11,6 +11,8 @@
 #include "Ohm.h"
 #include "OhmMsg.h"
 #include "OhmSocket.h"
+#include "OhmRepair.h"
+#include "OhmZone.h"
 
 namespace OpenHome {
 namespace Av {
@@ -55,6 +57,7 @@ class IOhmReceiver
 public:
 	virtual void Add(OhmMsg& aMsg) = 0;
 	virtual void ResendSeen() = 0;
+	virtual void Switched() = 0; // nothing more will be added from the channel played before a Switch
 	virtual ~IOhmReceiver() {}
 };
 
@@ -69,10 +72,16 @@ class OhmProtocolMulticast
 public:
 	OhmProtocolMulticast(Environment& aEnv, IOhmReceiver& aReceiver, IOhmMsgFactory& aFactory);
     void Play(TIpAddress aInterface, TUint aTtl, const Endpoint& aEndpoint);
+	void Switch(const Endpoint& aEndpoint); // play another channel without stopping
 	void Stop();
 	void RequestResend(const Brx& aFrames);
+	void RequestResendRange(TUint aFirst, TUint aFramesCount, const Brx& aBitmap);
+	void SetRecvBufBytes(TUint aBytes); // on the protocol thread
+	TUint KernelDrops();
+	void SetTap(IOhmSocketTap* aTap);
 
 private:
+	TBool Switched();
     void SendJoin();
     void SendListen();
     void Send(TUint aType);
@@ -86,6 +95,10 @@ private:
     Endpoint iEndpoint;
     Timer iTimerJoin;
     Timer iTimerListen;
+	Mutex iMutex;
+	TBool iOpen;									// [iMutex]
+	TBool iSwitching;								// [iMutex]
+	Endpoint iEndpointNext;							// [iMutex]
 };
 
 class OhmProtocolUnicast
@@ -103,9 +116,14 @@ public:
 	void SetInterface(TIpAddress aValue);
     void SetTtl(TUint aValue);
     void Play(TIpAddress aInterface, TUint aTtl, const Endpoint& aEndpoint);
+	void Switch(const Endpoint& aEndpoint); // play another sender without stopping
 	void Stop();
 	void EmergencyStop();
 	void RequestResend(const Brx& aFrames);
+	void RequestResendRange(TUint aFirst, TUint aFramesCount, const Brx& aBitmap);
+	void SetRecvBufBytes(TUint aBytes); // on the protocol thread
+	TUint KernelDrops();
+	void SetTap(IOhmSocketTap* aTap);
 
 private:
 	void HandleAudio(const OhmHeader& aHeader);
@@ -113,6 +131,7 @@ private:
 	void HandleMetatext(const OhmHeader& aHeader);
 	void HandleSlave(const OhmHeader& aHeader);
 	void Broadcast(OhmMsg& aMsg);
+	TBool Switched();
     void SendJoin();
     void SendListen();
     void SendLeave();
@@ -133,6 +152,10 @@ private:
 	TUint iSlaveCount;
     Endpoint iSlaveList[kMaxSlaveCount];
 	Bws<kMaxFrameBytes> iMessageBuffer;
+	Mutex iMutex;
+	TBool iOpen;									// [iMutex]
+	TBool iSwitching;								// [iMutex]
+	Endpoint iEndpointNext;							// [iMutex]
 };
 
 class OhmReceiver : public IOhmReceiver, public IOhmMsgProcessor
@@ -148,16 +171,16 @@ class OhmReceiver : public IOhmReceiver, public IOhmMsgProcessor
 	static const TUint kMaxZoneBytes = 100;
 	static const TUint kMaxZoneFrameBytes = 1024;
 
-	static const TUint kTimerZoneQueryDelayMs = 100;
-
 	static const TUint kDefaultLatency = 50;
 
-	static const TUint kMaxRepairBacklogFrames = 200;
 	static const TUint kMaxRepairMissedFrames = 20;
 
 	static const TUint kInitialRepairTimeoutMs = 10;
 	static const TUint kSubsequentRepairTimeoutMs = 30;
 
+	static const TUint kStartTimeoutMs = 20; // longest the first live frames wait for a fast start burst
+	static const TUint kMaxStartFrames = OhmRepairWindow<OhmMsgAudio>::kMaxFrames / 2; // room for a burst before the first live frame
+
 public:
     OhmReceiver(Environment& aEnv, TIpAddress aInterface, TUint aTtl, IOhmReceiverDriver& aDriver);
 
@@ -169,6 +192,8 @@ public:
 
 	void Play(const Brx& aUri);
 	void Stop();
+	void SetTap(IOhmSocketTap* aTap); // while stopped, 0 to remove
+	TUint KernelDrops() const; // datagrams dropped for want of receive buffer by the socket playing
     
     ~OhmReceiver();
 
@@ -177,19 +202,33 @@ private:
 	void RunZone();
 	void StopLocked();
 	void SendZoneQuery();
+	void ZoneQueryOverheard();
+	void ZoneQueryAnswered();
 	void PlayZoneMode(const Brx& aUri);
+	TBool PlaySwitchLocked(const Brx& aUri);
+	TBool SwitchLocked(const OpenHome::Uri& aUri, const Endpoint& aEndpoint);
 	void Reset();
+	void UpdateRecvBufBytes(OhmMsgAudio& aMsg);
+	void ApplyRecvBufBytes(); // on the protocol thread
+	TUint KernelDropsLocked() const; // [iMutexMode]
 	void RepairReset();
 	void TimerRepairExpired();
 
 	TBool RepairBegin(OhmMsgAudio& aMsg);
 	TBool Repair(OhmMsgAudio& aMsg);
 
+	void PlayFirst(OhmMsgAudio& aMsg);
+	void StartBegin(OhmMsgAudio& aMsg);
+	void StartAdd(OhmMsgAudio& aMsg);
+	void StartEnd();
+	void TimerStartExpired();
+
 	TUint Latency(OhmMsgAudio& aMsg);
 	
 	// IOhmReceiver
 	virtual void Add(OhmMsg& aMsg);
 	virtual void ResendSeen();
+	virtual void Switched();
 
 	// IOhmMsgProcessor
 	virtual void Process(OhmMsgAudio& aMsg);
@@ -205,11 +244,16 @@ private:
 	ThreadFunctor* iThreadZone;
 	mutable Mutex iMutexMode;
 	mutable Mutex iMutexTransport;
+	Mutex iMutexZone;
 	Semaphore iPlaying;
 	Semaphore iZoning;
 	Semaphore iStopped;
 	Semaphore iNullStop;
 	TUint iLatency;									// [iMutexTransport] 0 = first audio message of stream not yet received
+	TBool iSwitching;								// [iMutexTransport] messages are from the channel switched from
+	TUint64 iSwitchUs;								// [iMutexTransport] when the last switch began, 0 once its first frame is in
+	TUint iRecvBufBytes;							// [iMutexTransport] 0 = not yet sized for this stream
+	TBool iRecvBufResize;							// [iMutexTransport] iRecvBufBytes is still to be applied to the socket
 	EOhmReceiverTransportState iTransportState;		// [iMutexTransport]
 	EOhmReceiverPlayMode iPlayMode;
 	TBool iZoneMode;
@@ -225,13 +269,19 @@ private:
     Srs<kMaxZoneFrameBytes> iRxZone;
     Bws<kMaxZoneFrameBytes> iTxZone;
 	Timer iTimerZoneQuery;
+	OhzZoneCache iZoneCache;						// [iThreadZone]
+	OhzQueryBackoff iZoneQueryBackoff;				// [iMutexZone]
+	TBool iZoneAnswered;							// [iMutexZone] no more queries until zone mode restarts
 	OhmMsgFactory iFactory;
 	TUint iFrame;
 	TBool iRepairing;
-	TUint iRepairLast;
-	OhmMsgAudio* iRepairFirst;
-	FifoLite<OhmMsgAudio*, kMaxRepairBacklogFrames> iFifoRepair;
+	TBool iResendRange;								// [iMutexTransport] the sender accepts resend requests as a bitmap
+	OhmRepairWindow<OhmMsgAudio> iRepairWindow;	// [iMutexTransport] frames held while starting or repairing
 	Timer iTimerRepair;
+	TBool iStarting;								// [iMutexTransport] holding the first frames of a stream for a fast start burst
+	TBool iStartResent;								// [iMutexTransport] a resent frame has arrived while starting
+	TUint iStartEarliest;							// [iMutexTransport] the earliest frame held while starting
+	Timer iTimerStart;
 };
 
 } // namespace Av
@@ -0,0 +1,39 @@
+#include "OhmRepair.h"
+
+using namespace OpenHome;
+using namespace OpenHome::Av;
+
+// OhmResendFilter
+
+OhmResendFilter::OhmResendFilter()
+	: iWindowUs(kDefaultWindowUs)
+{
+	Reset();
+}
+
+void OhmResendFilter::SetWindowUs(TUint aValue)
+{
+	iWindowUs = aValue;
+}
+
+void OhmResendFilter::Reset()
+{
+	for (TUint i = 0; i < kMaxFrames; i++) {
+		iUsed[i] = false;
+	}
+}
+
+TBool OhmResendFilter::Pass(TUint aFrame, TUint64 aTimeUs)
+{
+	TUint slot = aFrame % kMaxFrames;
+
+	if (iUsed[slot] && iFrame[slot] == aFrame && aTimeUs - iTimeUs[slot] < iWindowUs) {
+		return (false);
+	}
+
+	iUsed[slot] = true;
+	iFrame[slot] = aFrame;
+	iTimeUs[slot] = aTimeUs;
+
+	return (true);
+}
@@ -0,0 +1,248 @@
+#ifndef HEADER_OHM_REPAIR
+#define HEADER_OHM_REPAIR
+
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Standard.h>
+
+#include <string.h>
+
+namespace OpenHome {
+namespace Av {
+
+// OhmRepairWindow holds the frames a receiver has been sent ahead of a gap until the gap is filled
+//
+// Frames sit in slots indexed by frame number, with a bitmap of the slots filled, so adding a frame
+// or taking the next one due costs the same however many are held, and the gaps are listed 64
+// frames at a time from the bitmap. The window spans kMaxFrames from the first frame not yet taken.
+// T is the frame type, which has Frame(); the window holds pointers and never releases them.
+
+enum EOhmRepairAdd
+{
+	eOhmRepairAdded,
+	eOhmRepairDuplicate,
+	eOhmRepairBeyond	// too far ahead of the first frame for the window
+};
+
+template<class T> class OhmRepairWindow
+{
+public:
+	static const TUint kMaxFrames = 256; // a power of two and a multiple of 64
+
+private:
+	static const TUint kSlotMask = kMaxFrames - 1;
+	static const TUint kWords = kMaxFrames / 64;
+
+public:
+	OhmRepairWindow();
+	void Begin(TUint aFirst); // while empty, with aFirst the next frame due
+	TUint First() const; // the next frame due
+	TUint Last() const; // the latest frame held, when Count() > 0
+	TUint Count() const;
+	EOhmRepairAdd Add(T& aFrame); // frames before First() are the caller's to discard
+	T* Next(); // the next frame due if held, moving the window on past it, else 0
+	T* Remove(); // the earliest frame held, moving the window on past it, 0 once empty
+	TUint Missed(TUint* aFrames, TUint aMaxFrames) const; // the gaps between First() and Last()
+
+private:
+	TBool Held(TUint aFrame) const;
+	void Clear(TUint aFrame);
+	static TUint LowestBit(TUint64 aBits);
+
+private:
+	T* iSlot[kMaxFrames];
+	TUint64 iReceived[kWords];
+	TUint iFirst;
+	TUint iLast;
+	TUint iCount;
+};
+
+// OhmRepairWindow
+
+template<class T> OhmRepairWindow<T>::OhmRepairWindow()
+	: iFirst(0)
+	, iLast(0)
+	, iCount(0)
+{
+	memset(iSlot, 0, sizeof(iSlot));
+	memset(iReceived, 0, sizeof(iReceived));
+}
+
+template<class T> void OhmRepairWindow<T>::Begin(TUint aFirst)
+{
+	ASSERT(iCount == 0);
+	iFirst = aFirst;
+	iLast = aFirst;
+}
+
+template<class T> TUint OhmRepairWindow<T>::First() const
+{
+	return (iFirst);
+}
+
+template<class T> TUint OhmRepairWindow<T>::Last() const
+{
+	return (iLast);
+}
+
+template<class T> TUint OhmRepairWindow<T>::Count() const
+{
+	return (iCount);
+}
+
+template<class T> EOhmRepairAdd OhmRepairWindow<T>::Add(T& aFrame)
+{
+	TUint frame = aFrame.Frame();
+
+	if (frame - iFirst >= kMaxFrames) {
+		return (eOhmRepairBeyond);
+	}
+
+	if (Held(frame)) {
+		return (eOhmRepairDuplicate);
+	}
+
+	TUint slot = frame & kSlotMask;
+
+	iSlot[slot] = &aFrame;
+	iReceived[slot >> 6] |= (TUint64)1 << (slot & 63);
+
+	if (iCount == 0 || (TInt)(frame - iLast) > 0) {
+		iLast = frame;
+	}
+
+	iCount++;
+
+	return (eOhmRepairAdded);
+}
+
+template<class T> T* OhmRepairWindow<T>::Next()
+{
+	if (!Held(iFirst)) {
+		return (0);
+	}
+
+	T* frame = iSlot[iFirst & kSlotMask];
+
+	Clear(iFirst);
+
+	iFirst++;
+
+	return (frame);
+}
+
+template<class T> T* OhmRepairWindow<T>::Remove()
+{
+	if (iCount == 0) {
+		return (0);
+	}
+
+	for (;;) {
+		TUint slot = iFirst & kSlotMask;
+		TUint shift = slot & 63;
+		TUint64 held = iReceived[slot >> 6] >> shift;
+
+		if (held != 0) {
+			iFirst += LowestBit(held);
+			return (Next());
+		}
+
+		iFirst += 64 - shift;
+	}
+}
+
+// Words are taken from the bitmap a piece at a time, each piece ending at a word boundary or Last()
+
+template<class T> TUint OhmRepairWindow<T>::Missed(TUint* aFrames, TUint aMaxFrames) const
+{
+	TUint count = 0;
+
+	if (iCount == 0) {
+		return (0);
+	}
+
+	TUint frame = iFirst;
+
+	while (frame != iLast && count < aMaxFrames) {
+		TUint slot = frame & kSlotMask;
+		TUint shift = slot & 63;
+		TUint span = 64 - shift;
+		TUint remaining = iLast - frame;
+
+		if (span > remaining) {
+			span = remaining;
+		}
+
+		TUint64 gaps = ~iReceived[slot >> 6] >> shift;
+
+		if (span < 64) {
+			gaps &= ((TUint64)1 << span) - 1;
+		}
+
+		while (gaps != 0 && count < aMaxFrames) {
+			aFrames[count++] = frame + LowestBit(gaps);
+			gaps &= gaps - 1;
+		}
+
+		frame += span;
+	}
+
+	return (count);
+}
+
+template<class T> TBool OhmRepairWindow<T>::Held(TUint aFrame) const
+{
+	TUint slot = aFrame & kSlotMask;
+	return ((iReceived[slot >> 6] & ((TUint64)1 << (slot & 63))) != 0);
+}
+
+template<class T> void OhmRepairWindow<T>::Clear(TUint aFrame)
+{
+	TUint slot = aFrame & kSlotMask;
+	iReceived[slot >> 6] &= ~((TUint64)1 << (slot & 63));
+	iSlot[slot] = 0;
+	iCount--;
+}
+
+template<class T> TUint OhmRepairWindow<T>::LowestBit(TUint64 aBits)
+{
+#ifdef __GNUC__
+	return (__builtin_ctzll(aBits));
+#else
+	TUint bit = 0;
+	while ((aBits & 1) == 0) {
+		aBits >>= 1;
+		bit++;
+	}
+	return (bit);
+#endif
+}
+
+// OhmResendFilter lets a sender resend each frame at most once in a window of time, so that a frame
+// asked for by many receivers of one multicast stream goes out once rather than once for each of
+// them. The window must be shorter than the time a receiver waits before asking again, so that a
+// resend lost on its way to a receiver can still be asked for. Frames are remembered in slots
+// indexed by frame number, so only the latest kMaxFrames frames resent are remembered.
+
+class OhmResendFilter
+{
+public:
+	static const TUint kMaxFrames = 256;
+	static const TUint kDefaultWindowUs = 20000; // OhmReceiver asks again every 30ms
+
+public:
+	OhmResendFilter();
+	void SetWindowUs(TUint aValue); // 0 to let every frame through
+	void Reset();
+	TBool Pass(TUint aFrame, TUint64 aTimeUs); // whether to resend aFrame at aTimeUs
+
+private:
+	TUint iWindowUs;
+	TBool iUsed[kMaxFrames];
+	TUint iFrame[kMaxFrames];
+	TUint64 iTimeUs[kMaxFrames];
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+#endif // HEADER_OHM_REPAIR
@@ -1,9 +1,13 @@
 #include "OhmSender.h"
+#include "OhmTrace.h"
+#include "OhmRealtime.h"
+#include "OhmSilence.h"
 #include <OpenHome/Net/Core/DvAvOpenhomeOrgSender1.h>
 #include <OpenHome/Private/Ascii.h>
 #include <OpenHome/Private/Arch.h>
 #include <OpenHome/Private/Debug.h>
 #include <OpenHome/Private/Env.h>
+#include <OpenHome/Os.h>
 #include "Debug.h"
 
 #include <stdio.h>
@@ -253,17 +257,47 @@ const Brx& OhmSenderServer::MimeType() const
 // OhmSenderDriver
 
 OhmSenderDriver::OhmSenderDriver(Environment& aEnv)
-    : iMutex("OHMD")
-	, iEnabled(false)
-    , iActive(false)
-	, iSend(false)
+    : iEnv(aEnv)
+    , iMutex("OHMD")
+	, iFastStart(false)
     , iFrame(0)
+    , iBitRate(0)
+	, iDtx(false)
     , iSamplesTotal(0)
     , iSampleStart(0)
 	, iLatency(100)
-    , iSocket(aEnv)
-	, iFactory(100, 10, 10)
+	, iFactory(OhmSenderDriverOutput::kMaxHistoryFrames, 10, 10)
+	, iOutputCount(0)
 {
+	iFactory.Prefault();
+	OhmRealtime::Prefault(this, sizeof(OhmSenderDriver));
+
+	AddOutput();
+}
+
+OhmSenderDriver::~OhmSenderDriver()
+{
+	for (TUint i = 0; i < iOutputCount; i++) {
+		iMutex.Wait();
+		iOutput[i]->ResetLocked();
+		iMutex.Signal();
+		delete (iOutput[i]);
+	}
+}
+
+IOhmSenderDriver& OhmSenderDriver::AddOutput()
+{
+    AutoMutex mutex(iMutex);
+
+	ASSERT(iOutputCount < kMaxOutputs);
+
+	OhmSenderDriverOutput* output = new OhmSenderDriverOutput(iEnv, *this);
+
+	OhmRealtime::Prefault(output, sizeof(OhmSenderDriverOutput));
+
+	iOutput[iOutputCount++] = output;
+
+	return (*output);
 }
 
 void OhmSenderDriver::SetAudioFormat(TUint aSampleRate, TUint aBitRate, TUint aChannels, TUint aBitDepth, TBool aLossless, const Brx& aCodecName)
@@ -276,15 +310,29 @@ void OhmSenderDriver::SetAudioFormat(TUint aSampleRate, TUint aBitRate, TUint aC
     iBitDepth = aBitDepth;
     iLossless = aLossless;
     iCodecName.Replace(aCodecName);
+
+	for (TUint i = 0; i < iOutputCount; i++) {
+		iOutput[i]->iSocket.SetSendBufBytes(OhmSocket::BufBytes(iBitRate / 8, iOutput[i]->iLatency));
+	}
 }
 
+// Each frame is built and externalised once, then sent by every output that is sending
+
 void OhmSenderDriver::SendAudio(const TByte* aData, TUint aBytes)
 {
     AutoMutex mutex(iMutex);
     
     TUint samples = aBytes * 8 / iChannels / iBitDepth;
 
-    if (!iSend) {
+	TBool keeping = false;
+
+	for (TUint i = 0; i < iOutputCount; i++) {
+		if (iOutput[i]->Keeping()) {
+			keeping = true;
+		}
+	}
+
+    if (!keeping) {
         iSampleStart += samples;
         return;
     }
@@ -298,8 +346,8 @@ void OhmSenderDriver::SendAudio(const TByte* aData, TUint aBytes)
 
 	TUint latency = iLatency * multiplier / 1000;
     
-	if (iFifoHistory.SlotsUsed() == kMaxHistoryFrames) {
-		iFifoHistory.Read()->RemoveRef();
+	for (TUint i = 0; i < iOutputCount; i++) {
+		iOutput[i]->Retire(iFrame);
 	}
 
 	OhmMsgAudio& msg = iFactory.CreateAudio(
@@ -322,6 +370,12 @@ void OhmSenderDriver::SendAudio(const TByte* aData, TUint aBytes)
         iCodecName,
 		Brn(aData, aBytes)
 	);
+
+	msg.SetResendRange(true);
+
+	if (iDtx && iLossless && OhmSilence::IsSilent(aData, aBytes)) {
+		msg.SetSilence(true);
+	}
     
 	WriterBuffer writer(iBuffer);
 	writer.Flush();
@@ -329,22 +383,311 @@ void OhmSenderDriver::SendAudio(const TByte* aData, TUint aBytes)
 
 	msg.SetResent(true);
 
-	iFifoHistory.Write(&msg);
+	TUint64 now = OsTimeInUs(iEnv.OsCtx());
+
+	for (TUint i = 0; i < iOutputCount; i++) {
+		if (iOutput[i]->Keeping()) {
+			iOutput[i]->Send(msg, iBuffer, now);
+		}
+	}
+
+	msg.RemoveRef(); // the histories hold it now
 
-    try {
-		iSocket.Send(iBuffer, iEndpoint);
-    }
-    catch (NetworkError&) {
-    }
-        
     iSampleStart += samples;
 
     iFrame++;
+
+	// resends only take what is left once the live frame is away
+
+	for (TUint i = 0; i < iOutputCount; i++) {
+		if (iOutput[i]->iSend) {
+			iOutput[i]->SendResendsLocked(now);
+		}
+	}
+}
+
+void OhmSenderDriver::SetFastStart(TBool aValue)
+{
+    AutoMutex mutex(iMutex);
+
+	iFastStart = aValue;
+
+	if (!iFastStart) {
+		for (TUint i = 0; i < iOutputCount; i++) {
+			if (!iOutput[i]->iSend) {
+				iOutput[i]->ResetLocked();
+			}
+		}
+	}
+}
+
+void OhmSenderDriver::SetResendShare(TUint aPercent)
+{
+	for (TUint i = 0; i < iOutputCount; i++) {
+		iOutput[i]->SetResendShare(aPercent);
+	}
+}
+
+void OhmSenderDriver::SetDtx(TBool aValue)
+{
+    AutoMutex mutex(iMutex);
+
+	iDtx = aValue;
+}
+
+void OhmSenderDriver::GetStats(OhmSenderDriverStats& aStats)
+{
+	iOutput[0]->GetStats(aStats);
+}
+
+void OhmSenderDriver::ResetStats()
+{
+	for (TUint i = 0; i < iOutputCount; i++) {
+		iOutput[i]->ResetStats();
+	}
+}
+
+void OhmSenderDriver::PrintStats()
+{
+	for (TUint i = 0; i < iOutputCount; i++) {
+		iOutput[i]->PrintStats();
+	}
 }
 
 // IOhmSenderDriver
 
 void OhmSenderDriver::SetEnabled(TBool aValue)
+{
+	iOutput[0]->SetEnabled(aValue);
+}
+
+void OhmSenderDriver::SetActive(TBool aValue)
+{
+	iOutput[0]->SetActive(aValue);
+}
+
+void OhmSenderDriver::SetEndpoint(const Endpoint& aEndpoint, TIpAddress aAdapter)
+{
+	iOutput[0]->SetEndpoint(aEndpoint, aAdapter);
+}
+
+void OhmSenderDriver::SetTtl(TUint aValue)
+{
+	iOutput[0]->SetTtl(aValue);
+}
+
+void OhmSenderDriver::SetLatency(TUint aValue)
+{
+	iOutput[0]->SetLatency(aValue);
+}
+
+void OhmSenderDriver::SetTrackPosition(TUint64 aSamplesTotal, TUint64 aSampleStart)
+{
+	iOutput[0]->SetTrackPosition(aSamplesTotal, aSampleStart);
+}
+
+void OhmSenderDriver::Resend(const Brx& aFrames)
+{
+	iOutput[0]->Resend(aFrames);
+}
+
+void OhmSenderDriver::FastStart()
+{
+	iOutput[0]->FastStart();
+}
+
+void OhmSenderDriver::AddUnicast(const Endpoint& aEndpoint)
+{
+	iOutput[0]->AddUnicast(aEndpoint);
+}
+
+void OhmSenderDriver::RemoveUnicast(const Endpoint& aEndpoint)
+{
+	iOutput[0]->RemoveUnicast(aEndpoint);
+}
+
+// frames are numbered from 0 again once no output is sending them
+
+void OhmSenderDriver::ResetLocked()
+{
+	for (TUint i = 0; i < iOutputCount; i++) {
+		if (iOutput[i]->iSend) {
+			return;
+		}
+	}
+
+	iFrame = 0;
+}
+
+// OhmSenderDriverOutput
+
+OhmSenderDriverOutput::OhmSenderDriverOutput(Environment& aEnv, OhmSenderDriver& aDriver)
+	: iEnv(aEnv)
+	, iDriver(aDriver)
+	, iMutex(aDriver.iMutex)
+	, iEnabled(false)
+	, iActive(false)
+	, iSend(false)
+	, iAdapter(0)
+	, iUnicastCount(0)
+	, iLatency(100)
+	, iSocket(aEnv)
+	, iResendShare(OhmSenderDriver::kDefaultResendShare)
+	, iResendTokens(0)
+	, iResendTokensUs(0)
+{
+	for (TUint i = 0; i < kMaxHistoryFrames; i++) {
+		iSentUs[i] = 0;
+	}
+
+	ResetStatsLocked();
+}
+
+// frames are kept in the history while sending, and in fast start mode while enabled, so the first
+// receiver to join has some
+
+TBool OhmSenderDriverOutput::Keeping() const
+{
+	return (iSend || (iDriver.iFastStart && iEnabled));
+}
+
+void OhmSenderDriverOutput::Send(OhmMsgAudio& aMsg, const Brx& aBuffer, TUint64 aNowUs)
+{
+	aMsg.AddRef();
+
+	iFifoHistory.Write(&aMsg);
+
+	iSentUs[aMsg.Frame() % kMaxHistoryFrames] = aNowUs;
+
+	if (iSend) {
+		OhmSendBatch batch(iSocket);
+
+		Transmit(aBuffer);
+
+		iStatsAudioBytes += aBuffer.Bytes() * (1 + iUnicastCount);
+		iStatsFrames++;
+
+		if (aMsg.Silence()) {
+			iStatsSilentFrames++;
+			iStatsSilenceBytes += aMsg.Audio().Bytes() * (1 + iUnicastCount);
+		}
+	}
+}
+
+// The one serialised frame goes to the endpoint and to each unicast receiver
+
+void OhmSenderDriverOutput::Transmit(const Brx& aBuffer)
+{
+	try {
+		iSocket.Send(aBuffer, iEndpoint);
+	}
+	catch (NetworkError&) {
+	}
+
+	for (TUint i = 0; i < iUnicastCount; i++) {
+		try {
+			iSocket.Send(aBuffer, iUnicast[i]);
+		}
+		catch (NetworkError&) {
+		}
+	}
+}
+
+// Makes room for aFrame. The oldest frame leaves a full history, and any resends still queued for
+// frames that old are dropped, so no output holds a frame the history of every output has let go.
+
+void OhmSenderDriverOutput::Retire(TUint aFrame)
+{
+	if (iFifoHistory.SlotsUsed() == kMaxHistoryFrames) {
+		iFifoHistory.Read()->RemoveRef();
+	}
+
+	TUint count = iFifoResend.SlotsUsed();
+
+	for (TUint i = 0; i < count; i++) {
+		OhmMsgAudio* msg = iFifoResend.Read();
+
+		if (aFrame - msg->Frame() >= kMaxHistoryFrames) {
+			iStatsResendDroppedLate++;
+			msg->RemoveRef();
+		}
+		else {
+			iFifoResend.Write(msg);
+		}
+	}
+}
+
+void OhmSenderDriverOutput::SetResendShare(TUint aPercent)
+{
+    AutoMutex mutex(iMutex);
+	iResendShare = aPercent;
+}
+
+void OhmSenderDriverOutput::GetStats(OhmSenderDriverStats& aStats)
+{
+    AutoMutex mutex(iMutex);
+
+	TUint64 us = OsTimeInUs(iEnv.OsCtx()) - iStatsUs;
+
+	aStats.iResendQueued = iFifoResend.SlotsUsed();
+	aStats.iResendQueuedMax = iStatsResendQueuedMax;
+	aStats.iResent = iStatsResent;
+	aStats.iResendDroppedLate = iStatsResendDroppedLate;
+	aStats.iResendDroppedFull = iStatsResendDroppedFull;
+	aStats.iAudioBitRate = (us == 0) ? 0 : (TUint)(iStatsAudioBytes * 8 * 1000000 / us);
+	aStats.iResendBitRate = (us == 0) ? 0 : (TUint)(iStatsResendBytes * 8 * 1000000 / us);
+	aStats.iFrames = iStatsFrames;
+	aStats.iSilentFrames = iStatsSilentFrames;
+	aStats.iSilenceBitRate = (us == 0) ? 0 : (TUint)(iStatsSilenceBytes * 8 * 1000000 / us);
+}
+
+void OhmSenderDriverOutput::ResetStats()
+{
+    AutoMutex mutex(iMutex);
+	ResetStatsLocked();
+}
+
+void OhmSenderDriverOutput::ResetStatsLocked()
+{
+	iStatsUs = OsTimeInUs(iEnv.OsCtx());
+	iStatsAudioBytes = 0;
+	iStatsResendBytes = 0;
+	iStatsResent = 0;
+	iStatsResendDroppedLate = 0;
+	iStatsResendDroppedFull = 0;
+	iStatsResendQueuedMax = iFifoResend.SlotsUsed();
+	iStatsFrames = 0;
+	iStatsSilentFrames = 0;
+	iStatsSilenceBytes = 0;
+}
+
+void OhmSenderDriverOutput::PrintStats()
+{
+	OhmSenderDriverStats stats;
+
+	GetStats(stats);
+
+	iMutex.Wait();
+	TIpAddress adapter = iAdapter;
+	iMutex.Signal();
+
+	printf("egress %d.%d.%d.%d: audio %u bps, resend %u bps, %u resent, queued %u (max %u), %u dropped late, %u dropped queue full, %u of %u frames silent saving %u bps\n",
+		adapter&0xff, (adapter>>8)&0xff, (adapter>>16)&0xff, (adapter>>24)&0xff,
+		stats.iAudioBitRate,
+		stats.iResendBitRate,
+		stats.iResent,
+		stats.iResendQueued,
+		stats.iResendQueuedMax,
+		stats.iResendDroppedLate,
+		stats.iResendDroppedFull,
+		stats.iSilentFrames,
+		stats.iFrames,
+		stats.iSilenceBitRate);
+}
+
+// IOhmSenderDriver
+
+void OhmSenderDriverOutput::SetEnabled(TBool aValue)
 {
     AutoMutex mutex(iMutex);
 
@@ -359,10 +702,13 @@ void OhmSenderDriver::SetEnabled(TBool aValue)
 		if (aValue && iActive) { // turning on
 			iSend = true;
 		}
+		else if (!aValue) { // discard any fast start history
+			ResetLocked();
+		}
 	}
 }
 
-void OhmSenderDriver::SetActive(TBool aValue)
+void OhmSenderDriverOutput::SetActive(TBool aValue)
 {
     AutoMutex mutex(iMutex);
 	
@@ -380,54 +726,82 @@ void OhmSenderDriver::SetActive(TBool aValue)
 	}
 }
 
-void OhmSenderDriver::SetEndpoint(const Endpoint& aEndpoint, TIpAddress aAdapter)
+void OhmSenderDriverOutput::SetEndpoint(const Endpoint& aEndpoint, TIpAddress aAdapter)
 {
     AutoMutex mutex(iMutex);
     iEndpoint.Replace(aEndpoint);
 	iAdapter = aAdapter;
 }
 
-
-void OhmSenderDriver::SetTtl(TUint aValue)
+void OhmSenderDriverOutput::SetTtl(TUint aValue)
 {
     AutoMutex mutex(iMutex);
     iSocket.SetTtl(aValue);
 }
 
-void OhmSenderDriver::SetLatency(TUint aValue)
+void OhmSenderDriverOutput::SetLatency(TUint aValue)
 {
     AutoMutex mutex(iMutex);
     iLatency = aValue;
+	iDriver.iLatency = aValue;
+    iSocket.SetSendBufBytes(OhmSocket::BufBytes(iDriver.iBitRate / 8, iLatency));
 }
 
-void OhmSenderDriver::SetTrackPosition(TUint64 aSamplesTotal, TUint64 aSampleStart)
+void OhmSenderDriverOutput::AddUnicast(const Endpoint& aEndpoint)
 {
     AutoMutex mutex(iMutex);
-    iSamplesTotal = aSamplesTotal;
-    iSampleStart = aSampleStart;
+
+	for (TUint i = 0; i < iUnicastCount; i++) {
+		if (iUnicast[i].Equals(aEndpoint)) {
+			return;
+		}
+	}
+
+	if (iUnicastCount == kMaxUnicastEndpoints) {
+		LOG(kMedia, "OhmSenderDriver::AddUnicast %x:%d refused\n", aEndpoint.Address(), aEndpoint.Port());
+		return;
+	}
+
+	iUnicast[iUnicastCount++].Replace(aEndpoint);
 }
 
-void OhmSenderDriver::Resend(OhmMsgAudio& aMsg)
+void OhmSenderDriverOutput::RemoveUnicast(const Endpoint& aEndpoint)
 {
-	WriterBuffer writer(iBuffer);
+    AutoMutex mutex(iMutex);
+
+	for (TUint i = 0; i < iUnicastCount; i++) {
+		if (iUnicast[i].Equals(aEndpoint)) {
+			iUnicast[i].Replace(iUnicast[--iUnicastCount]);
+			return;
+		}
+	}
+}
+
+void OhmSenderDriverOutput::SetTrackPosition(TUint64 aSamplesTotal, TUint64 aSampleStart)
+{
+    AutoMutex mutex(iMutex);
+    iDriver.iSamplesTotal = aSamplesTotal;
+    iDriver.iSampleStart = aSampleStart;
+}
+
+void OhmSenderDriverOutput::Resend(OhmMsgAudio& aMsg)
+{
+	WriterBuffer writer(iDriver.iBuffer);
 
 	writer.Flush();
 
 	aMsg.Externalise(writer);
 
-	try {
-		iSocket.Send(iBuffer, iEndpoint);
-	}
-	catch (NetworkError&) {
-	}
+	OhmTrace::Record(eOhmTraceResendSent, aMsg.Frame());
 
+	Transmit(iDriver.iBuffer);
 }
 
-void OhmSenderDriver::Resend(const Brx& aFrames)
+void OhmSenderDriverOutput::Resend(const Brx& aFrames)
 {
     AutoMutex mutex(iMutex);
 
-	printf("RESEND");
+	LOG(kMedia, "RESEND");
 
 	ReaderBuffer buffer(aFrames);
 	ReaderBinary reader(buffer);
@@ -438,7 +812,7 @@ void OhmSenderDriver::Resend(const Brx& aFrames)
 
 	frames--;
 
-	printf(" %d", frame);
+	LOG(kMedia, " %d", frame);
 	
 	TBool found = false;
 
@@ -451,7 +825,7 @@ void OhmSenderDriver::Resend(const Brx& aFrames)
 			TInt diff = frame - msg->Frame();
 
 			if (diff == 0) {
-				Resend(*msg);
+				QueueResend(*msg);
 				if (frames-- > 0) {
 					frame = reader.ReadUintBe(4);
 				}
@@ -472,7 +846,7 @@ void OhmSenderDriver::Resend(const Brx& aFrames)
 					diff = frame - msg->Frame();
 
 					if (diff == 0) {
-						Resend(*msg);
+						QueueResend(*msg);
 
 						if (frames-- > 0) {
 							frame = reader.ReadUintBe(4);
@@ -490,20 +864,144 @@ void OhmSenderDriver::Resend(const Brx& aFrames)
 		iFifoHistory.Write(msg);
 	}
 
-	printf("\n");
+	LOG(kMedia, "\n");
+
+	OhmSendBatch batch(iSocket);
+
+	SendResendsLocked(OsTimeInUs(iEnv.OsCtx()));
 }
 
-void OhmSenderDriver::ResetLocked()
+void OhmSenderDriverOutput::QueueResend(OhmMsgAudio& aMsg)
 {
-	iSend = false;
+	if (iFifoResend.SlotsFree() == 0) {
+		iStatsResendDroppedFull++;
+		return;
+	}
 
-	iFrame = 0;
+	aMsg.AddRef();
+
+	iFifoResend.Write(&aMsg);
+
+	if (iFifoResend.SlotsUsed() > iStatsResendQueuedMax) {
+		iStatsResendQueuedMax = iFifoResend.SlotsUsed();
+	}
+}
+
+// Sends queued resends while there are tokens for them. A resend may overdraw the bucket, so one
+// is always sent once the debt for the last is paid off, however big the frames. Those that could
+// no longer be played if they arrived are dropped rather than sent.
+
+void OhmSenderDriverOutput::SendResendsLocked(TUint64 aNowUs)
+{
+	TBool limited = (iResendShare > 0 && iDriver.iBitRate > 0);
+
+	if (limited) {
+		TInt64 rate = (TInt64)iDriver.iBitRate / 8 * iResendShare / 100; // bytes per second
+		TInt64 max = rate * kMaxResendBurstMs * 1000;
+
+		iResendTokens += rate * (TInt64)(aNowUs - iResendTokensUs);
+
+		if (iResendTokens > max) {
+			iResendTokens = max;
+		}
+	}
+
+	iResendTokensUs = aNowUs;
+
+	while (iFifoResend.SlotsUsed() > 0) {
+		if (limited && iResendTokens < 0) {
+			break;
+		}
+
+		OhmMsgAudio* msg = iFifoResend.Read();
+
+		TUint age = iDriver.iFrame - msg->Frame();
+
+		if (age > kMaxHistoryFrames || aNowUs + kMinResendLeadUs > iSentUs[msg->Frame() % kMaxHistoryFrames] + (TUint64)iLatency * 1000) {
+			LOG(kMedia, "RESEND LATE %d\n", msg->Frame());
+			iStatsResendDroppedLate++;
+			msg->RemoveRef();
+			continue;
+		}
+
+		Resend(*msg);
+
+		msg->RemoveRef();
+
+		iStatsResent++;
+		iStatsResendBytes += iDriver.iBuffer.Bytes() * (1 + iUnicastCount);
+
+		if (limited) {
+			iResendTokens -= (TInt64)iDriver.iBuffer.Bytes() * 1000000;
+		}
+	}
+}
+
+// Sends the newest history frames covering the latency, oldest first and ahead of the next live
+// frame, so a joining receiver sees one continuous run of frames. The history frames are already
+// marked as resent; receivers that have them discard them as duplicates.
+
+void OhmSenderDriverOutput::FastStart()
+{
+    AutoMutex mutex(iMutex);
+
+	if (!iDriver.iFastStart || !iSend) {
+		return;
+	}
+
+	OhmMsgAudio* history[kMaxHistoryFrames];
+
+	TUint count = iFifoHistory.SlotsUsed();
+
+	for (TUint i = 0; i < count; i++) {
+		history[i] = iFifoHistory.Read();
+		iFifoHistory.Write(history[i]);
+	}
+
+	TUint64 needed = (TUint64)iLatency * iDriver.iSampleRate / 1000;
+	TUint64 samples = 0;
+	TUint bytes = 0;
+	TUint first = count;
+
+	while (first > 0 && samples < needed) {
+		OhmMsgAudio* msg = history[first - 1];
+		TUint msgBytes = OhmHeader::kHeaderBytes + OhmHeaderAudio::kHeaderBytes + iDriver.iCodecName.Bytes() + (msg->Silence() ? 0 : msg->Audio().Bytes());
+
+		if (bytes + msgBytes > kMaxFastStartBytes) {
+			break;
+		}
+
+		bytes += msgBytes;
+		samples += msg->Samples();
+		first--;
+	}
+
+	LOG(kMedia, "OhmSenderDriver::FastStart %d frames\n", count - first);
+
+	OhmSendBatch batch(iSocket);
+
+	for (TUint i = first; i < count; i++) {
+		Resend(*history[i]);
+	}
+}
+
+void OhmSenderDriverOutput::ResetLocked()
+{
+	iSend = false;
 
 	TUint count = iFifoHistory.SlotsUsed();
 
 	for (TUint i = 0; i < count; i++) {
 		iFifoHistory.Read()->RemoveRef();
 	}
+
+	count = iFifoResend.SlotsUsed();
+
+	for (TUint i = 0; i < count; i++) {
+		iFifoResend.Read()->RemoveRef();
+	}
+
+	iDriver.ResetLocked();
 }
 
 // OhmSender
@@ -519,29 +1017,42 @@ OhmSender::OhmSender(Environment& aEnv, Net::DvDevice& aDevice, IOhmSenderDriver
     , iTtl(aTtl)
 	, iLatency(aLatency)
     , iMulticast(aMulticast)
+    , iHybrid(false)
 	, iEnabled(false)
     , iSocketOhm(aEnv)
     , iSocketOhz(aEnv)
+    , iSocketOhu(aEnv)
     , iRxBuffer(iSocketOhm)
+    , iRxHybrid(iSocketOhu)
 	, iRxZone(iSocketOhz)
     , iMutexStartStop("OHMS")
     , iMutexActive("OHMA")
     , iMutexZone("OHMZ")
     , iNetworkDeactivated("OHDN", 0)
     , iZoneDeactivated("OHDZ", 0)
+    , iHybridDeactivated("OHDH", 0)
     , iStarted(false)
 	, iZoneStarted(false)
+    , iHybridStarted(false)
     , iActive(false)
     , iAliveJoined(false)
     , iAliveBlocked(false)
+	, iSwitching(false)
+	, iSwitchInterface(0)
+    , iHybridCount(0)
     , iTimerAliveJoin(aEnv, MakeFunctor(*this, &OhmSender::TimerAliveJoinExpired), "OhmSenderAliveJoin")
     , iTimerAliveAudio(aEnv, MakeFunctor(*this, &OhmSender::TimerAliveAudioExpired), "OhmSenderAliveAudio")
     , iTimerExpiry(aEnv, MakeFunctor(*this, &OhmSender::TimerExpiryExpired), "OhmSenderExpiry")
     , iTimerZoneUri(aEnv, MakeFunctor(*this, &OhmSender::TimerZoneUriExpired), "OhmSenderZoneUri")
     , iTimerPresetInfo(aEnv, MakeFunctor(*this, &OhmSender::TimerPresetInfoExpired), "OhmSenderPresetInfo")
+    , iTimerHybridExpiry(aEnv, MakeFunctor(*this, &OhmSender::TimerHybridExpiryExpired), "OhmSenderHybridExpiry")
     , iSequenceTrack(0)
     , iSequenceMetatext(0)
 	, iClientControllingTrackMetadata(false)
+	, iSendZoneUriCount(0)
+	, iSendPresetInfoCount(0)
+	, iZoneUriAnswer(false)
+	, iPresetInfoAnswer(false)
     , iPreset(aPreset)
 {
     iProvider = new ProviderSender(aEnv, iDevice);
@@ -553,6 +1064,8 @@ OhmSender::OhmSender(Environment& aEnv, Net::DvDevice& aDevice, IOhmSenderDriver
 	iDriver.SetLatency(iLatency);
 
 	LOG(kMedia, "OHM SENDER DRIVER LATENCY %d\n", iLatency);
+
+	OhmRealtime::Prefault(this, sizeof(OhmSender)); // the transmit and receive buffers
        
     iThreadMulticast = new ThreadFunctor("MTXM", MakeFunctor(*this, &OhmSender::RunMulticast), kThreadPriorityNetwork, kThreadStackBytesNetwork);
     iThreadMulticast->Start();
@@ -563,6 +1076,9 @@ OhmSender::OhmSender(Environment& aEnv, Net::DvDevice& aDevice, IOhmSenderDriver
     iThreadZone = new ThreadFunctor("MTXZ", MakeFunctor(*this, &OhmSender::RunZone), kThreadPriorityNetwork, kThreadStackBytesNetwork);
     iThreadZone->Start();    
 
+    iThreadHybrid = new ThreadFunctor("MTXH", MakeFunctor(*this, &OhmSender::RunHybrid), kThreadPriorityNetwork, kThreadStackBytesNetwork);
+    iThreadHybrid->Start();
+
     iServer = new OhmSenderServer(aEnv, aInterface, aImage, aMimeType);
 
     // scope for AutoMutex
@@ -588,6 +1104,11 @@ const Brx& OhmSender::SenderMetadata() const
 	return (iSenderMetadata);
 }
 
+const Brx& OhmSender::HybridUri() const
+{
+	return (iHybridUri);
+}
+
 
 void OhmSender::SetName(const Brx& aValue)
 {
@@ -605,7 +1126,13 @@ void OhmSender::SetChannel(TUint aValue)
 
 	if (iChannel != aValue) {
 		if (iMulticast) {
-			if (iEnabled) {
+			if (iStarted) {
+				iChannel = aValue;
+				UpdateChannel();
+				Switch(iOhmInterface);
+				UpdateUri();
+			}
+			else if (iEnabled) {
 				Stop();
 				iChannel = aValue;
 				UpdateChannel();
@@ -643,7 +1170,14 @@ void OhmSender::SetInterface(TIpAddress aValue)
 	}
 
 	if (iOhmInterface != aValue) {
-		if (iEnabled) {
+		if (iStarted && iMulticast && aValue != 0) {
+			Switch(aValue);
+			StopHybrid();
+			if (iHybrid) {
+				StartHybrid(aValue);
+			}
+		}
+		else if (iEnabled) {
 			Stop();
 			Start(aValue);
 		}
@@ -660,17 +1194,13 @@ void OhmSender::SetTtl(TUint aValue)
     AutoMutex mutex(iMutexStartStop);
     
 	if (iTtl != aValue) {
-		if (iEnabled) {
-			Stop();
-			iTtl = aValue;
-			iDriver.SetTtl(iTtl);
-			LOG(kMedia, "OHM SENDER DRIVER TTL %d\n", iTtl);
-			Start(iOhmInterface);
-		}
-		else {
-			iTtl = aValue;
-			iDriver.SetTtl(iTtl);
-			LOG(kMedia, "OHM SENDER DRIVER TTL %d\n", iTtl);
+		iTtl = aValue;
+		iDriver.SetTtl(iTtl);
+		LOG(kMedia, "OHM SENDER DRIVER TTL %d\n", iTtl);
+
+		if (iStarted) {
+			AutoMutex mutex(iMutexActive);
+			iSocketOhm.SetTtl(iTtl);
 		}
 	}
 }
@@ -679,19 +1209,12 @@ void OhmSender::SetLatency(TUint aValue)
 {
     AutoMutex mutex(iMutexStartStop);
     
+	// the next audio frame carries the new latency
+
 	if (iLatency != aValue) {
-		if (iEnabled) {
-			Stop();
-			iLatency = aValue;
-			iDriver.SetLatency(iLatency);
-			LOG(kMedia, "OHM SENDER DRIVER LATENCY %d\n", iLatency);
-			Start(iOhmInterface);
-		}
-		else {
-			iLatency = aValue;
-			iDriver.SetLatency(iLatency);
-			LOG(kMedia, "OHM SENDER DRIVER LATENCY %d\n", iLatency);
-		}
+		iLatency = aValue;
+		iDriver.SetLatency(iLatency);
+		LOG(kMedia, "OHM SENDER DRIVER LATENCY %d\n", iLatency);
 	}
 }
 
@@ -713,6 +1236,24 @@ void OhmSender::SetMulticast(TBool aValue)
 	}
 }
 
+void OhmSender::SetHybrid(TBool aValue)
+{
+    AutoMutex mutex(iMutexStartStop);
+
+	if (iHybrid != aValue) {
+		iHybrid = aValue;
+
+		if (iStarted && iMulticast) {
+			if (iHybrid) {
+				StartHybrid(iOhmInterface);
+			}
+			else {
+				StopHybrid();
+			}
+		}
+	}
+}
+
 void OhmSender::SetEnabled(TBool aValue)
 {
     AutoMutex mutex(iMutexStartStop);
@@ -742,11 +1283,20 @@ void OhmSender::Start(TIpAddress aValue)
     if (!iStarted) {
         if (aValue != 0)
         {
+            {
+                AutoMutex mutex(iMutexActive);
+                iResendFilter.Reset();
+            }
+
             if (iMulticast) {
                 iSocketOhm.OpenMulticast(aValue, iTtl, iMulticastEndpoint);
                 iTargetEndpoint.Replace(iMulticastEndpoint);
                 iTargetInterface = aValue;
                 iThreadMulticast->Signal();
+
+                if (iHybrid) {
+                    StartHybrid(aValue);
+                }
             }
             else {
                 iSocketOhm.OpenUnicast(aValue, iTtl);
@@ -767,6 +1317,14 @@ void OhmSender::Start(TIpAddress aValue)
 void OhmSender::Stop()
 {
     if (iStarted) {
+        // scope for AutoMutex
+        {
+        AutoMutex mutex(iMutexActive);
+        iSwitching = false;
+        }
+
+        StopHybrid();
+
         iSocketOhm.ReadInterrupt();
         iNetworkDeactivated.Wait();
         iSocketOhm.Close();
@@ -775,6 +1333,46 @@ void OhmSender::Stop()
     }
 }
 
+// Switch always called with the start/stop mutex locked, while started in multicast mode
+
+// The sockets for the new channel or interface are opened before the old ones close. The multicast
+// thread is interrupted to swap them and carries on, so audio is sent throughout and receivers
+// already joined stay joined until they follow the new uri.
+
+void OhmSender::Switch(TIpAddress aValue)
+{
+    AutoMutex mutex(iMutexActive);
+
+    iSocketOhm.PrepareMulticast(aValue, iMulticastEndpoint);
+
+    iSwitchEndpoint.Replace(iMulticastEndpoint);
+    iSwitchInterface = aValue;
+    iSwitching = true;
+
+    iSocketOhm.ReadInterrupt();
+}
+
+TBool OhmSender::Switched()
+{
+    AutoMutex mutex(iMutexActive);
+
+    if (!iSwitching) {
+        return (false);
+    }
+
+    iSocketOhm.Switch();
+
+    iTargetEndpoint.Replace(iSwitchEndpoint);
+    iTargetInterface = iSwitchInterface;
+    iSwitching = false;
+
+    iDriver.SetEndpoint(iTargetEndpoint, iTargetInterface);
+
+    LOG(kMedia, "OHM SENDER DRIVER ENDPOINT %x:%d\n", iTargetEndpoint.Address(), iTargetEndpoint.Port());
+
+    return (true);
+}
+
 void OhmSender::StopZone()
 {
 	if (iZoneStarted)
@@ -802,6 +1400,35 @@ void OhmSender::StartZone(TIpAddress aValue)
     }
 }
 
+// StartHybrid and StopHybrid always called with the start/stop mutex locked
+
+// While hybrid, receivers that cannot hear the multicast group join by unicast at the hybrid uri.
+// The driver sends each frame to the group and to each of them, and resends to all from the one
+// history.
+
+void OhmSender::StartHybrid(TIpAddress aValue)
+{
+    if (!iHybridStarted && aValue != 0) {
+        iSocketOhu.OpenUnicast(aValue, iTtl);
+        iHybridUri.Replace("ohu://");
+        iSocketOhu.This().AppendEndpoint(iHybridUri);
+        iThreadHybrid->Signal();
+        iHybridStarted = true;
+    }
+}
+
+void OhmSender::StopHybrid()
+{
+    if (iHybridStarted) {
+        iSocketOhu.ReadInterrupt();
+        iHybridDeactivated.Wait();
+        iTimerHybridExpiry.Cancel();
+        iSocketOhu.Close();
+        iHybridUri.Replace(Brx::Empty());
+        iHybridStarted = false;
+    }
+}
+
 void OhmSender::SetTrack(const Brx& aUri, const Brx& aMetadata, TUint64 aSamplesTotal, TUint64 aSampleStart)
 {
     AutoMutex mutex(iMutexActive);
@@ -864,6 +1491,10 @@ OhmSender::~OhmSender()
 
     LOG(kMedia, "OhmSender::~OhmSender deleted tcp server\n");
 
+	delete iThreadHybrid;
+
+    LOG(kMedia, "OhmSender::~OhmSender deleted hybrid thread\n");
+
 	delete iThreadUnicast;
 
     LOG(kMedia, "OhmSender::~OhmSender deleted unicast thread\n");
@@ -889,6 +1520,8 @@ OhmSender::~OhmSender()
 
 void OhmSender::RunMulticast()
 {
+	OhmRealtime::Apply(eOhmThreadRepair);
+
     for (;;) {
         LOG(kMedia, "OhmSender::RunMulticast wait\n");
         
@@ -900,92 +1533,95 @@ void OhmSender::RunMulticast()
 
 		LOG(kMedia, "OHM SENDER DRIVER ENDPOINT %x:%d\n", iTargetEndpoint.Address(), iTargetEndpoint.Port());
 
-        try {
-            for (;;) {
-                try {
-                    OhmHeader header;
-                    header.Internalise(iRxBuffer);
+        do {
+            try {
+                for (;;) {
+                    try {
+                        OhmHeader header;
+                        header.Internalise(iRxBuffer);
                     
-                    if (header.MsgType() <= OhmHeader::kMsgTypeListen) {
-                        LOG(kMedia, "OhmSender::RunMulticast join/listen received\n");
+                        if (header.MsgType() <= OhmHeader::kMsgTypeListen) {
+                            LOG(kMedia, "OhmSender::RunMulticast join/listen received\n");
                         
-                        AutoMutex mutex(iMutexActive);
+                            AutoMutex mutex(iMutexActive);
                         
-                        if (header.MsgType() == OhmHeader::kMsgTypeJoin) {
-                            SendTrack();
-                            SendMetatext();
-                        }
+                            TBool fastStart = false;
+
+                            if (header.MsgType() == OhmHeader::kMsgTypeJoin) {
+                                OhmHeaderJoin headerJoin;
+                                headerJoin.Internalise(iRxBuffer, header);
+                                fastStart = headerJoin.FastStart();
+                                SendTrack();
+                                SendMetatext();
+                            }
                         
-						if (!iActive) {
-							iActive = true;
-	                        iDriver.SetActive(true);
-							LOG(kMedia, "OHM SENDER DRIVER ACTIVE %d\n", iActive);
-						}
+    						if (!iActive) {
+    							iActive = true;
+    	                        iDriver.SetActive(true);
+    							LOG(kMedia, "OHM SENDER DRIVER ACTIVE %d\n", iActive);
+    						}
+
+    						if (fastStart) {
+    							iDriver.FastStart();
+    						}
                         
-						iAliveJoined = true;
-
-                        iTimerAliveJoin.FireIn(kTimerAliveJoinTimeoutMs);
-                    }
-					else if (header.MsgType() == OhmHeader::kMsgTypeResend) {
-                        LOG(kMedia, "OhmSender::RunMulticast resend received\n");
-
-						OhmHeaderResend headerResend;
-						headerResend.Internalise(iRxBuffer, header);
-
-						TUint frames = headerResend.FramesCount();
-
-						if (frames > 0) {
-							iDriver.Resend(iRxBuffer.Read(frames * 4));
-						}
-					}
-					else if (header.MsgType() == OhmHeader::kMsgTypeAudio) {
-						// Check sender not us
-
-						Endpoint sender = iSocketOhm.Sender();
+    						iAliveJoined = true;
 
-						if (sender.Address() != iOhmInterface) {
-	                        LOG(kMedia, "OhmSender::RunMulticast audio received\n");
-
-							// The following randomisation prevents two senders from both sending,
-							// both seeing each other's audio, both backing off for the same amount of time,
-							// then both sending again, then both seeing each other's audio again,
-							// then both backing off for the same amount of time ...
+                            iTimerAliveJoin.FireIn(kTimerAliveJoinTimeoutMs);
+                        }
+    					else if (header.MsgType() == OhmHeader::kMsgTypeResend || header.MsgType() == OhmHeader::kMsgTypeResendRange) {
+                            LOG(kMedia, "OhmSender::RunMulticast resend received\n");
+    						Resend(header, iRxBuffer);
+    					}
+    					else if (header.MsgType() == OhmHeader::kMsgTypeAudio) {
+    						// Check sender not us
+
+    						Endpoint sender = iSocketOhm.Sender();
+
+    						if (sender.Address() != iOhmInterface) {
+    	                        LOG(kMedia, "OhmSender::RunMulticast audio received\n");
+
+    							// The following randomisation prevents two senders from both sending,
+    							// both seeing each other's audio, both backing off for the same amount of time,
+    							// then both sending again, then both seeing each other's audio again,
+    							// then both backing off for the same amount of time ...
                         
-							TUint delay = iEnv.Random(kTimerAliveAudioTimeoutMs, kTimerAliveAudioTimeoutMs >> 1);
+    							TUint delay = iEnv.Random(kTimerAliveAudioTimeoutMs, kTimerAliveAudioTimeoutMs >> 1);
 
-                            // scope for AutoMutex
-                            {
-                            AutoMutex mutex(iMutexActive);
+                                // scope for AutoMutex
+                                {
+                                AutoMutex mutex(iMutexActive);
                         
-							if (iActive) {
-								iActive = false;
-								iDriver.SetActive(false);
-								LOG(kMedia, "OHM SENDER DRIVER ACTIVE %d\n", iActive);
-							} 
+    							if (iActive) {
+    								iActive = false;
+    								iDriver.SetActive(false);
+    								LOG(kMedia, "OHM SENDER DRIVER ACTIVE %d\n", iActive);
+    							} 
 
-							iAliveBlocked = true;
+    							iAliveBlocked = true;
 
-							iTimerAliveAudio.FireIn(delay);
-                            }
+    							iTimerAliveAudio.FireIn(delay);
+                                }
 
-							LOG(kMedia, "OhmSender::RunMulticast blocked\n");
+    							LOG(kMedia, "OhmSender::RunMulticast blocked\n");
 
-							iProvider->SetStatusBlocked();
-						}
+    							iProvider->SetStatusBlocked();
+    						}
+                        }
+                    }
+                    catch (OhmError&)
+                    {
                     }
-                }
-                catch (OhmError&)
-                {
-                }
                 
-                iRxBuffer.ReadFlush();
+                    iRxBuffer.ReadFlush();
+                }
+            }
+            catch (ReaderError&) {
+                LOG(kMedia, "OhmSender::RunMulticast reader error\n");
             }
-        }
-        catch (ReaderError&) {
-            LOG(kMedia, "OhmSender::RunMulticast reader error\n");
-        }
 
-        iRxBuffer.ReadFlush();
+            iRxBuffer.ReadFlush();
+        } while (Switched());
 
         iTimerAliveJoin.Cancel();
         iTimerAliveAudio.Cancel();
@@ -1012,6 +1648,8 @@ void OhmSender::RunMulticast()
 
 void OhmSender::RunUnicast()
 {
+	OhmRealtime::Apply(eOhmThreadRepair);
+
     for (;;) {
         LOG(kMedia, "OhmSender::RunUnicast wait\n");
         
@@ -1065,6 +1703,10 @@ void OhmSender::RunUnicast()
                 iDriver.SetActive(true);
 
 				LOG(kMedia, "OHM SENDER DRIVER ACTIVE %d\n", true);
+
+				// a unicast join is always the receiver's first, so always gets a fast start (if offered)
+
+				iDriver.FastStart();
                 }
                 
                 iTimerExpiry.FireIn(kTimerExpiryTimeoutMs);
@@ -1180,17 +1822,9 @@ void OhmSender::RunUnicast()
                                 }
                             }
                         }
-						else if (header.MsgType() == OhmHeader::kMsgTypeResend) {
-							LOG(kMedia, "OhmSender::RunMulticast resend received\n");
-
-							OhmHeaderResend headerResend;
-							headerResend.Internalise(iRxBuffer, header);
-
-							TUint frames = headerResend.FramesCount();
-
-							if (frames > 0) {
-								iDriver.Resend(iRxBuffer.Read(frames * 4));
-							}
+						else if (header.MsgType() == OhmHeader::kMsgTypeResend || header.MsgType() == OhmHeader::kMsgTypeResendRange) {
+							LOG(kMedia, "OhmSender::RunUnicast resend received\n");
+							Resend(header, iRxBuffer);
 						}
                     }
                     catch (OhmError&)
@@ -1242,6 +1876,112 @@ void OhmSender::RunUnicast()
     }
 }
 
+void OhmSender::RunHybrid()
+{
+	OhmRealtime::Apply(eOhmThreadRepair);
+
+    for (;;) {
+        LOG(kMedia, "OhmSender::RunHybrid wait\n");
+
+        iThreadHybrid->Wait();
+
+        LOG(kMedia, "OhmSender::RunHybrid go\n");
+
+        try {
+            for (;;) {
+                try {
+                    OhmHeader header;
+                    header.Internalise(iRxHybrid);
+
+                    if (header.MsgType() <= OhmHeader::kMsgTypeListen) {
+                        Endpoint sender(iSocketOhu.Sender());
+
+                        AutoMutex mutex(iMutexActive);
+
+                        CheckHybridExpiry();
+
+                        TUint index = FindHybrid(sender);
+
+                        if (index == iHybridCount) {
+                            if (index == kMaxHybridCount) {
+                                LOG(kMedia, "OhmSender::RunHybrid full, %x:%d refused\n", sender.Address(), sender.Port());
+                                iRxHybrid.ReadFlush();
+                                continue;
+                            }
+
+                            LOG(kMedia, "OhmSender::RunHybrid %x:%d joined\n", sender.Address(), sender.Port());
+
+                            iHybridList[index].Replace(sender);
+                            iHybridCount++;
+                            iDriver.AddUnicast(sender);
+                        }
+
+                        if (header.MsgType() == OhmHeader::kMsgTypeJoin) {
+                            SendTrack();
+                            SendMetatext();
+                        }
+
+                        iHybridExpiry[index] = Time::Now(iEnv) + kTimerExpiryTimeoutMs;
+
+                        iTimerHybridExpiry.FireIn(kTimerExpiryTimeoutMs);
+
+                        if (!iActive) {
+                            iActive = true;
+                            iDriver.SetActive(true);
+                            LOG(kMedia, "OHM SENDER DRIVER ACTIVE %d\n", iActive);
+                        }
+
+                        iAliveJoined = true;
+
+                        iTimerAliveJoin.FireIn(kTimerAliveJoinTimeoutMs);
+                    }
+                    else if (header.MsgType() == OhmHeader::kMsgTypeLeave) {
+                        Endpoint sender(iSocketOhu.Sender());
+
+                        AutoMutex mutex(iMutexActive);
+
+                        TUint index = FindHybrid(sender);
+
+                        if (index < iHybridCount) {
+                            LOG(kMedia, "OhmSender::RunHybrid %x:%d left\n", sender.Address(), sender.Port());
+                            RemoveHybrid(index);
+                            SendLeave(sender);
+                        }
+                    }
+                    else if (header.MsgType() == OhmHeader::kMsgTypeResend || header.MsgType() == OhmHeader::kMsgTypeResendRange) {
+                        LOG(kMedia, "OhmSender::RunHybrid resend received\n");
+                        Resend(header, iRxHybrid);
+                    }
+                }
+                catch (OhmError&)
+                {
+                }
+
+                iRxHybrid.ReadFlush();
+            }
+        }
+        catch (ReaderError&) {
+            LOG(kMedia, "OhmSender::RunHybrid reader error\n");
+        }
+
+        iRxHybrid.ReadFlush();
+
+        // scope for AutoMutex
+        {
+        AutoMutex mutex(iMutexActive);
+
+        while (iHybridCount > 0) {
+            SendLeave(iHybridList[iHybridCount - 1]);
+            RemoveHybrid(iHybridCount - 1);
+        }
+        }
+
+        iHybridDeactivated.Signal();
+
+        LOG(kMedia, "OhmSender::RunHybrid stop\n");
+    }
+}
+
 void OhmSender::TimerAliveJoinExpired()
 {
     AutoMutex mutex(iMutexActive);
@@ -1284,6 +2024,17 @@ void OhmSender::TimerExpiryExpired()
     }
 }
 
+void OhmSender::TimerHybridExpiryExpired()
+{
+    AutoMutex mutex(iMutexActive);
+
+    CheckHybridExpiry();
+
+    if (iHybridCount > 0) {
+        iTimerHybridExpiry.FireIn(kTimerExpiryTimeoutMs);
+    }
+}
+
 void OhmSender::UpdateChannel()
 {
     TUint address = (iChannel & 0xffff) | 0xeffd0000; // 239.253.x.x
@@ -1365,6 +2116,14 @@ void OhmSender::Send()
     }
     catch (NetworkError&) {
     }
+
+    for (TUint i = 0; i < iHybridCount; i++) {
+        try {
+            iSocketOhm.Send(iTxBuffer, iHybridList[i]);
+        }
+        catch (NetworkError&) {
+        }
+    }
 }
 
 // SendTrack called with alive mutex locked;
@@ -1465,6 +2224,69 @@ void OhmSender::SendLeave(const Endpoint& aEndpoint)
     }
 }
 
+// A resend request, either a list of frames or a bitmap of a range of frames, is passed to the
+// driver as a list of frames, less those resent within the last few ms for another receiver
+
+void OhmSender::Resend(const OhmHeader& aHeader, Srs<kMaxAudioFrameBytes>& aBuffer)
+{
+    AutoMutex mutex(iMutexActive); // requests arrive on the multicast and hybrid threads
+
+    WriterBuffer writer(iResendFrames);
+    WriterBinary writerBinary(writer);
+
+    writer.Flush();
+
+    TUint64 now = OsTimeInUs(iEnv.OsCtx());
+    TUint requested = 0;
+
+    if (aHeader.MsgType() == OhmHeader::kMsgTypeResend) {
+        OhmHeaderResend headerResend;
+        headerResend.Internalise(aBuffer, aHeader);
+
+        TUint frames = headerResend.FramesCount();
+
+        if (frames > kMaxResendFrames) {
+            THROW(OhmError);
+        }
+
+        ReaderBuffer buffer(aBuffer.Read(frames * 4));
+        ReaderBinary reader(buffer);
+
+        for (TUint i = 0; i < frames; i++) {
+            TUint frame = reader.ReadUintBe(4);
+
+            if (iResendFilter.Pass(frame, now)) {
+                writerBinary.WriteUint32Be(frame);
+            }
+        }
+
+        requested = frames;
+    }
+    else {
+        OhmHeaderResendRange headerResendRange;
+        headerResendRange.Internalise(aBuffer, aHeader);
+
+        TUint first = headerResendRange.First();
+        Brn bitmap(aBuffer.Read(headerResendRange.BitmapBytes()));
+
+        for (TUint i = 0; i < headerResendRange.FramesCount(); i++) {
+            if (bitmap[i >> 3] & (1 << (i & 7))) {
+                requested++;
+
+                if (iResendFilter.Pass(first + i, now)) {
+                    writerBinary.WriteUint32Be(first + i);
+                }
+            }
+        }
+    }
+
+    LOG(kMedia, "OhmSender::Resend %d of %d frames\n", iResendFrames.Bytes() / 4, requested);
+
+    if (iResendFrames.Bytes() > 0) {
+        iDriver.Resend(iResendFrames);
+    }
+}
+
 TBool OhmSender::CheckSlaveExpiry()
 {
     TBool changed = false;
@@ -1504,10 +2326,50 @@ TUint OhmSender::FindSlave(const Endpoint& aEndpoint)
     return (iSlaveCount);
 }
 
+// Hybrid receivers are held with the active mutex locked
+
+void OhmSender::CheckHybridExpiry()
+{
+    for (TUint i = 0; i < iHybridCount;) {
+        if (Time::IsInPastOrNow(iEnv, iHybridExpiry[i])) {
+            LOG(kMedia, "OhmSender::CheckHybridExpiry %x:%d expired\n", iHybridList[i].Address(), iHybridList[i].Port());
+            RemoveHybrid(i);
+            continue;
+        }
+        i++;
+    }
+}
+
+void OhmSender::RemoveHybrid(TUint aIndex)
+{
+    iDriver.RemoveUnicast(iHybridList[aIndex]);
+
+    iHybridCount--;
+    for (TUint i = aIndex; i < iHybridCount; i++) {
+        iHybridList[i].Replace(iHybridList[i + 1]);
+        iHybridExpiry[i] = iHybridExpiry[i + 1];
+    }
+}
+
+// Returns index of supplied endpoint, or iHybridCount if not found
+
+TUint OhmSender::FindHybrid(const Endpoint& aEndpoint)
+{
+    for (TUint i = 0; i < iHybridCount; i++) {
+        if (aEndpoint.Equals(iHybridList[i])) {
+            return (i);
+        }
+    }
+    
+    return (iHybridCount);
+}
+
 // Zone handling
 
 void OhmSender::RunZone()
 {
+	OhmRealtime::Apply(eOhmThreadZone);
+
     for (;;) {
         LOG(kMedia, "OhmSender::RunZone wait\n");
         
@@ -1541,7 +2403,7 @@ void OhmSender::RunZone()
 					if (zone == iDevice.Udn())
 					{
 	                    AutoMutex mutex(iMutexZone);
-						SendZoneUri(1);
+						AnswerZoneQuery();
 					}
 				}
 				else if (header.MsgType() == OhzHeader::kMsgTypePresetQuery) {
@@ -1553,7 +2415,40 @@ void OhmSender::RunZone()
 					if (preset > 0) {
 	                    AutoMutex mutex(iMutexZone);
 						if (preset == iPreset) {
-							SendPresetInfo(1);
+							AnswerPresetQuery();
+						}
+					}
+				}
+				else if (header.MsgType() == OhzHeader::kMsgTypeZoneUri) {
+					OhzHeaderZoneUri headerZoneUri;
+					headerZoneUri.Internalise(iRxZone, header);
+
+					if (headerZoneUri.ZoneBytes() == iDevice.Udn().Bytes() && headerZoneUri.UriBytes() <= Ohm::kMaxUriBytes && !iSocketOhz.SenderIsThis())
+					{
+						Brn zone = iRxZone.Read(headerZoneUri.ZoneBytes());
+						Brn uri = iRxZone.Read(headerZoneUri.UriBytes());
+
+	                    AutoMutex mutex(iMutexZone);
+						if (iZoneUriAnswer && zone == iDevice.Udn() && uri == iUri) {
+							LOG(kMedia, "OhmSender::RunZone zone query already answered\n");
+							iZoneUriAnswer = false;
+							iSendZoneUriCount = 0;
+						}
+					}
+				}
+				else if (header.MsgType() == OhzHeader::kMsgTypePresetInfo) {
+					OhzHeaderPresetInfo headerPresetInfo;
+					headerPresetInfo.Internalise(iRxZone, header);
+
+					if (headerPresetInfo.MetadataBytes() <= kMaxMetadataBytes && !iSocketOhz.SenderIsThis())
+					{
+						Brn metadata = iRxZone.Read(headerPresetInfo.MetadataBytes());
+
+	                    AutoMutex mutex(iMutexZone);
+						if (iPresetInfoAnswer && headerPresetInfo.Preset() == iPreset && metadata == iSenderMetadata) {
+							LOG(kMedia, "OhmSender::RunZone preset query already answered\n");
+							iPresetInfoAnswer = false;
+							iSendPresetInfoCount = 0;
 						}
 					}
 				}
@@ -1579,13 +2474,33 @@ void OhmSender::RunZone()
 void OhmSender::SendZoneUri(TUint aCount)
 {
     iSendZoneUriCount = aCount;
+    iZoneUriAnswer = false;
 	iTimerZoneUri.FireIn(0);
 }
 
+// Queries arriving while a ZoneUri is waiting to go out are answered by it: every receiver
+// listening on the zone group hears the one answer. If a directory (see ZoneWatcher) answers
+// for us in the meantime, RunZone withdraws ours.
+
+void OhmSender::AnswerZoneQuery()
+{
+    if (iSendZoneUriCount > 0) {
+        return;
+    }
+
+    iSendZoneUriCount = 1;
+    iZoneUriAnswer = true;
+	iTimerZoneUri.FireIn(kTimerZoneUriAggregateMs);
+}
+
 void OhmSender::SendZoneUri()
 {
 	ASSERT(iSendZoneUriCount <= 3);
 
+    if (iSendZoneUriCount == 0) {
+        return; // withdrawn
+    }
+
     try
     {
         OhzHeaderZoneUri headerZoneUri(iDevice.Udn(), iUri);
@@ -1623,15 +2538,25 @@ void OhmSender::SendZoneUri()
     }
 }
 
-void OhmSender::SendPresetInfo(TUint aCount)
+// as AnswerZoneQuery
+
+void OhmSender::AnswerPresetQuery()
 {
-	iSendPresetInfoCount = aCount;
+    if (iSendPresetInfoCount > 0) {
+        return;
+    }
 
-    SendPresetInfo();
+    iSendPresetInfoCount = 1;
+    iPresetInfoAnswer = true;
+	iTimerPresetInfo.FireIn(kTimerZoneUriAggregateMs);
 }
 
 void OhmSender::SendPresetInfo()
 {
+    if (iSendPresetInfoCount == 0) {
+        return; // withdrawn
+    }
+
     try
     {
     	OhzHeaderPresetInfo headerPresetInfo(iPreset, iSenderMetadata);
@@ -1679,46 +2604,41 @@ void OhmSender::TimerPresetInfoExpired()
 
 OhmSenderSession::OhmSenderSession(Environment& aEnv, const IOhmSenderSessionData& aData)
 	: iData(aData)
+    , iReadBuffer(*this)
+    , iReaderUntil(iReadBuffer)
+    , iReaderRequest(aEnv, iReaderUntil)
+    , iWriterBuffer(*this)
+    , iWriterResponse(iWriterBuffer)
     , iSemaphore("OHMS", 1)
 {
-    iReadBuffer = new Srs<1024>(*this);
-    iReaderUntil = new ReaderUntilS<kMaxRequestBytes>(*iReadBuffer);
-    iReaderRequest = new ReaderHttpRequest(aEnv, *iReaderUntil);
-    iWriterBuffer = new Sws<kMaxResponseBytes>(*this);
-    iWriterResponse = new WriterHttpResponse(*iWriterBuffer);
-    iReaderRequest->AddMethod(Http::kMethodGet);
-    iReaderRequest->AddMethod(Http::kMethodHead);
-    iReaderRequest->AddHeader(iHeaderHost);
+    iReaderRequest.AddMethod(Http::kMethodGet);
+    iReaderRequest.AddMethod(Http::kMethodHead);
+    iReaderRequest.AddHeader(iHeaderHost);
 }
 
 OhmSenderSession::~OhmSenderSession()
 {
     Interrupt(true);
     iSemaphore.Wait();
-    delete iWriterResponse;
-    delete iWriterBuffer;
-    delete iReaderRequest;
-    delete iReaderUntil;
-    delete iReadBuffer;
 }
 
 void OhmSenderSession::Run()
 {
     iSemaphore.Wait();
     iErrorStatus = &HttpStatus::kOk;
-    iReaderRequest->Flush();
+    iReaderRequest.Flush();
     
 	try {
         try {
-            iReaderRequest->Read();
+            iReaderRequest.Read();
         }
         catch (HttpError&) {
             Error(HttpStatus::kBadRequest);
         }
-        if (iReaderRequest->MethodNotAllowed()) {
+        if (iReaderRequest.MethodNotAllowed()) {
             Error(HttpStatus::kMethodNotAllowed);
         }
-        const Brx& method = iReaderRequest->Method();
+        const Brx& method = iReaderRequest.Method();
         iResponseStarted = false;
         iResponseEnded = false;
         if (method == Http::kMethodGet) {
@@ -1742,12 +2662,12 @@ void OhmSenderSession::Run()
             if (iErrorStatus == &HttpStatus::kOk) {
                 iErrorStatus = &HttpStatus::kNotFound;
             }
-            iWriterResponse->WriteStatus(*iErrorStatus, Http::eHttp11);
-            Http::WriteHeaderConnectionClose(*iWriterResponse);
-            iWriterResponse->WriteFlush();
+            iWriterResponse.WriteStatus(*iErrorStatus, Http::eHttp11);
+            Http::WriteHeaderConnectionClose(iWriterResponse);
+            iWriterResponse.WriteFlush();
         }
         else if (!iResponseEnded) {
-            iWriterResponse->WriteFlush();
+            iWriterResponse.WriteFlush();
         }
     }
     catch (WriterError&) {
@@ -1764,36 +2684,36 @@ void OhmSenderSession::Error(const HttpStatus& aStatus)
 
 void OhmSenderSession::Get(TBool aWriteEntity)
 {
-    if (iReaderRequest->Version() == Http::eHttp11) {
+    if (iReaderRequest.Version() == Http::eHttp11) {
         if (!iHeaderHost.Received()) {
             Error(HttpStatus::kBadRequest);
         }
     }
 
 	if (iHeaderExpect.Continue()) {
-        iWriterResponse->WriteStatus(HttpStatus::kContinue, Http::eHttp11);
-        iWriterResponse->WriteFlush();
+        iWriterResponse.WriteStatus(HttpStatus::kContinue, Http::eHttp11);
+        iWriterResponse.WriteFlush();
     }
 
-    iWriterResponse->WriteStatus(HttpStatus::kOk, Http::eHttp11);
+    iWriterResponse.WriteStatus(HttpStatus::kOk, Http::eHttp11);
 
-    Http::WriteHeaderContentLength(*iWriterResponse, iData.Image().Bytes());
+    Http::WriteHeaderContentLength(iWriterResponse, iData.Image().Bytes());
 
-	IWriterAscii& writer = iWriterResponse->WriteHeaderField(Http::kHeaderContentType);
+	IWriterAscii& writer = iWriterResponse.WriteHeaderField(Http::kHeaderContentType);
 	writer.Write(iData.MimeType());
 	writer.Write(Brn("; charset=\"utf-8\""));
 	writer.WriteFlush();
 
-	Http::WriteHeaderConnectionClose(*iWriterResponse);
+	Http::WriteHeaderConnectionClose(iWriterResponse);
 
-    iWriterResponse->WriteFlush();
+    iWriterResponse.WriteFlush();
 
     iResponseStarted = true;
 
 	if (aWriteEntity) {
-		iWriterBuffer->Write(iData.Image());
+		iWriterBuffer.Write(iData.Image());
 	}
 
-    iWriterBuffer->WriteFlush();
+    iWriterBuffer.WriteFlush();
 }
 
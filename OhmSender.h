@@ -12,6 +12,7 @@
 #include "Ohm.h"
 #include "OhmMsg.h"
 #include "OhmSocket.h"
+#include "OhmRepair.h"
 #include "OhmSenderDriver.h"
 
 namespace OpenHome {
@@ -21,15 +22,137 @@ namespace Av {
 class ProviderSender;
 class OhmSenderServer;
 
+// OhmSenderDriverStats reports what an output of an OhmSenderDriver has sent since its stats were last reset
+
+class OhmSenderDriverStats
+{
+public:
+	TUint iResendQueued;							// frames now waiting to be resent
+	TUint iResendQueuedMax;
+	TUint iResent;
+	TUint iResendDroppedLate;						// could no longer arrive within the stream's latency
+	TUint iResendDroppedFull;						// requested while the queue was full
+	TUint iAudioBitRate;							// bits per second
+	TUint iResendBitRate;							// bits per second
+	TUint iFrames;									// live frames sent
+	TUint iSilentFrames;							// of which sent as silence
+	TUint iSilenceBitRate;							// bits per second of zeros left out of the audio
+};
+
+class OhmSenderDriver;
+
+// OhmSenderDriverOutput sends the frames of an OhmSenderDriver to the endpoint of the OhmSender it
+// drives, through a socket of its own, and keeps its own history of them for resends. The histories
+// hold references to frames shared by every output, so a frame is built once however many there are.
+
+// Live audio is sent as it comes. Requested resends are queued and drained behind it through a
+// token bucket filled at a share of the stream's bit rate, so a burst of resends does not add to
+// the congestion that caused the loss
+
+class OhmSenderDriverOutput : public IOhmSenderDriver
+{
+	friend class OhmSenderDriver;
+
+	static const TUint kMaxFastStartBytes = 12 * 1024; // sent back to back, so must fit a receiver's socket buffer
+	static const TUint kMaxResendBurstMs = 20; // resend tokens banked while the queue is empty
+	static const TUint kMinResendLeadUs = 5000; // a resend sent closer than this to its frame's play time is too late
+	static const TUint kMaxUnicastEndpoints = 8;
+
+public:
+	static const TUint kMaxHistoryFrames = 100;
+
+public:
+	void SetResendShare(TUint aPercent); // of the stream's bit rate resends may use on top of it, 0 for no limit
+	void GetStats(OhmSenderDriverStats& aStats);
+	void ResetStats();
+	void PrintStats();
+
+private:
+	OhmSenderDriverOutput(Environment& aEnv, OhmSenderDriver& aDriver);
+	TBool Keeping() const;
+	void Send(OhmMsgAudio& aMsg, const Brx& aBuffer, TUint64 aNowUs);
+	void Transmit(const Brx& aBuffer);
+	void Retire(TUint aFrame);
+	void ResetLocked();
+	void ResetStatsLocked();
+	void Resend(OhmMsgAudio& aMsg);
+	void QueueResend(OhmMsgAudio& aMsg);
+	void SendResendsLocked(TUint64 aNowUs);
+
+	// IOhmSenderDriver
+	virtual void SetEnabled(TBool aValue);
+	virtual void SetActive(TBool aValue);
+	virtual void SetEndpoint(const Endpoint& aEndpoint, TIpAddress aAdapter);
+	virtual void SetTtl(TUint aValue);
+	virtual void SetLatency(TUint aValue);
+	virtual void SetTrackPosition(TUint64 aSampleStart, TUint64 aSamplesTotal);
+	virtual void Resend(const Brx& aFrames);
+	virtual void FastStart();
+	virtual void AddUnicast(const Endpoint& aEndpoint);
+	virtual void RemoveUnicast(const Endpoint& aEndpoint);
+
+private:
+	Environment& iEnv;
+	OhmSenderDriver& iDriver;
+	Mutex& iMutex;											// the driver's, which guards all below
+	TBool iEnabled;
+	TBool iActive;
+	TBool iSend;
+	Endpoint iEndpoint;
+	TIpAddress iAdapter;
+	Endpoint iUnicast[kMaxUnicastEndpoints];				// sent to as well as iEndpoint
+	TUint iUnicastCount;
+	TUint iLatency;
+	OhmSocketUdp iSocket;
+	FifoLite<OhmMsgAudio*, kMaxHistoryFrames> iFifoHistory;
+	TUint64 iSentUs[kMaxHistoryFrames];						// when each frame in the history was first sent, by frame number
+	FifoLite<OhmMsgAudio*, kMaxHistoryFrames> iFifoResend;	// oldest request first
+	TUint iResendShare;
+	TInt64 iResendTokens;									// bytes * 1000000, negative while in debt for the last resend
+	TUint64 iResendTokensUs;								// when tokens were last added
+	TUint64 iStatsUs;
+	TUint64 iStatsAudioBytes;
+	TUint64 iStatsResendBytes;
+	TUint iStatsResent;
+	TUint iStatsResendDroppedLate;
+	TUint iStatsResendDroppedFull;
+	TUint iStatsResendQueuedMax;
+	TUint iStatsFrames;
+	TUint iStatsSilentFrames;
+	TUint64 iStatsSilenceBytes;
+};
+
+// OhmSenderDriver builds the audio frames of a stream and hands them to its outputs, one for each
+// OhmSender publishing the stream. It drives the first itself; each OhmSender publishing the same
+// stream on another interface is given an output of its own from AddOutput.
+//
+// In discontinuous transmission (DTX) a frame of uncompressed audio that is all zero is sent as its
+// header alone, marked as silence. It keeps its frame number, sample count and sample start, so
+// receivers fill in the zeros and see an unbroken stream; its resends and fast starts are as small.
+// Receivers that predate the silence flag would play such a frame as empty, so DTX is off until set.
+
 class OhmSenderDriver : public IOhmSenderDriver
 {
+	friend class OhmSenderDriverOutput;
+
     static const TUint kMaxAudioFrameBytes = 16 * 1024;
-	static const TUint kMaxHistoryFrames = 100;
+	static const TUint kMaxOutputs = 4;
+
+public:
+	static const TUint kDefaultResendShare = 50; // percent
 
 public:
     OhmSenderDriver(Environment& aEnv);
+    ~OhmSenderDriver();
     void SetAudioFormat(TUint aSampleRate, TUint aBitRate, TUint aChannels, TUint aBitDepth, TBool aLossless, const Brx& aCodecName);
     void SendAudio(const TByte* aData, TUint aBytes);
+    void SetFastStart(TBool aValue); // keep recent audio even while no receiver is listening
+	IOhmSenderDriver& AddOutput(); // for another OhmSender publishing the same stream
+	void SetResendShare(TUint aPercent); // of every output
+	void SetDtx(TBool aValue); // send silent frames without their samples
+	void GetStats(OhmSenderDriverStats& aStats); // of the first output
+	void ResetStats(); // of every output
+	void PrintStats(); // of every output
 
 private:    
     // IOhmSenderDriver
@@ -40,18 +163,17 @@ private:
     virtual void SetLatency(TUint aValue);
     virtual void SetTrackPosition(TUint64 aSampleStart, TUint64 aSamplesTotal);
 	virtual void Resend(const Brx& aFrames);
+    virtual void FastStart();
+	virtual void AddUnicast(const Endpoint& aEndpoint);
+	virtual void RemoveUnicast(const Endpoint& aEndpoint);
 
 private:
 	void ResetLocked();
-	void Resend(OhmMsgAudio& aMsg);
 
 private:
+	Environment& iEnv;
     Mutex iMutex;
-	TBool iEnabled;
-    TBool iActive;
-	TBool iSend;
-    Endpoint iEndpoint;
-	TIpAddress iAdapter;
+	TBool iFastStart;
     Bws<kMaxAudioFrameBytes> iBuffer;
     TUint iFrame;
     TUint iSampleRate;
@@ -59,13 +181,14 @@ private:
     TUint iChannels;
     TUint iBitDepth;
     TBool iLossless;
+	TBool iDtx;
     Bws<Ohm::kMaxCodecNameBytes> iCodecName;
     TUint64 iSamplesTotal;
     TUint64 iSampleStart;
-	TUint iLatency;
-    SocketUdp iSocket;
+	TUint iLatency;											// as last set on any output
 	OhmMsgFactory iFactory;
-	FifoLite<OhmMsgAudio*, kMaxHistoryFrames> iFifoHistory;
+	OhmSenderDriverOutput* iOutput[kMaxOutputs];
+	TUint iOutputCount;
 };
 
 class OhmSender
@@ -82,7 +205,10 @@ class OhmSender
     static const TUint kMaxSlaveCount = 4;
     static const TUint kMaxZoneFrameBytes = 1 * 1024;
     static const TUint kTimerZoneUriDelayMs = 100;
+    static const TUint kTimerZoneUriAggregateMs = 20;
     static const TUint kTimerPresetInfoDelayMs = 100;
+    static const TUint kMaxResendFrames = OhmHeaderResendRange::kMaxFramesCount;
+    static const TUint kMaxHybridCount = 8;
 
 public:
 	static const TUint kMaxNameBytes = 64;
@@ -96,6 +222,7 @@ public:
 
 	const Brx& SenderUri() const;
 	const Brx& SenderMetadata() const; // might change after SetName() and SetMulticast()
+	const Brx& HybridUri() const; // where receivers join by unicast while hybrid, empty otherwise
 
 	void SetName(const Brx& aValue);
 	void SetChannel(TUint aValue);
@@ -103,6 +230,7 @@ public:
     void SetTtl(TUint aValue);
     void SetLatency(TUint aValue);
     void SetMulticast(TBool aValue);
+    void SetHybrid(TBool aValue); // while multicast, also send to receivers that join by unicast at HybridUri()
 	void SetEnabled(TBool aValue);
     void SetTrack(const Brx& aUri, const Brx& aMetadata, TUint64 aSamplesTotal, TUint64 aSampleStart);
 	void SetMetatext(const Brx& aValue);
@@ -111,6 +239,7 @@ public:
 private:
     void RunMulticast();
     void RunUnicast();
+    void RunHybrid();
 	void RunZone();
 
     void UpdateChannel();
@@ -119,8 +248,12 @@ private:
 
     void Start(TIpAddress aValue);
     void Stop();
+    void Switch(TIpAddress aValue);
+    TBool Switched();
     void StartZone(TIpAddress aValue);
     void StopZone();
+    void StartHybrid(TIpAddress aValue);
+    void StopHybrid();
     void EnabledChanged();
     void ChannelChanged();
     void TimerAliveJoinExpired();
@@ -128,6 +261,7 @@ private:
     void TimerExpiryExpired();
     void TimerZoneUriExpired();
     void TimerPresetInfoExpired();
+    void TimerHybridExpiryExpired();
     void Send();
     void SendTrackInfo();
     void SendTrack();
@@ -137,11 +271,16 @@ private:
     void SendLeave(const Endpoint& aEndpoint);
 	void SendZoneUri(TUint aCount);
 	void SendZoneUri();
-	void SendPresetInfo(TUint aCount);
+	void AnswerZoneQuery();
+	void AnswerPresetQuery();
 	void SendPresetInfo();
+    void Resend(const OhmHeader& aHeader, Srs<kMaxAudioFrameBytes>& aBuffer);
     TUint FindSlave(const Endpoint& aEndpoint);
     void RemoveSlave(TUint aIndex);
     TBool CheckSlaveExpiry();
+    TUint FindHybrid(const Endpoint& aEndpoint);
+    void RemoveHybrid(TUint aIndex);
+    void CheckHybridExpiry();
     
 private:
     Environment& iEnv;
@@ -154,10 +293,13 @@ private:
     TUint iTtl;
     TUint iLatency;
     TBool iMulticast;
+    TBool iHybrid;
     TBool iEnabled;
     OhmSocket iSocketOhm;
     OhzSocket iSocketOhz;
+    OhmSocket iSocketOhu;       // where receivers join by unicast while hybrid
     Srs<kMaxAudioFrameBytes> iRxBuffer;
+    Srs<kMaxAudioFrameBytes> iRxHybrid;
     Bws<kMaxAudioFrameBytes> iTxBuffer;
     Srs<kMaxZoneFrameBytes> iRxZone;
     Bws<kMaxZoneFrameBytes> iTxZone;
@@ -166,29 +308,40 @@ private:
     Mutex iMutexZone;
     Semaphore iNetworkDeactivated;
     Semaphore iZoneDeactivated;
+    Semaphore iHybridDeactivated;
     ProviderSender* iProvider;
     TBool iStarted;
     TBool iZoneStarted;
+    TBool iHybridStarted;
     TBool iActive;
     TBool iAliveJoined;
     TBool iAliveBlocked;
     Endpoint iMulticastEndpoint;
     Endpoint iTargetEndpoint;
 	TIpAddress iTargetInterface;
+	TBool iSwitching;           // [iMutexActive] the multicast thread is to move to the sockets prepared
+	Endpoint iSwitchEndpoint;   // [iMutexActive]
+	TIpAddress iSwitchInterface;// [iMutexActive]
     ThreadFunctor* iThreadMulticast;
     ThreadFunctor* iThreadUnicast;
     ThreadFunctor* iThreadZone;
+    ThreadFunctor* iThreadHybrid;
     Bws<Ohm::kMaxUriBytes> iUri;
+    Bws<Ohm::kMaxUriBytes> iHybridUri;
     Uri iSenderUri;
     Bws<kMaxMetadataBytes> iSenderMetadata;
     TUint iSlaveCount;
     Endpoint iSlaveList[kMaxSlaveCount];
     TUint iSlaveExpiry[kMaxSlaveCount];
+    TUint iHybridCount;                         // [iMutexActive]
+    Endpoint iHybridList[kMaxHybridCount];      // [iMutexActive] receivers joined by unicast while hybrid
+    TUint iHybridExpiry[kMaxHybridCount];       // [iMutexActive]
     Timer iTimerAliveJoin;
     Timer iTimerAliveAudio;
     Timer iTimerExpiry;
     Timer iTimerZoneUri;
     Timer iTimerPresetInfo;
+    Timer iTimerHybridExpiry;
     Bws<Ohm::kMaxTrackUriBytes> iTrackUri;
     Bws<Ohm::kMaxTrackMetadataBytes> iTrackMetadata;
     Bws<Ohm::kMaxTrackMetatextBytes> iTrackMetatext;
@@ -197,7 +350,11 @@ private:
 	TBool iClientControllingTrackMetadata;
 	TUint iSendZoneUriCount;
 	TUint iSendPresetInfoCount;
+	TBool iZoneUriAnswer;       // [iMutexZone] the ZoneUri due only answers a query
+	TBool iPresetInfoAnswer;    // [iMutexZone] the PresetInfo due only answers a query
 	TUint iPreset;
+    OhmResendFilter iResendFilter;              // [iMutexActive] taken by Resend, which the multicast, unicast and hybrid threads call
+    Bws<kMaxResendFrames * 4> iResendFrames;    // [iMutexActive]
     OhmSenderServer* iServer;
 };
 
@@ -211,6 +368,7 @@ public:
 
 class OhmSenderSession : public SocketTcpSession
 {
+    static const TUint kMaxReadBytes = 1024;
     static const TUint kMaxRequestBytes = 4*1024;
     static const TUint kMaxResponseBytes = 4*1024;
 public:
@@ -222,11 +380,11 @@ private:
     void Get(TBool aWriteEntity);
 private:
 	const IOhmSenderSessionData& iData;
-    Srx* iReadBuffer;
-    ReaderUntil* iReaderUntil;
-    ReaderHttpRequest* iReaderRequest;
-    Sws<kMaxResponseBytes>* iWriterBuffer;
-    WriterHttpResponse* iWriterResponse;
+    Srs<kMaxReadBytes> iReadBuffer;
+    ReaderUntilS<kMaxRequestBytes> iReaderUntil;
+    ReaderHttpRequest iReaderRequest;
+    Sws<kMaxResponseBytes> iWriterBuffer;
+    WriterHttpResponse iWriterResponse;
     HttpHeaderHost iHeaderHost;
     HttpHeaderExpect iHeaderExpect;
 	const HttpStatus* iErrorStatus;
@@ -18,6 +18,9 @@ public:
     virtual void SetLatency(TUint aValue) = 0;
     virtual void SetTrackPosition(TUint64 aSampleStart, TUint64 aSamplesTotal) = 0;
 	virtual void Resend(const Brx& aFrames) = 0;
+    virtual void FastStart() = 0; // send the recent audio a joining receiver needs to fill its latency
+    virtual void AddUnicast(const Endpoint& aEndpoint) = 0; // send to this receiver as well as to the endpoint
+    virtual void RemoveUnicast(const Endpoint& aEndpoint) = 0;
     virtual ~IOhmSenderDriver() {}
 };
 
@@ -0,0 +1,84 @@
+#include "OhmSilence.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define OHM_SILENCE_SSE2
+# include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# define OHM_SILENCE_NEON
+# include <arm_neon.h>
+#endif
+
+using namespace OpenHome;
+using namespace OpenHome::Av;
+
+// OhmSilence
+
+TBool OhmSilence::IsSilent(const TByte* aData, TUint aBytes)
+{
+	TUint blocks = aBytes / kBlockBytes;
+
+#if defined(OHM_SILENCE_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+
+	for (TUint i = 0; i < blocks; i++) {
+		const TByte* p = aData + i * kBlockBytes;
+		__m128i acc = _mm_or_si128(
+			_mm_or_si128(_mm_loadu_si128((const __m128i*)p), _mm_loadu_si128((const __m128i*)(p + 16))),
+			_mm_or_si128(_mm_loadu_si128((const __m128i*)(p + 32)), _mm_loadu_si128((const __m128i*)(p + 48))));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, zero)) != 0xffff) {
+			return (false);
+		}
+	}
+#elif defined(OHM_SILENCE_NEON)
+	for (TUint i = 0; i < blocks; i++) {
+		const TByte* p = aData + i * kBlockBytes;
+		uint8x16_t acc = vorrq_u8(vorrq_u8(vld1q_u8(p), vld1q_u8(p + 16)), vorrq_u8(vld1q_u8(p + 32), vld1q_u8(p + 48)));
+		uint64x2_t wide = vreinterpretq_u64_u8(acc);
+
+		if ((vgetq_lane_u64(wide, 0) | vgetq_lane_u64(wide, 1)) != 0) {
+			return (false);
+		}
+	}
+#else
+	blocks = 0;
+#endif
+
+	TUint scanned = blocks * kBlockBytes;
+
+	return (IsSilentScalar(aData + scanned, aBytes - scanned));
+}
+
+TBool OhmSilence::IsSilentScalar(const TByte* aData, TUint aBytes)
+{
+	TUint words = aBytes / sizeof(TUint64);
+
+	for (TUint i = 0; i < words; i++) {
+		TUint64 word;
+		memcpy(&word, aData + i * sizeof(TUint64), sizeof(word)); // audio need not be aligned
+		if (word != 0) {
+			return (false);
+		}
+	}
+
+	for (TUint i = words * sizeof(TUint64); i < aBytes; i++) {
+		if (aData[i] != 0) {
+			return (false);
+		}
+	}
+
+	return (true);
+}
+
+const TChar* OhmSilence::Implementation()
+{
+#if defined(OHM_SILENCE_SSE2)
+	return ("sse2");
+#elif defined(OHM_SILENCE_NEON)
+	return ("neon");
+#else
+	return ("scalar");
+#endif
+}
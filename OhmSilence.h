@@ -0,0 +1,31 @@
+#ifndef HEADER_OHM_SILENCE
+#define HEADER_OHM_SILENCE
+
+#include <OpenHome/OhNetTypes.h>
+
+namespace OpenHome {
+namespace Av {
+
+// OhmSilence finds digital silence: audio whose every byte is zero. A sender in discontinuous
+// transmission sends such a frame as its header alone, marked as silence, and receivers put the
+// zeros back.
+//
+// The scan ORs the audio together 64 bytes at a time in SSE2 or NEON registers where the compiler
+// targets them, otherwise 8 bytes at a time, and stops at the first block that is not all zero, so
+// a frame of music typically costs one block.
+
+class OhmSilence
+{
+public:
+	static const TUint kBlockBytes = 64;
+
+public:
+	static TBool IsSilent(const TByte* aData, TUint aBytes);
+	static TBool IsSilentScalar(const TByte* aData, TUint aBytes); // for comparison
+	static const TChar* Implementation(); // "sse2", "neon" or "scalar"
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+#endif // HEADER_OHM_SILENCE
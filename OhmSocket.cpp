@@ -1,8 +1,71 @@
 #include "OhmSocket.h"
 
+#ifdef __linux__
+# include <stdio.h>
+#endif
+
 using namespace OpenHome;
 using namespace OpenHome::Av;
 
+// The kernel counts the datagrams it drops for want of receive buffer against each socket. ohNet
+// gives no access to the descriptor, so the count is found in /proc/net/udp by the local address
+// and port; other sockets in this host bound to the same address and port are counted too.
+
+static TUint KernelDrops(TIpAddress aAddress, TUint aPort)
+{
+    TUint drops = 0;
+
+#ifdef __linux__
+    FILE* file = fopen("/proc/net/udp", "r");
+
+    if (file == 0) {
+        return (0);
+    }
+
+    char line[256];
+
+    if (fgets(line, sizeof(line), file) != 0) { // column headings
+        while (fgets(line, sizeof(line), file) != 0) {
+            unsigned address;
+            unsigned port;
+            unsigned count;
+
+            // sl local_address rem_address st tx_queue:rx_queue tr:tm->when retrnsmt uid timeout inode ref pointer drops
+
+            if (sscanf(line, " %*u: %x:%x %*x:%*x %*x %*x:%*x %*x:%*x %*x %*u %*u %*u %*u %*x %u", &address, &port, &count) == 3) {
+                if (port == aPort && (address == aAddress || address == 0)) {
+                    drops += count;
+                }
+            }
+        }
+    }
+
+    fclose(file);
+#else
+    (void)aAddress;
+    (void)aPort;
+#endif
+
+    return (drops);
+}
+
+// OhmSendBatch
+
+OhmSendBatch::OhmSendBatch(OhmSocketUdpBase& aSocket)
+    : iSocket(aSocket)
+{
+#ifdef OHM_IO_URING
+    iSocket.BeginBatch();
+#endif
+}
+
+OhmSendBatch::~OhmSendBatch()
+{
+#ifdef OHM_IO_URING
+    iSocket.EndBatch();
+#endif
+}
+
 // OhmSocket
 
 // Sends on same socket in Unicast mode, but different socket in Multicast mode
@@ -12,6 +75,15 @@ OhmSocket::OhmSocket(Environment& aEnv)
     , iRxSocket(0)
 	, iTxSocket(0)
 	, iReader(0)
+	, iInterface(0)
+	, iTtl(0)
+	, iRecvBufBytes(kReceiveBufBytes)
+	, iSendBufBytes(kSendBufBytes)
+	, iRxSocketNext(0)
+	, iTxSocketNext(0)
+	, iReaderNext(0)
+	, iInterfaceNext(0)
+	, iTap(0)
 {
 }
 
@@ -20,12 +92,14 @@ void OhmSocket::OpenUnicast(TIpAddress aInterface, TUint aTtl)
     ASSERT(!iRxSocket);
     ASSERT(!iTxSocket);
     ASSERT(!iReader);
-    iRxSocket = new SocketUdp(iEnv, 0, aInterface);
+    iRxSocket = new OhmSocketUdp(iEnv, 0, aInterface);
     iRxSocket->SetTtl(aTtl);
-    iRxSocket->SetRecvBufBytes(kReceiveBufBytes);
-    iRxSocket->SetSendBufBytes(kSendBufBytes);
-    iReader = new UdpReader(*iRxSocket);
+    iRxSocket->SetRecvBufBytes(iRecvBufBytes);
+    iRxSocket->SetSendBufBytes(iSendBufBytes);
+    iReader = new OhmUdpReader(*iRxSocket);
     iThis.Replace(Endpoint(iRxSocket->Port(), aInterface));
+    iInterface = aInterface;
+    iTtl = aTtl;
 }
 
 void OhmSocket::OpenMulticast(TIpAddress aInterface, TUint aTtl, const Endpoint& aEndpoint)
@@ -33,22 +107,145 @@ void OhmSocket::OpenMulticast(TIpAddress aInterface, TUint aTtl, const Endpoint&
     ASSERT(!iRxSocket);
     ASSERT(!iTxSocket);
     ASSERT(!iReader);
-    iRxSocket = new SocketUdpMulticast(iEnv, aInterface, aEndpoint);
-    iRxSocket->SetRecvBufBytes(kReceiveBufBytes);
-	iTxSocket = new SocketUdp(iEnv, 0, aInterface);
+    iRxSocket = new OhmSocketUdpMulticast(iEnv, aInterface, aEndpoint);
+    iRxSocket->SetRecvBufBytes(iRecvBufBytes);
+	iTxSocket = new OhmSocketUdp(iEnv, 0, aInterface);
     iTxSocket->SetTtl(aTtl);
-    iTxSocket->SetSendBufBytes(kSendBufBytes);
-    iReader = new UdpReader(*iRxSocket);
+    iTxSocket->SetSendBufBytes(iSendBufBytes);
+    iReader = new OhmUdpReader(*iRxSocket);
     iThis.Replace(aEndpoint);
+    iInterface = aInterface;
+    iTtl = aTtl;
+}
+
+// Switching channel opens the next receive socket before the current one is closed, so the new
+// channel is joined while the old one is still being read. The multicast transmit socket is kept
+// unless the interface changes.
+
+void OhmSocket::PrepareUnicast()
+{
+    ASSERT(iReader);
+    ASSERT(!iTxSocket);
+    CloseNext(); // prepared for a switch since superseded
+    iRxSocketNext = new OhmSocketUdp(iEnv, 0, iInterface);
+    iRxSocketNext->SetTtl(iTtl);
+    iRxSocketNext->SetRecvBufBytes(iRecvBufBytes);
+    iRxSocketNext->SetSendBufBytes(iSendBufBytes);
+    iReaderNext = new OhmUdpReader(*iRxSocketNext);
+    iThisNext.Replace(Endpoint(iRxSocketNext->Port(), iInterface));
+    iInterfaceNext = iInterface;
+}
+
+void OhmSocket::PrepareMulticast(const Endpoint& aEndpoint)
+{
+    PrepareMulticast(iInterface, aEndpoint);
+}
+
+void OhmSocket::PrepareMulticast(TIpAddress aInterface, const Endpoint& aEndpoint)
+{
+    ASSERT(iReader);
+    ASSERT(iTxSocket);
+    CloseNext(); // prepared for a switch since superseded
+    iRxSocketNext = new OhmSocketUdpMulticast(iEnv, aInterface, aEndpoint);
+    iRxSocketNext->SetRecvBufBytes(iRecvBufBytes);
+    if (aInterface != iInterface) {
+        iTxSocketNext = new OhmSocketUdp(iEnv, 0, aInterface);
+        iTxSocketNext->SetTtl(iTtl);
+        iTxSocketNext->SetSendBufBytes(iSendBufBytes);
+    }
+    iReaderNext = new OhmUdpReader(*iRxSocketNext);
+    iThisNext.Replace(aEndpoint);
+    iInterfaceNext = aInterface;
+}
+
+void OhmSocket::Switch()
+{
+    ASSERT(iReaderNext);
+    delete (iReader);
+    delete (iRxSocket);
+    iReader = iReaderNext;
+    iRxSocket = iRxSocketNext;
+    iThis.Replace(iThisNext);
+    iInterface = iInterfaceNext;
+    iReaderNext = 0;
+    iRxSocketNext = 0;
+    if (iTxSocketNext) {
+        delete (iTxSocket);
+        iTxSocket = iTxSocketNext;
+        iTxSocketNext = 0;
+    }
+}
+
+// Big enough for the kernel to hold a latency's worth of stream while the reading thread is held up,
+// allowing for the kernel charging each datagram about twice its payload
+
+TUint OhmSocket::BufBytes(TUint aBytesPerSecond, TUint aLatencyMs)
+{
+    TUint64 bytes = (TUint64)aBytesPerSecond * aLatencyMs / 1000 * 2;
+
+    if (bytes < kReceiveBufBytes) {
+        return (kReceiveBufBytes);
+    }
+
+    if (bytes > kMaxBufBytes) {
+        return (kMaxBufBytes);
+    }
+
+    return ((TUint)bytes);
+}
+
+void OhmSocket::SetRecvBufBytes(TUint aBytes)
+{
+    iRecvBufBytes = aBytes;
+    if (iRxSocket) {
+        iRxSocket->SetRecvBufBytes(aBytes);
+    }
+}
+
+void OhmSocket::SetSendBufBytes(TUint aBytes)
+{
+    iSendBufBytes = aBytes;
+    if (iTxSocket) {
+        iTxSocket->SetSendBufBytes(aBytes);
+    }
+    else if (iRxSocket) {
+        iRxSocket->SetSendBufBytes(aBytes);
+    }
+}
+
+TUint OhmSocket::KernelDrops() const
+{
+    ASSERT(iRxSocket);
+    return (::KernelDrops(iThis.Address(), iRxSocket->Port()));
+}
+
+// TTL is a socket option, so can change without reopening
+
+void OhmSocket::SetTtl(TUint aValue)
+{
+    ASSERT(iRxSocket);
+    iTtl = aValue;
+    if (iTxSocket) {
+        iTxSocket->SetTtl(aValue);
+    }
+    else {
+        iRxSocket->SetTtl(aValue);
+    }
 }
 
 void OhmSocket::Send(const Brx& aBuffer, const Endpoint& aEndpoint)
 {
 	if (iTxSocket) {
 		iTxSocket->Send(aBuffer, aEndpoint);
+		if (iTap) {
+			iTap->Datagram(aBuffer, Endpoint(iTxSocket->Port(), iInterface), aEndpoint);
+		}
 	}
 	else {
 		iRxSocket->Send(aBuffer, aEndpoint);
+		if (iTap) {
+			iTap->Datagram(aBuffer, iThis, aEndpoint);
+		}
 	}
 }
 
@@ -75,13 +272,37 @@ void OhmSocket::Close()
 		delete (iTxSocket);
 	    iTxSocket = 0;
 	}
+	CloseNext();
     iThis.Replace(Endpoint());
 }
+
+void OhmSocket::CloseNext()
+{
+    if (iReaderNext) {
+        delete (iReaderNext);
+        iReaderNext = 0;
+        delete (iRxSocketNext);
+        iRxSocketNext = 0;
+    }
+    if (iTxSocketNext) {
+        delete (iTxSocketNext);
+        iTxSocketNext = 0;
+    }
+}
+
+void OhmSocket::SetTap(IOhmSocketTap* aTap)
+{
+    ASSERT(!iReader);
+    iTap = aTap;
+}
     
 void OhmSocket::Read(Bwx& aBuffer)
 {
     ASSERT(iReader);
     iReader->Read(aBuffer);
+    if (iTap) {
+        iTap->Datagram(aBuffer, iReader->Sender(), iThis);
+    }
 }
 
 void OhmSocket::ReadFlush()
@@ -111,6 +332,9 @@ OhzSocket::OhzSocket(Environment& aEnv)
     , iRxSocket(0)
 	, iTxSocket(0)
 	, iEndpoint(51972, Brn("239.255.255.250"))
+	, iReader(0)
+	, iInterface(0)
+	, iTap(0)
 {
 }
 
@@ -119,19 +343,41 @@ const Endpoint& OhzSocket::This() const
 	return (iEndpoint);
 }
 
+Endpoint OhzSocket::Sender() const
+{
+    ASSERT(iReader);
+    return (iReader->Sender());
+}
+
+TBool OhzSocket::SenderIsThis() const
+{
+    ASSERT(iReader);
+    return (iReader->Sender().Equals(Endpoint(iTxSocket->Port(), iInterface)));
+}
+
+TUint OhzSocket::KernelDrops() const
+{
+    ASSERT(iRxSocket);
+    return (::KernelDrops(iEndpoint.Address(), iEndpoint.Port()));
+}
+
 void OhzSocket::Open(TIpAddress aInterface, TUint aTtl)
 {
     ASSERT(!iRxSocket);
-    iRxSocket = new SocketUdpMulticast(iEnv, aInterface, iEndpoint);
-	iTxSocket = new SocketUdp(iEnv, 0, aInterface);
+    iRxSocket = new OhmSocketUdpMulticast(iEnv, aInterface, iEndpoint);
+	iTxSocket = new OhmSocketUdp(iEnv, 0, aInterface);
     iTxSocket->SetTtl(aTtl);
-    iReader = new UdpReader(*iRxSocket);
+    iReader = new OhmUdpReader(*iRxSocket);
+    iInterface = aInterface;
 }
 
 void OhzSocket::Send(const Brx& aBuffer)
 {
     ASSERT(iTxSocket);
     iTxSocket->Send(aBuffer, iEndpoint);
+    if (iTap) {
+        iTap->Datagram(aBuffer, Endpoint(iTxSocket->Port(), iInterface), iEndpoint);
+    }
 }
 
 void OhzSocket::Close()
@@ -144,11 +390,20 @@ void OhzSocket::Close()
 	iTxSocket = 0;
     iReader = 0;
 }
+
+void OhzSocket::SetTap(IOhmSocketTap* aTap)
+{
+    ASSERT(!iRxSocket);
+    iTap = aTap;
+}
     
 void OhzSocket::Read(Bwx& aBuffer)
 {
     ASSERT(iRxSocket);
     iReader->Read(aBuffer);
+    if (iTap) {
+        iTap->Datagram(aBuffer, iReader->Sender(), iEndpoint);
+    }
 }
 
 void OhzSocket::ReadFlush()
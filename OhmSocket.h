@@ -8,23 +8,78 @@
 
 #include "Ohm.h"
 
+#ifdef OHM_IO_URING
+# include "OhmUring.h"
+#endif
+
 namespace OpenHome {
 class Environment;
 namespace Av {
 
+// The sockets beneath OhmSocket and OhzSocket are ohNet's, read on blocking threads, unless built
+// on Linux with OHM_IO_URING defined, when they are the io_uring backend in OhmUring.h
+
+#ifdef OHM_IO_URING
+typedef OhmUringSocketUdpBase OhmSocketUdpBase;
+typedef OhmUringSocketUdp OhmSocketUdp;
+typedef OhmUringSocketUdpMulticast OhmSocketUdpMulticast;
+typedef OhmUringReader OhmUdpReader;
+#else
+typedef SocketUdpBase OhmSocketUdpBase;
+typedef SocketUdp OhmSocketUdp;
+typedef SocketUdpMulticast OhmSocketUdpMulticast;
+typedef UdpReader OhmUdpReader;
+#endif
+
+// OhmSendBatch holds back the sends made on a socket while it is in scope and submits them together
+// The blocking backend sends each at once
+
+class OhmSendBatch : public INonCopyable
+{
+public:
+    OhmSendBatch(OhmSocketUdpBase& aSocket);
+    ~OhmSendBatch();
+
+private:
+    OhmSocketUdpBase& iSocket;
+};
+
+// IOhmSocketTap is offered every datagram received or sent through a socket (see OhmCapture)
+// The tap is called on the reading or sending thread, so must be thread safe if shared between sockets
+
+class IOhmSocketTap
+{
+public:
+    virtual void Datagram(const Brx& aBuffer, const Endpoint& aSender, const Endpoint& aDestination) = 0;
+    virtual ~IOhmSocketTap() {}
+};
+
 class OhmSocket : public IReaderSource, public INonCopyable
 {
     static const TUint kSendBufBytes = 16392;
     static const TUint kReceiveBufBytes = 16392;
+    static const TUint kMaxBufBytes = 4 * 1024 * 1024;
+
+public:
+    static TUint BufBytes(TUint aBytesPerSecond, TUint aLatencyMs); // to hold a latency's worth of stream
 
 public:
     OhmSocket(Environment& aEnv);
     void OpenUnicast(TIpAddress aInterface, TUint aTtl);
     void OpenMulticast(TIpAddress aInterface, TUint aTtl, const Endpoint& aEndpoint);
+    void PrepareUnicast(); // open the next receive socket while the current one is still read
+    void PrepareMulticast(const Endpoint& aEndpoint);
+    void PrepareMulticast(TIpAddress aInterface, const Endpoint& aEndpoint); // also replaces the transmit socket
+    void Switch(); // on the reading thread, replace the current sockets with the next
+    void SetTtl(TUint aValue); // applies to the open socket
+    void SetRecvBufBytes(TUint aBytes); // applies to the open socket and those opened later
+    void SetSendBufBytes(TUint aBytes);
+    TUint KernelDrops() const; // datagrams the kernel dropped with the receive buffer full (Linux only, else 0)
     Endpoint This() const;
     Endpoint Sender() const;
     void Send(const Brx& aBuffer, const Endpoint& aEndpoint);
     void Close();
+    void SetTap(IOhmSocketTap* aTap); // set while closed, 0 to remove
     ~OhmSocket();
 
 public:
@@ -33,12 +88,25 @@ public:
     virtual void ReadFlush();
     virtual void ReadInterrupt();
 
+private:
+    void CloseNext();
+
 private:
     Environment& iEnv;
-    SocketUdpBase* iRxSocket;
-	SocketUdpBase* iTxSocket;
-    UdpReader* iReader;
+    OhmSocketUdpBase* iRxSocket;
+	OhmSocketUdpBase* iTxSocket;
+    OhmUdpReader* iReader;
     Endpoint iThis;
+    TIpAddress iInterface;
+    TUint iTtl;
+    TUint iRecvBufBytes;
+    TUint iSendBufBytes;
+    OhmSocketUdpBase* iRxSocketNext;
+    OhmSocketUdpBase* iTxSocketNext;
+    OhmUdpReader* iReaderNext;
+    Endpoint iThisNext;
+    TIpAddress iInterfaceNext;
+    IOhmSocketTap* iTap;
 };
 
 class OhzSocket : public IReaderSource, public INonCopyable
@@ -49,9 +117,13 @@ public:
     OhzSocket(Environment& aEnv);
 
 	const Endpoint& This() const;
+	Endpoint Sender() const; // of the last datagram read
+	TBool SenderIsThis() const; // the last datagram read was one sent through this socket
+	TUint KernelDrops() const; // datagrams the kernel dropped with the receive buffer full (Linux only, else 0)
 	void Open(TIpAddress aInterface, TUint aTtl);
     void Send(const Brx& aBuffer);
     void Close();
+    void SetTap(IOhmSocketTap* aTap); // set while closed, 0 to remove
 
     // IReaderSource
     virtual void Read(Bwx& aBuffer);
@@ -62,10 +134,12 @@ public:
 
 private:
     Environment& iEnv;
-    SocketUdpMulticast* iRxSocket;
-    SocketUdp* iTxSocket;
+    OhmSocketUdpMulticast* iRxSocket;
+    OhmSocketUdp* iTxSocket;
     Endpoint iEndpoint;
-    UdpReader* iReader;
+    OhmUdpReader* iReader;
+    TIpAddress iInterface;
+    IOhmSocketTap* iTap;
 };
 
 
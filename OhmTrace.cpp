@@ -0,0 +1,264 @@
+#include "OhmTrace.h"
+
+#include <OpenHome/Private/Thread.h>
+
+#include <chrono>
+
+using namespace OpenHome;
+using namespace OpenHome::Av;
+
+namespace OpenHome {
+namespace Av {
+
+struct OhmTraceEntry
+{
+	TUint64 iTime;
+	TUint iEvent;
+	TUint iFrame;
+};
+
+// OhmTraceRing
+
+// Written by the thread that has claimed it, and copied out by a dump, both under iMutex
+
+class OhmTraceRing
+{
+public:
+	OhmTraceRing(TUint aId);
+	void Record(TUint64 aTime, EOhmTraceEvent aEvent, TUint aFrame);
+	TUint64 LastTime();
+	TUint WriteChromeJson(FILE* aFile, TUint64 aSince, TBool& aFirst, OhmTraceEntry* aCopy);
+
+public:
+	TBool iClaimed; // [OhmTraceMutex()]
+	Thread* iOwner; // [OhmTraceMutex()] also read unlocked by Record, which compares it with the current thread
+
+private:
+	Mutex iMutex;
+	TUint iId;
+	TUint64 iHead;
+	OhmTraceEntry iEntries[OhmTrace::kMaxRingEvents];
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+static TBool gOhmTraceEnabled = false;
+static OhmTraceRing* gOhmTraceRings[OhmTrace::kMaxRings]; // created by the first SetEnabled(true) and never freed
+
+// constructed on first use, as ohNet mutexes can only be created once the library is initialised
+
+static Mutex& OhmTraceMutex()
+{
+	static Mutex mutex("OHTR");
+	return (mutex);
+}
+
+OhmTraceRing::OhmTraceRing(TUint aId)
+	: iClaimed(false)
+	, iOwner(0)
+	, iMutex("OHTG")
+	, iId(aId)
+	, iHead(0)
+{
+}
+
+void OhmTraceRing::Record(TUint64 aTime, EOhmTraceEvent aEvent, TUint aFrame)
+{
+	AutoMutex mutex(iMutex);
+
+	OhmTraceEntry& entry = iEntries[iHead % OhmTrace::kMaxRingEvents];
+
+	entry.iTime = aTime;
+	entry.iEvent = aEvent;
+	entry.iFrame = aFrame;
+
+	iHead++;
+}
+
+TUint64 OhmTraceRing::LastTime()
+{
+	AutoMutex mutex(iMutex);
+
+	if (iHead == 0) {
+		return (0);
+	}
+
+	return (iEntries[(iHead - 1) % OhmTrace::kMaxRingEvents].iTime);
+}
+
+// The ring is copied out under the mutex and written to the file after, so the recording thread
+// is never held up by file i/o
+
+TUint OhmTraceRing::WriteChromeJson(FILE* aFile, TUint64 aSince, TBool& aFirst, OhmTraceEntry* aCopy)
+{
+	iMutex.Wait();
+
+	TUint64 head = iHead;
+	TUint64 tail = (head > OhmTrace::kMaxRingEvents) ? head - OhmTrace::kMaxRingEvents : 0;
+	TUint entries = (TUint)(head - tail);
+
+	for (TUint i = 0; i < entries; i++) {
+		aCopy[i] = iEntries[(tail + i) % OhmTrace::kMaxRingEvents];
+	}
+
+	iMutex.Signal();
+
+	TUint count = 0;
+
+	for (TUint i = 0; i < entries; i++) {
+		const OhmTraceEntry& entry = aCopy[i];
+
+		if (entry.iTime < aSince) {
+			continue;
+		}
+
+		fprintf(aFile, "%s\n{\"name\":\"%s\",\"cat\":\"ohm\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,\"pid\":1,\"tid\":%u,\"args\":{\"frame\":%u}}",
+			aFirst ? "" : ",",
+			OhmTrace::EventName((EOhmTraceEvent)entry.iEvent),
+			(unsigned long long)entry.iTime,
+			iId,
+			entry.iFrame);
+
+		aFirst = false;
+		count++;
+	}
+
+	return (count);
+}
+
+// The ring claimed by the current thread, claiming one with the thread's first event
+
+static OhmTraceRing& OhmTraceRingCurrent()
+{
+	Thread* thread = Thread::Current();
+
+	for (TUint i = 0; i < OhmTrace::kMaxRings; i++) {
+		OhmTraceRing* ring = gOhmTraceRings[i];
+
+		if (ring->iClaimed && ring->iOwner == thread) {
+			return (*ring);
+		}
+	}
+
+	AutoMutex mutex(OhmTraceMutex());
+
+	OhmTraceRing* oldest = 0;
+	TUint64 oldestTime = 0;
+
+	for (TUint i = 0; i < OhmTrace::kMaxRings; i++) {
+		OhmTraceRing* ring = gOhmTraceRings[i];
+
+		if (!ring->iClaimed) {
+			oldest = ring;
+			break;
+		}
+
+		// the owner of a ring that has gone quiet has most likely exited, and a ring taken from a
+		// thread still running is only shared with it, as the mutex keeps each record whole
+
+		TUint64 time = ring->LastTime();
+
+		if (oldest == 0 || time < oldestTime) {
+			oldest = ring;
+			oldestTime = time;
+		}
+	}
+
+	oldest->iClaimed = true;
+	oldest->iOwner = thread;
+
+	return (*oldest);
+}
+
+// OhmTrace
+
+void OhmTrace::SetEnabled(TBool aValue)
+{
+	AutoMutex mutex(OhmTraceMutex());
+
+	if (aValue && gOhmTraceRings[0] == 0) {
+		for (TUint i = 0; i < kMaxRings; i++) {
+			gOhmTraceRings[i] = new OhmTraceRing(i + 1);
+		}
+	}
+
+	gOhmTraceEnabled = aValue;
+}
+
+TBool OhmTrace::Enabled()
+{
+	return (gOhmTraceEnabled);
+}
+
+void OhmTrace::Record(EOhmTraceEvent aEvent, TUint aFrame)
+{
+	if (!gOhmTraceEnabled) {
+		return;
+	}
+
+	OhmTraceRingCurrent().Record(TimeInUs(), aEvent, aFrame);
+}
+
+TUint64 OhmTrace::TimeInUs()
+{
+	return ((TUint64)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+const TChar* OhmTrace::EventName(EOhmTraceEvent aEvent)
+{
+	switch (aEvent)
+	{
+	case eOhmTraceRx:
+		return ("rx");
+	case eOhmTraceDuplicate:
+		return ("duplicate");
+	case eOhmTraceGap:
+		return ("gap");
+	case eOhmTraceResendRequested:
+		return ("resend-requested");
+	case eOhmTraceResendReceived:
+		return ("resend-received");
+	case eOhmTraceRepaired:
+		return ("repaired");
+	case eOhmTraceDelivered:
+		return ("delivered");
+	case eOhmTraceDropped:
+		return ("dropped");
+	case eOhmTraceResendSent:
+		return ("resend-sent");
+	}
+
+	return ("unknown");
+}
+
+TUint OhmTrace::WriteChromeJson(FILE* aFile, TUint aSeconds)
+{
+	TUint64 now = TimeInUs();
+	TUint64 window = (TUint64)aSeconds * 1000000;
+	TUint64 since = (now > window) ? now - window : 0;
+
+	fprintf(aFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	TBool first = true;
+	TUint count = 0;
+
+	OhmTraceMutex().Wait();
+	TBool created = (gOhmTraceRings[0] != 0);
+	OhmTraceMutex().Signal();
+
+	if (created) {
+		OhmTraceEntry* copy = new OhmTraceEntry[kMaxRingEvents];
+
+		for (TUint i = 0; i < kMaxRings; i++) {
+			count += gOhmTraceRings[i]->WriteChromeJson(aFile, since, first, copy);
+		}
+
+		delete[] copy;
+	}
+
+	fprintf(aFile, "\n]}\n");
+
+	return (count);
+}
+
@@ -0,0 +1,50 @@
+#ifndef HEADER_OHM_TRACE
+#define HEADER_OHM_TRACE
+
+#include <OpenHome/OhNetTypes.h>
+
+#include <stdio.h>
+
+namespace OpenHome {
+namespace Av {
+
+enum EOhmTraceEvent
+{
+	eOhmTraceRx,
+	eOhmTraceDuplicate,
+	eOhmTraceGap,
+	eOhmTraceResendRequested,
+	eOhmTraceResendReceived,
+	eOhmTraceRepaired,
+	eOhmTraceDelivered,
+	eOhmTraceDropped,
+	eOhmTraceResendSent,
+};
+
+// OhmTrace records frame lifecycle events into a binary ring per recording thread
+// SetEnabled(true) creates the rings, once the library is initialised, so recording does no
+// allocation. A thread claims a free ring with its first event, or the ring least recently
+// recorded into once all are claimed. Recording takes only its ring's mutex, which is otherwise
+// taken just to dump the ring or hand it to another thread, so it is cheap enough to leave enabled.
+// WriteChromeJson dumps the last N seconds of all rings in Chrome trace event format
+// (load the file in chrome://tracing or ui.perfetto.dev)
+
+class OhmTrace
+{
+public:
+	static const TUint kMaxRings = 8;
+	static const TUint kMaxRingEvents = 16 * 1024;
+
+	static void SetEnabled(TBool aValue); // disabled until first enabled
+	static TBool Enabled();
+	static void Record(EOhmTraceEvent aEvent, TUint aFrame);
+	static TUint64 TimeInUs(); // monotonic
+	static const TChar* EventName(EOhmTraceEvent aEvent);
+	static TUint WriteChromeJson(FILE* aFile, TUint aSeconds); // returns number of events written
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+#endif // HEADER_OHM_TRACE
+
@@ -0,0 +1,689 @@
+#include "OhmUring.h"
+
+#ifdef OHM_IO_URING
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+using namespace OpenHome;
+using namespace OpenHome::Av;
+
+// liburing is not assumed, so the rings are set up and entered with the system calls directly
+
+static TInt UringSetup(TUint aEntries, struct io_uring_params* aParams)
+{
+    return ((TInt)syscall(__NR_io_uring_setup, aEntries, aParams));
+}
+
+static TInt UringEnter(TInt aFd, TUint aSubmit, TUint aWaitFor, TUint aFlags)
+{
+    return ((TInt)syscall(__NR_io_uring_enter, aFd, aSubmit, aWaitFor, aFlags, 0, 0));
+}
+
+static TInt UringRegister(TInt aFd, TUint aOpcode, void* aArg, TUint aArgs)
+{
+    return ((TInt)syscall(__NR_io_uring_register, aFd, aOpcode, aArg, aArgs));
+}
+
+// OhmUring
+
+OhmUring::OhmUring(TUint aEntries)
+    : iSqRing(MAP_FAILED)
+    , iCqRing(MAP_FAILED)
+    , iSqes((struct io_uring_sqe*)MAP_FAILED)
+    , iSqTailLocal(0)
+    , iPending(0)
+{
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+
+    iFd = UringSetup(aEntries, &params);
+
+    if (iFd < 0) {
+        THROW(NetworkError);
+    }
+
+    iEntries = params.sq_entries;
+    iSqRingBytes = params.sq_off.array + params.sq_entries * sizeof(TUint);
+    iCqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    iSqesBytes = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (iCqRingBytes > iSqRingBytes) {
+            iSqRingBytes = iCqRingBytes;
+        }
+        iCqRingBytes = iSqRingBytes;
+    }
+
+    iSqRing = mmap(0, iSqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, iFd, IORING_OFF_SQ_RING);
+
+    if (iSqRing != MAP_FAILED) {
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            iCqRing = iSqRing;
+        }
+        else {
+            iCqRing = mmap(0, iCqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, iFd, IORING_OFF_CQ_RING);
+        }
+        iSqes = (struct io_uring_sqe*)mmap(0, iSqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, iFd, IORING_OFF_SQES);
+    }
+
+    if (iSqRing == MAP_FAILED || iCqRing == MAP_FAILED || iSqes == MAP_FAILED) {
+        Unmap();
+        close(iFd);
+        THROW(NetworkError);
+    }
+
+    TByte* sq = (TByte*)iSqRing;
+    TByte* cq = (TByte*)iCqRing;
+
+    iSqHead = (TUint*)(sq + params.sq_off.head);
+    iSqTail = (TUint*)(sq + params.sq_off.tail);
+    iSqMask = (TUint*)(sq + params.sq_off.ring_mask);
+    iSqArray = (TUint*)(sq + params.sq_off.array);
+    iCqHead = (TUint*)(cq + params.cq_off.head);
+    iCqTail = (TUint*)(cq + params.cq_off.tail);
+    iCqMask = (TUint*)(cq + params.cq_off.ring_mask);
+    iCqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    iSqTailLocal = *iSqTail;
+}
+
+TInt OhmUring::Handle() const
+{
+    return (iFd);
+}
+
+struct io_uring_sqe* OhmUring::Sqe()
+{
+    TUint head = __atomic_load_n(iSqHead, __ATOMIC_ACQUIRE);
+
+    if (iSqTailLocal - head >= iEntries) {
+        return (0);
+    }
+
+    TUint index = iSqTailLocal & *iSqMask;
+
+    struct io_uring_sqe* sqe = &iSqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+
+    iSqArray[index] = index;
+    iSqTailLocal++;
+    iPending++;
+
+    return (sqe);
+}
+
+// Returns after one successful call, which may be short of the completions asked for if a signal
+// interrupted the wait, so callers take completions with Cqe() until they have what they expect
+
+void OhmUring::Enter(TUint aWaitFor)
+{
+    __atomic_store_n(iSqTail, iSqTailLocal, __ATOMIC_RELEASE);
+
+    for (;;) {
+        TInt submitted = UringEnter(iFd, iPending, aWaitFor, (aWaitFor > 0) ? IORING_ENTER_GETEVENTS : 0);
+
+        if (submitted >= 0) {
+            iPending -= submitted;
+            return;
+        }
+
+        if (errno != EINTR) {
+            THROW(NetworkError);
+        }
+    }
+}
+
+TBool OhmUring::Cqe(struct io_uring_cqe& aCqe)
+{
+    TUint head = *iCqHead;
+
+    if (head == __atomic_load_n(iCqTail, __ATOMIC_ACQUIRE)) {
+        return (false);
+    }
+
+    aCqe = iCqes[head & *iCqMask];
+
+    __atomic_store_n(iCqHead, head + 1, __ATOMIC_RELEASE);
+
+    return (true);
+}
+
+void OhmUring::Unmap()
+{
+    if (iSqes != MAP_FAILED) {
+        munmap(iSqes, iSqesBytes);
+    }
+    if (iCqRing != MAP_FAILED && iCqRing != iSqRing) {
+        munmap(iCqRing, iCqRingBytes);
+    }
+    if (iSqRing != MAP_FAILED) {
+        munmap(iSqRing, iSqRingBytes);
+    }
+}
+
+OhmUring::~OhmUring()
+{
+    Unmap();
+    close(iFd);
+}
+
+// OhmUringSocketUdpBase
+
+OhmUringSocketUdpBase::OhmUringSocketUdpBase()
+    : iFd(-1)
+    , iTxMutex("OHMT")
+    , iTxRing(0)
+    , iTxBuffer(0)
+    , iTxQueued(0)
+    , iTxBatch(0)
+{
+    iFd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+    if (iFd < 0) {
+        THROW(NetworkError);
+    }
+}
+
+TInt OhmUringSocketUdpBase::Handle() const
+{
+    return (iFd);
+}
+
+void OhmUringSocketUdpBase::SetOption(TInt aLevel, TInt aName, TInt aValue)
+{
+    if (setsockopt(iFd, aLevel, aName, &aValue, sizeof(aValue)) < 0) {
+        THROW(NetworkError);
+    }
+}
+
+void OhmUringSocketUdpBase::SetTtl(TUint aValue)
+{
+    SetOption(IPPROTO_IP, IP_TTL, aValue);
+    SetOption(IPPROTO_IP, IP_MULTICAST_TTL, aValue);
+}
+
+void OhmUringSocketUdpBase::SetRecvBufBytes(TUint aBytes)
+{
+    SetOption(SOL_SOCKET, SO_RCVBUF, aBytes);
+}
+
+void OhmUringSocketUdpBase::SetSendBufBytes(TUint aBytes)
+{
+    SetOption(SOL_SOCKET, SO_SNDBUF, aBytes);
+}
+
+TUint OhmUringSocketUdpBase::Port() const
+{
+    struct sockaddr_in address;
+    socklen_t bytes = sizeof(address);
+
+    if (getsockname(iFd, (struct sockaddr*)&address, &bytes) < 0) {
+        THROW(NetworkError);
+    }
+
+    return (ntohs(address.sin_port));
+}
+
+// Each send is copied into a slot of its own, which stays untouched until its completion is taken.
+// Outside a batch a send is submitted and completed at once, so errors are thrown as before.
+
+void OhmUringSocketUdpBase::Send(const Brx& aBuffer, const Endpoint& aEndpoint)
+{
+    ASSERT(aBuffer.Bytes() <= kMaxDatagramBytes);
+
+    AutoMutex mutex(iTxMutex);
+
+    if (iTxBuffer == 0) {
+        iTxBuffer = new TByte[kMaxTxSlots * kMaxDatagramBytes];
+    }
+
+    if (iTxRing == 0) {
+        iTxRing = new OhmUring(kMaxTxSlots);
+    }
+
+    if (iTxQueued == kMaxTxSlots) { // a batch holds as many sends as there are slots
+        FlushLocked();
+    }
+
+    TUint slot = iTxQueued;
+    TByte* ptr = iTxBuffer + slot * kMaxDatagramBytes;
+
+    memcpy(ptr, aBuffer.Ptr(), aBuffer.Bytes());
+
+    struct sockaddr_in& address = iTxAddress[slot];
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(aEndpoint.Port());
+    address.sin_addr.s_addr = aEndpoint.Address();
+
+    iTxVector[slot].iov_base = ptr;
+    iTxVector[slot].iov_len = aBuffer.Bytes();
+
+    struct msghdr& msg = iTxMsg[slot];
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &address;
+    msg.msg_namelen = sizeof(address);
+    msg.msg_iov = &iTxVector[slot];
+    msg.msg_iovlen = 1;
+
+    struct io_uring_sqe* sqe = iTxRing->Sqe();
+
+    ASSERT(sqe);
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = iFd;
+    sqe->addr = (TUint64)(uintptr_t)&msg;
+    sqe->len = 1;
+    sqe->user_data = slot;
+
+    iTxQueued++;
+
+    if (iTxBatch == 0) {
+        if (!FlushLocked()) {
+            THROW(NetworkError);
+        }
+    }
+}
+
+TBool OhmUringSocketUdpBase::FlushLocked()
+{
+    TUint failed = 0;
+
+    try {
+        iTxRing->Enter(iTxQueued);
+
+        struct io_uring_cqe cqe;
+        TUint completed = 0;
+
+        while (completed < iTxQueued) {
+            if (iTxRing->Cqe(cqe)) {
+                if (cqe.res < 0) {
+                    failed++;
+                }
+                completed++;
+            }
+            else {
+                iTxRing->Enter(iTxQueued - completed);
+            }
+        }
+    }
+    catch (NetworkError&) {
+        delete (iTxRing); // abandons whatever was submitted; a new ring is made by the next send
+        iTxRing = 0;
+        failed++;
+    }
+
+    iTxQueued = 0;
+
+    return (failed == 0);
+}
+
+// Sends on a socket share its lock, so another thread's sends made during a batch join the batch
+
+void OhmUringSocketUdpBase::BeginBatch()
+{
+    AutoMutex mutex(iTxMutex);
+    iTxBatch++;
+}
+
+void OhmUringSocketUdpBase::EndBatch()
+{
+    AutoMutex mutex(iTxMutex);
+
+    ASSERT(iTxBatch > 0);
+
+    if (--iTxBatch == 0 && iTxQueued > 0) {
+        FlushLocked();
+    }
+}
+
+OhmUringSocketUdpBase::~OhmUringSocketUdpBase()
+{
+    delete (iTxRing);
+    delete [] iTxBuffer;
+    close(iFd);
+}
+
+// OhmUringSocketUdp
+
+OhmUringSocketUdp::OhmUringSocketUdp(Environment& /* aEnv */)
+{
+    Bind(0, 0);
+}
+
+OhmUringSocketUdp::OhmUringSocketUdp(Environment& /* aEnv */, TUint aPort, TIpAddress aInterface)
+{
+    Bind(aPort, aInterface);
+}
+
+void OhmUringSocketUdp::Bind(TUint aPort, TIpAddress aInterface)
+{
+    struct sockaddr_in address;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(aPort);
+    address.sin_addr.s_addr = aInterface;
+
+    if (bind(iFd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        THROW(NetworkError);
+    }
+
+    if (aInterface != 0) { // multicast sent from here leaves through the interface it is bound to
+        struct in_addr multicastIf;
+        multicastIf.s_addr = aInterface;
+
+        if (setsockopt(iFd, IPPROTO_IP, IP_MULTICAST_IF, &multicastIf, sizeof(multicastIf)) < 0) {
+            THROW(NetworkError);
+        }
+    }
+}
+
+// OhmUringSocketUdpMulticast
+
+// Bound to the group rather than the wildcard address, and with IP_MULTICAST_ALL off, so only
+// datagrams for this group arrive however many groups other sockets in the process have joined
+
+OhmUringSocketUdpMulticast::OhmUringSocketUdpMulticast(Environment& /* aEnv */, TIpAddress aInterface, const Endpoint& aEndpoint)
+{
+    SetOption(SOL_SOCKET, SO_REUSEADDR, 1);
+    SetOption(IPPROTO_IP, IP_MULTICAST_ALL, 0);
+
+    struct sockaddr_in address;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(aEndpoint.Port());
+    address.sin_addr.s_addr = aEndpoint.Address();
+
+    if (bind(iFd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        THROW(NetworkError);
+    }
+
+    struct ip_mreq request;
+
+    request.imr_multiaddr.s_addr = aEndpoint.Address();
+    request.imr_interface.s_addr = aInterface;
+
+    if (setsockopt(iFd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) < 0) {
+        THROW(NetworkError);
+    }
+
+    struct in_addr multicastIf;
+    multicastIf.s_addr = aInterface;
+
+    if (setsockopt(iFd, IPPROTO_IP, IP_MULTICAST_IF, &multicastIf, sizeof(multicastIf)) < 0) {
+        THROW(NetworkError);
+    }
+}
+
+// OhmUringReader
+
+// Receives land in buffers the reader has handed to the kernel. With multishot, each buffer starts
+// with an io_uring_recvmsg_out header followed by the sender's address and then the datagram;
+// a single shot receive fills the buffer with the datagram alone and the address goes to iName.
+// Each datagram is copied out and its buffer handed straight back, so the kernel only runs out of
+// buffers if the reading thread falls behind, and then the socket's own buffer queues the rest.
+
+OhmUringReader::OhmUringReader(OhmUringSocketUdpBase& aSocket)
+    : iSocket(aSocket)
+    , iRing(0)
+    , iEventFd(-1)
+    , iBufferRing((struct io_uring_buf_ring*)MAP_FAILED)
+    , iBufferRingBytes(kBufferCount * sizeof(struct io_uring_buf))
+    , iBuffers(0)
+    , iMultishot(true)
+    , iArmed(false)
+    , iInterrupted(false)
+{
+    memset(&iMsg, 0, sizeof(iMsg));
+    memset(&iName, 0, sizeof(iName));
+    iMsg.msg_name = &iName;
+    iMsg.msg_namelen = sizeof(iName);
+
+    try {
+        iRing = new OhmUring(kRingEntries);
+
+        iEventFd = eventfd(0, EFD_CLOEXEC);
+
+        if (iEventFd < 0) {
+            THROW(NetworkError);
+        }
+
+        iBufferRing = (struct io_uring_buf_ring*)mmap(0, iBufferRingBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (iBufferRing == MAP_FAILED) {
+            THROW(NetworkError);
+        }
+
+        struct io_uring_buf_reg reg;
+
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = (TUint64)(uintptr_t)iBufferRing;
+        reg.ring_entries = kBufferCount;
+        reg.bgid = kBufferGroup;
+
+        if (UringRegister(iRing->Handle(), IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            THROW(NetworkError);
+        }
+
+        iBuffers = new TByte[kBufferCount * kBufferBytes];
+
+        for (TUint i = 0; i < kBufferCount; i++) {
+            Recycle(i);
+        }
+
+        struct io_uring_sqe* sqe = iRing->Sqe();
+
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = iEventFd;
+        sqe->poll32_events = POLLIN;
+        sqe->user_data = kUserDataInterrupt;
+
+        Arm();
+
+        iRing->Enter(0);
+    }
+    catch (NetworkError&) {
+        Close();
+        throw;
+    }
+}
+
+void OhmUringReader::Arm()
+{
+    struct io_uring_sqe* sqe = iRing->Sqe();
+
+    ASSERT(sqe);
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = iSocket.Handle();
+    sqe->addr = (TUint64)(uintptr_t)&iMsg;
+    sqe->len = 1;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    sqe->ioprio = iMultishot ? IORING_RECV_MULTISHOT : 0;
+    sqe->user_data = kUserDataReceive;
+
+    iArmed = true;
+}
+
+void OhmUringReader::Recycle(TUint aId)
+{
+    TUint16 tail = iBufferRing->tail;
+
+    // not iBufferRing->bufs, which C++ places after the empty struct of __DECLARE_FLEX_ARRAY
+
+    struct io_uring_buf* buf = (struct io_uring_buf*)iBufferRing + (tail & (kBufferCount - 1));
+
+    buf->addr = (TUint64)(uintptr_t)(iBuffers + aId * kBufferBytes);
+    buf->len = kBufferBytes;
+    buf->bid = (TUint16)aId;
+
+    __atomic_store_n(&iBufferRing->tail, (TUint16)(tail + 1), __ATOMIC_RELEASE);
+}
+
+Endpoint OhmUringReader::Sender() const
+{
+    return (iSender);
+}
+
+void OhmUringReader::Read(Bwx& aBuffer)
+{
+    for (;;) {
+        if (iInterrupted) {
+            THROW(ReaderError);
+        }
+
+        if (!iArmed) {
+            Arm();
+        }
+
+        struct io_uring_cqe cqe;
+
+        if (!iRing->Cqe(cqe)) {
+            try {
+                iRing->Enter(1);
+            }
+            catch (NetworkError&) {
+                THROW(ReaderError);
+            }
+            continue;
+        }
+
+        if (cqe.user_data == kUserDataInterrupt) {
+            iInterrupted = true;
+            continue;
+        }
+
+        if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+            iArmed = false; // rearmed on the next pass
+        }
+
+        if (cqe.res < 0) {
+            if (cqe.res == -EINVAL && iMultishot) {
+                iMultishot = false;
+                continue;
+            }
+            if (cqe.res == -ENOBUFS || cqe.res == -EINTR) {
+                continue;
+            }
+            THROW(ReaderError);
+        }
+
+        ASSERT(cqe.flags & IORING_CQE_F_BUFFER);
+
+        TUint id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        const TByte* buffer = iBuffers + id * kBufferBytes;
+        const TByte* payload = buffer;
+        const struct sockaddr_in* name = &iName;
+        TUint bytes = cqe.res;
+
+        if (iMultishot) {
+            const struct io_uring_recvmsg_out* out = (const struct io_uring_recvmsg_out*)buffer;
+            TUint offset = sizeof(*out) + iMsg.msg_namelen + iMsg.msg_controllen;
+
+            name = (const struct sockaddr_in*)(buffer + sizeof(*out));
+            payload = buffer + offset;
+            bytes = (out->payloadlen < bytes - offset) ? out->payloadlen : bytes - offset;
+        }
+
+        if (bytes > aBuffer.MaxBytes()) {
+            bytes = aBuffer.MaxBytes();
+        }
+
+        aBuffer.Replace(payload, bytes);
+
+        iSender.Replace(Endpoint(ntohs(name->sin_port), name->sin_addr.s_addr));
+
+        Recycle(id);
+
+        return;
+    }
+}
+
+void OhmUringReader::ReadFlush()
+{
+}
+
+void OhmUringReader::ReadInterrupt()
+{
+    TUint64 value = 1;
+
+    if (write(iEventFd, &value, sizeof(value)) < 0) {
+        ASSERTS();
+    }
+}
+
+// The kernel may still be writing to a buffer until the receive is cancelled
+
+void OhmUringReader::Cancel()
+{
+    if (!iArmed) {
+        return;
+    }
+
+    struct io_uring_sqe* sqe = iRing->Sqe();
+
+    if (sqe == 0) {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = kUserDataReceive;
+    sqe->user_data = kUserDataCancel;
+
+    TBool cancelled = false;
+
+    try {
+        while (iArmed || !cancelled) {
+            struct io_uring_cqe cqe;
+
+            if (!iRing->Cqe(cqe)) {
+                iRing->Enter(1);
+            }
+            else if (cqe.user_data == kUserDataCancel) {
+                cancelled = true;
+            }
+            else if (cqe.user_data == kUserDataReceive && (cqe.flags & IORING_CQE_F_MORE) == 0) {
+                iArmed = false;
+            }
+        }
+    }
+    catch (NetworkError&) {
+    }
+}
+
+void OhmUringReader::Close()
+{
+    if (iRing != 0) {
+        Cancel();
+        delete (iRing);
+        iRing = 0;
+    }
+    if (iBufferRing != MAP_FAILED) {
+        munmap(iBufferRing, iBufferRingBytes);
+    }
+    delete [] iBuffers;
+    if (iEventFd >= 0) {
+        close(iEventFd);
+    }
+}
+
+OhmUringReader::~OhmUringReader()
+{
+    Close();
+}
+
+#endif // OHM_IO_URING
@@ -0,0 +1,169 @@
+#ifndef HEADER_OHM_URING
+#define HEADER_OHM_URING
+
+// An io_uring backend for the Ohm and Ohz sockets, built on Linux with OHM_IO_URING defined
+//
+// The classes mirror SocketUdp, SocketUdpMulticast and UdpReader closely enough for OhmSocket.h
+// to select between them with typedefs, so the protocol code is the same for either backend.
+//
+// Each reader keeps a multishot receive armed against a ring of buffers provided to the kernel,
+// so a stream costs one system call per wakeup rather than one per datagram. Sends are queued on
+// a ring of their own, and sends made between BeginBatch() and EndBatch() are submitted together.
+
+#ifdef OHM_IO_URING
+
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Private/Stream.h>
+#include <OpenHome/Private/Network.h>
+#include <OpenHome/Private/Thread.h>
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace OpenHome {
+class Environment;
+namespace Av {
+
+// OhmUring is one submission and completion queue pair, used from one thread at a time
+
+class OhmUring : public INonCopyable
+{
+public:
+    OhmUring(TUint aEntries);
+    TInt Handle() const;
+    struct io_uring_sqe* Sqe(); // the next free submission entry, cleared; 0 if all in use
+    void Enter(TUint aWaitFor); // submit any new entries and wait for this many completions
+    TBool Cqe(struct io_uring_cqe& aCqe); // take the next completion, false if none
+    ~OhmUring();
+
+private:
+    void Unmap();
+
+private:
+    TInt iFd;
+    TUint iEntries;
+    void* iSqRing;
+    TUint iSqRingBytes;
+    void* iCqRing;
+    TUint iCqRingBytes;
+    struct io_uring_sqe* iSqes;
+    TUint iSqesBytes;
+    TUint* iSqHead;
+    TUint* iSqTail;
+    TUint* iSqMask;
+    TUint* iSqArray;
+    TUint* iCqHead;
+    TUint* iCqTail;
+    TUint* iCqMask;
+    struct io_uring_cqe* iCqes;
+    TUint iSqTailLocal;
+    TUint iPending;
+};
+
+class OhmUringSocketUdpBase : public INonCopyable
+{
+    static const TUint kMaxTxSlots = 16;
+
+public:
+    static const TUint kMaxDatagramBytes = 20 * 1024;
+
+public:
+    TInt Handle() const;
+    void SetTtl(TUint aValue);
+    void SetRecvBufBytes(TUint aBytes);
+    void SetSendBufBytes(TUint aBytes);
+    TUint Port() const;
+    void Send(const Brx& aBuffer, const Endpoint& aEndpoint);
+    void BeginBatch(); // hold back sends until the matching EndBatch()
+    void EndBatch(); // submit the sends held back together, ignoring any that fail
+    virtual ~OhmUringSocketUdpBase();
+
+protected:
+    OhmUringSocketUdpBase();
+    void SetOption(TInt aLevel, TInt aName, TInt aValue);
+
+private:
+    TBool FlushLocked();
+
+protected:
+    TInt iFd;
+
+private:
+    Mutex iTxMutex;
+    OhmUring* iTxRing; // [iTxMutex] created on first send, so sockets only read need none
+    TByte* iTxBuffer;
+    struct sockaddr_in iTxAddress[kMaxTxSlots];
+    struct iovec iTxVector[kMaxTxSlots];
+    struct msghdr iTxMsg[kMaxTxSlots];
+    TUint iTxQueued;
+    TUint iTxBatch;
+};
+
+class OhmUringSocketUdp : public OhmUringSocketUdpBase
+{
+public:
+    OhmUringSocketUdp(Environment& aEnv);
+    OhmUringSocketUdp(Environment& aEnv, TUint aPort, TIpAddress aInterface);
+
+private:
+    void Bind(TUint aPort, TIpAddress aInterface);
+};
+
+class OhmUringSocketUdpMulticast : public OhmUringSocketUdpBase
+{
+public:
+    OhmUringSocketUdpMulticast(Environment& aEnv, TIpAddress aInterface, const Endpoint& aEndpoint);
+};
+
+// OhmUringReader reads one datagram at a time, like UdpReader, so Srx can be layered on top
+
+class OhmUringReader : public IReaderSource, public INonCopyable
+{
+    static const TUint kBufferCount = 32; // a power of two
+    static const TUint kRingEntries = kBufferCount; // completions for every buffer without overflow
+    static const TUint kBufferBytes = sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + OhmUringSocketUdpBase::kMaxDatagramBytes;
+    static const TUint kBufferGroup = 0;
+    static const TUint64 kUserDataReceive = 1;
+    static const TUint64 kUserDataInterrupt = 2;
+    static const TUint64 kUserDataCancel = 3;
+
+public:
+    OhmUringReader(OhmUringSocketUdpBase& aSocket);
+    Endpoint Sender() const; // of the last datagram read
+    ~OhmUringReader();
+
+    // IReaderSource
+    virtual void Read(Bwx& aBuffer);
+    virtual void ReadFlush();
+    virtual void ReadInterrupt(); // every read after this throws ReaderError
+
+private:
+    void Arm();
+    void Recycle(TUint aId);
+    void Cancel();
+    void Close();
+
+private:
+    OhmUringSocketUdpBase& iSocket;
+    OhmUring* iRing;
+    TInt iEventFd;
+    struct io_uring_buf_ring* iBufferRing;
+    TUint iBufferRingBytes;
+    TByte* iBuffers;
+    struct msghdr iMsg;
+    struct sockaddr_in iName;
+    TBool iMultishot; // kernels before 6.0 take single shot receives only
+    TBool iArmed;
+    TBool iInterrupted;
+    Endpoint iSender;
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+#endif // OHM_IO_URING
+
+#endif // HEADER_OHM_URING
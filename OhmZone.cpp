@@ -0,0 +1,90 @@
+#include "OhmZone.h"
+#include <OpenHome/Private/Env.h>
+
+using namespace OpenHome;
+using namespace OpenHome::Av;
+
+// OhzZoneCache
+
+OhzZoneCache::OhzZoneCache()
+	: iCount(0)
+	, iClock(0)
+{
+}
+
+void OhzZoneCache::Set(const Brx& aZone, const Brx& aUri)
+{
+	if (aZone.Bytes() > kMaxZoneBytes || aUri.Bytes() > Ohm::kMaxUriBytes) {
+		return;
+	}
+
+	TUint index = 0;
+
+	while (index < iCount && iZone[index] != aZone) {
+		index++;
+	}
+
+	if (index == kMaxZones) {
+		index = 0;
+
+		for (TUint i = 1; i < iCount; i++) {
+			if (iAge[i] < iAge[index]) {
+				index = i;
+			}
+		}
+	}
+	else if (index == iCount) {
+		iCount++;
+	}
+
+	iZone[index].Replace(aZone);
+	iUri[index].Replace(aUri);
+	iAge[index] = ++iClock;
+}
+
+TBool OhzZoneCache::Find(const Brx& aZone, Bwx& aUri) const
+{
+	for (TUint i = 0; i < iCount; i++) {
+		if (iZone[i] == aZone) {
+			aUri.Replace(iUri[i]);
+			return (true);
+		}
+	}
+
+	return (false);
+}
+
+void OhzZoneCache::Clear()
+{
+	iCount = 0;
+}
+
+// OhzQueryBackoff
+
+OhzQueryBackoff::OhzQueryBackoff(Environment& aEnv)
+	: iEnv(aEnv)
+	, iDelayMs(kInitialDelayMs)
+{
+}
+
+TUint OhzQueryBackoff::Start(TBool aCached)
+{
+	iDelayMs = kInitialDelayMs;
+
+	if (aCached) {
+		return (iEnv.Random(kVerifyDelayMs, kVerifyDelayMs >> 2));
+	}
+
+	return (iEnv.Random(kJitterMs));
+}
+
+TUint OhzQueryBackoff::Queried()
+{
+	TUint delay = iEnv.Random(iDelayMs, iDelayMs >> 1);
+
+	if (iDelayMs < kMaxDelayMs) {
+		iDelayMs <<= 1;
+	}
+
+	return (delay);
+}
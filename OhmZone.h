@@ -0,0 +1,66 @@
+#ifndef HEADER_OHM_ZONE
+#define HEADER_OHM_ZONE
+
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Buffer.h>
+
+#include "Ohm.h"
+
+namespace OpenHome {
+class Environment;
+namespace Av {
+
+// OhzZoneCache remembers the uri last announced for each zone, whichever receiver asked for it
+// Receivers learn from every ZoneUri they overhear, so a zone played before (or announced to a neighbour)
+// can be played without waiting for an answer. The least recently announced zone is forgotten when full.
+
+class OhzZoneCache
+{
+public:
+    static const TUint kMaxZones = 16;
+    static const TUint kMaxZoneBytes = 100;
+
+public:
+    OhzZoneCache();
+
+    void Set(const Brx& aZone, const Brx& aUri);
+    TBool Find(const Brx& aZone, Bwx& aUri) const;
+    void Clear();
+
+private:
+    Bws<kMaxZoneBytes> iZone[kMaxZones];
+    Bws<Ohm::kMaxUriBytes> iUri[kMaxZones];
+    TUint iAge[kMaxZones];
+    TUint iCount;
+    TUint iClock;
+};
+
+// OhzQueryBackoff decides when a receiver next asks for the uri of its zone
+// The first query is jittered so receivers started together (power restore) do not ask together, and the
+// interval doubles after each query up to kMaxDelayMs. A query for the same zone overheard from another
+// receiver counts as one of our own: its answer reaches every receiver listening on the zone group.
+// With a cached uri the query only verifies it, so it is spread over kVerifyDelayMs.
+
+class OhzQueryBackoff
+{
+public:
+    static const TUint kInitialDelayMs = 100;
+    static const TUint kMaxDelayMs = 3200;
+    static const TUint kJitterMs = 20;
+    static const TUint kVerifyDelayMs = 1000;
+
+public:
+    OhzQueryBackoff(Environment& aEnv);
+
+    TUint Start(TBool aCached); // delay before the first query
+    TUint Queried();            // delay before the next query, after this receiver or another asked
+
+private:
+    Environment& iEnv;
+    TUint iDelayMs;
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+#endif // HEADER_OHM_ZONE
@@ -0,0 +1,274 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/Env.h>
+
+#include "../OhmPacer.h"
+#include "../OhmRealtime.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+# include <sys/resource.h>
+#endif
+
+#ifdef _WIN32
+#define CDECL __cdecl
+#else
+#define CDECL
+#endif
+
+// Measures what the scheduling and memory locking of OhmRealtime do for an audio thread on a
+// loaded machine
+//
+// An OhmPacer thread in the send role wakes once a period, as a sender's audio thread does, and
+// each time builds a frame into the next part of a pool the size of a sender's history, as
+// OhmSenderDriver does into its messages. Meanwhile time-shared threads spin over memory of their
+// own to load every CPU. The run is made twice: with the send role left time shared and the pool
+// touched for the first time as frames land in it, and with the role given a SCHED_FIFO priority
+// (and CPUs, if set) and memory locked, so the pool is resident before the first frame. Reported
+// are percentiles of how far each wake strayed from the period, of the time each frame took to
+// build, and the page faults the audio thread took. Scheduling and locking need root or
+// CAP_SYS_NICE and CAP_IPC_LOCK, and only take effect on Linux.
+
+namespace OpenHome {
+namespace Av {
+
+static const TUint kFrameBytes = 960;
+static const TUint kPoolFrames = 100;
+static const TUint kFrameStrideBytes = 9 * 1024; // as an OhmMsgAudio, so a frame lands on pages of its own
+
+static TUint64 ThreadMinorFaults()
+{
+#ifdef __linux__
+	struct rusage usage;
+	if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+		return ((TUint64)usage.ru_minflt);
+	}
+#endif
+	return (0);
+}
+
+class LoadThread
+{
+	static const TUint kBytes = 4 * 1024 * 1024; // well past the caches
+
+public:
+	LoadThread(const TChar* aName)
+		: iStop(false)
+		, iMemory(kBytes, 1)
+	{
+		iThread = new ThreadFunctor(aName, MakeFunctor(*this, &LoadThread::Run), kPriorityNormal);
+		iThread->Start();
+	}
+
+	~LoadThread()
+	{
+		iStop = true;
+		delete (iThread);
+	}
+
+private:
+	void Run()
+	{
+		TUint index = 0;
+
+		while (!iStop) {
+			iMemory[index] = (TByte)(iMemory[index] + iMemory[(index + kBytes / 2) % kBytes]);
+			index = (index + 64) % kBytes;
+		}
+	}
+
+private:
+	std::atomic<TBool> iStop;
+	std::vector<TByte> iMemory;
+	ThreadFunctor* iThread;
+};
+
+class AudioProbe : public IOhmPacerHandler
+{
+public:
+	AudioProbe(TUint aPeriodUs, TUint aFrames)
+		: iPeriodNs((TUint64)aPeriodUs * 1000)
+		, iFrames(aFrames)
+		, iPool(0)
+		, iPrevious(0)
+		, iFaults(0)
+		, iDone("RTBD", 0)
+	{
+		iJitter.reserve(aFrames);
+		iWork.reserve(aFrames);
+		memset(iFrame, 0x55, sizeof(iFrame));
+	}
+
+	void Run()
+	{
+		iPool = new TByte[kPoolFrames * kFrameStrideBytes]; // untouched until a frame lands, unless locked
+
+		OhmRealtime::Prefault(iPool, kPoolFrames * kFrameStrideBytes);
+
+		iJitter.clear();
+		iWork.clear();
+		iPrevious = 0;
+		iFaults = 0;
+
+		OhmPacer pacer("RTBP", *this, kPriorityNormal);
+		pacer.SetRole(eOhmThreadSend);
+		pacer.SetPeriod(iPeriodNs / 1000, 1000000);
+		pacer.Start();
+
+		iDone.Wait();
+
+		pacer.Stop();
+
+		delete[] (iPool);
+	}
+
+	void Print(const TChar* aName)
+	{
+		std::sort(iJitter.begin(), iJitter.end());
+		std::sort(iWork.begin(), iWork.end());
+
+		printf("%-10s %-8s %8llu %8llu %8llu %8llu\n", aName, "jitter", Percentile(iJitter, 500), Percentile(iJitter, 990), Percentile(iJitter, 999), Percentile(iJitter, 1000));
+		printf("%-10s %-8s %8llu %8llu %8llu %8llu   %llu faults\n", "", "build", Percentile(iWork, 500), Percentile(iWork, 990), Percentile(iWork, 999), Percentile(iWork, 1000), (unsigned long long)iFaults);
+	}
+
+private:
+	static unsigned long long Percentile(const std::vector<TUint64>& aSorted, TUint aPerMille) // in us
+	{
+		if (aSorted.size() == 0) {
+			return (0);
+		}
+
+		TUint index = (TUint)((aSorted.size() - 1) * aPerMille / 1000);
+
+		return ((unsigned long long)(aSorted[index] / 1000));
+	}
+
+	// IOhmPacerHandler
+
+	virtual void Pace()
+	{
+		TUint64 now = OhmPacer::TimeInNs();
+
+		if (iJitter.size() == iFrames) {
+			return; // the run is over; waiting to be stopped
+		}
+
+		if (iPrevious == 0) {
+			iFaultsStart = ThreadMinorFaults();
+		}
+		else {
+			TUint64 interval = now - iPrevious;
+			iJitter.push_back((interval > iPeriodNs) ? interval - iPeriodNs : iPeriodNs - interval);
+		}
+
+		iPrevious = now;
+
+		TByte* frame = iPool + (iWork.size() % kPoolFrames) * kFrameStrideBytes;
+
+		memcpy(frame, iFrame, kFrameBytes);
+
+		iWork.push_back(OhmPacer::TimeInNs() - now);
+
+		if (iJitter.size() == iFrames) {
+			iFaults = ThreadMinorFaults() - iFaultsStart;
+			iDone.Signal();
+		}
+	}
+
+private:
+	TUint64 iPeriodNs;
+	TUint iFrames;
+	TByte* iPool;
+	TUint64 iPrevious;
+	TUint64 iFaultsStart;
+	TUint64 iFaults;
+	Semaphore iDone;
+	std::vector<TUint64> iJitter;
+	std::vector<TUint64> iWork;
+	TByte iFrame[kFrameBytes];
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+	InitialisationParams* initParams = InitialisationParams::Create();
+
+    OptionParser parser;
+    OptionUint optionPriority("-P", "--fifo-priority", 80, "SCHED_FIFO priority of the send role in the realtime run");
+    OptionUint optionCpus("-C", "--cpus", 0, "Mask of the cpus the send role runs on in the realtime run, 0 for any");
+    OptionUint optionLoad("-l", "--load", 4, "Number of time-shared threads loading the cpus");
+    OptionUint optionPeriod("-p", "--period", 1000, "Period of the audio thread in us");
+    OptionUint optionFrames("-f", "--frames", 10000, "Number of periods measured in each run");
+    parser.AddOption(&optionPriority);
+    parser.AddOption(&optionCpus);
+    parser.AddOption(&optionLoad);
+    parser.AddOption(&optionPeriod);
+    parser.AddOption(&optionFrames);
+    if (!parser.Parse(aArgc, aArgv)) {
+        return (1);
+    }
+
+    Library* lib = new Library(initParams);
+
+	TUint period = optionPeriod.Value();
+	TUint frames = optionFrames.Value();
+
+	if (period == 0) {
+		period = 1;
+	}
+
+	if (frames == 0) {
+		frames = 1;
+	}
+
+	printf("%d load threads, %d periods of %d us\n\n", optionLoad.Value(), frames, period);
+
+	std::vector<LoadThread*> load;
+
+	for (TUint i = 0; i < optionLoad.Value(); i++) {
+		load.push_back(new LoadThread("RTBL"));
+	}
+
+	AudioProbe probe(period, frames);
+
+	printf("%-10s %-8s %8s %8s %8s %8s\n", "run", "us", "p50", "p99", "p99.9", "max");
+
+	probe.Run();
+	probe.Print("normal");
+
+	OhmRealtime::SetRole(eOhmThreadSend, optionPriority.Value(), optionCpus.Value());
+
+	TBool locked = OhmRealtime::SetLockMemory(true);
+
+	probe.Run();
+	probe.Print("realtime");
+
+	OhmRealtime::SetLockMemory(false);
+
+	if (!locked || OhmRealtime::Refusals() > 0) {
+		printf("\nscheduling or locking was refused (%d times); the realtime run was not realtime\n", OhmRealtime::Refusals());
+	}
+
+	for (TUint i = 0; i < load.size(); i++) {
+		delete (load[i]);
+	}
+
+	delete lib;
+
+	return (0);
+}
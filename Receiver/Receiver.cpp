@@ -3,13 +3,18 @@
 #include <OpenHome/Private/Thread.h>
 #include <OpenHome/Private/OptionParser.h>
 #include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/Env.h>
 #include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Os.h>
 #include "../Debug.h"
 
 #include <vector>
 #include <stdio.h>
 
 #include "../OhmReceiver.h"
+#include "../OhmTrace.h"
+#include "../OhmCapture.h"
+#include "../OhmRealtime.h"
 
 #ifdef _WIN32
 
@@ -53,10 +58,17 @@ using namespace OpenHome::TestFramework;
 using namespace OpenHome::Av;
 
 
+// Reports time to first audio: from Play until a latency's worth of audio has arrived, which is
+// when a player could start. A sender offering fast start (WavSender -F) sends most of it at once.
+// Also reports time to the first frame, which for a channel switch (keys z and x) is the switch time,
+// and any gap in the arrival of audio longer than a few frames, as when the sender is reconfigured.
+
 class OhmReceiverDriver : public IOhmReceiverDriver, public IOhmMsgProcessor
 {
+	static const TUint kGapFrames = 4;
+
 public:
-	OhmReceiverDriver();
+	OhmReceiverDriver(Environment& aEnv);
 
 private:
 	// IOhmReceiverDriver
@@ -74,16 +86,26 @@ private:
 	virtual void Process(OhmMsgMetatext& aMsg);
 
 private:
+	Environment& iEnv;
 	TBool iReset;
 	TUint iCount;
 	TUint iFrame;
+	TUint64 iStartedUs;
+	TBool iFirstAudio;
+	TUint64 iBufferedSamples;
+	TUint64 iAudioUs; // arrival of the last audio, 0 if none since started
 };
 
 
-OhmReceiverDriver::OhmReceiverDriver()
+OhmReceiverDriver::OhmReceiverDriver(Environment& aEnv)
+	: iEnv(aEnv)
 {
 	iReset = true;
 	iCount = 0;
+	iStartedUs = 0;
+	iFirstAudio = true;
+	iBufferedSamples = 0;
+	iAudioUs = 0;
 }
 
 void OhmReceiverDriver::Add(OhmMsg& aMsg)
@@ -98,6 +120,10 @@ void OhmReceiverDriver::Timestamp(OhmMsg& /*aMsg*/)
 
 void OhmReceiverDriver::Started()
 {
+	iStartedUs = OsTimeInUs(iEnv.OsCtx());
+	iFirstAudio = false;
+	iBufferedSamples = 0;
+	iAudioUs = 0;
 	printf("=== STARTED ====\n");
 }
 
@@ -109,7 +135,7 @@ void OhmReceiverDriver::Connected()
 
 void OhmReceiverDriver::Playing()
 {
-	printf("=== PLAYING ====\n");
+	printf("=== PLAYING after %d ms ====\n", (TUint)((OsTimeInUs(iEnv.OsCtx()) - iStartedUs) / 1000));
 }
 
 void OhmReceiverDriver::Disconnected()
@@ -124,6 +150,30 @@ void OhmReceiverDriver::Stopped()
 
 void OhmReceiverDriver::Process(OhmMsgAudio& aMsg)
 {
+	TUint64 now = OsTimeInUs(iEnv.OsCtx());
+
+	if (iAudioUs != 0 && aMsg.SampleRate() != 0) {
+		TUint64 frameUs = (TUint64)aMsg.Samples() * 1000000 / aMsg.SampleRate();
+
+		if (now - iAudioUs > frameUs * kGapFrames) {
+			printf("=== GAP of %d ms before frame %d ====\n", (TUint)((now - iAudioUs) / 1000), aMsg.Frame());
+		}
+	}
+
+	iAudioUs = now;
+
+	if (!iFirstAudio) {
+		TUint multiplier = ((aMsg.SampleRate() % 441) == 0) ? 44100 * 256 : 48000 * 256;
+		TUint latencyMs = (TUint)((TUint64)aMsg.MediaLatency() * 1000 / multiplier);
+
+		iBufferedSamples += aMsg.Samples();
+
+		if (iBufferedSamples * 1000 >= (TUint64)latencyMs * aMsg.SampleRate()) {
+			iFirstAudio = true;
+			printf("=== FIRST AUDIO after %d ms (latency %d ms) ====\n", (TUint)((now - iStartedUs) / 1000), latencyMs);
+		}
+	}
+
 	if (++iCount == 100) {
 		printf(".");
 		iCount = 0;
@@ -175,6 +225,27 @@ int CDECL main(int aArgc, char* aArgv[])
 
     OptionString optionUri("-u", "--uri", Brn("mpus://0.0.0.0:0"), "[uri] uri of the sender");
     parser.AddOption(&optionUri);
+
+    OptionString optionSwitch("-U", "--switch-uri", Brn(""), "[uri] uri of a second sender to switch to");
+    parser.AddOption(&optionSwitch);
+
+    OptionString optionTrace("-T", "--trace", Brn("ohmtrace.json"), "[file] file written by the trace dump key");
+    parser.AddOption(&optionTrace);
+
+    OptionUint optionTraceSeconds("-s", "--trace-seconds", 10, "[seconds] length of history written by the trace dump key");
+    parser.AddOption(&optionTraceSeconds);
+
+    OptionString optionCapture("-c", "--capture", Brn(""), "[file] record all received and sent datagrams to a capture file");
+    parser.AddOption(&optionCapture);
+
+    OptionUint optionFifoPriority("-P", "--fifo-priority", 0, "[1..99] SCHED_FIFO priority of the network receive thread, 0 for time shared");
+    parser.AddOption(&optionFifoPriority);
+
+    OptionUint optionCpus("-C", "--cpus", 0, "[mask] cpus the network receive thread runs on, 0 for any");
+    parser.AddOption(&optionCpus);
+
+    OptionBool optionLockMemory("-L", "--lock-memory", "[lock memory] lock all pages in RAM and pre-fault the message pools and buffers");
+    parser.AddOption(&optionLockMemory);
     
     if (!parser.Parse(aArgc, aArgv)) {
         return (1);
@@ -184,6 +255,8 @@ int CDECL main(int aArgc, char* aArgv[])
 
 	Library* lib = new Library(initParams);
 
+	OhmTrace::SetEnabled(true); // for the trace dump key
+
     std::vector<NetworkAdapter*>* subnetList = lib->CreateSubnetList();
     TIpAddress subnet = (*subnetList)[optionAdapter.Value()]->Subnet();
     TIpAddress adapter = (*subnetList)[optionAdapter.Value()]->Address();
@@ -193,15 +266,38 @@ int CDECL main(int aArgc, char* aArgv[])
 
     TUint ttl = optionTtl.Value();
 	Brhz uri(optionUri.Value());
+	Brhz uriSwitch(optionSwitch.Value());
+	TBool switched = false;
 
-	OhmReceiverDriver* driver = new OhmReceiverDriver();
+	// before the receiver, whose threads and pools it applies to
+
+	OhmRealtime::SetRole(eOhmThreadNetworkRx, optionFifoPriority.Value(), optionCpus.Value());
+
+	if (optionLockMemory.Value() && !OhmRealtime::SetLockMemory(true)) {
+		printf("Unable to lock memory\n");
+	}
+
+	OhmReceiverDriver* driver = new OhmReceiverDriver(lib->Env());
 
 	OhmReceiver* receiver = new OhmReceiver(lib->Env(), adapter, ttl, *driver);
 
+	OhmCaptureWriter* capture = 0;
+
+	if (optionCapture.Value().Bytes() > 0) {
+		try {
+			capture = new OhmCaptureWriter(lib->Env(), optionCapture.Value());
+			receiver->SetTap(capture);
+		}
+		catch (OhmCaptureError&) {
+			printf("Unable to create capture file\n");
+		}
+	}
+
     CpStack* cpStack = lib->StartCp(subnet);
     (void)cpStack; // avoid unused variable warning
 
-	printf("q = quit\n");
+	printf("q = quit, p = play, s = stop, d = dump trace\n");
+	printf("z = switch to the other sender, x = stop then play the other sender, k = kernel drops, r = realtime\n");
 	
 	Debug::SetLevel(Debug::kMedia);
 
@@ -220,10 +316,42 @@ int CDECL main(int aArgc, char* aArgv[])
 			printf("STOP\n");
 			receiver->Stop();
     	}
+		else if (key == 'k') {
+			printf("KERNEL DROPS %d\n", receiver->KernelDrops());
+		}
+		else if (key == 'r') {
+			OhmRealtime::PrintConfig();
+		}
+		else if ((key == 'z' || key == 'x') && uriSwitch.Bytes() > 0) {
+			switched = !switched;
+			const Brhz& next = switched ? uriSwitch : uri;
+			if (key == 'x') {
+				receiver->Stop();
+			}
+			printf("%s %s\n", key == 'z' ? "SWITCH" : "STOP AND PLAY", next.CString());
+			receiver->Play(next);
+		}
+		else if (key == 'd') {
+			Brhz file(optionTrace.Value());
+			FILE* trace = fopen(file.CString(), "w");
+			if (trace == 0) {
+				printf("Unable to open %s\n", file.CString());
+			}
+			else {
+				TUint events = OhmTrace::WriteChromeJson(trace, optionTraceSeconds.Value());
+				fclose(trace);
+				printf("TRACE %d events from the last %d seconds written to %s\n", events, optionTraceSeconds.Value(), file.CString());
+			}
+		}
     }
        
 	delete(receiver);
 
+	if (capture != 0) {
+		printf("CAPTURED %d datagrams\n", capture->Count());
+		delete (capture);
+	}
+
 	delete lib;
 
 	printf("\n");
@@ -0,0 +1,571 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Private/Fifo.h>
+#include <OpenHome/Os.h>
+
+#include "../OhmRepair.h"
+
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+#ifdef _WIN32
+#define CDECL __cdecl
+#else
+#define CDECL
+#endif
+
+// Times the receiver's repair of lost frames
+//
+// A stream of frames is lost at random at each loss rate given, each lost frame arriving again a
+// while later as if resent (and perhaps being lost again). The same arrivals are put through the
+// repair as OhmReceiver used to do it, with the frames held in a FifoLite that is rotated to insert
+// each late arrival, and as it does now, with OhmRepairWindow. As in OhmReceiver, the list of frames
+// missed is made every few frames while repairing. Each counts the frames it delivers out of order,
+// which should be none, and the frames it gives up on by resetting the repair.
+
+namespace OpenHome {
+namespace Av {
+
+class BenchFrame
+{
+public:
+	BenchFrame() : iFrame(0) {}
+	void Set(TUint aFrame) {iFrame = aFrame;}
+	TUint Frame() const {return (iFrame);}
+
+private:
+	TUint iFrame;
+};
+
+class BenchArrival
+{
+public:
+	BenchArrival(TUint aTick, TUint aFrame) : iTick(aTick), iFrame(aFrame) {}
+	TBool operator<(const BenchArrival& aOther) const {return (iTick < aOther.iTick);}
+	TUint Frame() const {return (iFrame);}
+
+private:
+	TUint iTick;
+	TUint iFrame;
+};
+
+class BenchRepair
+{
+public:
+	static const TUint kMaxMissedFrames = 20; // OhmReceiver::kMaxRepairMissedFrames
+
+public:
+	BenchRepair();
+	virtual void Process(BenchFrame& aFrame) = 0;
+	virtual TUint Missed(TUint* aFrames) = 0;
+	TBool Repairing() const {return (iRepairing);}
+	TUint Delivered() const {return (iDelivered);}
+	TUint Resets() const {return (iResets);}
+	TUint OutOfOrder() const {return (iOutOfOrder);}
+	TUint MaxHeld() const {return (iMaxHeld);}
+	virtual ~BenchRepair() {}
+
+protected:
+	void Deliver(BenchFrame& aFrame);
+	void Held(TUint aCount);
+
+protected:
+	TBool iStarted;
+	TBool iRepairing;
+	TUint iFrame;
+	TUint iDelivered;
+	TUint iResets;
+	TUint iOutOfOrder;
+	TUint iMaxHeld;
+	TUint iExpected;
+};
+
+// Repair as OhmReceiver did it before OhmRepairWindow
+
+class LegacyRepair : public BenchRepair
+{
+	static const TUint kMaxRepairBacklogFrames = 200;
+
+public:
+	LegacyRepair();
+	virtual void Process(BenchFrame& aFrame);
+	virtual TUint Missed(TUint* aFrames);
+
+private:
+	TBool Repair(BenchFrame& aFrame);
+	void Reset();
+
+private:
+	TUint iRepairLast;
+	BenchFrame* iRepairFirst;
+	FifoLite<BenchFrame*, kMaxRepairBacklogFrames> iFifoRepair;
+};
+
+// Repair as OhmReceiver does it now
+
+class WindowRepair : public BenchRepair
+{
+public:
+	WindowRepair();
+	virtual void Process(BenchFrame& aFrame);
+	virtual TUint Missed(TUint* aFrames);
+
+private:
+	TBool Repair(BenchFrame& aFrame);
+	void Reset();
+
+private:
+	OhmRepairWindow<BenchFrame> iWindow;
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+// BenchRepair
+
+BenchRepair::BenchRepair()
+	: iStarted(false)
+	, iRepairing(false)
+	, iFrame(0)
+	, iDelivered(0)
+	, iResets(0)
+	, iOutOfOrder(0)
+	, iMaxHeld(0)
+	, iExpected(0)
+{
+}
+
+void BenchRepair::Deliver(BenchFrame& aFrame)
+{
+	if (iDelivered > 0 && aFrame.Frame() != iExpected) {
+		iOutOfOrder++;
+	}
+	iExpected = aFrame.Frame() + 1;
+	iDelivered++;
+}
+
+void BenchRepair::Held(TUint aCount)
+{
+	if (aCount > iMaxHeld) {
+		iMaxHeld = aCount;
+	}
+}
+
+// LegacyRepair
+
+LegacyRepair::LegacyRepair()
+	: iRepairLast(0)
+	, iRepairFirst(0)
+{
+}
+
+void LegacyRepair::Process(BenchFrame& aFrame)
+{
+	if (!iStarted) {
+		iStarted = true;
+		iFrame = aFrame.Frame();
+		iExpected = iFrame;
+		Deliver(aFrame);
+		return;
+	}
+
+	if (iRepairing) {
+		iRepairing = Repair(aFrame);
+		return;
+	}
+
+	TInt diff = aFrame.Frame() - iFrame;
+
+	if (diff == 1) {
+		iFrame++;
+		Deliver(aFrame);
+	}
+	else if (diff > 1) {
+		iRepairFirst = &aFrame;
+		iRepairing = true;
+	}
+}
+
+TBool LegacyRepair::Repair(BenchFrame& aFrame)
+{
+	TUint frame = aFrame.Frame();
+	TInt diff = frame - iFrame;
+
+	if (diff == 1) {
+		iFrame++;
+		Deliver(aFrame);
+
+		while (iRepairFirst->Frame() == iFrame + 1) {
+			iFrame++;
+			Deliver(*iRepairFirst);
+			if (iFifoRepair.SlotsUsed() == 0) {
+				return (false);
+			}
+			iRepairFirst = iFifoRepair.Read();
+		}
+
+		return (true);
+	}
+
+	if (diff < 1) {
+		return (true);
+	}
+
+	diff = frame - iRepairFirst->Frame();
+
+	if (diff < 0) {
+		TUint count = iFifoRepair.SlotsUsed();
+
+		if (count == kMaxRepairBacklogFrames) {
+			Reset();
+			return (false);
+		}
+
+		iFifoRepair.Write(iRepairFirst);
+
+		if (count == 0) {
+			iRepairLast = iRepairFirst->Frame();
+		}
+
+		for (TUint i = 0; i < count; i++) {
+			iFifoRepair.Write(iFifoRepair.Read());
+		}
+
+		iRepairFirst = &aFrame;
+		Held(count + 2);
+		return (true);
+	}
+
+	if (diff == 0) {
+		return (true);
+	}
+
+	if (iFifoRepair.SlotsUsed() == 0) {
+		iFifoRepair.Write(&aFrame);
+		iRepairLast = frame;
+		Held(2);
+		return (true);
+	}
+
+	diff = frame - iRepairLast;
+
+	if (diff > 0) {
+		TUint count = iFifoRepair.SlotsUsed();
+
+		if (count == kMaxRepairBacklogFrames) {
+			Reset();
+			return (false);
+		}
+
+		iFifoRepair.Write(&aFrame);
+		iRepairLast = frame;
+		Held(count + 2);
+		return (true);
+	}
+
+	if (diff == 0) {
+		return (true);
+	}
+
+	TUint count = iFifoRepair.SlotsUsed();
+	TBool found = false;
+
+	for (TUint i = 0; i < count; i++) {
+		BenchFrame* msg = iFifoRepair.Read();
+
+		if (!found) {
+			diff = frame - msg->Frame();
+
+			if (diff < 0) {
+				if (count == kMaxRepairBacklogFrames) {
+					iFifoRepair.Write(&aFrame);
+					Reset();
+					return (false);
+				}
+
+				iFifoRepair.Write(&aFrame);
+				found = true;
+			}
+			else if (diff == 0) {
+				found = true;
+			}
+		}
+
+		iFifoRepair.Write(msg);
+	}
+
+	Held(iFifoRepair.SlotsUsed() + 1);
+
+	return (true);
+}
+
+void LegacyRepair::Reset()
+{
+	while (iFifoRepair.SlotsUsed() > 0) {
+		iFifoRepair.Read();
+	}
+	iStarted = false;
+	iResets++;
+}
+
+TUint LegacyRepair::Missed(TUint* aFrames)
+{
+	TUint count = 0;
+
+	TUint start = iFrame + 1;
+	TUint end = iRepairFirst->Frame();
+
+	for (TUint i = start; i < end; i++) {
+		aFrames[count] = i;
+		if (++count == kMaxMissedFrames) {
+			break;
+		}
+	}
+
+	if (count < kMaxMissedFrames) {
+		TUint slots = iFifoRepair.SlotsUsed();
+
+		for (TUint j = 0; j < slots; j++) {
+			BenchFrame* msg = iFifoRepair.Read();
+			if (count < kMaxMissedFrames) {
+				start = end + 1;
+				end = msg->Frame();
+				for (TUint i = start; i < end; i++) {
+					aFrames[count] = i;
+					if (++count == kMaxMissedFrames) {
+						break;
+					}
+				}
+			}
+			iFifoRepair.Write(msg);
+		}
+	}
+
+	return (count);
+}
+
+// WindowRepair
+
+WindowRepair::WindowRepair()
+{
+}
+
+void WindowRepair::Process(BenchFrame& aFrame)
+{
+	if (!iStarted) {
+		iStarted = true;
+		iFrame = aFrame.Frame();
+		iExpected = iFrame;
+		Deliver(aFrame);
+		return;
+	}
+
+	if (iRepairing) {
+		iRepairing = Repair(aFrame);
+		return;
+	}
+
+	TInt diff = aFrame.Frame() - iFrame;
+
+	if (diff == 1) {
+		iFrame++;
+		Deliver(aFrame);
+	}
+	else if (diff > 1) {
+		iWindow.Begin(iFrame + 1);
+		if (iWindow.Add(aFrame) == eOhmRepairBeyond) {
+			Reset();
+			return;
+		}
+		iRepairing = true;
+	}
+}
+
+TBool WindowRepair::Repair(BenchFrame& aFrame)
+{
+	TInt diff = aFrame.Frame() - iFrame;
+
+	if (diff < 1) {
+		return (true);
+	}
+
+	switch (iWindow.Add(aFrame)) {
+	case eOhmRepairAdded:
+		break;
+	case eOhmRepairDuplicate:
+		return (true);
+	case eOhmRepairBeyond:
+		Reset();
+		return (false);
+	}
+
+	Held(iWindow.Count());
+
+	BenchFrame* frame;
+
+	while ((frame = iWindow.Next()) != 0) {
+		iFrame++;
+		Deliver(*frame);
+	}
+
+	return (iWindow.Count() > 0);
+}
+
+void WindowRepair::Reset()
+{
+	while (iWindow.Remove() != 0) {
+	}
+	iStarted = false;
+	iResets++;
+}
+
+TUint WindowRepair::Missed(TUint* aFrames)
+{
+	return (iWindow.Missed(aFrames, kMaxMissedFrames));
+}
+
+// Lost frames arrive again aResendFrames later, give or take half that, so late arrivals overtake
+// each other as resends do. Resends come whether asked for or not, so every run sees the same.
+
+static void Schedule(Environment& aEnv, std::vector<BenchArrival>& aArrivals, TUint aFrames, TUint aLossPercent, TUint aResendFrames)
+{
+	for (TUint frame = 0; frame < aFrames; frame++) {
+		TUint tick = frame;
+
+		while (aEnv.Random(100) < aLossPercent) {
+			tick += aResendFrames / 2 + aEnv.Random(aResendFrames);
+		}
+
+		aArrivals.push_back(BenchArrival(tick, frame));
+	}
+
+	std::stable_sort(aArrivals.begin(), aArrivals.end());
+}
+
+static TUint64 Run(Environment& aEnv, BenchRepair& aRepair, std::vector<BenchFrame>& aFrames, const std::vector<BenchArrival>& aArrivals, TUint aTimerFrames, TUint& aRequested)
+{
+	TUint missed[BenchRepair::kMaxMissedFrames];
+	TUint requested = 0;
+
+	TUint64 start = OsTimeInUs(aEnv.OsCtx());
+
+	for (TUint i = 0; i < aArrivals.size(); i++) {
+		aRepair.Process(aFrames[aArrivals[i].Frame()]);
+
+		if (i % aTimerFrames == 0 && aRepair.Repairing()) {
+			requested += aRepair.Missed(missed);
+		}
+	}
+
+	TUint64 us = OsTimeInUs(aEnv.OsCtx()) - start;
+
+	aRequested = requested;
+
+	return (us);
+}
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+	InitialisationParams* initParams = InitialisationParams::Create();
+
+    OptionParser parser;
+    OptionUint optionFrames("-f", "--frames", 200000, "Number of frames in the stream");
+    OptionUint optionResend("-r", "--resend", 40, "Frames after a loss that the resent frame arrives, on average");
+    OptionUint optionTimer("-t", "--timer", 6, "Frames between lists of missed frames while repairing");
+    OptionUint optionLoss("-l", "--loss", 0, "Percentage of frames lost (default 1, 10 and 30 in turn)");
+    OptionUint optionRepeat("-n", "--repeat", 5, "Number of times each stream is repaired");
+    parser.AddOption(&optionFrames);
+    parser.AddOption(&optionResend);
+    parser.AddOption(&optionTimer);
+    parser.AddOption(&optionLoss);
+    parser.AddOption(&optionRepeat);
+    if (!parser.Parse(aArgc, aArgv)) {
+        return (1);
+    }
+
+    Library* lib = new Library(initParams);
+	Environment& env = lib->Env();
+
+	TUint frames = optionFrames.Value();
+	TUint resend = optionResend.Value();
+	TUint timer = optionTimer.Value();
+	TUint repeat = optionRepeat.Value();
+
+	if (frames == 0) {
+		frames = 1;
+	}
+
+	if (resend == 0) {
+		resend = 1;
+	}
+
+	if (timer == 0) {
+		timer = 1;
+	}
+
+	if (repeat == 0) {
+		repeat = 1;
+	}
+
+	std::vector<TUint> losses;
+
+	if (optionLoss.Value() == 0) {
+		losses.push_back(1);
+		losses.push_back(10);
+		losses.push_back(30);
+	}
+	else {
+		losses.push_back(optionLoss.Value() > 90 ? 90 : optionLoss.Value());
+	}
+
+	std::vector<BenchFrame> pool(frames);
+
+	for (TUint i = 0; i < frames; i++) {
+		pool[i].Set(i);
+	}
+
+	printf("%d frames, resent %d frames later on average, missed list every %d frames\n\n", frames, resend, timer);
+	printf("%5s %-7s %10s %8s %7s %8s %10s %12s\n", "loss", "repair", "delivered", "resets", "order", "held", "requested", "ns/frame");
+
+	for (TUint l = 0; l < losses.size(); l++) {
+		std::vector<BenchArrival> arrivals;
+		Schedule(env, arrivals, frames, losses[l], resend);
+
+		TUint64 legacyUs = 0;
+		TUint64 windowUs = 0;
+		TUint legacyRequested = 0;
+		TUint windowRequested = 0;
+		LegacyRepair* legacy = 0;
+		WindowRepair* window = 0;
+
+		for (TUint i = 0; i < repeat; i++) {
+			delete (legacy);
+			delete (window);
+			legacy = new LegacyRepair();
+			window = new WindowRepair();
+			legacyUs += Run(env, *legacy, pool, arrivals, timer, legacyRequested);
+			windowUs += Run(env, *window, pool, arrivals, timer, windowRequested);
+		}
+
+		TUint count = (TUint)arrivals.size() * repeat;
+
+		printf("%4d%% %-7s %10d %8d %7d %8d %10d %12d\n", losses[l], "fifo", legacy->Delivered(), legacy->Resets(), legacy->OutOfOrder(), legacy->MaxHeld(), legacyRequested, (TUint)(legacyUs * 1000 / count));
+		printf("%4d%% %-7s %10d %8d %7d %8d %10d %12d\n", losses[l], "window", window->Delivered(), window->Resets(), window->OutOfOrder(), window->MaxHeld(), windowRequested, (TUint)(windowUs * 1000 / count));
+
+		delete (legacy);
+		delete (window);
+	}
+
+	delete lib;
+
+	return (0);
+}
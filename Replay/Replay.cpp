@@ -0,0 +1,239 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Private/Ascii.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Private/Parser.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Os.h>
+#include "../Debug.h"
+
+#include <vector>
+#include <stdio.h>
+
+#include "../OhmReceiver.h"
+#include "../OhmCapture.h"
+
+#ifdef _WIN32
+
+#pragma warning(disable:4355) // use of 'this' in ctor lists safe in this case
+
+#define CDECL __cdecl
+
+#else
+
+#define CDECL
+
+#endif
+
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+// Replays a capture recorded with "Receiver -c" (or a pcap file) into an OhmReceiver and reports what it delivered
+
+class ReplayDriver : public IOhmReceiverDriver, public IOhmMsgProcessor
+{
+public:
+	ReplayDriver();
+	void Print() const;
+
+private:
+	// IOhmReceiverDriver
+	virtual void Add(OhmMsg& aMsg);
+	virtual void Timestamp(OhmMsg& aMsg);
+	virtual void Started();
+	virtual void Connected();
+	virtual void Playing();
+	virtual void Disconnected();
+	virtual void Stopped();
+
+	// IOhmMsgProcessor
+	virtual void Process(OhmMsgAudio& aMsg);
+	virtual void Process(OhmMsgTrack& aMsg);
+	virtual void Process(OhmMsgMetatext& aMsg);
+
+private:
+	TBool iReset;
+	TUint iFrame;
+	TUint iAudio;
+	TUint iTrack;
+	TUint iMetatext;
+	TUint iPlaying;
+	TUint iDisconnected;
+	TUint iDiscontinuities;
+};
+
+ReplayDriver::ReplayDriver()
+	: iReset(true)
+	, iFrame(0)
+	, iAudio(0)
+	, iTrack(0)
+	, iMetatext(0)
+	, iPlaying(0)
+	, iDisconnected(0)
+	, iDiscontinuities(0)
+{
+}
+
+void ReplayDriver::Print() const
+{
+	printf("Audio frames delivered: %d\n", iAudio);
+	printf("Discontinuities:        %d\n", iDiscontinuities);
+	printf("Track messages:         %d\n", iTrack);
+	printf("Metatext messages:      %d\n", iMetatext);
+	printf("Playing:                %d\n", iPlaying);
+	printf("Disconnected:           %d\n", iDisconnected);
+}
+
+void ReplayDriver::Add(OhmMsg& aMsg)
+{
+	aMsg.Process(*this);
+	aMsg.RemoveRef();
+}
+
+void ReplayDriver::Timestamp(OhmMsg& /*aMsg*/)
+{
+}
+
+void ReplayDriver::Started()
+{
+}
+
+void ReplayDriver::Connected()
+{
+}
+
+void ReplayDriver::Playing()
+{
+	iReset = true;
+	iPlaying++;
+}
+
+void ReplayDriver::Disconnected()
+{
+	iDisconnected++;
+}
+
+void ReplayDriver::Stopped()
+{
+}
+
+void ReplayDriver::Process(OhmMsgAudio& aMsg)
+{
+	if (!iReset && aMsg.Frame() != iFrame + 1) {
+		iDiscontinuities++;
+	}
+
+	iReset = false;
+	iFrame = aMsg.Frame();
+	iAudio++;
+}
+
+void ReplayDriver::Process(OhmMsgTrack& /*aMsg*/)
+{
+	iTrack++;
+}
+
+void ReplayDriver::Process(OhmMsgMetatext& /*aMsg*/)
+{
+	iMetatext++;
+}
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+    OptionParser parser;
+
+    OptionString optionFile("-f", "--file", Brn(""), "[file] capture (or pcap) file to replay");
+    parser.AddOption(&optionFile);
+
+    OptionBool optionRealTime("-r", "--realtime", "[realtime] replay at the pace of the capture rather than as fast as possible");
+    parser.AddOption(&optionRealTime);
+
+    OptionString optionSender("-s", "--sender", Brn(""), "[address:port] only replay messages from this sender");
+    parser.AddOption(&optionSender);
+
+    OptionBool optionLogging("-z", "--logging", "[logging] enable receiver logging");
+    parser.AddOption(&optionLogging);
+
+    if (!parser.Parse(aArgc, aArgv)) {
+        return (1);
+    }
+
+    InitialisationParams* initParams = InitialisationParams::Create();
+
+	Library* lib = new Library(initParams);
+
+	if (optionLogging.Value()) {
+		Debug::SetLevel(Debug::kMedia);
+	}
+
+	Endpoint sender;
+	TBool filter = false;
+
+	if (optionSender.Value().Bytes() > 0) {
+		Parser parserSender(optionSender.Value());
+		Brn address = parserSender.Next(':');
+		Brn port = parserSender.Remaining();
+		try {
+			sender.Replace(Endpoint(Ascii::Uint(port), address));
+			filter = true;
+		}
+		catch (AsciiError&) {
+			printf("Invalid sender endpoint\n");
+			delete lib;
+			return (1);
+		}
+	}
+
+	OhmCaptureReader* reader;
+
+	try {
+		reader = new OhmCaptureReader(optionFile.Value());
+	}
+	catch (OhmCaptureError&) {
+		Brhz file(optionFile.Value());
+		printf("Unable to read capture file %s\n", file.CString());
+		delete lib;
+		return (1);
+	}
+
+	ReplayDriver* driver = new ReplayDriver();
+
+	OhmReceiver* receiver = new OhmReceiver(lib->Env(), 0, 1, *driver);
+
+	OhmReplayer* replayer = new OhmReplayer(lib->Env(), *receiver);
+
+	if (filter) {
+		replayer->SetSender(sender);
+	}
+
+	TUint64 start = OsTimeInUs(lib->Env().OsCtx());
+
+	TUint count = replayer->Replay(*reader, optionRealTime.Value());
+
+	TUint64 elapsed = OsTimeInUs(lib->Env().OsCtx()) - start;
+
+	receiver->Stop();
+
+	printf("Messages replayed:      %d\n", count);
+	printf("Elapsed:                %d ms\n", (TUint)(elapsed / 1000));
+	if (elapsed > 0) {
+		printf("Rate:                   %d msgs/s\n", (TUint)((TUint64)count * 1000000 / elapsed));
+	}
+
+	driver->Print();
+
+	delete (receiver);
+	delete (replayer);
+	delete (driver);
+	delete (reader);
+
+	delete lib;
+
+    return (0);
+}
+
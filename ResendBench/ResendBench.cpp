@@ -0,0 +1,499 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/Env.h>
+
+#include "../Ohm.h"
+#include "../OhmRepair.h"
+
+#include <vector>
+#include <queue>
+#include <stdio.h>
+
+#ifdef _WIN32
+#define CDECL __cdecl
+#else
+#define CDECL
+#endif
+
+// Counts the bytes spent on resends by a multicast stream with many receivers
+//
+// Each receiver of a simulated multicast stream loses frames at random, and some frames are lost
+// on the way to every receiver. The receivers repair the stream as OhmReceiver does: they ask for
+// what they have missed a random time up to 10ms after a gap, again every 30ms while still
+// missing frames, and put off asking for 30ms when they see another receiver ask. The sender
+// resends any frame still in its history, and every receiver is sent each resend (which it may
+// lose in turn). Frames are lost in runs of a given length. The same losses of the stream are
+// repaired four ways, with requests as a list of frames or, where shorter, as a bitmap of a range
+// of frames, and with the sender resending every frame asked for or each frame at most once in
+// OhmResendFilter's window. Reported for each are the datagrams and
+// bytes of the requests and of the resends, the frames the receivers played and played late, and
+// the times a receiver fell so far behind that it started again.
+
+namespace OpenHome {
+namespace Av {
+
+class SimFrame
+{
+public:
+	SimFrame() : iFrame(0) {}
+	void Set(TUint aFrame) {iFrame = aFrame;}
+	TUint Frame() const {return (iFrame);}
+
+private:
+	TUint iFrame;
+};
+
+enum ESimEvent
+{
+	eSimSend,       // the sender sends iFrame
+	eSimArrive,     // iFrame reaches iReceiver
+	eSimTimer,      // iReceiver's repair timer, if still due at this time
+	eSimRequest,    // iReceiver's request reaches the sender
+	eSimSeen        // iReceiver sees another receiver's request
+};
+
+class SimEvent
+{
+public:
+	SimEvent(TUint64 aTimeUs, ESimEvent aType, TUint aReceiver, TUint aFrame, TUint aRequest)
+		: iTimeUs(aTimeUs), iType(aType), iReceiver(aReceiver), iFrame(aFrame), iRequest(aRequest) {}
+	TBool operator<(const SimEvent& aOther) const {return (iTimeUs > aOther.iTimeUs);} // earliest first
+
+public:
+	TUint64 iTimeUs;
+	ESimEvent iType;
+	TUint iReceiver;
+	TUint iFrame;
+	TUint iRequest;
+};
+
+class SimConfig
+{
+public:
+	TUint iReceivers;
+	TUint iFrames;
+	TUint iPeriodUs;
+	TUint iAudioBytes;
+	TUint iLatencyMs;
+	TUint iDelayUs;
+	TUint iLossPercent;
+	TUint iSharedLossPermille;
+	TUint iBurstFrames;
+};
+
+class SimStats
+{
+public:
+	SimStats() : iRequests(0), iRequestBytes(0), iResends(0), iResendBytes(0), iDelivered(0), iLate(0), iResets(0) {}
+
+public:
+	TUint64 iRequests;
+	TUint64 iRequestBytes;
+	TUint64 iResends;
+	TUint64 iResendBytes;
+	TUint64 iDelivered;
+	TUint64 iLate;
+	TUint64 iResets;
+};
+
+// A receiver's repair, as OhmReceiver does it
+
+class SimReceiver
+{
+public:
+	static const TUint kMaxRepairMissedFrames = 20;
+	static const TUint kInitialRepairTimeoutMs = 10;
+	static const TUint kSubsequentRepairTimeoutMs = 30;
+
+public:
+	SimReceiver();
+	void Arrive(SimFrame& aFrame, TUint64 aTimeUs, const SimConfig& aConfig, SimStats& aStats);
+	TUint Missed(TUint* aFrames) const;
+	TBool Repairing() const {return (iRepairing);}
+	TUint64 TimerUs() const {return (iTimerUs);}
+	void SetTimerUs(TUint64 aValue) {iTimerUs = aValue;}
+
+private:
+	void Deliver(TUint aFrame, TUint64 aTimeUs, const SimConfig& aConfig, SimStats& aStats);
+	void Reset(SimStats& aStats);
+
+private:
+	TBool iStarted;
+	TBool iRepairing;
+	TUint iFrame;
+	TUint64 iTimerUs; // 0 = not due
+	OhmRepairWindow<SimFrame> iWindow;
+};
+
+class Simulation
+{
+	static const TUint kMaxHistoryFrames = 100; // OhmSenderDriver
+	static const TUint kCodecNameBytes = 3;
+
+public:
+	Simulation(Environment& aEnv, const SimConfig& aConfig, const std::vector<TByte>& aLost, TBool aRange, TBool aFilter);
+	void Run();
+	const SimStats& Stats() const {return (iStats);}
+
+private:
+	void Timer(TUint aReceiver, TUint64 aTimeUs);
+	void Request(TUint aReceiver, TUint aRequest, TUint64 aTimeUs);
+	void Schedule(TUint64 aTimeUs, ESimEvent aType, TUint aReceiver, TUint aFrame, TUint aRequest);
+
+private:
+	Environment& iEnv;
+	const SimConfig& iConfig;
+	const std::vector<TByte>& iLost;
+	TBool iRange;
+	TBool iFilter;
+	std::vector<SimFrame> iPool;
+	std::vector<SimReceiver> iReceivers;
+	std::vector<std::vector<TUint> > iRequests;
+	std::priority_queue<SimEvent> iEvents;
+	OhmResendFilter iResendFilter;
+	TUint iSent;
+	TUint64 iEndUs;
+	SimStats iStats;
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+// SimReceiver
+
+SimReceiver::SimReceiver()
+	: iStarted(false)
+	, iRepairing(false)
+	, iFrame(0)
+	, iTimerUs(0)
+{
+}
+
+void SimReceiver::Arrive(SimFrame& aFrame, TUint64 aTimeUs, const SimConfig& aConfig, SimStats& aStats)
+{
+	if (!iStarted) {
+		iStarted = true;
+		iFrame = aFrame.Frame();
+		Deliver(iFrame, aTimeUs, aConfig, aStats);
+		return;
+	}
+
+	TInt diff = aFrame.Frame() - iFrame;
+
+	if (diff < 1) {
+		return;
+	}
+
+	if (!iRepairing) {
+		if (diff == 1) {
+			iFrame++;
+			Deliver(iFrame, aTimeUs, aConfig, aStats);
+			return;
+		}
+
+		iWindow.Begin(iFrame + 1);
+		iRepairing = true;
+	}
+
+	if (iWindow.Add(aFrame) == eOhmRepairBeyond) {
+		Reset(aStats);
+		return;
+	}
+
+	SimFrame* frame;
+
+	while ((frame = iWindow.Next()) != 0) {
+		iFrame++;
+		Deliver(iFrame, aTimeUs, aConfig, aStats);
+	}
+
+	if (iWindow.Count() == 0) {
+		iRepairing = false;
+		iTimerUs = 0;
+	}
+}
+
+TUint SimReceiver::Missed(TUint* aFrames) const
+{
+	return (iWindow.Missed(aFrames, kMaxRepairMissedFrames));
+}
+
+void SimReceiver::Deliver(TUint aFrame, TUint64 aTimeUs, const SimConfig& aConfig, SimStats& aStats)
+{
+	aStats.iDelivered++;
+
+	if (aTimeUs > (TUint64)aFrame * aConfig.iPeriodUs + aConfig.iLatencyMs * 1000) {
+		aStats.iLate++;
+	}
+}
+
+void SimReceiver::Reset(SimStats& aStats)
+{
+	while (iWindow.Remove() != 0) {
+	}
+
+	iStarted = false;
+	iRepairing = false;
+	iTimerUs = 0;
+	aStats.iResets++;
+}
+
+// Simulation
+
+Simulation::Simulation(Environment& aEnv, const SimConfig& aConfig, const std::vector<TByte>& aLost, TBool aRange, TBool aFilter)
+	: iEnv(aEnv)
+	, iConfig(aConfig)
+	, iLost(aLost)
+	, iRange(aRange)
+	, iFilter(aFilter)
+	, iPool(aConfig.iFrames)
+	, iReceivers(aConfig.iReceivers)
+	, iSent(0)
+	, iEndUs((TUint64)aConfig.iFrames * aConfig.iPeriodUs + 1000000)
+{
+	for (TUint i = 0; i < aConfig.iFrames; i++) {
+		iPool[i].Set(i);
+	}
+
+	for (TUint i = 0; i < aConfig.iFrames; i++) {
+		Schedule((TUint64)i * aConfig.iPeriodUs, eSimSend, 0, i, 0);
+	}
+}
+
+void Simulation::Schedule(TUint64 aTimeUs, ESimEvent aType, TUint aReceiver, TUint aFrame, TUint aRequest)
+{
+	iEvents.push(SimEvent(aTimeUs, aType, aReceiver, aFrame, aRequest));
+}
+
+void Simulation::Run()
+{
+	while (!iEvents.empty()) {
+		SimEvent event = iEvents.top();
+		iEvents.pop();
+
+		if (event.iTimeUs > iEndUs) {
+			break; // receivers still missing frames the sender no longer has would ask for ever
+		}
+
+		switch (event.iType) {
+		case eSimSend:
+			iSent = event.iFrame + 1;
+			for (TUint r = 0; r < iConfig.iReceivers; r++) {
+				if (!iLost[(TUint64)event.iFrame * iConfig.iReceivers + r]) {
+					Schedule(event.iTimeUs + iConfig.iDelayUs, eSimArrive, r, event.iFrame, 0);
+				}
+			}
+			break;
+		case eSimArrive:
+			{
+				SimReceiver& receiver = iReceivers[event.iReceiver];
+				TBool repairing = receiver.Repairing();
+				receiver.Arrive(iPool[event.iFrame], event.iTimeUs, iConfig, iStats);
+				if (!repairing && receiver.Repairing()) {
+					receiver.SetTimerUs(event.iTimeUs + 1 + iEnv.Random(SimReceiver::kInitialRepairTimeoutMs * 1000));
+					Schedule(receiver.TimerUs(), eSimTimer, event.iReceiver, 0, 0);
+				}
+			}
+			break;
+		case eSimTimer:
+			if (iReceivers[event.iReceiver].TimerUs() == event.iTimeUs) {
+				Timer(event.iReceiver, event.iTimeUs);
+			}
+			break;
+		case eSimRequest:
+			Request(event.iReceiver, event.iRequest, event.iTimeUs);
+			break;
+		case eSimSeen:
+			{
+				SimReceiver& receiver = iReceivers[event.iReceiver];
+				if (receiver.Repairing()) {
+					receiver.SetTimerUs(event.iTimeUs + SimReceiver::kSubsequentRepairTimeoutMs * 1000);
+					Schedule(receiver.TimerUs(), eSimTimer, event.iReceiver, 0, 0);
+				}
+			}
+			break;
+		}
+	}
+}
+
+void Simulation::Timer(TUint aReceiver, TUint64 aTimeUs)
+{
+	SimReceiver& receiver = iReceivers[aReceiver];
+
+	TUint frames[SimReceiver::kMaxRepairMissedFrames];
+	TUint count = receiver.Missed(frames);
+
+	if (count > 0) {
+		TUint bytes;
+
+		OhmHeaderResend headerResend(count);
+		OhmHeaderResendRange headerResendRange(frames[0], frames[count - 1] - frames[0] + 1);
+
+		if (iRange && headerResendRange.MsgBytes() < headerResend.MsgBytes()) {
+			bytes = OhmHeader::kHeaderBytes + headerResendRange.MsgBytes();
+		}
+		else {
+			bytes = OhmHeader::kHeaderBytes + headerResend.MsgBytes();
+		}
+
+		iStats.iRequests++;
+		iStats.iRequestBytes += bytes;
+
+		iRequests.push_back(std::vector<TUint>(frames, frames + count));
+		Schedule(aTimeUs + iConfig.iDelayUs, eSimRequest, aReceiver, 0, (TUint)iRequests.size() - 1);
+
+		// requests are sent to the multicast group, so the other receivers see them too
+
+		for (TUint r = 0; r < iConfig.iReceivers; r++) {
+			if (r != aReceiver) {
+				Schedule(aTimeUs + iConfig.iDelayUs, eSimSeen, r, 0, 0);
+			}
+		}
+	}
+
+	receiver.SetTimerUs(aTimeUs + SimReceiver::kSubsequentRepairTimeoutMs * 1000);
+	Schedule(receiver.TimerUs(), eSimTimer, aReceiver, 0, 0);
+}
+
+void Simulation::Request(TUint /* aReceiver */, TUint aRequest, TUint64 aTimeUs)
+{
+	const std::vector<TUint>& frames = iRequests[aRequest];
+
+	for (TUint i = 0; i < frames.size(); i++) {
+		TUint frame = frames[i];
+
+		if (frame >= iSent || iSent - frame > kMaxHistoryFrames) {
+			continue; // no longer in the sender's history
+		}
+
+		if (iFilter && !iResendFilter.Pass(frame, aTimeUs)) {
+			continue;
+		}
+
+		iStats.iResends++;
+		iStats.iResendBytes += OhmHeader::kHeaderBytes + OhmHeaderAudio::kHeaderBytes + kCodecNameBytes + iConfig.iAudioBytes;
+
+		for (TUint r = 0; r < iConfig.iReceivers; r++) {
+			if (iEnv.Random(1000) >= iConfig.iLossPercent * 10) {
+				Schedule(aTimeUs + iConfig.iDelayUs, eSimArrive, r, frame, 0);
+			}
+		}
+	}
+}
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+	InitialisationParams* initParams = InitialisationParams::Create();
+
+    OptionParser parser;
+    OptionUint optionReceivers("-r", "--receivers", 20, "Number of receivers");
+    OptionUint optionFrames("-f", "--frames", 12000, "Number of frames in the stream");
+    OptionUint optionPeriod("-p", "--period", 5000, "Time in us between frames");
+    OptionUint optionBytes("-b", "--bytes", 960, "Bytes of audio in each frame");
+    OptionUint optionLatency("-t", "--latency", 100, "Latency in ms, after which a frame is late");
+    OptionUint optionDelay("-d", "--delay", 1000, "Time in us a datagram takes to arrive");
+    OptionUint optionLoss("-l", "--loss", 2, "Percentage of frames each receiver loses");
+    OptionUint optionShared("-s", "--shared", 5, "Frames in a thousand lost on the way to every receiver");
+    OptionUint optionBurst("-u", "--burst", 1, "Frames lost in a row each time frames are lost");
+    parser.AddOption(&optionReceivers);
+    parser.AddOption(&optionFrames);
+    parser.AddOption(&optionPeriod);
+    parser.AddOption(&optionBytes);
+    parser.AddOption(&optionLatency);
+    parser.AddOption(&optionDelay);
+    parser.AddOption(&optionLoss);
+    parser.AddOption(&optionShared);
+    parser.AddOption(&optionBurst);
+    if (!parser.Parse(aArgc, aArgv)) {
+        return (1);
+    }
+
+    Library* lib = new Library(initParams);
+	Environment& env = lib->Env();
+
+	SimConfig config;
+	config.iReceivers = optionReceivers.Value() == 0 ? 1 : optionReceivers.Value();
+	config.iFrames = optionFrames.Value() == 0 ? 1 : optionFrames.Value();
+	config.iPeriodUs = optionPeriod.Value() == 0 ? 1 : optionPeriod.Value();
+	config.iAudioBytes = optionBytes.Value();
+	config.iLatencyMs = optionLatency.Value();
+	config.iDelayUs = optionDelay.Value();
+	config.iLossPercent = optionLoss.Value() > 90 ? 90 : optionLoss.Value();
+	config.iSharedLossPermille = optionShared.Value() > 900 ? 900 : optionShared.Value();
+	config.iBurstFrames = optionBurst.Value() == 0 ? 1 : optionBurst.Value();
+
+	// the same losses of the stream for every run
+
+	std::vector<TByte> lost((size_t)config.iFrames * config.iReceivers);
+	std::vector<TUint> burst(config.iReceivers + 1, 0); // frames still to lose in the current run, the last shared
+	TUint burstPermille = config.iBurstFrames * 1000;
+
+	for (TUint f = 0; f < config.iFrames; f++) {
+		if (burst[config.iReceivers] == 0 && env.Random(burstPermille) < config.iSharedLossPermille) {
+			burst[config.iReceivers] = config.iBurstFrames;
+		}
+
+		TBool shared = (burst[config.iReceivers] > 0);
+
+		if (shared) {
+			burst[config.iReceivers]--;
+		}
+
+		for (TUint r = 0; r < config.iReceivers; r++) {
+			if (burst[r] == 0 && env.Random(burstPermille) < config.iLossPercent * 10) {
+				burst[r] = config.iBurstFrames;
+			}
+
+			lost[(size_t)f * config.iReceivers + r] = (shared || burst[r] > 0) ? 1 : 0;
+
+			if (burst[r] > 0) {
+				burst[r]--;
+			}
+		}
+	}
+
+	TUint seconds = (TUint)((TUint64)config.iFrames * config.iPeriodUs / 1000000);
+
+	if (seconds == 0) {
+		seconds = 1;
+	}
+
+	printf("%d receivers, %d s of %d byte frames every %d us, %d%% lost by each receiver, %d in 1000 by all, in runs of %d\n\n",
+		config.iReceivers, seconds, config.iAudioBytes, config.iPeriodUs, config.iLossPercent, config.iSharedLossPermille, config.iBurstFrames);
+	printf("%-6s %-8s %9s %11s %9s %11s %10s %10s %8s %7s\n", "req", "resend", "requests", "req bytes", "resends", "res bytes", "bytes/s", "played", "late", "resets");
+
+	for (TUint i = 0; i < 4; i++) {
+		TBool range = (i & 1) != 0;
+		TBool filter = (i & 2) != 0;
+
+		Simulation* simulation = new Simulation(env, config, lost, range, filter);
+		simulation->Run();
+
+		const SimStats& stats = simulation->Stats();
+
+		printf("%-6s %-8s %9llu %11llu %9llu %11llu %10llu %10llu %8llu %7llu\n",
+			range ? "range" : "list",
+			filter ? "once" : "each",
+			(unsigned long long)stats.iRequests,
+			(unsigned long long)stats.iRequestBytes,
+			(unsigned long long)stats.iResends,
+			(unsigned long long)stats.iResendBytes,
+			(unsigned long long)((stats.iRequestBytes + stats.iResendBytes) / seconds),
+			(unsigned long long)stats.iDelivered,
+			(unsigned long long)stats.iLate,
+			(unsigned long long)stats.iResets);
+
+		delete (simulation);
+	}
+
+	delete lib;
+
+	return (0);
+}
@@ -0,0 +1,245 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Private/Network.h>
+#include <OpenHome/Private/Stream.h>
+#include <OpenHome/Os.h>
+
+#include "../OhmSender.h"
+#include "../OhmSilence.h"
+
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+# include <sys/resource.h>
+#endif
+
+#ifdef _WIN32
+#define CDECL __cdecl
+#else
+#define CDECL
+#endif
+
+// Measures what discontinuous transmission (DTX) saves a sender whose audio is often silent
+//
+// First the silence scan itself: the time OhmSilence takes over a frame of zeros, which it must
+// read to the end, and over a frame of music, which it gives up on at once, with its vector
+// implementation and with the scalar one.
+//
+// Then a stream in which the given share of every hundred frames is digital silence is sent by an
+// OhmSenderDriver to a socket on the loopback interface, which is never read, with DTX off and on.
+// Reported are the CPU time the sending thread used for each frame and the bytes on the wire. A
+// silence frame is also read back as a receiver would, to check it comes back as the zeros it
+// stands for. CPU time is only measured on Linux.
+
+namespace OpenHome {
+namespace Av {
+
+static TUint64 ThreadCpuUs()
+{
+#ifdef __linux__
+	struct rusage usage;
+	if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+		return ((TUint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+	}
+#endif
+	return (0);
+}
+
+static const TUint kSampleRate = 48000;
+static const TUint kChannels = 2;
+static const TUint kBitDepth = 16;
+static const TUint kBitRate = kSampleRate * kChannels * kBitDepth;
+static const TUint kScanRepeats = 100;
+static const TUint kMaxFrameBytes = 16 * 1024;
+
+typedef TBool (*ScanFunction)(const TByte* aData, TUint aBytes);
+
+static TUint ScanNs(ScanFunction aScan, const Brx& aAudio, TUint aFrames)
+{
+	TUint silent = 0;
+
+	TUint64 start = ThreadCpuUs();
+
+	for (TUint i = 0; i < aFrames * kScanRepeats; i++) {
+		if (aScan(aAudio.Ptr(), aAudio.Bytes())) {
+			silent++;
+		}
+	}
+
+	TUint64 cpuUs = ThreadCpuUs() - start;
+
+	if (silent != 0 && silent != aFrames * kScanRepeats) {
+		printf("scan gave different answers for the same frame\n");
+	}
+
+	return ((TUint)(cpuUs * 1000 / (aFrames * kScanRepeats)));
+}
+
+static void BenchScan(TUint aFrames, const Brx& aSilence, const Brx& aMusic)
+{
+	printf("%-12s %10s %10s\n", "scan", "silent ns", "music ns");
+	printf("%-12s %10d %10d\n", OhmSilence::Implementation(), ScanNs(OhmSilence::IsSilent, aSilence, aFrames), ScanNs(OhmSilence::IsSilent, aMusic, aFrames));
+	printf("%-12s %10d %10d\n", "scalar", ScanNs(OhmSilence::IsSilentScalar, aSilence, aFrames), ScanNs(OhmSilence::IsSilentScalar, aMusic, aFrames));
+}
+
+// The bytes of a frame as externalised, after checking that a receiver reads the audio back from them
+
+static TUint WireBytes(OhmMsgFactory& aFactory, const Brx& aAudio, TBool aSilence)
+{
+	OhmMsgAudio& msg = aFactory.CreateAudio(false, true, false, false, aAudio.Bytes() * 8 / kChannels / kBitDepth, 0, 0, 0, 0, 0, 0, kSampleRate, kBitRate, 0, kBitDepth, kChannels, Brn("PCM"), aAudio);
+
+	msg.SetSilence(aSilence);
+
+	Bws<kMaxFrameBytes> buffer;
+	WriterBuffer writer(buffer);
+	msg.Externalise(writer);
+	msg.RemoveRef();
+
+	ReaderBuffer reader(buffer);
+	OhmHeader header;
+	header.Internalise(reader);
+
+	OhmMsgAudio& received = aFactory.CreateAudio(reader, header);
+
+	if (received.Silence() != aSilence || received.Audio() != aAudio) {
+		printf("frame read back differs from the frame sent\n");
+	}
+
+	received.RemoveRef();
+
+	return (buffer.Bytes());
+}
+
+static TBool Silent(TUint aFrame, TUint aSilencePercent)
+{
+	return ((aFrame % 100) < aSilencePercent); // in runs, as when the desktop goes quiet
+}
+
+static void BenchStream(Environment& aEnv, TBool aDtx, TUint aSilencePercent, TUint aFrames, const Brx& aSilence, const Brx& aMusic, TIpAddress aLoopback)
+{
+	OhmMsgFactory factory(2, 1, 1);
+
+	TUint silenceBytes = WireBytes(factory, aSilence, aDtx);
+	TUint musicBytes = WireBytes(factory, aMusic, false);
+
+	SocketUdp sink(aEnv, 0, aLoopback);
+
+	OhmSenderDriver* driver = new OhmSenderDriver(aEnv);
+	driver->SetAudioFormat(kSampleRate, kBitRate, kChannels, kBitDepth, true, Brn("PCM"));
+	driver->SetDtx(aDtx);
+
+	IOhmSenderDriver& output = *driver;
+
+	output.SetEndpoint(Endpoint(sink.Port(), aLoopback), aLoopback);
+	output.SetEnabled(true);
+	output.SetActive(true);
+
+	TUint64 bytes = 0;
+
+	TUint64 start = ThreadCpuUs();
+
+	for (TUint f = 0; f < aFrames; f++) {
+		if (Silent(f, aSilencePercent)) {
+			driver->SendAudio(aSilence.Ptr(), aSilence.Bytes());
+			bytes += silenceBytes;
+		}
+		else {
+			driver->SendAudio(aMusic.Ptr(), aMusic.Bytes());
+			bytes += musicBytes;
+		}
+	}
+
+	TUint64 cpuUs = ThreadCpuUs() - start;
+
+	OhmSenderDriverStats stats;
+	driver->GetStats(stats);
+
+	output.SetActive(false);
+	output.SetEnabled(false);
+
+	delete (driver);
+
+	printf("%-12s %10d %10d %10d %10d\n", aDtx ? "dtx" : "off", (TUint)(cpuUs * 1000 / aFrames), (TUint)(bytes / aFrames), (TUint)(bytes / 1024), stats.iSilentFrames);
+}
+
+} // namespace Av
+} // namespace OpenHome
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+	InitialisationParams* initParams = InitialisationParams::Create();
+
+    OptionParser parser;
+    OptionUint optionSilence("-s", "--silence", 75, "Percent of the stream that is digital silence");
+    OptionUint optionFrames("-f", "--frames", 20000, "Number of frames sent");
+    OptionUint optionBytes("-b", "--bytes", 960, "Bytes of audio in each frame");
+    parser.AddOption(&optionSilence);
+    parser.AddOption(&optionFrames);
+    parser.AddOption(&optionBytes);
+    if (!parser.Parse(aArgc, aArgv)) {
+        return (1);
+    }
+
+    Library* lib = new Library(initParams);
+
+	TUint silence = optionSilence.Value();
+	TUint frames = optionFrames.Value();
+	TUint bytes = optionBytes.Value();
+
+	if (silence > 100) {
+		silence = 100;
+	}
+
+	if (frames == 0) {
+		frames = 1;
+	}
+
+	TUint frameBytes = kChannels * kBitDepth / 8;
+
+	bytes -= bytes % frameBytes;
+
+	if (bytes < frameBytes) {
+		bytes = frameBytes;
+	}
+
+	if (bytes > OhmMsgAudio::kMaxSampleBytes) {
+		bytes = OhmMsgAudio::kMaxSampleBytes;
+	}
+
+	TIpAddress loopback = Endpoint(0, Brn("127.0.0.1")).Address();
+
+	std::vector<TByte> zeros(bytes, 0);
+	std::vector<TByte> music(bytes);
+
+	srand(1);
+
+	for (TUint i = 0; i < bytes; i++) {
+		music[i] = (TByte)(rand() | 1);
+	}
+
+	Brn audioSilence(&zeros[0], bytes);
+	Brn audioMusic(&music[0], bytes);
+
+	printf("%d frames of %d bytes, %d%% silent\n\n", frames, bytes, silence);
+
+	BenchScan(frames, audioSilence, audioMusic);
+
+	printf("\n%-12s %10s %10s %10s %10s\n", "stream", "ns/frame", "B/frame", "KB", "silent");
+
+	BenchStream(lib->Env(), false, silence, frames, audioSilence, audioMusic, loopback);
+	BenchStream(lib->Env(), true, silence, frames, audioSilence, audioMusic, loopback);
+
+	delete lib;
+
+	return (0);
+}
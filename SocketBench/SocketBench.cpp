@@ -0,0 +1,277 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/Network.h>
+#include <OpenHome/Os.h>
+
+#include "../OhmSocket.h"
+
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+# include <sys/resource.h>
+#endif
+
+#ifdef _WIN32
+#define CDECL __cdecl
+#else
+#define CDECL
+#endif
+
+// Compares the cost of the socket backends to Ohm streams
+//
+// A sender on this host streams frames of Ohm audio size to receivers on the loopback interface,
+// one receiving thread per stream, as a host running several senders and receivers would. Each
+// frame carries the time it was sent, so a receiving thread can tell how long it took to reach it.
+// Reported for each backend are the CPU time the receiving threads and the sending thread used per
+// second of stream and the median, 99th percentile and worst time from send to read.
+//
+// The blocking backend is ohNet's SocketUdp and UdpReader. The io_uring backend is reported as well
+// when built with OHM_IO_URING; its sender submits a frame for every stream with one system call.
+// CPU time is only measured on Linux.
+
+namespace OpenHome {
+namespace Av {
+
+static TUint64 ThreadCpuUs()
+{
+#ifdef __linux__
+	struct rusage usage;
+	if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+		return ((TUint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+	}
+#endif
+	return (0);
+}
+
+static void BeginBatch(SocketUdpBase& /* aSocket */)
+{
+}
+
+static void EndBatch(SocketUdpBase& /* aSocket */)
+{
+}
+
+#ifdef OHM_IO_URING
+
+static void BeginBatch(OhmUringSocketUdpBase& aSocket)
+{
+	aSocket.BeginBatch();
+}
+
+static void EndBatch(OhmUringSocketUdpBase& aSocket)
+{
+	aSocket.EndBatch();
+}
+
+#endif // OHM_IO_URING
+
+template<class S, class R> class BenchStream
+{
+	static const TUint kMaxFrameBytes = 16 * 1024;
+
+public:
+	BenchStream(Environment& aEnv, TIpAddress aInterface, TUint aFrames, Semaphore& aDone)
+		: iEnv(aEnv)
+		, iSocket(aEnv, 0, aInterface)
+		, iReader(iSocket)
+		, iDone(aDone)
+		, iCpuUs(0)
+	{
+		iSocket.SetRecvBufBytes(OhmSocket::BufBytes(1024 * 1024, 100));
+		iLatencyUs.reserve(aFrames);
+		iThread = new ThreadFunctor("BNCH", MakeFunctor(*this, &BenchStream::Run), kPriorityHigh);
+		iThread->Start();
+	}
+
+	TUint Port() const {return (iSocket.Port());}
+	void Stop() {iReader.ReadInterrupt();}
+	TUint64 CpuUs() const {return (iCpuUs);}
+	const std::vector<TUint>& LatencyUs() const {return (iLatencyUs);}
+
+	~BenchStream()
+	{
+		delete (iThread);
+	}
+
+private:
+	void Run()
+	{
+		TUint64 start = ThreadCpuUs();
+
+		try {
+			for (;;) {
+				iReader.Read(iBuffer);
+				TUint64 now = OsTimeInUs(iEnv.OsCtx());
+				TUint64 sent;
+				memcpy(&sent, iBuffer.Ptr(), sizeof(sent));
+				iLatencyUs.push_back((TUint)(now - sent));
+			}
+		}
+		catch (ReaderError&) {
+		}
+
+		iCpuUs = ThreadCpuUs() - start;
+		iDone.Signal();
+	}
+
+private:
+	Environment& iEnv;
+	S iSocket;
+	R iReader;
+	Semaphore& iDone;
+	ThreadFunctor* iThread;
+	Bws<kMaxFrameBytes> iBuffer;
+	std::vector<TUint> iLatencyUs;
+	TUint64 iCpuUs;
+};
+
+template<class S, class R> void Bench(Environment& aEnv, const TChar* aName, TUint aStreams, TUint aFrames, TUint aFrameBytes, TUint aIntervalMs)
+{
+	TIpAddress loopback = Endpoint(0, Brn("127.0.0.1")).Address();
+	Semaphore done("BNCD", 0);
+
+	std::vector<BenchStream<S, R>*> streams;
+
+	for (TUint i = 0; i < aStreams; i++) {
+		streams.push_back(new BenchStream<S, R>(aEnv, loopback, aFrames, done));
+	}
+
+	S sender(aEnv, 0, loopback);
+	sender.SetSendBufBytes(OhmSocket::BufBytes(1024 * 1024, 100));
+
+	std::vector<TByte> frame(aFrameBytes, 0);
+
+	TUint64 senderStart = ThreadCpuUs();
+	TUint64 start = OsTimeInUs(aEnv.OsCtx());
+	TUint sent = 0;
+
+	for (TUint f = 0; f < aFrames; f++) {
+		TUint64 due = start + (TUint64)f * aIntervalMs * 1000;
+		TUint64 now = OsTimeInUs(aEnv.OsCtx());
+
+		if (due > now) {
+			Thread::Sleep((TUint)((due - now + 999) / 1000));
+		}
+
+		BeginBatch(sender);
+
+		for (TUint i = 0; i < aStreams; i++) {
+			TUint64 stamp = OsTimeInUs(aEnv.OsCtx());
+			memcpy(&frame[0], &stamp, sizeof(stamp));
+			try {
+				sender.Send(Brn(&frame[0], aFrameBytes), Endpoint(streams[i]->Port(), loopback));
+				sent++;
+			}
+			catch (NetworkError&) {
+			}
+		}
+
+		EndBatch(sender);
+	}
+
+	TUint64 senderCpuUs = ThreadCpuUs() - senderStart;
+	TUint64 streamUs = (TUint64)aFrames * aIntervalMs * 1000;
+
+	Thread::Sleep(100); // for the last frames to arrive
+
+	std::vector<TUint> latencies;
+	TUint64 receiverCpuUs = 0;
+
+	for (TUint i = 0; i < aStreams; i++) {
+		streams[i]->Stop();
+		done.Wait();
+	}
+
+	for (TUint i = 0; i < aStreams; i++) {
+		receiverCpuUs += streams[i]->CpuUs();
+		latencies.insert(latencies.end(), streams[i]->LatencyUs().begin(), streams[i]->LatencyUs().end());
+		delete (streams[i]);
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+
+	TUint received = (TUint)latencies.size();
+	TUint p50 = received ? latencies[received / 2] : 0;
+	TUint p99 = received ? latencies[(TUint)((TUint64)received * 99 / 100)] : 0;
+	TUint worst = received ? latencies[received - 1] : 0;
+
+	// CPU time per stream for each second of stream
+
+	TUint rxCpu = (TUint)(receiverCpuUs * 1000000 / streamUs / aStreams);
+	TUint txCpu = (TUint)(senderCpuUs * 1000000 / streamUs / aStreams);
+
+	printf("%-9s %7d/%-7d %8d %8d %8d %8d %8d\n", aName, received, sent, rxCpu, txCpu, p50, p99, worst);
+}
+
+} // namespace Av
+} // namespace OpenHome
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+	InitialisationParams* initParams = InitialisationParams::Create();
+
+    OptionParser parser;
+    OptionUint optionStreams("-n", "--streams", 8, "Number of streams");
+    OptionUint optionFrames("-f", "--frames", 1000, "Number of frames sent on each stream");
+    OptionUint optionBytes("-b", "--bytes", 1100, "Bytes in each frame");
+    OptionUint optionInterval("-i", "--interval", 5, "Time in ms between frames");
+    parser.AddOption(&optionStreams);
+    parser.AddOption(&optionFrames);
+    parser.AddOption(&optionBytes);
+    parser.AddOption(&optionInterval);
+    if (!parser.Parse(aArgc, aArgv)) {
+        return (1);
+    }
+
+    Library* lib = new Library(initParams);
+
+	TUint streams = optionStreams.Value();
+	TUint frames = optionFrames.Value();
+	TUint bytes = optionBytes.Value();
+	TUint interval = optionInterval.Value();
+
+	if (streams == 0) {
+		streams = 1;
+	}
+
+	if (frames == 0) {
+		frames = 1;
+	}
+
+	if (bytes < sizeof(TUint64)) {
+		bytes = sizeof(TUint64);
+	}
+
+	if (bytes > 16 * 1024) {
+		bytes = 16 * 1024;
+	}
+
+	if (interval == 0) {
+		interval = 1;
+	}
+
+	printf("%d streams of %d frames of %d bytes every %d ms\n\n", streams, frames, bytes, interval);
+	printf("%-9s %15s %8s %8s %8s %8s %8s\n", "backend", "received", "rx us/s", "tx us/s", "p50 us", "p99 us", "max us");
+
+	Bench<SocketUdp, UdpReader>(lib->Env(), "blocking", streams, frames, bytes, interval);
+
+#ifdef OHM_IO_URING
+	Bench<OhmUringSocketUdp, OhmUringReader>(lib->Env(), "io_uring", streams, frames, bytes, interval);
+#endif
+
+	delete lib;
+
+	return (0);
+}
@@ -0,0 +1,297 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/Env.h>
+
+#include "../OhmReceiver.h"
+
+#include <vector>
+#include <stdio.h>
+
+#ifdef _WIN32
+#define CDECL __cdecl
+#else
+#define CDECL
+#endif
+
+// Checks where an OhmReceiver starts playing a stream when its join is answered with a fast start
+//
+// Frames are handed to the receiver as its protocols would, live or resent, in the orders a
+// joining receiver can see them: the burst of recent frames a sender answers a join with can
+// arrive after the first live frames when the stream is already playing, or ahead of them when
+// the sender was idle, or not at all from a sender without fast start. In every case the driver
+// must be given one contiguous run of frames starting at the earliest frame sent.
+
+namespace OpenHome {
+namespace Av {
+
+static const TUint kFirstLive = 1000;
+static const TUint kBurstFrames = 8;
+static const TUint kSamples = 240;
+
+class TestDriver : public IOhmReceiverDriver, public IOhmMsgProcessor
+{
+public:
+	TestDriver();
+	TBool Check(const TChar* aName, TUint aFirst, TUint aLast);
+
+private:
+	// IOhmReceiverDriver
+	virtual void Add(OhmMsg& aMsg);
+	virtual void Timestamp(OhmMsg& aMsg);
+	virtual void Started();
+	virtual void Connected();
+	virtual void Playing();
+	virtual void Disconnected();
+	virtual void Stopped();
+
+	// IOhmMsgProcessor
+	virtual void Process(OhmMsgAudio& aMsg);
+	virtual void Process(OhmMsgTrack& aMsg);
+	virtual void Process(OhmMsgMetatext& aMsg);
+
+private:
+	Mutex iMutex;
+	TUint iPlaying;
+	std::vector<TUint> iFrames;
+};
+
+TestDriver::TestDriver()
+	: iMutex("TFSD")
+	, iPlaying(0)
+{
+}
+
+TBool TestDriver::Check(const TChar* aName, TUint aFirst, TUint aLast)
+{
+	AutoMutex mutex(iMutex);
+
+	TBool pass = (iPlaying == 1 && iFrames.size() == aLast - aFirst + 1);
+
+	for (TUint i = 0; pass && i < iFrames.size(); i++) {
+		pass = (iFrames[i] == aFirst + i);
+	}
+
+	printf("%-16s %s: %d frames", aName, pass ? "PASS" : "FAIL", (TUint)iFrames.size());
+
+	if (iFrames.size() > 0) {
+		printf(" from %d to %d", iFrames[0], iFrames[iFrames.size() - 1]);
+	}
+
+	printf(", expected %d to %d\n", aFirst, aLast);
+
+	return (pass);
+}
+
+void TestDriver::Add(OhmMsg& aMsg)
+{
+	aMsg.Process(*this);
+	aMsg.RemoveRef();
+}
+
+void TestDriver::Timestamp(OhmMsg& /*aMsg*/)
+{
+}
+
+void TestDriver::Started()
+{
+}
+
+void TestDriver::Connected()
+{
+}
+
+void TestDriver::Playing()
+{
+	AutoMutex mutex(iMutex);
+	iPlaying++;
+}
+
+void TestDriver::Disconnected()
+{
+}
+
+void TestDriver::Stopped()
+{
+}
+
+void TestDriver::Process(OhmMsgAudio& aMsg)
+{
+	AutoMutex mutex(iMutex);
+	iFrames.push_back(aMsg.Frame());
+}
+
+void TestDriver::Process(OhmMsgTrack& /*aMsg*/)
+{
+}
+
+void TestDriver::Process(OhmMsgMetatext& /*aMsg*/)
+{
+}
+
+// Test hands frames to a receiver of its own, through the interface its protocols use
+
+class Test
+{
+	static const TUint kWaitMs = 100; // well past the receiver's wait for a burst
+
+public:
+	Test(Environment& aEnv);
+	void Live(TUint aFrame);
+	void Resent(TUint aFrame);
+	void Burst(TUint aFirst, TUint aLast, TUint aSkip = 0);
+	void Wait();
+	TBool Check(const TChar* aName, TUint aFirst, TUint aLast);
+	~Test();
+
+private:
+	void Send(TUint aFrame, TBool aResent);
+
+private:
+	OhmMsgFactory iFactory;
+	TestDriver iDriver;
+	OhmReceiver* iReceiver;
+	TByte iAudio[kSamples * 4];
+};
+
+Test::Test(Environment& aEnv)
+	: iFactory(100, 1, 1)
+{
+	iReceiver = new OhmReceiver(aEnv, 0, 1, iDriver);
+
+	for (TUint i = 0; i < sizeof(iAudio); i++) {
+		iAudio[i] = (TByte)i;
+	}
+}
+
+void Test::Live(TUint aFrame)
+{
+	Send(aFrame, false);
+}
+
+void Test::Resent(TUint aFrame)
+{
+	Send(aFrame, true);
+}
+
+void Test::Burst(TUint aFirst, TUint aLast, TUint aSkip)
+{
+	for (TUint frame = aFirst; frame <= aLast; frame++) {
+		if (frame != aSkip) {
+			Resent(frame);
+		}
+	}
+}
+
+void Test::Wait()
+{
+	Thread::Sleep(kWaitMs);
+}
+
+TBool Test::Check(const TChar* aName, TUint aFirst, TUint aLast)
+{
+	return (iDriver.Check(aName, aFirst, aLast));
+}
+
+Test::~Test()
+{
+	delete (iReceiver);
+}
+
+void Test::Send(TUint aFrame, TBool aResent)
+{
+	OhmMsgAudio& msg = iFactory.CreateAudio(false, true, false, aResent, kSamples, aFrame, 0, 0, 0, 0, 0, 48000, 48000 * 32, 0, 16, 2, Brn("PCM"), Brn(iAudio, sizeof(iAudio)));
+	IOhmReceiver& receiver = *iReceiver;
+	receiver.Add(msg);
+}
+
+// A join to a stream already playing: live frames first, then the burst of those before them
+
+static TBool TestJoinPlaying(Environment& aEnv)
+{
+	Test test(aEnv);
+
+	test.Live(kFirstLive);
+	test.Live(kFirstLive + 1);
+	test.Burst(kFirstLive - kBurstFrames, kFirstLive - 1);
+	test.Live(kFirstLive + 2);
+
+	return (test.Check("join playing", kFirstLive - kBurstFrames, kFirstLive + 2));
+}
+
+// A join to an idle sender: the burst comes ahead of the first live frame
+
+static TBool TestJoinIdle(Environment& aEnv)
+{
+	Test test(aEnv);
+
+	test.Burst(kFirstLive - kBurstFrames, kFirstLive - 1);
+	test.Live(kFirstLive);
+	test.Live(kFirstLive + 1);
+
+	return (test.Check("join idle", kFirstLive - kBurstFrames, kFirstLive + 1));
+}
+
+// A sender without fast start: play starts from the first live frame once the wait is over
+
+static TBool TestNoBurst(Environment& aEnv)
+{
+	Test test(aEnv);
+
+	test.Live(kFirstLive);
+	test.Live(kFirstLive + 1);
+	test.Wait();
+	test.Live(kFirstLive + 2);
+
+	return (test.Check("no burst", kFirstLive, kFirstLive + 2));
+}
+
+// A burst missing a frame: play starts from the earliest frame and the gap is repaired
+
+static TBool TestBurstGap(Environment& aEnv)
+{
+	Test test(aEnv);
+
+	TUint missing = kFirstLive - 3;
+
+	test.Live(kFirstLive);
+	test.Burst(kFirstLive - kBurstFrames, kFirstLive - 1, missing);
+	test.Wait();
+	test.Resent(missing);
+	test.Live(kFirstLive + 1);
+
+	return (test.Check("burst gap", kFirstLive - kBurstFrames, kFirstLive + 1));
+}
+
+} // namespace Av
+} // namespace OpenHome
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+	InitialisationParams* initParams = InitialisationParams::Create();
+
+    OptionParser parser;
+    if (!parser.Parse(aArgc, aArgv)) {
+        return (1);
+    }
+
+    Library* lib = new Library(initParams);
+
+	TBool pass = true;
+
+	pass = TestJoinPlaying(lib->Env()) && pass;
+	pass = TestJoinIdle(lib->Env()) && pass;
+	pass = TestNoBurst(lib->Env()) && pass;
+	pass = TestBurstGap(lib->Env()) && pass;
+
+	delete lib;
+
+	return (pass ? 0 : 1);
+}
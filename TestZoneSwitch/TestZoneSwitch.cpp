@@ -0,0 +1,259 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/Timer.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/Env.h>
+
+#include "../OhmReceiver.h"
+
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define CDECL __cdecl
+#else
+#define CDECL
+#endif
+
+// Checks that a receiver in zone mode follows its zone from one sender to another and can then be stopped
+//
+// The zone is announced to the receiver through the zone group as a sender would announce it: first
+// one multicast sender, then two more in turn. The first starts the multicast protocol, the other two
+// switch it in place. Stopping the receiver afterwards must stop that protocol; a receiver that has
+// lost track of it hangs, which the watchdog reports.
+
+namespace OpenHome {
+namespace Av {
+
+static const TUint kSettleMs = 500;
+static const TUint kWatchdogMs = 5000;
+
+class TestDriver : public IOhmReceiverDriver
+{
+public:
+	TestDriver();
+	TUint StopCount() const;
+
+private:
+	// IOhmReceiverDriver
+	virtual void Add(OhmMsg& aMsg);
+	virtual void Timestamp(OhmMsg& aMsg);
+	virtual void Started();
+	virtual void Connected();
+	virtual void Playing();
+	virtual void Disconnected();
+	virtual void Stopped();
+
+private:
+	mutable Mutex iMutex;
+	TUint iStopped;
+};
+
+TestDriver::TestDriver()
+	: iMutex("TZSD")
+	, iStopped(0)
+{
+}
+
+TUint TestDriver::StopCount() const
+{
+	AutoMutex mutex(iMutex);
+	return (iStopped);
+}
+
+void TestDriver::Add(OhmMsg& aMsg)
+{
+	aMsg.RemoveRef();
+}
+
+void TestDriver::Timestamp(OhmMsg& /*aMsg*/)
+{
+}
+
+void TestDriver::Started()
+{
+}
+
+void TestDriver::Connected()
+{
+}
+
+void TestDriver::Playing()
+{
+}
+
+void TestDriver::Disconnected()
+{
+}
+
+void TestDriver::Stopped()
+{
+	AutoMutex mutex(iMutex);
+	iStopped++;
+}
+
+// Watchdog fails the test if the receiver does not stop in time
+
+class Watchdog
+{
+public:
+	Watchdog(Environment& aEnv);
+	void Start();
+	void Cancel();
+
+private:
+	void Expired();
+
+private:
+	Timer iTimer;
+};
+
+Watchdog::Watchdog(Environment& aEnv)
+	: iTimer(aEnv, MakeFunctor(*this, &Watchdog::Expired), "TestZoneSwitchWatchdog")
+{
+}
+
+void Watchdog::Start()
+{
+	iTimer.FireIn(kWatchdogMs);
+}
+
+void Watchdog::Cancel()
+{
+	iTimer.Cancel();
+}
+
+void Watchdog::Expired()
+{
+	printf("zone switch FAIL: receiver did not stop within %d ms\n", kWatchdogMs);
+	exit(1);
+}
+
+// ZoneAnnouncer announces the zone's uri as OhmSender::SendZoneUri does
+
+class ZoneAnnouncer
+{
+	static const TUint kMaxFrameBytes = 1024;
+
+public:
+	ZoneAnnouncer(Environment& aEnv, TIpAddress aInterface, TUint aTtl, const Brx& aZone);
+	const Endpoint& This() const;
+	void Announce(const Brx& aUri);
+	~ZoneAnnouncer();
+
+private:
+	OhzSocket iSocket;
+	Brn iZone;
+	Bws<kMaxFrameBytes> iTx;
+};
+
+ZoneAnnouncer::ZoneAnnouncer(Environment& aEnv, TIpAddress aInterface, TUint aTtl, const Brx& aZone)
+	: iSocket(aEnv)
+	, iZone(aZone)
+{
+	iSocket.Open(aInterface, aTtl);
+}
+
+const Endpoint& ZoneAnnouncer::This() const
+{
+	return (iSocket.This());
+}
+
+void ZoneAnnouncer::Announce(const Brx& aUri)
+{
+	OhzHeaderZoneUri headerZoneUri(iZone, aUri);
+	OhzHeader header(OhzHeader::kMsgTypeZoneUri, headerZoneUri.MsgBytes());
+
+	WriterBuffer writer(iTx);
+
+	writer.Flush();
+	header.Externalise(writer);
+	headerZoneUri.Externalise(writer);
+	writer.Write(iZone);
+	writer.Write(aUri);
+
+	iSocket.Send(iTx);
+
+	Thread::Sleep(kSettleMs);
+}
+
+ZoneAnnouncer::~ZoneAnnouncer()
+{
+	iSocket.Close();
+}
+
+static TBool TestZoneSwitch(Environment& aEnv, TIpAddress aInterface, TUint aTtl)
+{
+	Brn zone("TestZoneSwitch");
+
+	TestDriver driver;
+	OhmReceiver* receiver = new OhmReceiver(aEnv, aInterface, aTtl, driver);
+	ZoneAnnouncer announcer(aEnv, aInterface, aTtl, zone);
+
+	Bws<Ohm::kMaxUriBytes> uri("ohz://");
+	announcer.This().AppendEndpoint(uri);
+	uri.Append('/');
+	uri.Append(zone);
+
+	receiver->Play(uri);
+
+	Thread::Sleep(kSettleMs);
+
+	announcer.Announce(Brn("ohm://239.253.121.1:51972")); // starts the multicast protocol
+	announcer.Announce(Brn("ohm://239.253.121.2:51972")); // switches it
+	announcer.Announce(Brn("ohm://239.253.121.3:51972")); // switches it again
+
+	Watchdog watchdog(aEnv);
+
+	watchdog.Start();
+	receiver->Stop();
+	watchdog.Cancel();
+
+	TBool pass = (driver.StopCount() == 1);
+
+	printf("zone switch %s: stopped %d times, expected 1\n", pass ? "PASS" : "FAIL", driver.StopCount());
+
+	delete (receiver);
+
+	return (pass);
+}
+
+} // namespace Av
+} // namespace OpenHome
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+	InitialisationParams* initParams = InitialisationParams::Create();
+
+    OptionParser parser;
+
+    OptionUint optionAdapter("-a", "--adapter", 0, "[adapter] index of network adapter to use");
+    parser.AddOption(&optionAdapter);
+
+    OptionUint optionTtl("-t", "--ttl", 1, "[ttl] ttl");
+    parser.AddOption(&optionTtl);
+
+    if (!parser.Parse(aArgc, aArgv)) {
+        return (1);
+    }
+
+    Library* lib = new Library(initParams);
+
+    std::vector<NetworkAdapter*>* subnetList = lib->CreateSubnetList();
+    TIpAddress adapter = (*subnetList)[optionAdapter.Value()]->Address();
+    Library::DestroySubnetList(subnetList);
+
+	TBool pass = TestZoneSwitch(lib->Env(), adapter, optionTtl.Value());
+
+	delete lib;
+
+	return (pass ? 0 : 1);
+}
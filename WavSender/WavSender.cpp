@@ -12,8 +12,11 @@
 
 #include <vector>
 #include <stdio.h>
+#include <string.h>
 
 #include "../OhmSender.h"
+#include "../OhmPacer.h"
+#include "../OhmRealtime.h"
 
 #include "Icon.h"
 
@@ -24,6 +27,7 @@
 #define CDECL __cdecl
 
 #include <conio.h>
+#include <windows.h>
 
 int mygetch()
 {
@@ -36,6 +40,10 @@ int mygetch()
 
 #include <termios.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 
 int mygetch()
 {
@@ -58,33 +66,419 @@ using namespace OpenHome::Net;
 using namespace OpenHome::TestFramework;
 using namespace OpenHome::Av;
 
-class PcmSender
+// WavFile parses the RIFF chunks of a wav file and maps its audio data into memory,
+// so sending can begin without reading the file and memory use does not grow with its length
+
+class WavFile
+{
+	static const TUint kReadAheadBytes = 1024 * 1024;
+	static const TUint kReleaseBytes = 4 * 1024 * 1024;
+	static const TUint kMaxFormatBytes = 40;
+	static const TUint kWaveFormatPcm = 1;
+	static const TUint kWaveFormatExtensible = 0xfffe;
+
+public:
+	WavFile();
+	TBool Open(const TChar* aFilename); // prints the reason for failure
+	const TByte* Data() const {return (iData);}
+	TUint Bytes() const {return (iBytes);}
+	TUint SampleRate() const {return (iSampleRate);}
+	TUint ByteRate() const {return (iByteRate);}
+	TUint Channels() const {return (iChannels);}
+	TUint BitDepth() const {return (iBitDepth);}
+	TUint SampleCount() const {return (iBytes / (iChannels * iBitDepth / 8));}
+	void Advise(TUint aIndex); // read position: read ahead of it, release what has been sent
+	~WavFile();
+
+private:
+	TBool ParseFormat(const TByte* aFormat, TUint aBytes);
+	TBool Map(const TChar* aFilename, TUint64 aOffset, TUint64 aBytes);
+	static TUint Uint16(const TByte* aPtr);
+	static TUint Uint32(const TByte* aPtr);
+
+private:
+	TByte* iMap;
+	TUint64 iMapBytes;
+	const TByte* iData;
+	TUint iBytes;
+	TUint iSampleRate;
+	TUint iByteRate;
+	TUint iChannels;
+	TUint iBitDepth;
+	TUint iAdvised;         // read ahead up to here
+	TUint iReleased;        // released up to here
+#ifdef _WIN32
+	HANDLE iFile;
+	HANDLE iMapping;
+#endif
+};
+
+WavFile::WavFile()
+	: iMap(0)
+	, iMapBytes(0)
+	, iData(0)
+	, iBytes(0)
+	, iSampleRate(0)
+	, iByteRate(0)
+	, iChannels(0)
+	, iBitDepth(0)
+	, iAdvised(0)
+	, iReleased(0)
+#ifdef _WIN32
+	, iFile(INVALID_HANDLE_VALUE)
+	, iMapping(0)
+#endif
+{
+}
+
+TUint WavFile::Uint16(const TByte* aPtr)
+{
+	return (aPtr[0] | (aPtr[1] << 8));
+}
+
+TUint WavFile::Uint32(const TByte* aPtr)
+{
+	return (aPtr[0] | (aPtr[1] << 8) | (aPtr[2] << 16) | ((TUint)aPtr[3] << 24));
+}
+
+TBool WavFile::Open(const TChar* aFilename)
+{
+	FILE* file = fopen(aFilename, "rb");
+
+	if (file == 0) {
+		printf("Unable to open specified wav file\n");
+		return (false);
+	}
+
+	TByte header[12];
+
+	if (fread(header, 1, 12, file) != 12 || memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+		printf("Invalid wav file\n");
+		fclose(file);
+		return (false);
+	}
+
+	// walk the chunks until both the format and data chunks have been found
+
+	TUint64 offset = 12;
+	TUint64 dataOffset = 0;
+	TUint64 dataBytes = 0;
+	TBool format = false;
+	TBool data = false;
+
+	while (!format || !data) {
+		TByte chunk[8];
+
+		if (fread(chunk, 1, 8, file) != 8) {
+			break;
+		}
+
+		offset += 8;
+
+		TUint64 bytes = Uint32(chunk + 4);
+
+		if (memcmp(chunk, "fmt ", 4) == 0) {
+			TByte fmt[kMaxFormatBytes];
+			TUint read = (bytes < kMaxFormatBytes) ? (TUint)bytes : kMaxFormatBytes;
+			if (fread(fmt, 1, read, file) != read) {
+				break;
+			}
+			if (!ParseFormat(fmt, read)) {
+				fclose(file);
+				return (false);
+			}
+			format = true;
+		}
+		else if (memcmp(chunk, "data", 4) == 0) {
+			dataOffset = offset;
+			dataBytes = bytes;
+			data = true;
+		}
+
+		offset += bytes + (bytes & 1); // chunks are padded to an even length
+
+		if (!format || !data) {
+			// seek from the start to keep within the range of a long for files over 2GB
+			rewind(file);
+			TUint64 remaining = offset;
+			while (remaining > 0) {
+				long step = (remaining > 0x40000000) ? 0x40000000 : (long)remaining;
+				if (fseek(file, step, SEEK_CUR) != 0) {
+					break;
+				}
+				remaining -= step;
+			}
+		}
+	}
+
+	fclose(file);
+
+	if (!format || !data) {
+		printf("Invalid wav file\n");
+		return (false);
+	}
+
+	return (Map(aFilename, dataOffset, dataBytes));
+}
+
+TBool WavFile::ParseFormat(const TByte* aFormat, TUint aBytes)
+{
+	if (aBytes < 16) {
+		printf("Invalid wav file\n");
+		return (false);
+	}
+
+	TUint audioFormat = Uint16(aFormat);
+
+	iChannels = Uint16(aFormat + 2);
+	iSampleRate = Uint32(aFormat + 4);
+	iByteRate = Uint32(aFormat + 8);
+
+	TUint blockAlign = Uint16(aFormat + 12);
+
+	iBitDepth = Uint16(aFormat + 14);
+
+	if (audioFormat == kWaveFormatExtensible) {
+		// WAVEFORMATEXTENSIBLE: cbSize, valid bits, channel mask then the sub format guid,
+		// the first two bytes of which are the format code.  Samples are sent in their
+		// container size, so valid bits and channel mask are not needed
+
+		if (aBytes < 40 || Uint16(aFormat + 16) < 22) {
+			printf("Invalid wav file\n");
+			return (false);
+		}
+
+		audioFormat = Uint16(aFormat + 24);
+	}
+
+	if (audioFormat != kWaveFormatPcm) {
+		printf("Unsupported wav file (format %d)\n", audioFormat);
+		return (false);
+	}
+
+	if (iChannels == 0 || iSampleRate == 0 || iBitDepth == 0 || (iBitDepth % 8) != 0 || iBitDepth > 32 || blockAlign != iChannels * iBitDepth / 8) {
+		printf("Unsupported wav file (%d channels, %d bit)\n", iChannels, iBitDepth);
+		return (false);
+	}
+
+	return (true);
+}
+
+#ifdef _WIN32
+
+TBool WavFile::Map(const TChar* aFilename, TUint64 aOffset, TUint64 aBytes)
+{
+	iFile = CreateFileA(aFilename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+
+	LARGE_INTEGER size;
+
+	if (iFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(iFile, &size)) {
+		printf("Unable to open specified wav file\n");
+		return (false);
+	}
+
+	iMapBytes = size.QuadPart;
+
+	if (iMapBytes <= aOffset) {
+		printf("Wav file contains no audio\n");
+		return (false);
+	}
+
+	iMapping = CreateFileMapping(iFile, 0, PAGE_READONLY, 0, 0, 0);
+
+	if (iMapping != 0) {
+		iMap = (TByte*)MapViewOfFile(iMapping, FILE_MAP_READ, 0, 0, 0);
+	}
+
+#else
+
+TBool WavFile::Map(const TChar* aFilename, TUint64 aOffset, TUint64 aBytes)
+{
+	int fd = open(aFilename, O_RDONLY);
+
+	struct stat st;
+
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		printf("Unable to open specified wav file\n");
+		if (fd >= 0) {
+			close(fd);
+		}
+		return (false);
+	}
+
+	iMapBytes = st.st_size;
+
+	if (iMapBytes <= aOffset) {
+		printf("Wav file contains no audio\n");
+		close(fd);
+		return (false);
+	}
+
+	void* map = mmap(0, (size_t)iMapBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	close(fd);
+
+	if (map != MAP_FAILED) {
+		iMap = (TByte*)map;
+		madvise(iMap, (size_t)iMapBytes, MADV_SEQUENTIAL);
+	}
+
+#endif
+
+	if (iMap == 0) {
+		printf("Unable to map wav file\n");
+		return (false);
+	}
+
+	// files still being written (or written by streaming tools) may have a zero or
+	// oversized data length: use whatever is present, in whole sample frames
+
+	if (aBytes == 0 || aOffset + aBytes > iMapBytes) {
+		aBytes = iMapBytes - aOffset;
+	}
+
+	if (aBytes > 0xffffffff) {
+		printf("Wav file audio truncated to the first 4GB (%llu bytes present)\n", (unsigned long long)aBytes);
+		aBytes = 0xffffffff;
+	}
+
+	TUint frameBytes = iChannels * iBitDepth / 8;
+
+	iData = iMap + aOffset;
+	iBytes = (TUint)aBytes - ((TUint)aBytes % frameBytes);
+
+	if (iBytes == 0) {
+		printf("Wav file contains no audio\n");
+		return (false);
+	}
+
+	Advise(0);
+
+	return (true);
+}
+
+void WavFile::Advise(TUint aIndex)
+{
+#ifndef _WIN32
+	static const uintptr_t kPageMask = 4096 - 1;
+
+	if (aIndex < iReleased) {
+		// restarted
+		iReleased = 0;
+		iAdvised = 0;
+	}
+
+	if (aIndex + kReadAheadBytes / 2 > iAdvised) {
+		TUint end = aIndex + kReadAheadBytes;
+		if (end > iBytes || end < aIndex) {
+			end = iBytes;
+		}
+		uintptr_t from = (uintptr_t)(iData + aIndex) & ~kPageMask;
+		madvise((void*)from, (size_t)((uintptr_t)(iData + end) - from), MADV_WILLNEED);
+		iAdvised = end;
+	}
+
+	if (aIndex - iReleased >= kReleaseBytes) {
+		// pages already sent are clean, so dropping them just returns them to the page cache
+		uintptr_t from = (uintptr_t)(iData + iReleased) & ~kPageMask;
+		uintptr_t to = (uintptr_t)(iData + aIndex) & ~kPageMask;
+		if (to > from) {
+			madvise((void*)from, (size_t)(to - from), MADV_DONTNEED);
+		}
+		iReleased = aIndex;
+	}
+#else
+	(void)aIndex;
+#endif
+}
+
+WavFile::~WavFile()
+{
+#ifdef _WIN32
+	if (iMap != 0) {
+		UnmapViewOfFile(iMap);
+	}
+	if (iMapping != 0) {
+		CloseHandle(iMapping);
+	}
+	if (iFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(iFile);
+	}
+#else
+	if (iMap != 0) {
+		munmap(iMap, (size_t)iMapBytes);
+	}
+#endif
+}
+
+static DvDeviceStandard* CreateDevice(DvStack& aDvStack, const Brx& aUdn, const Brhz& aName)
+{
+	DvDeviceStandard* device = new DvDeviceStandard(aDvStack, aUdn);
+
+	device->SetAttribute("Upnp.Domain", "av.openhome.org");
+	device->SetAttribute("Upnp.Type", "Sender");
+	device->SetAttribute("Upnp.Version", "1");
+	device->SetAttribute("Upnp.FriendlyName", aName.CString());
+	device->SetAttribute("Upnp.Manufacturer", "Openhome");
+	device->SetAttribute("Upnp.ManufacturerUrl", "http://www.openhome.org");
+	device->SetAttribute("Upnp.ModelDescription", "Openhome WavSender");
+	device->SetAttribute("Upnp.ModelName", "Openhome WavSender");
+	device->SetAttribute("Upnp.ModelNumber", "1");
+	device->SetAttribute("Upnp.ModelUrl", "http://www.openhome.org");
+	device->SetAttribute("Upnp.SerialNumber", "");
+	device->SetAttribute("Upnp.Upc", "");
+
+	return (device);
+}
+
+static void PrintMemory(const TChar* aWhen)
+{
+#ifdef _WIN32
+	printf("peak rss %s: not available\n", aWhen);
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	TUint64 kb = usage.ru_maxrss / 1024; // bytes on Mac
+#else
+	TUint64 kb = usage.ru_maxrss;        // kilobytes on Linux
+#endif
+	printf("peak rss %s: %llu KB\n", aWhen, (unsigned long long)kb);
+#endif
+}
+
+class PcmSender : public IOhmPacerHandler
 {
 public:
-	static const TUint kPeriodMs = 5;
+	static const TUint kPeriodUs = 5000;
 	static const TUint kSpeedNormal = 100;
     static const TUint kSpeedMin = 75;
 	static const TUint kSpeedMax = 150;
 	static const TUint kMaxPacketBytes = 4096;
 	
 public:
-	PcmSender(Environment& aEnv, OhmSender* aSender, OhmSenderDriver* aDriver, const Brx& aUri, const TByte* aData, TUint aSampleCount, TUint aSampleRate, TUint aBitRate, TUint aChannels, TUint aBitDepth);
+	PcmSender(Environment& aEnv, OhmSender* aSender, OhmSenderDriver* aDriver, const Brx& aUri, WavFile& aFile, TUint aPeriodUs);
 	void Start();
 	void Pause();
 	void SetSpeed(TUint aValue);
 	void Restart();
 	void SetVerbosity(TBool bValue);
+	void PrintJitter();
 	~PcmSender();
 	
 private:
 	void CalculatePacketBytes();
-	void TimerExpired();
+	void Send(TUint aIndex, TUint aBytes);
+
+	// IOhmPacerHandler
+	virtual void Pace();
 	
 private:
     Environment& iEnv;
     OhmSender* iSender;
     OhmSenderDriver* iDriver;
 	Bws<OhmSender::kMaxTrackUriBytes> iUri;
+	WavFile& iFile;
 	const TByte* iData;
 	TUint iSampleCount;
 	TUint iSampleRate;
@@ -92,7 +486,8 @@ private:
 	TUint iChannels;
 	TUint iBitDepth;
 	TUint iTotalBytes;
-	Timer iTimer;
+	TUint iPeriodUs;
+	OhmPacer iPacer;
 	Mutex iMutex;
 	TBool iPaused;
 	TUint iSpeed;           // percent, 100%=normal
@@ -100,36 +495,38 @@ private:
 	TUint iPacketBytes;     // how many bytes of audio in each packet
 	TUint iPacketSamples;   // how many audio samples in each packet
 	TUint iPacketTime;      // how much audio time in each packet
-	TUint64 iLastTimeUs;    // last time stamp from system
-	TInt32 iTimeOffsetUs;   // running offset in usec from ideal time
-	                        //  <0 means sender is behind
-	                        //  >0 means sender is ahead
+	TUint iPeriodSamples;   // how many audio samples in each packet at normal speed
+	TUint iPackets;
 	TBool iVerbose;
+	TByte iPacket[kMaxPacketBytes]; // audio converted to network byte order
 };
 
-PcmSender::PcmSender(Environment& aEnv, OhmSender* aSender, OhmSenderDriver* aDriver, const Brx& aUri, const TByte* aData, TUint aSampleCount, TUint aSampleRate, TUint aBitRate, TUint aChannels, TUint aBitDepth)
+PcmSender::PcmSender(Environment& aEnv, OhmSender* aSender, OhmSenderDriver* aDriver, const Brx& aUri, WavFile& aFile, TUint aPeriodUs)
 	: iEnv(aEnv)
     , iSender(aSender)
 	, iDriver(aDriver)
 	, iUri(aUri)
-	, iData(aData)
-	, iSampleCount(aSampleCount)
-	, iSampleRate(aSampleRate)
-	, iBitRate(aBitRate)
-	, iChannels(aChannels)
-	, iBitDepth(aBitDepth)
-	, iTotalBytes(aSampleCount * aChannels * aBitDepth / 8)
-	, iTimer(aEnv, MakeFunctor(*this, &PcmSender::TimerExpired), "PcmSender")
+	, iFile(aFile)
+	, iData(aFile.Data())
+	, iSampleCount(aFile.SampleCount())
+	, iSampleRate(aFile.SampleRate())
+	, iBitRate(aFile.ByteRate() * 8)
+	, iChannels(aFile.Channels())
+	, iBitDepth(aFile.BitDepth())
+	, iTotalBytes(aFile.Bytes())
+	, iPeriodUs(aPeriodUs)
+	, iPacer("PCMS", *this, kPriorityHigh)
 	, iMutex("WAVP")
 	, iPaused(false)
 	, iSpeed(kSpeedNormal)
 	, iIndex(0)
-	, iLastTimeUs(0)
-	, iTimeOffsetUs(0)
+	, iPackets(0)
 	, iVerbose(false)
 {
 	CalculatePacketBytes();
-	printf ("bytes per packet:   %d\n", iPacketBytes);
+	iPacer.SetRole(eOhmThreadSend);
+	iPacer.SetPeriod(iPeriodSamples, iSampleRate); // exact audio time of each packet, so the long term rate does not drift
+	printf ("bytes per packet:   %u\n", iPacketBytes);
 	printf ("samples per packet: %d\n", iPacketSamples);
 	printf ("usec per packet:    %d\n", iPacketTime);
 }
@@ -138,7 +535,7 @@ void PcmSender::Start()
 {
     iDriver->SetAudioFormat(iSampleRate, iBitRate, iChannels, iBitDepth, true, Brn("WAV"));
 	iSender->SetEnabled(true);
-	iTimer.FireIn(kPeriodMs);
+	iPacer.Start();
 }
 
 void PcmSender::Pause()
@@ -147,9 +544,6 @@ void PcmSender::Pause()
 
 	if (iPaused) {
 		iPaused = false;
-		iLastTimeUs = 0;
-		iTimeOffsetUs = 0;
-		iTimer.FireIn(kPeriodMs);
 	}
 	else {
 		iPaused = true;
@@ -181,6 +575,12 @@ void PcmSender::SetVerbosity(TBool aValue)
 	iMutex.Signal();
 }
 
+void PcmSender::PrintJitter()
+{
+	iPacer.PrintStats();
+	iPacer.ResetStats();
+}
+
 void PcmSender::CalculatePacketBytes()
 {
     TUint bytespersample = iChannels * iBitDepth / 8;
@@ -190,11 +590,15 @@ void PcmSender::CalculatePacketBytes()
 	// but vary the amount of data that is actually sent
 
 	// calculate the amount of time in each packet
-	TUint norm_bytes = (iSampleRate * bytespersample * kPeriodMs) / 1000;
+	TUint norm_bytes = (TUint)(((TUint64)iSampleRate * bytespersample * iPeriodUs) / 1000000);
 	if (norm_bytes > kMaxPacketBytes) {
 		norm_bytes = kMaxPacketBytes;
 	}
+	if (norm_bytes < bytespersample) {
+		norm_bytes = bytespersample;
+	}
 	TUint norm_packet_samples = norm_bytes / bytespersample;
+	iPeriodSamples = norm_packet_samples;
 	iPacketTime = (norm_packet_samples*1000000/(iSampleRate/10) + 5)/10;
 	
 	// calculate the adjusted speed packet size
@@ -206,74 +610,76 @@ void PcmSender::CalculatePacketBytes()
 	iPacketBytes = iPacketSamples * bytespersample;
 }
 
-void PcmSender::TimerExpired()
+void PcmSender::Send(TUint aIndex, TUint aBytes)
 {
+	// wav samples are little endian and ohm big endian, so swap each packet as it is sent
+
+	const TByte* src = &iData[aIndex];
+	TByte* dst = iPacket;
+	TUint count = aBytes;
+
+	switch (iBitDepth)
+	{
+	case 16:
+		for (; count >= 2; count -= 2, src += 2, dst += 2) {
+			dst[0] = src[1];
+			dst[1] = src[0];
+		}
+		break;
+	case 24:
+		for (; count >= 3; count -= 3, src += 3, dst += 3) {
+			dst[0] = src[2];
+			dst[1] = src[1];
+			dst[2] = src[0];
+		}
+		break;
+	case 32:
+		for (; count >= 4; count -= 4, src += 4, dst += 4) {
+			dst[0] = src[3];
+			dst[1] = src[2];
+			dst[2] = src[1];
+			dst[3] = src[0];
+		}
+		break;
+	default:
+		memcpy(dst, src, count);
+		break;
+	}
+
+	iDriver->SendAudio(iPacket, aBytes);
+
+	iFile.Advise(aIndex + aBytes);
+}
+
+void PcmSender::Pace()
+{
+	// called on absolute deadlines by the pacer, so there is no drift to correct here
+
 	iMutex.Wait();
 	
 	if (!iPaused) {
-	    TUint64 now = OsTimeInUs(iEnv.OsCtx());
-
 	    if (iIndex == 0) {
             iSender->SetTrack(iUri, Brx::Empty(), iSampleCount, 0);
             iSender->SetMetatext(Brn("PcmSender repeated play"));
 	    }
 	    
 		if (iIndex + iPacketBytes <= iTotalBytes) {
-			iDriver->SendAudio(&iData[iIndex], iPacketBytes);
+			Send(iIndex, iPacketBytes);
             iIndex += iPacketBytes;
 		}
 		else {
-            iDriver->SendAudio(&iData[iIndex], iTotalBytes - iIndex);
+            Send(iIndex, iTotalBytes - iIndex);
             iSender->SetTrack(iUri, Brx::Empty(), iSampleCount, 0);
             TUint remaining = iPacketBytes + iIndex - iTotalBytes;
-            iDriver->SendAudio(&iData[0], remaining);
+            Send(0, remaining);
             iIndex = remaining;
 		}
-	
-		// skip the first packet, and any time the clock value wraps
-		if (iLastTimeUs && iLastTimeUs < now) {
-
-			// will contain the new time out in ms
-			TUint new_timer_ms = kPeriodMs;
-
-			// the difference in usec from where we should be
-			TInt32 diff = (TInt32)(now - iLastTimeUs) - iPacketTime;
-
-			// increment running offset
-			iTimeOffsetUs -= diff;
-
-			// determine new timer value based upon current offset from ideal
-			if (iTimeOffsetUs < -1000) {
-				// we are late
-				TInt32 time_offset_ms = iTimeOffsetUs/1000;
-				if (time_offset_ms < 1-(TInt32)kPeriodMs) {
-					// in case callback is severely late, we can only catch up so much
-					new_timer_ms = 1;
-				} else {
-					new_timer_ms = kPeriodMs + time_offset_ms;
-				}
-			} else if (iTimeOffsetUs > 1000) {
-				// we are early
-				new_timer_ms = kPeriodMs+1;
-			} else {
-				// we are about on time
-				new_timer_ms = kPeriodMs;
-			}
 
-			// set timer
-			iTimer.FireIn(new_timer_ms);
-
-			// logging
-			if (iVerbose) {
-				if (iTimeOffsetUs >= 1000)
-					printf ("tnow:%d tlast:%d actual:%4d diff:%4d offset:%5d timer:%d\n", (TUint)now, (TUint)iLastTimeUs, (TUint)(now-iLastTimeUs), diff, iTimeOffsetUs, new_timer_ms);
-				else
-					printf ("tnow:%d tlast:%d actual:%4d diff:%4d offset:%4d timer:%d\n", (TUint)now, (TUint)iLastTimeUs, (TUint)(now-iLastTimeUs), diff, iTimeOffsetUs, new_timer_ms);
-			}
-		} else {
-			iTimer.FireIn(kPeriodMs);
+		// logging: emission jitter once a second
+		if (iVerbose && (++iPackets % (1000000 / iPacketTime + 1)) == 0) {
+			iPacer.PrintStats();
+			iPacer.ResetStats();
 		}
-		iLastTimeUs = now;
 	}
 	
 	iMutex.Signal();
@@ -281,7 +687,7 @@ void PcmSender::TimerExpired()
 
 PcmSender::~PcmSender()
 {
-	iTimer.Cancel();
+	iPacer.Stop();
 	delete (iSender);
 	delete (iDriver);
 }
@@ -311,6 +717,9 @@ int CDECL main(int aArgc, char* aArgv[])
     OptionUint optionLatency("-l", "--latency", 100, "[latency] latency in ms");
     parser.AddOption(&optionLatency);
 
+    OptionUint optionPeriod("-p", "--period", PcmSender::kPeriodUs, "[period] audio packet period in us");
+    parser.AddOption(&optionPeriod);
+
     OptionBool optionMulticast("-m", "--multicast", "[multicast] use multicast instead of unicast");
     parser.AddOption(&optionMulticast);
 
@@ -320,6 +729,30 @@ int CDECL main(int aArgc, char* aArgv[])
     OptionBool optionPacketLogging("-z", "--logging", "[logging] toggle packet logging");
     parser.AddOption(&optionPacketLogging);
 
+    OptionBool optionFastStart("-F", "--fast-start", "[fast start] send recent audio to joining receivers at once");
+    parser.AddOption(&optionFastStart);
+
+    OptionUint optionResendShare("-R", "--resend-share", OhmSenderDriver::kDefaultResendShare, "[resend share] percent of the bit rate resends may use, 0 for no limit");
+    parser.AddOption(&optionResendShare);
+
+    OptionBool optionAllAdapters("-A", "--all-adapters", "[all adapters] also publish the stream on every other adapter");
+    parser.AddOption(&optionAllAdapters);
+
+    OptionBool optionHybrid("-H", "--hybrid", "[hybrid] while multicast, also send to receivers that join by unicast");
+    parser.AddOption(&optionHybrid);
+
+    OptionBool optionDtx("-D", "--dtx", "[dtx] send silent frames without their samples (receivers must understand silence frames)");
+    parser.AddOption(&optionDtx);
+
+    OptionUint optionFifoPriority("-P", "--fifo-priority", 0, "[1..99] SCHED_FIFO priority of the send thread, one less for the repair threads, 0 for time shared");
+    parser.AddOption(&optionFifoPriority);
+
+    OptionUint optionCpus("-C", "--cpus", 0, "[mask] cpus the send and repair threads run on, 0 for any");
+    parser.AddOption(&optionCpus);
+
+    OptionBool optionLockMemory("-L", "--lock-memory", "[lock memory] lock all pages in RAM and pre-fault the message pools and buffers");
+    parser.AddOption(&optionLockMemory);
+
     if (!parser.Parse(aArgc, aArgv)) {
         return (1);
     }
@@ -341,6 +774,11 @@ int CDECL main(int aArgc, char* aArgv[])
 
     TIpAddress subnet = (*subnetList)[optionAdapter.Value()]->Subnet();
     TIpAddress adapter = (*subnetList)[optionAdapter.Value()]->Address();
+    std::vector<TIpAddress> adapters;
+    for (unsigned i=0; i<subnetList->size(); ++i) {
+        adapters.push_back((*subnetList)[i]->Address());
+    }
+    TUint adapterIndex = optionAdapter.Value();
     Library::DestroySubnetList(subnetList);
     lib->SetCurrentSubnet(subnet);
 
@@ -358,208 +796,99 @@ int CDECL main(int aArgc, char* aArgv[])
     TUint channel = optionChannel.Value();
     TUint ttl = optionTtl.Value();
     TUint latency = optionLatency.Value();
+    TUint period = optionPeriod.Value();
     TBool multicast = optionMulticast.Value();
     TBool disabled = optionDisabled.Value();
     TBool logging = optionPacketLogging.Value();
+    TBool fastStart = optionFastStart.Value();
+    TUint resendShare = optionResendShare.Value();
+    TBool allAdapters = optionAllAdapters.Value();
+    TBool hybrid = optionHybrid.Value();
+    TBool dtx = optionDtx.Value();
+    TUint fifoPriority = optionFifoPriority.Value();
 
-    // Read WAV file
-    
-    FILE* pFile = fopen(file.CString(), "rb");
-    
-    if (pFile == 0) {
-    	printf("Unable to open specified wav file\n");
-    	return (1);
-    }
-    
-    TByte* header = new TByte[44];
-    
-    size_t count = fread((void*)header, 1, 44, pFile);
-    
-    if (count != 44)
-    {
-    	printf("Unable to read the specified wav file\n");
-    	return (1);
-    }
-    
-    if (header[0] != 'R' || header[1] != 'I' || header[2] != 'F' || header[3] != 'F')
-    {
-    	printf("Invalid wav file\n");
-    	return (1);
-    }
-    
-    TUint header0;
-    TUint header1;
-    TUint header2;
-    TUint header3;
+    // before any thread or pool it applies to is created
 
-    header0 = header[4];
-    header1 = header[5];
-    header2 = header[6];
-    header3 = header[7];
+    OhmRealtime::SetRole(eOhmThreadSend, fifoPriority, optionCpus.Value());
+    OhmRealtime::SetRole(eOhmThreadRepair, (fifoPriority > 1) ? fifoPriority - 1 : fifoPriority, optionCpus.Value());
 
-    // TUint chunkSize = header0 | (header1 << 8) | (header2 << 16) | (header3 << 24);
-    
-    if (header[8] != 'W' || header[9] != 'A' || header[10] != 'V' || header[11] != 'E')
-    {
-    	printf("Invalid wav file\n");
-    	return (1);
+    if (optionLockMemory.Value() && !OhmRealtime::SetLockMemory(true)) {
+        printf("unable to lock memory\n");
     }
-    
-    if (header[12] != 'f' || header[13] != 'm' || header[14] != 't' || header[15] != ' ')
-    {
-    	printf("Invalid wav file\n");
-    	return (1);
-    }
-    
-    header0 = header[16];
-    header1 = header[17];
-    header2 = header[18];
-    header3 = header[19];
 
-    TUint subChunk1Size = header0 | (header1 << 8) | (header2 << 16) | (header3 << 24);
-    
-    if (subChunk1Size != 16)
-    {
-    	printf("Unsupported wav file\n");
-    	return (1);
-    }
-    
-    header0 = header[20];
-    header1 = header[21];
+    // Map WAV file
 
-    TUint audioFormat = header0 | (header1 << 8);
-    
-    if (audioFormat != 1)
-    {
-    	printf("Unsupported wav file\n");
-    	return (1);
-    }
-    
-    header0 = header[22];
-    header1 = header[23];
-
-    TUint numChannels = header0 | (header1 << 8);
-    
-    header0 = header[24];
-    header1 = header[25];
-    header2 = header[26];
-    header3 = header[27];
-
-    TUint sampleRate = header0 | (header1 << 8) | (header2 << 16) | (header3 << 24);
-    
-    header0 = header[28];
-    header1 = header[29];
-    header2 = header[30];
-    header3 = header[31];
-
-    TUint byteRate = header0 | (header1 << 8) | (header2 << 16) | (header3 << 24);
-    
-    //header0 = header[32];
-    //header1 = header[33];
+    TUint64 startUs = OsTimeInUs(lib->Env().OsCtx());
 
-    //TUint blockAlign = header0 | (header1 << 8);
-    
-    header0 = header[34];
-    header1 = header[35];
+    WavFile* wav = new WavFile();
 
-    TUint bitsPerSample = header0 | (header1 << 8);
-    
-    if (header[36] != 'd' || header[37] != 'a' || header[38] != 't' || header[39] != 'a')
-    {
-    	printf("Invalid wav file\n");
+    if (!wav->Open(file.CString())) {
     	return (1);
     }
-    
-    header0 = header[40];
-    header1 = header[41];
-    header2 = header[42];
-    header3 = header[43];
 
-    TUint subChunk2Size = header0 | (header1 << 8) | (header2 << 16) | (header3 << 24);
-    
-    TByte* data = new TByte[subChunk2Size];
-    
-    count = fread((void*)data, 1, subChunk2Size, pFile);
-    
-    if (count != subChunk2Size)
-    {
-    	printf("Unable to read wav file %d, %d\n", (int)count, subChunk2Size);
-    	return (1);
-    }
-    printf ("bytes in file:      %d\n", subChunk2Size);
-    
-    fclose(pFile);
-    
-    // Convert sample data
-    
-    TByte* sample = new TByte[4];
-    
-  	TUint bytesPerSample = bitsPerSample / 8;
-	TUint sampleCount = subChunk2Size / bytesPerSample / numChannels;
+    TUint64 openUs = OsTimeInUs(lib->Env().OsCtx());
 
-    TUint scount = subChunk2Size / bytesPerSample;
-    
-    TUint pindex = 0;
-    
-    printf ("sample rate:        %d\n", sampleRate);
-    printf ("sample size:        %d\n", bytesPerSample);
-    printf ("channels:           %d\n", numChannels);
+    printf ("bytes in file:      %u\n", wav->Bytes());
+    printf ("sample rate:        %d\n", wav->SampleRate());
+    printf ("sample size:        %d\n", wav->BitDepth() / 8);
+    printf ("channels:           %d\n", wav->Channels());
+    printf ("file ready in:      %d us\n", (TUint)(openUs - startUs));
 
-    while (scount-- > 0)
-    {
-    	TUint bcount = bytesPerSample;
-
-	    TUint sindex = 0;
-	    
-	    while (bcount-- > 0)
-	    {
-	    	sample[sindex++] = data[pindex++];
-	    }
-	    
-    	bcount = bytesPerSample;
-    	
-    	sindex = 0;
-
-	    while (bcount-- > 0)
-	    {
-	    	data[--pindex] = sample[sindex++];
-	    }
-	    
-		pindex += bytesPerSample;	    
-    }
-    
     DvStack* dvStack = lib->StartDv();
 
-    DvDeviceStandard* device = new DvDeviceStandard(*dvStack, udn);
-    
-    device->SetAttribute("Upnp.Domain", "av.openhome.org");
-    device->SetAttribute("Upnp.Type", "Sender");
-    device->SetAttribute("Upnp.Version", "1");
-    device->SetAttribute("Upnp.FriendlyName", name.CString());
-    device->SetAttribute("Upnp.Manufacturer", "Openhome");
-    device->SetAttribute("Upnp.ManufacturerUrl", "http://www.openhome.org");
-    device->SetAttribute("Upnp.ModelDescription", "Openhome WavSender");
-    device->SetAttribute("Upnp.ModelName", "Openhome WavSender");
-    device->SetAttribute("Upnp.ModelNumber", "1");
-    device->SetAttribute("Upnp.ModelUrl", "http://www.openhome.org");
-    device->SetAttribute("Upnp.SerialNumber", "");
-    device->SetAttribute("Upnp.Upc", "");
+    DvDeviceStandard* device = CreateDevice(*dvStack, udn, name);
 
     OhmSenderDriver* driver = new OhmSenderDriver(lib->Env());
+
+    driver->SetFastStart(fastStart);
+    driver->SetResendShare(resendShare);
+    driver->SetDtx(dtx);
     
 	Brn icon(icon_png, icon_png_len);
 
 	OhmSender* sender = new OhmSender(lib->Env(), *device, *driver, name, channel, adapter, ttl, latency, multicast, !disabled, icon, Brn("image/png"), 0);
 	
-    PcmSender* pcmsender = new PcmSender(lib->Env(), sender, driver, file, data, sampleCount, sampleRate, byteRate * 8, numChannels, bitsPerSample);
+    sender->SetHybrid(hybrid);
+
+    if (hybrid) {
+        Brhz uri(sender->HybridUri());
+        printf("hybrid uri:         %s\n", uri.CString());
+    }
+
+    PcmSender* pcmsender = new PcmSender(lib->Env(), sender, driver, file, *wav, period);
     
     device->SetEnabled();
 
+    // every other adapter has a device and sender of its own, fed by another output of the one
+    // driver, so the audio is read and its frames built once
+
+    std::vector<DvDeviceStandard*> devices;
+    std::vector<OhmSender*> senders;
+
+    if (allAdapters) {
+        for (unsigned i=0; i<adapters.size(); ++i) {
+            if (i == adapterIndex) {
+                continue;
+            }
+            Bws<Ascii::kMaxUintStringBytes + 64> other(udn);
+            other.Append('-');
+            Ascii::AppendDec(other, i);
+            DvDeviceStandard* d = CreateDevice(*dvStack, other, name);
+            senders.push_back(new OhmSender(lib->Env(), *d, driver->AddOutput(), name, channel, adapters[i], ttl, latency, multicast, !disabled, icon, Brn("image/png"), 0));
+            d->SetEnabled();
+            devices.push_back(d);
+        }
+    }
+
 	pcmsender->Start();
+
+	printf("started in:         %d ms\n", (TUint)((OsTimeInUs(lib->Env().OsCtx()) - startUs) / 1000));
+	PrintMemory("at start");
 	
 	TUint speed = PcmSender::kSpeedNormal;
 	
-	printf("q = quit, f = faster, s = slower, n = normal, p = pause, r = restart, m = toggle multicast, e = toggle enabled\n");
+	printf("q = quit, f = faster, s = slower, n = normal, p = pause, r = restart, m = toggle multicast, e = toggle enabled, i = memory, j = jitter, g = egress, h = toggle hybrid, x = toggle dtx\n");
+	printf("t = toggle ttl, l = toggle latency, c = next channel, a = next adapter (run Receiver to see any audio gap)\n");
 	
     for (;;) {
     	int key = mygetch();
@@ -610,6 +939,19 @@ int CDECL main(int aArgc, char* aArgv[])
             }
         }
 
+        if (key == 'h') {
+            hybrid = !hybrid;
+            sender->SetHybrid(hybrid);
+            Brhz uri(sender->HybridUri());
+            printf("hybrid %d %s\n", hybrid, uri.CString());
+        }
+
+        if (key == 'x') {
+            dtx = !dtx;
+            driver->SetDtx(dtx);
+            printf("dtx %d\n", dtx);
+        }
+
         if (key == 'e') {
             if (disabled) {
                 disabled = false;
@@ -623,6 +965,45 @@ int CDECL main(int aArgc, char* aArgv[])
             }
         }
 
+        if (key == 'j') {
+            pcmsender->PrintJitter();
+        }
+
+        if (key == 'g') {
+            driver->PrintStats();
+            driver->ResetStats();
+        }
+
+        if (key == 't') {
+            ttl = (ttl == optionTtl.Value()) ? ttl + 1 : optionTtl.Value();
+            sender->SetTtl(ttl);
+            printf("ttl %d\n", ttl);
+        }
+
+        if (key == 'l') {
+            latency = (latency == optionLatency.Value()) ? latency * 2 : optionLatency.Value();
+            sender->SetLatency(latency);
+            printf("latency %d\n", latency);
+        }
+
+        if (key == 'c') {
+            channel = (channel + 1) & 0xffff;
+            sender->SetChannel(channel);
+            printf("channel %d\n", channel);
+        }
+
+        if (key == 'a') {
+            adapterIndex = (adapterIndex + 1) % adapters.size();
+            adapter = adapters[adapterIndex];
+            sender->SetInterface(adapter);
+            printf("adapter %d.%d.%d.%d\n", adapter&0xff, (adapter>>8)&0xff, (adapter>>16)&0xff, (adapter>>24)&0xff);
+        }
+
+        if (key == 'i') {
+            PrintMemory("now");
+            OhmRealtime::PrintConfig();
+        }
+
         if (key == 'z') {
             if (logging) {
                 pcmsender->SetVerbosity(logging=false);
@@ -632,9 +1013,21 @@ int CDECL main(int aArgc, char* aArgv[])
         }
     }
        
+    for (unsigned i=0; i<senders.size(); ++i) {
+        delete (senders[i]);
+    }
+
     delete (pcmsender);
 
+    for (unsigned i=0; i<devices.size(); ++i) {
+        delete (devices[i]);
+    }
+
     delete (device);
+
+    PrintMemory("at exit");
+
+    delete (wav);
     
 	UpnpLibrary::Close();
 
@@ -56,7 +56,7 @@ all_common : all_common_native
 !else
 all_common : all_common_native all_common_cs
 !endif
-all: $(objdir)$(dllprefix)ohSongcast.$(dllext) $(objdir)TestSongcast.$(exeext) all_common
+all: $(objdir)$(dllprefix)ohSongcast.$(dllext) $(objdir)TestSongcast.$(exeext) $(objdir)TestSongcastBatch.$(exeext) $(objdir)TestSongcastStartup.$(exeext) all_common
 
 
 # Include rules to build platform independent code
@@ -84,3 +84,11 @@ $(objdir)TestSongcast.$(exeext) : $(objdir)$(dllprefix)ohSongcast.$(dllext) ohSo
 	$(compiler)TestSongcast.$(objext) -c $(cflags) $(includes) ohSongcast\TestSongcast.cpp
 	$(link) $(linkoutput)$(objdir)TestSongcast.$(exeext) $(objdir)TestSongcast.$(objext) $(objects_songcast_dll) $(ohnetdir)$(libprefix)TestFramework.$(libext)
 
+$(objdir)TestSongcastBatch.$(exeext) : $(objdir)$(dllprefix)ohSongcast.$(dllext) ohSongcast\TestSongcastBatch.cpp
+	$(compiler)TestSongcastBatch.$(objext) -c $(cflags) $(includes) ohSongcast\TestSongcastBatch.cpp
+	$(link) $(linkoutput)$(objdir)TestSongcastBatch.$(exeext) $(objdir)TestSongcastBatch.$(objext) $(objects_songcast_dll) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
+$(objdir)TestSongcastStartup.$(exeext) : $(objdir)$(dllprefix)ohSongcast.$(dllext) ohSongcast\TestSongcastStartup.cpp
+	$(compiler)TestSongcastStartup.$(objext) -c $(cflags) $(includes) ohSongcast\TestSongcastStartup.cpp
+	$(link) $(linkoutput)$(objdir)TestSongcastStartup.$(exeext) $(objdir)TestSongcastStartup.$(objext) $(objects_songcast_dll) $(ohnetdir)$(libprefix)TestFramework.$(libext)
+
@@ -48,6 +48,7 @@
 #define OHM_TYPE_METATEXT           5
 #define OHM_TYPE_SLAVE              6
 #define OHM_TYPE_RESEND             7
+#define OHM_TYPE_RESEND_RANGE       8
 
 
 static const value_string ohm_type_vals[] = {
@@ -59,6 +60,7 @@ static const value_string ohm_type_vals[] = {
 	{ OHM_TYPE_METATEXT,      "Metatext" },
 	{ OHM_TYPE_SLAVE,         "Slave" },
 	{ OHM_TYPE_RESEND,        "Resend" },
+	{ OHM_TYPE_RESEND_RANGE,  "Resend Range" },
 	{ 0, NULL }
 };
 
@@ -115,6 +117,11 @@ static int hf_slave_count = -1;
 /* Resend packet fields */
 static int hf_resend_count = -1;
 
+/* Resend Range packet fields */
+static int hf_resend_range_first = -1;
+static int hf_resend_range_count = -1;
+static int hf_resend_range_bitmap = -1;
+
 static const int *audio_flags[] = {
 	&hf_audio_flag_halt,
 	&hf_audio_flag_ll,
@@ -289,6 +296,18 @@ static int dissect_ohm(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree)
 			/* Frame count */
 			proto_tree_add_item(ohm_tree, hf_resend_count, tvb, offset, 4, ENC_BIG_ENDIAN);
 			offset += 4;
+			break;
+
+		case OHM_TYPE_RESEND_RANGE:
+			/* First frame */
+			proto_tree_add_item(ohm_tree, hf_resend_range_first, tvb, offset, 4, ENC_BIG_ENDIAN);
+			offset += 4;
+			/* Frame count */
+			proto_tree_add_item(ohm_tree, hf_resend_range_count, tvb, offset, 4, ENC_BIG_ENDIAN);
+			offset += 4;
+			/* Bitmap of frames to resend */
+			proto_tree_add_item(ohm_tree, hf_resend_range_bitmap, tvb, offset, -1, ENC_NA);
+			break;
 		}
 	}
 
@@ -691,6 +710,39 @@ void proto_register_ohm(void)
 				  0x0,
 				  "Frame Count", 
 				  HFILL }
+		},
+		{
+			&hf_resend_range_first,
+				{ "First Frame", 
+				  "ohm.resend_range_first",
+				  FT_UINT32, 
+				  BASE_DEC, 
+				  NULL, 
+				  0x0,
+				  "First Frame", 
+				  HFILL }
+		},
+		{
+			&hf_resend_range_count,
+				{ "Frame Count", 
+				  "ohm.resend_range_count",
+				  FT_UINT32, 
+				  BASE_DEC, 
+				  NULL, 
+				  0x0,
+				  "Frames covered by the bitmap", 
+				  HFILL }
+		},
+		{
+			&hf_resend_range_bitmap,
+				{ "Bitmap", 
+				  "ohm.resend_range_bitmap",
+				  FT_BYTES, 
+				  BASE_NONE, 
+				  NULL, 
+				  0x0,
+				  "Frames to resend, lsb first from the first frame", 
+				  HFILL }
 		}
 	};
 
@@ -0,0 +1,454 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/Env.h>
+
+#include "../Ohm.h"
+#include "../OhmZone.h"
+
+#include <vector>
+#include <map>
+#include <stdio.h>
+
+#ifdef _WIN32
+#define CDECL __cdecl
+#else
+#define CDECL
+#endif
+
+// Counts the Ohz packets a house of zone mode receivers puts on the zone group
+//
+// Runs in simulated time: no packets are sent. Each scenario is run twice, once with the receivers
+// and sender behaving as they used to (a query every 100ms until answered, each query answered) and
+// once as OhmReceiver and OhmSender do now (OhzQueryBackoff, OhzZoneCache and aggregated answers).
+//
+//   power    every receiver starts within half a second of the others and the sender appears later
+//   join     the sender is already running when the receivers start
+//   rejoin   as join, but the receivers have played the zone before, so have it cached
+
+namespace OpenHome {
+namespace Av {
+
+class Simulation;
+
+class SimulatedReceiver
+{
+public:
+	SimulatedReceiver(Simulation& aSimulation, Environment& aEnv, TUint aIndex);
+	void Start(TBool aCached);
+	void TimerExpired(TUint aGeneration);
+	void QueryReceived(TUint aSender);
+	void UriReceived();
+	TBool Answered() const {return (iAnswered);}
+	TUint WaitedMs() const {return (iPlayingAt - iStartedAt);}
+
+private:
+	void FireIn(TUint aDelayMs);
+
+private:
+	Simulation& iSimulation;
+	OhzQueryBackoff iBackoff;
+	TUint iIndex;
+	TUint iGeneration;
+	TBool iAnswered;
+	TBool iPlaying;
+	TUint iStartedAt;
+	TUint iPlayingAt;
+};
+
+class Simulation
+{
+public:
+	static const TUint kSender = 0xffffffff;
+	static const TUint kMaxDurationMs = 60000;
+	static const TUint kNetworkDelayMs = 1;
+	static const TUint kLegacyQueryDelayMs = 100;
+	static const TUint kSenderUriDelayMs = 100; // OhmSender::kTimerZoneUriDelayMs
+	static const TUint kSenderAggregateMs = 20; // OhmSender::kTimerZoneUriAggregateMs
+
+public:
+	Simulation(Environment& aEnv, TUint aReceivers, TBool aLegacy, TUint aLossPercent);
+	~Simulation();
+	void Run(TUint aReceiverSpreadMs, TUint aSenderStartMs, TBool aCached);
+	void Report(const TChar* aScenario) const;
+
+	TUint Now() const {return (iNow);}
+	TBool Legacy() const {return (iLegacy);}
+	void Timer(TUint aReceiver, TUint aDelayMs, TUint aGeneration);
+	void SendQuery(TUint aReceiver);
+
+private:
+	enum EEvent {
+		eReceiverStart,
+		eReceiverTimer,
+		eQuery,
+		eUri,
+		eSenderStart,
+		eSenderTimer
+	};
+
+	struct Event
+	{
+		EEvent iType;
+		TUint iTarget;
+		TUint iSource;
+		TUint iGeneration;
+	};
+
+	void Schedule(TUint aAt, EEvent aType, TUint aTarget, TUint aSource, TUint aGeneration);
+	void Deliver(EEvent aType, TUint aSource);
+	void SenderQueryReceived();
+	void SenderTimerExpired();
+	void Count();
+
+private:
+	Environment& iEnv;
+	TBool iLegacy;
+	TUint iLossPercent;
+	TBool iCached;
+	TUint iNow;
+	std::vector<SimulatedReceiver*> iReceivers;
+	std::multimap<TUint, Event> iEvents;
+	std::vector<TUint> iBuckets; // packets per 100ms
+	TUint iQueries;
+	TUint iUris;
+	TBool iSenderUp;
+	TUint iSenderCount;
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+// SimulatedReceiver - as OhmReceiver::RunZone
+
+SimulatedReceiver::SimulatedReceiver(Simulation& aSimulation, Environment& aEnv, TUint aIndex)
+	: iSimulation(aSimulation)
+	, iBackoff(aEnv)
+	, iIndex(aIndex)
+	, iGeneration(0)
+	, iAnswered(false)
+	, iPlaying(false)
+	, iStartedAt(0)
+	, iPlayingAt(0)
+{
+}
+
+void SimulatedReceiver::FireIn(TUint aDelayMs)
+{
+	iSimulation.Timer(iIndex, aDelayMs, ++iGeneration);
+}
+
+void SimulatedReceiver::Start(TBool aCached)
+{
+	iStartedAt = iSimulation.Now();
+	iPlayingAt = iStartedAt;
+
+	if (iSimulation.Legacy()) {
+		iSimulation.SendQuery(iIndex);
+		FireIn(Simulation::kLegacyQueryDelayMs);
+		return;
+	}
+
+	FireIn(iBackoff.Start(aCached));
+
+	if (aCached) {
+		iPlaying = true;
+		iPlayingAt = iSimulation.Now();
+	}
+}
+
+void SimulatedReceiver::TimerExpired(TUint aGeneration)
+{
+	if (aGeneration != iGeneration || iAnswered) {
+		return; // cancelled or rescheduled
+	}
+
+	iSimulation.SendQuery(iIndex);
+
+	if (iSimulation.Legacy()) {
+		FireIn(Simulation::kLegacyQueryDelayMs);
+	}
+	else {
+		FireIn(iBackoff.Queried());
+	}
+}
+
+void SimulatedReceiver::QueryReceived(TUint aSender)
+{
+	if (iSimulation.Legacy() || iAnswered || aSender == iIndex) {
+		return;
+	}
+
+	FireIn(iBackoff.Queried());
+}
+
+void SimulatedReceiver::UriReceived()
+{
+	iAnswered = true;
+	iGeneration++;
+
+	if (!iPlaying) {
+		iPlaying = true;
+		iPlayingAt = iSimulation.Now();
+	}
+}
+
+// Simulation
+
+Simulation::Simulation(Environment& aEnv, TUint aReceivers, TBool aLegacy, TUint aLossPercent)
+	: iEnv(aEnv)
+	, iLegacy(aLegacy)
+	, iLossPercent(aLossPercent)
+	, iCached(false)
+	, iNow(0)
+	, iBuckets(kMaxDurationMs / 100 + 1, 0)
+	, iQueries(0)
+	, iUris(0)
+	, iSenderUp(false)
+	, iSenderCount(0)
+{
+	for (TUint i = 0; i < aReceivers; i++) {
+		iReceivers.push_back(new SimulatedReceiver(*this, aEnv, i));
+	}
+}
+
+Simulation::~Simulation()
+{
+	for (TUint i = 0; i < iReceivers.size(); i++) {
+		delete (iReceivers[i]);
+	}
+}
+
+void Simulation::Schedule(TUint aAt, EEvent aType, TUint aTarget, TUint aSource, TUint aGeneration)
+{
+	Event event;
+	event.iType = aType;
+	event.iTarget = aTarget;
+	event.iSource = aSource;
+	event.iGeneration = aGeneration;
+	iEvents.insert(std::pair<TUint, Event>(aAt, event));
+}
+
+void Simulation::Timer(TUint aReceiver, TUint aDelayMs, TUint aGeneration)
+{
+	Schedule(iNow + aDelayMs, eReceiverTimer, aReceiver, 0, aGeneration);
+}
+
+void Simulation::Count()
+{
+	iBuckets[iNow / 100]++;
+}
+
+void Simulation::SendQuery(TUint aReceiver)
+{
+	iQueries++;
+	Count();
+	Deliver(eQuery, aReceiver);
+}
+
+// every member of the zone group hears a packet, less any lost on the way
+
+void Simulation::Deliver(EEvent aType, TUint aSource)
+{
+	for (TUint i = 0; i < iReceivers.size(); i++) {
+		if (iEnv.Random(99) >= iLossPercent) {
+			Schedule(iNow + kNetworkDelayMs, aType, i, aSource, 0);
+		}
+	}
+
+	if (aType == eQuery && iEnv.Random(99) >= iLossPercent) {
+		Schedule(iNow + kNetworkDelayMs, aType, kSender, aSource, 0);
+	}
+}
+
+// as OhmSender::RunZone and OhmSender::AnswerZoneQuery
+
+void Simulation::SenderQueryReceived()
+{
+	if (!iSenderUp) {
+		return;
+	}
+
+	if (iLegacy) {
+		iSenderCount = 1;
+		Schedule(iNow, eSenderTimer, kSender, 0, 0);
+		return;
+	}
+
+	if (iSenderCount > 0) {
+		return;
+	}
+
+	iSenderCount = 1;
+	Schedule(iNow + kSenderAggregateMs, eSenderTimer, kSender, 0, 0);
+}
+
+// as OhmSender::SendZoneUri; a legacy sender answers every query it is given
+
+void Simulation::SenderTimerExpired()
+{
+	if (iSenderCount == 0) {
+		return;
+	}
+
+	iUris++;
+	Count();
+	Deliver(eUri, kSender);
+
+	if (--iSenderCount > 0) {
+		Schedule(iNow + kSenderUriDelayMs, eSenderTimer, kSender, 0, 0);
+	}
+}
+
+void Simulation::Run(TUint aReceiverSpreadMs, TUint aSenderStartMs, TBool aCached)
+{
+	iCached = aCached;
+
+	for (TUint i = 0; i < iReceivers.size(); i++) {
+		Schedule(aReceiverSpreadMs == 0 ? 0 : iEnv.Random(aReceiverSpreadMs), eReceiverStart, i, 0, 0);
+	}
+
+	if (aSenderStartMs == 0) {
+		iSenderUp = true; // already running: its start up announcement has long gone
+	}
+	else {
+		Schedule(aSenderStartMs, eSenderStart, kSender, 0, 0);
+	}
+
+	while (!iEvents.empty()) {
+		std::multimap<TUint, Event>::iterator it = iEvents.begin();
+		iNow = it->first;
+		Event event = it->second;
+		iEvents.erase(it);
+
+		if (iNow >= kMaxDurationMs) {
+			break;
+		}
+
+		switch (event.iType) {
+		case eReceiverStart:
+			iReceivers[event.iTarget]->Start(iCached);
+			break;
+		case eReceiverTimer:
+			iReceivers[event.iTarget]->TimerExpired(event.iGeneration);
+			break;
+		case eQuery:
+			if (event.iTarget == kSender) {
+				SenderQueryReceived();
+			}
+			else {
+				iReceivers[event.iTarget]->QueryReceived(event.iSource);
+			}
+			break;
+		case eUri:
+			iReceivers[event.iTarget]->UriReceived();
+			break;
+		case eSenderStart:
+			iSenderUp = true; // UpdateUri announces the uri three times
+			iSenderCount = 3;
+			Schedule(iNow, eSenderTimer, kSender, 0, 0);
+			break;
+		case eSenderTimer:
+			SenderTimerExpired();
+			break;
+		}
+	}
+}
+
+void Simulation::Report(const TChar* aScenario) const
+{
+	TUint answered = 0;
+	TUint longestWait = 0;
+
+	for (TUint i = 0; i < iReceivers.size(); i++) {
+		if (iReceivers[i]->Answered()) {
+			answered++;
+		}
+		if (iReceivers[i]->WaitedMs() > longestWait) {
+			longestWait = iReceivers[i]->WaitedMs();
+		}
+	}
+
+	// busiest second, in steps of 100ms
+
+	TUint peak = 0;
+
+	for (TUint i = 0; i + 10 <= iBuckets.size(); i++) {
+		TUint packets = 0;
+		for (TUint j = i; j < i + 10; j++) {
+			packets += iBuckets[j];
+		}
+		if (packets > peak) {
+			peak = packets;
+		}
+	}
+
+	printf("%-8s %-7s %6d queries %5d uris %6d peak packets/s %3d/%d answered, longest wait to play %5d ms\n",
+		aScenario,
+		iLegacy ? "legacy" : "now",
+		iQueries,
+		iUris,
+		peak,
+		answered,
+		(TUint)iReceivers.size(),
+		longestWait);
+}
+
+static void Scenario(Environment& aEnv, const TChar* aName, TUint aReceivers, TUint aLossPercent, TUint aSpreadMs, TUint aSenderStartMs, TBool aCached)
+{
+	Simulation legacy(aEnv, aReceivers, true, aLossPercent);
+	legacy.Run(aSpreadMs, aSenderStartMs, false);
+	legacy.Report(aName);
+
+	Simulation now(aEnv, aReceivers, false, aLossPercent);
+	now.Run(aSpreadMs, aSenderStartMs, aCached);
+	now.Report(aName);
+}
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+	InitialisationParams* initParams = InitialisationParams::Create();
+
+    OptionParser parser;
+    OptionUint optionReceivers("-n", "--receivers", 50, "Number of receivers in zone mode");
+    OptionUint optionSpread("-p", "--spread", 500, "Time in ms over which the receivers start");
+    OptionUint optionSender("-s", "--sender", 2000, "Time in ms at which the sender appears after a power restore");
+    OptionUint optionLoss("-l", "--loss", 0, "Percentage of packets each listener loses");
+    parser.AddOption(&optionReceivers);
+    parser.AddOption(&optionSpread);
+    parser.AddOption(&optionSender);
+    parser.AddOption(&optionLoss);
+    if (!parser.Parse(aArgc, aArgv)) {
+        return (1);
+    }
+
+    Library* lib = new Library(initParams);
+
+	TUint receivers = optionReceivers.Value();
+	TUint loss = optionLoss.Value();
+	TUint sender = optionSender.Value();
+
+	if (loss > 99) {
+		loss = 99;
+	}
+
+	if (sender == 0) {
+		sender = 1;
+	}
+
+	printf("%d receivers, %d%% loss\n", receivers, loss);
+
+	Scenario(lib->Env(), "power", receivers, loss, optionSpread.Value(), sender, false);
+	Scenario(lib->Env(), "join", receivers, loss, optionSpread.Value(), 0, false);
+	Scenario(lib->Env(), "rejoin", receivers, loss, optionSpread.Value(), 0, true);
+
+	delete lib;
+
+	return (0);
+}
@@ -4,11 +4,14 @@
 #include <OpenHome/Private/Thread.h>
 #include <OpenHome/Private/OptionParser.h>
 #include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Os.h>
 
 #include "../Ohm.h"
 #include "../OhmSocket.h"
 
 #include <vector>
+#include <map>
 #include <stdio.h>
 
 #ifdef _WIN32
@@ -51,21 +54,226 @@ using namespace OpenHome::Net;
 using namespace OpenHome::TestFramework;
 using namespace OpenHome::Av;
 
+// ZoneDirectory holds the last zone uri and preset metadata heard on the Ohz group
+//
+// Given to a Watcher that answers queries (-d), it lets one responder serve a site: a query for a
+// zone or preset heard recently enough is answered at once from the table, and the sender, hearing
+// the answer while its own is held back (OhmSender::AnswerZoneQuery), stays quiet. An entry is only
+// served for kMaxAgeMs after its owner last announced it, so a sender that has gone is soon left to
+// answer (or not) for itself, and each sender still refreshes its entry now and again.
+
+class ZoneDirectory
+{
+	static const TUint kMaxZoneBytes = 100;
+	static const TUint kMaxMetadataBytes = 1024;
+
+public:
+	static const TUint kMaxAgeMs = 60000;
+
+public:
+	ZoneDirectory(Environment& aEnv);
+	void ZoneUri(const Brx& aZone, const Brx& aUri);
+	void PresetInfo(TUint aPreset, const Brx& aMetadata);
+	TBool FindZone(const Brx& aZone, Bwx& aUri); // false if unknown or stale
+	TBool FindPreset(TUint aPreset, Bwx& aMetadata);
+	void Print();
+	~ZoneDirectory();
+
+private:
+	class Zone
+	{
+	public:
+		Zone(const Brx& aZone) : iZone(aZone), iAnswers(0) {}
+
+	public:
+		Bws<kMaxZoneBytes> iZone;
+		Bws<Ohm::kMaxUriBytes> iUri;
+		TUint64 iHeardMs;
+		TUint iAnswers;
+	};
+
+	class Preset
+	{
+	public:
+		Preset() : iAnswers(0) {}
+
+	public:
+		Bws<kMaxMetadataBytes> iMetadata;
+		TUint64 iHeardMs;
+		TUint iAnswers;
+	};
+
+	TUint64 NowMs();
+
+private:
+	Environment& iEnv;
+	Mutex iMutex;
+	std::map<Brn, Zone*, BufferCmp> iZones; // keyed on each zone's own buffer
+	std::map<TUint, Preset*> iPresets;
+};
+
 class Watcher
 {
+	static const TUint kMaxFrameBytes = 2048;
+
 public:
-	Watcher(Environment& aEnv, TIpAddress aInterface);
+	Watcher(Environment& aEnv, TIpAddress aInterface, ZoneDirectory& aDirectory, TBool aAnswer);
 	void Run();
 	~Watcher();
+private:
+	void SendZoneUri(const Brx& aZone, const Brx& aUri);
+	void SendPresetInfo(TUint aPreset, const Brx& aMetadata);
 private:
 	TIpAddress iInterface;
+	ZoneDirectory& iDirectory;
+	TBool iAnswer;
 	OhzSocket iSocket;
-	Srs<1000> iBuffer;
+	Srs<kMaxFrameBytes> iBuffer;
+	Bws<kMaxFrameBytes> iTxBuffer;
 	ThreadFunctor* iThread;
 };
 
-Watcher::Watcher(Environment& aEnv, TIpAddress aInterface)
+// ZoneDirectory
+
+ZoneDirectory::ZoneDirectory(Environment& aEnv)
+	: iEnv(aEnv)
+	, iMutex("ZDIR")
+{
+}
+
+ZoneDirectory::~ZoneDirectory()
+{
+	std::map<Brn, Zone*, BufferCmp>::iterator zone;
+
+	for (zone = iZones.begin(); zone != iZones.end(); zone++) {
+		delete (zone->second);
+	}
+
+	std::map<TUint, Preset*>::iterator preset;
+
+	for (preset = iPresets.begin(); preset != iPresets.end(); preset++) {
+		delete (preset->second);
+	}
+}
+
+TUint64 ZoneDirectory::NowMs()
+{
+	return (OsTimeInUs(iEnv.OsCtx()) / 1000);
+}
+
+void ZoneDirectory::ZoneUri(const Brx& aZone, const Brx& aUri)
+{
+	if (aZone.Bytes() > kMaxZoneBytes || aUri.Bytes() > Ohm::kMaxUriBytes) {
+		return;
+	}
+
+	AutoMutex mutex(iMutex);
+
+	std::map<Brn, Zone*, BufferCmp>::iterator it = iZones.find(Brn(aZone));
+
+	Zone* zone;
+
+	if (it == iZones.end()) {
+		zone = new Zone(aZone);
+		iZones.insert(std::pair<Brn, Zone*>(Brn(zone->iZone), zone));
+	}
+	else {
+		zone = it->second;
+	}
+
+	zone->iUri.Replace(aUri);
+	zone->iHeardMs = NowMs();
+}
+
+void ZoneDirectory::PresetInfo(TUint aPreset, const Brx& aMetadata)
+{
+	if (aPreset == 0 || aMetadata.Bytes() > kMaxMetadataBytes) {
+		return;
+	}
+
+	AutoMutex mutex(iMutex);
+
+	std::map<TUint, Preset*>::iterator it = iPresets.find(aPreset);
+
+	Preset* preset;
+
+	if (it == iPresets.end()) {
+		preset = new Preset();
+		iPresets.insert(std::pair<TUint, Preset*>(aPreset, preset));
+	}
+	else {
+		preset = it->second;
+	}
+
+	preset->iMetadata.Replace(aMetadata);
+	preset->iHeardMs = NowMs();
+}
+
+TBool ZoneDirectory::FindZone(const Brx& aZone, Bwx& aUri)
+{
+	AutoMutex mutex(iMutex);
+
+	std::map<Brn, Zone*, BufferCmp>::iterator it = iZones.find(Brn(aZone));
+
+	if (it == iZones.end() || NowMs() - it->second->iHeardMs > kMaxAgeMs) {
+		return (false);
+	}
+
+	aUri.Replace(it->second->iUri);
+	it->second->iAnswers++;
+
+	return (true);
+}
+
+TBool ZoneDirectory::FindPreset(TUint aPreset, Bwx& aMetadata)
+{
+	AutoMutex mutex(iMutex);
+
+	std::map<TUint, Preset*>::iterator it = iPresets.find(aPreset);
+
+	if (it == iPresets.end() || NowMs() - it->second->iHeardMs > kMaxAgeMs) {
+		return (false);
+	}
+
+	aMetadata.Replace(it->second->iMetadata);
+	it->second->iAnswers++;
+
+	return (true);
+}
+
+void ZoneDirectory::Print()
+{
+	AutoMutex mutex(iMutex);
+
+	TUint64 now = NowMs();
+
+	printf("%d zones\n", (TUint)iZones.size());
+
+	std::map<Brn, Zone*, BufferCmp>::iterator zone;
+
+	for (zone = iZones.begin(); zone != iZones.end(); zone++) {
+		Bws<kMaxZoneBytes + 1> name(zone->second->iZone);
+		name.Append('\0');
+		Bws<Ohm::kMaxUriBytes + 1> uri(zone->second->iUri);
+		uri.Append('\0');
+		printf("  %s = %s (heard %ds ago, %d answers)\n", (TChar*)name.Ptr(), (TChar*)uri.Ptr(), (TUint)((now - zone->second->iHeardMs) / 1000), zone->second->iAnswers);
+	}
+
+	printf("%d presets\n", (TUint)iPresets.size());
+
+	std::map<TUint, Preset*>::iterator preset;
+
+	for (preset = iPresets.begin(); preset != iPresets.end(); preset++) {
+		printf("  %d = %d bytes of metadata (heard %ds ago, %d answers)\n", preset->first, preset->second->iMetadata.Bytes(), (TUint)((now - preset->second->iHeardMs) / 1000), preset->second->iAnswers);
+	}
+}
+
+// Watcher
+
+Watcher::Watcher(Environment& aEnv, TIpAddress aInterface, ZoneDirectory& aDirectory, TBool aAnswer)
 	: iInterface(aInterface)
+	, iDirectory(aDirectory)
+	, iAnswer(aAnswer)
     , iSocket(aEnv)
 	, iBuffer(iSocket)
 {
@@ -81,6 +289,37 @@ Watcher::~Watcher()
 	delete (iThread);
 }
 
+void Watcher::SendZoneUri(const Brx& aZone, const Brx& aUri)
+{
+	OhzHeaderZoneUri headerZoneUri(aZone, aUri);
+	OhzHeader header(OhzHeader::kMsgTypeZoneUri, headerZoneUri.MsgBytes());
+
+	WriterBuffer writer(iTxBuffer);
+
+	writer.Flush();
+	header.Externalise(writer);
+	headerZoneUri.Externalise(writer);
+	writer.Write(aZone);
+	writer.Write(aUri);
+
+	iSocket.Send(iTxBuffer);
+}
+
+void Watcher::SendPresetInfo(TUint aPreset, const Brx& aMetadata)
+{
+	OhzHeaderPresetInfo headerPresetInfo(aPreset, aMetadata);
+	OhzHeader header(OhzHeader::kMsgTypePresetInfo, headerPresetInfo.MsgBytes());
+
+	WriterBuffer writer(iTxBuffer);
+
+	writer.Flush();
+	header.Externalise(writer);
+	headerPresetInfo.Externalise(writer);
+	writer.Write(aMetadata);
+
+	iSocket.Send(iTxBuffer);
+}
+
 void Watcher::Run()
 {
 	try {
@@ -97,33 +336,53 @@ void Watcher::Run()
 				continue;
 			}
 
+			// this watcher's own answers come back to it: they are neither printed nor learnt from
+
+			TBool own = iSocket.SenderIsThis();
+
 			if (header.MsgType() == OhzHeader::kMsgTypeZoneQuery) {
 				OhzHeaderZoneQuery headerZoneQuery;
 				headerZoneQuery.Internalise(iBuffer, header);
 				Bws<1000> zone(iBuffer.Read(headerZoneQuery.ZoneBytes()));
+				Bws<Ohm::kMaxUriBytes> uri;
+				TBool answer = (iAnswer && iDirectory.FindZone(zone, uri));
+				if (answer) {
+					SendZoneUri(zone, uri);
+				}
 				zone.Append('\0');
-				printf("ZONE QUERY: %s\n", (TChar*)zone.Ptr());
+				printf("ZONE QUERY: %s%s\n", (TChar*)zone.Ptr(), answer ? " (answered)" : "");
 			}
 			else if (header.MsgType() == OhzHeader::kMsgTypeZoneUri) {
 				OhzHeaderZoneUri headerZoneUri;
 				headerZoneUri.Internalise(iBuffer, header);
 				Bws<1000> zone(iBuffer.Read(headerZoneUri.ZoneBytes()));
-				zone.Append('\0');
 				Bws<1000> uri(iBuffer.Read(headerZoneUri.UriBytes()));
-				uri.Append('\0');
-				printf("ZONE URI: %s = %s\n", (TChar*)zone.Ptr(), (TChar*)uri.Ptr());
+				if (!own) {
+					iDirectory.ZoneUri(zone, uri);
+					zone.Append('\0');
+					uri.Append('\0');
+					printf("ZONE URI: %s = %s\n", (TChar*)zone.Ptr(), (TChar*)uri.Ptr());
+				}
 			}
 			else if (header.MsgType() == OhzHeader::kMsgTypePresetQuery) {
 				OhzHeaderPresetQuery headerPresetQuery;
 				headerPresetQuery.Internalise(iBuffer, header);
-				printf("PRESET QUERY: %d\n", headerPresetQuery.Preset());
+				Bws<kMaxFrameBytes> info;
+				TBool answer = (iAnswer && iDirectory.FindPreset(headerPresetQuery.Preset(), info));
+				if (answer) {
+					SendPresetInfo(headerPresetQuery.Preset(), info);
+				}
+				printf("PRESET QUERY: %d%s\n", headerPresetQuery.Preset(), answer ? " (answered)" : "");
 			}
 			else if (header.MsgType() == OhzHeader::kMsgTypePresetInfo) {
 				OhzHeaderPresetInfo headerPresetInfo;
 				headerPresetInfo.Internalise(iBuffer, header);
-				Bws<1000> info(iBuffer.Read(headerPresetInfo.MetadataBytes()));
-				info.Append('\0');
-				printf("PRESET INFO: %d = %s\n", headerPresetInfo.Preset(), (TChar*)info.Ptr());
+				Bws<kMaxFrameBytes> info(iBuffer.Read(headerPresetInfo.MetadataBytes()));
+				if (!own) {
+					iDirectory.PresetInfo(headerPresetInfo.Preset(), info);
+					info.Append('\0');
+					printf("PRESET INFO: %d = %s\n", headerPresetInfo.Preset(), (TChar*)info.Ptr());
+				}
 			}
 
 			iBuffer.ReadFlush();
@@ -145,6 +404,8 @@ int CDECL main(int aArgc, char* aArgv[])
     OptionParser parser;
     OptionUint optionAdapter("-a", "--adapter", 0, "[adapter] index of network adapter to use");
     parser.AddOption(&optionAdapter);
+    OptionBool optionDirectory("-d", "--directory", "[directory] answer zone and preset queries from the table of those heard");
+    parser.AddOption(&optionDirectory);
     if (!parser.Parse(aArgc, aArgv)) {
         return (1);
     }
@@ -159,7 +420,10 @@ int CDECL main(int aArgc, char* aArgv[])
 
     printf("Using subnet %d.%d.%d.%d\n", subnet&0xff, (subnet>>8)&0xff, (subnet>>16)&0xff, (subnet>>24)&0xff);
 
-	Watcher* watcher = new Watcher(lib->Env(), interface);
+	ZoneDirectory* directory = new ZoneDirectory(lib->Env());
+	Watcher* watcher = new Watcher(lib->Env(), interface, *directory, optionDirectory.Value());
+
+	printf("Press 't' to list the zones and presets heard, 'q' to quit\n");
 
     for (;;) {
     	int key = mygetch();
@@ -167,8 +431,13 @@ int CDECL main(int aArgc, char* aArgv[])
     	if (key == 'q') {
     		break;
     	}
+
+    	if (key == 't') {
+    		directory->Print();
+    	}
 	}
 
 	delete (watcher);
+	delete (directory);
     delete lib;
 }
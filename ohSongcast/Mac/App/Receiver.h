@@ -22,6 +22,7 @@
 - (id) initWithPtr:(void*)aPtr;
 - (id) initWithPref:(PrefReceiver*)aPref;
 - (void) updateWithPtr:(void*)aPtr;
+- (bool) hasPtr:(void*)aPtr;
 - (PrefReceiver*) convertToPref;
 - (EReceiverState) status;
 - (void) play;
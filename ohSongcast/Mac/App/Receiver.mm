@@ -80,6 +80,16 @@
 }
 
 
+- (bool) hasPtr:(void*)aPtr
+{
+    // access to iPtr must be locked
+    @synchronized(iLock)
+    {
+        return (iPtr == aPtr);
+    }
+}
+
+
 - (PrefReceiver*) convertToPref
 {
     PrefReceiver* pref = [[[PrefReceiver alloc] init] autorelease];
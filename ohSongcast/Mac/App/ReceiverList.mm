@@ -74,7 +74,10 @@
 
 - (void) receiverChangedCallback:(THandle)aPtr type:(ECallbackType)aType
 {
-    // This is called from the ohSongcast receiver manager thread
+    // This is called from the ohSongcast receiver manager threads, one callback at a time for a device.
+    // A device moving rooms is briefly two receivers with the same udn, the new one possibly
+    // added before the old one is removed, so events for a receiver other than the one the
+    // list entry currently holds are ignored.
     NSString* udn = [NSString stringWithUTF8String:ReceiverUdn(aPtr)];
 
     // lock access to the receiver list
@@ -112,7 +115,7 @@
                 break;
                 
             case eRemoved:
-                if (receiver)
+                if (receiver && [receiver hasPtr:aPtr])
                 {
                     // clear the ptr for this receiver and send notification in the main thread
                     [receiver updateWithPtr:nil];
@@ -121,7 +124,7 @@
                 break;
                 
             case eChanged:
-                if (receiver)
+                if (receiver && [receiver hasPtr:aPtr])
                 {
                     // update the existing receiver and send notification in the main thread
                     [receiver updateWithPtr:aPtr];
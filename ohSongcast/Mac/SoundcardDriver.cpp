@@ -34,6 +34,9 @@ private:
     virtual void SetLatency(TUint aValue);
     virtual void SetTrackPosition(TUint64 aSampleStart, TUint64 aSamplesTotal);
 	virtual void Resend(const Brx& aFrames);
+    virtual void FastStart();
+    virtual void AddUnicast(const Endpoint& aEndpoint);
+    virtual void RemoveUnicast(const Endpoint& aEndpoint);
 
     static void DriverFound(void* aPtr, io_iterator_t aIterator);
     void DriverFound();
@@ -461,6 +464,22 @@ void OhmSenderDriverMac::Resend(const Brx& aFrames)
     }
 }
 
+// the audio history is kept by the kernel driver, which offers no fast start
+
+void OhmSenderDriverMac::FastStart()
+{
+}
+
+// the kernel driver sends to one endpoint, so offers no hybrid delivery
+
+void OhmSenderDriverMac::AddUnicast(const Endpoint& /*aEndpoint*/)
+{
+}
+
+void OhmSenderDriverMac::RemoveUnicast(const Endpoint& /*aEndpoint*/)
+{
+}
+
 // Implementation of internal Driver class
 
 OhmSenderDriverMac::Driver::Driver(io_service_t aService)
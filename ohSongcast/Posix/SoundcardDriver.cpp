@@ -29,6 +29,9 @@ private:
     virtual void SetLatency(TUint aValue);
     virtual void SetTrackPosition(TUint64 aSampleStart, TUint64 aSamplesTotal);
 	virtual void Resend(const Brx& aFrames);
+    virtual void FastStart();
+    virtual void AddUnicast(const Endpoint& aEndpoint);
+    virtual void RemoveUnicast(const Endpoint& aEndpoint);
 };
 
 
@@ -91,6 +94,21 @@ void OhmSenderDriverPosix::Resend(const Brx& aFrames)
 	printf("\n");
 }
 
+void OhmSenderDriverPosix::FastStart()
+{
+    printf("OhmSenderDriverPosix: FastStart\n");
+}
+
+void OhmSenderDriverPosix::AddUnicast(const Endpoint& aEndpoint)
+{
+    printf("OhmSenderDriverPosix: AddUnicast %8x:%d\n", aEndpoint.Address(), aEndpoint.Port());
+}
+
+void OhmSenderDriverPosix::RemoveUnicast(const Endpoint& aEndpoint)
+{
+    printf("OhmSenderDriverPosix: RemoveUnicast %8x:%d\n", aEndpoint.Address(), aEndpoint.Port());
+}
+
 
 // Soundcard - platform specific implementation of the C interface
 
@@ -16,8 +16,9 @@ using namespace OpenHome::Av;
 
 // ReceiverManager1Room
 
-ReceiverManager1Room::ReceiverManager1Room(IReceiverManager1Handler& aHandler, IRoom& aRoom)
+ReceiverManager1Room::ReceiverManager1Room(IReceiverManager1Handler& aHandler, ReceiverRegistry<ReceiverManager1Receiver>& aRegistry, IRoom& aRoom)
 	: iHandler(aHandler)
+	, iRegistry(aRegistry)
 	, iRoom(aRoom)
 	, iSelected(0)
 	, iRefCount(1)
@@ -34,20 +35,40 @@ ReceiverManager1Room::ReceiverManager1Room(IReceiverManager1Handler& aHandler, I
 
 	for (TUint i = 0; i < count; i++) {
 		if (iRoom.SourceType(i) == Brn("Receiver")) {
-			CpDevice& device = iRoom.SourceDevice(i);
-			const Brx& group = iRoom.SourceGroup(i);
-			const Brx& name = iRoom.SourceName(i);
+			Add(i, selectedDevice);
+		}
+	}
+}
 
-			ReceiverManager1Receiver* receiver = new ReceiverManager1Receiver(*this, group, name, i, device);
+void ReceiverManager1Room::Add(TUint aSourceIndex, CpDevice* aSelectedDevice)
+{
+	CpDevice& device = iRoom.SourceDevice(aSourceIndex);
+	const Brx& group = iRoom.SourceGroup(aSourceIndex);
+	const Brx& name = iRoom.SourceName(aSourceIndex);
 
-			if (selectedDevice == &device) {
-				iSelected = receiver;
-			}
+	ReceiverManager1Receiver* receiver = new ReceiverManager1Receiver(*this, group, name, aSourceIndex, device);
 
-			iReceiverList.push_back(receiver);
-			iHandler.ReceiverAdded(*receiver);
-		}
+	if (!iRegistry.Add(Name(), device.Udn(), *receiver)) {
+		receiver->RemoveRef(); // a second Receiver source on the same device
+		return;
+	}
+
+	if (aSelectedDevice == &device) {
+		iSelected = receiver;
+	}
+
+	iHandler.ReceiverAdded(*receiver);
+}
+
+void ReceiverManager1Room::Remove(ReceiverManager1Receiver& aReceiver)
+{
+	if (iSelected == &aReceiver) {
+		iSelected = 0;
 	}
+
+	iRegistry.Remove(Name(), aReceiver.Device().Udn(), aReceiver);
+	iHandler.ReceiverRemoved(aReceiver);
+	aReceiver.RemoveRef();
 }
 
 IRoom& ReceiverManager1Room::Room() const
@@ -83,16 +104,11 @@ void ReceiverManager1Room::SourceChanged()
 	if (iRoom.CurrentSourceType() == Brn("Receiver")) {
 		CpDevice& device = iRoom.CurrentSourceDevice();
 
-		std::vector<ReceiverManager1Receiver*>::iterator it = iReceiverList.begin();
+		ReceiverManager1Receiver* receiver = iRegistry.Find(Name(), device.Udn());
 
-		while (it != iReceiverList.end()) {
-			ReceiverManager1Receiver* receiver = *it;
-			if (&receiver->Device() == &device) {
-				iSelected = receiver;
-				iHandler.ReceiverChanged(*iSelected);
-				break;
-			}
-			it++;
+		if (receiver) {
+			iSelected = receiver;
+			iHandler.ReceiverChanged(*iSelected);
 		}
 	}
 }
@@ -107,105 +123,59 @@ void ReceiverManager1Room::Changed()
 		selectedDevice = &iRoom.CurrentSourceDevice();
 	}
 
-	std::vector<ReceiverManager1Receiver*> toadd;
-	std::vector<ReceiverManager1Receiver*> todelete;
-	std::vector<ReceiverManager1Receiver*>::iterator it;
-
-	// create initial toadd list
-
-	for (TUint i = 0; i < count; i++) {
-		if (iRoom.SourceType(i) == Brn("Receiver")) {
-			CpDevice& device = iRoom.SourceDevice(i);
-			const Brx& group = iRoom.SourceGroup(i);
-			const Brx& name = iRoom.SourceName(i);
-
-			ReceiverManager1Receiver* receiver = new ReceiverManager1Receiver(*this, group, name, i, device);
-
-			toadd.push_back(receiver);
-		}
-	}
-
-	// scan old list
+	// match the room's Receiver sources against its existing receivers, each a binary search
 
-	it = iReceiverList.begin();
+	TUint first = iRegistry.RoomFirst(Name());
+	TUint existing = iRegistry.RoomCount(Name());
 
-	while (it != iReceiverList.end()) {
-		ReceiverManager1Receiver* receiver = *it;
+	// the lists are members so that once grown they are reused rather than reallocated on every update
 
-		TBool found = false;
+	iFound.assign(existing, false);
+	iToAdd.clear();
+	iToDelete.clear();
 
-		std::vector<ReceiverManager1Receiver*>::iterator it2 = toadd.begin();
+	for (TUint i = 0; i < count; i++) {
+		if (iRoom.SourceType(i) == Brn("Receiver")) {
+			TUint index = iRegistry.IndexOf(Name(), iRoom.SourceDevice(i).Udn());
 
-		while (it2 != toadd.end()) {
-			ReceiverManager1Receiver* candidate = *it2;
-			if (candidate->Device().Udn() == receiver->Device().Udn()) {
-				receiver->SetSourceIndex(candidate->SourceIndex()); // update source index
-				delete (candidate);
-				toadd.erase(it2);
-				found = true;
-				break;
+			if (index == iRegistry.Count()) {
+				iToAdd.push_back(i);
+			}
+			else if (!iFound[index - first]) {
+				iFound[index - first] = true;
+				iRegistry.At(index).SetSourceIndex(i); // update source index
 			}
-
-			it2++;
 		}
+	}
 
-		if (!found) {
-			todelete.push_back(receiver);
+	for (TUint i = 0; i < existing; i++) {
+		if (!iFound[i]) {
+			iToDelete.push_back(&iRegistry.At(first + i));
 		}
-
-		it++;
 	}
 
 	// apply todelete list
 
-	it = todelete.begin();
-
-	while (it != todelete.end()) {
-		ReceiverManager1Receiver* receiver = *it;
-
-		std::vector<ReceiverManager1Receiver*>::iterator it2 = iReceiverList.begin();
-
-		while (it2 != iReceiverList.end()) {
-			if (receiver == *it2) {
-				if (&receiver->Device() == selectedDevice) {
-					iSelected = 0;
-				}
-				iHandler.ReceiverRemoved(*receiver);
-				receiver->RemoveRef();
-				iReceiverList.erase(it2);
-				break;
-			}
-
-			it2++;
-		}
-
-		it++;
+	for (TUint i = 0; i < iToDelete.size(); i++) {
+		Remove(*iToDelete[i]);
 	}
 
 	// apply toadd list
 
-	it = toadd.begin();
-
-	while (it != toadd.end()) {
-		ReceiverManager1Receiver* receiver = *it;
-		iReceiverList.push_back(receiver);
-		if (&receiver->Device() == selectedDevice) {
-			iSelected = receiver;
-		}
-		iHandler.ReceiverAdded(*receiver);
-		it++;
+	for (TUint i = 0; i < iToAdd.size(); i++) {
+		Add(iToAdd[i], selectedDevice);
 	}
 }
 
 void ReceiverManager1Room::Removed()
 {
-	std::vector<ReceiverManager1Receiver*>::iterator it = iReceiverList.begin();
+	TUint first = iRegistry.RoomFirst(Name());
+	TUint count = iRegistry.RoomCount(Name());
 
-	while (it != iReceiverList.end()) {
-		ReceiverManager1Receiver* receiver = *it;
-		iHandler.ReceiverRemoved(*receiver);
-		receiver->RemoveRef();
-		it++;
+	// each removal shifts the rest of the room down to first
+
+	for (TUint i = 0; i < count; i++) {
+		Remove(iRegistry.At(first));
 	}
 
 	RemoveRef();
@@ -213,45 +183,41 @@ void ReceiverManager1Room::Removed()
 
 void ReceiverManager1Room::VolumeControlChanged()
 {
-	std::vector<ReceiverManager1Receiver*>::iterator it = iReceiverList.begin();
+	TUint first = iRegistry.RoomFirst(Name());
+	TUint count = iRegistry.RoomCount(Name());
 
-	while (it != iReceiverList.end()) {
-		ReceiverManager1Receiver* receiver = *it;
-		iHandler.ReceiverVolumeControlChanged(*receiver);
-		it++;
+	for (TUint i = first; i < first + count; i++) {
+		iHandler.ReceiverVolumeControlChanged(iRegistry.At(i));
 	}
 }
 
 void ReceiverManager1Room::VolumeChanged()
 {
-	std::vector<ReceiverManager1Receiver*>::iterator it = iReceiverList.begin();
+	TUint first = iRegistry.RoomFirst(Name());
+	TUint count = iRegistry.RoomCount(Name());
 
-	while (it != iReceiverList.end()) {
-		ReceiverManager1Receiver* receiver = *it;
-		iHandler.ReceiverVolumeChanged(*receiver);
-		it++;
+	for (TUint i = first; i < first + count; i++) {
+		iHandler.ReceiverVolumeChanged(iRegistry.At(i));
 	}
 }
 
 void ReceiverManager1Room::MuteChanged()
 {
-	std::vector<ReceiverManager1Receiver*>::iterator it = iReceiverList.begin();
+	TUint first = iRegistry.RoomFirst(Name());
+	TUint count = iRegistry.RoomCount(Name());
 
-	while (it != iReceiverList.end()) {
-		ReceiverManager1Receiver* receiver = *it;
-		iHandler.ReceiverMuteChanged(*receiver);
-		it++;
+	for (TUint i = first; i < first + count; i++) {
+		iHandler.ReceiverMuteChanged(iRegistry.At(i));
 	}
 }
 
 void ReceiverManager1Room::VolumeLimitChanged()
 {
-	std::vector<ReceiverManager1Receiver*>::iterator it = iReceiverList.begin();
+	TUint first = iRegistry.RoomFirst(Name());
+	TUint count = iRegistry.RoomCount(Name());
 
-	while (it != iReceiverList.end()) {
-		ReceiverManager1Receiver* receiver = *it;
-		iHandler.ReceiverVolumeLimitChanged(*receiver);
-		it++;
+	for (TUint i = first; i < first + count; i++) {
+		iHandler.ReceiverVolumeLimitChanged(iRegistry.At(i));
 	}
 }
 
@@ -464,7 +430,7 @@ ReceiverManager1::~ReceiverManager1()
 
 void ReceiverManager1::RoomAdded(IRoom& aRoom)
 {
-	ReceiverManager1Room* room = new ReceiverManager1Room(*this, aRoom);
+	ReceiverManager1Room* room = new ReceiverManager1Room(*this, iRegistry, aRoom);
 	aRoom.SetUserData(room);
 }
 
@@ -8,6 +8,10 @@
 #include <OpenHome/Functor.h>
 #include <OpenHome/Av/CpTopology.h>
 
+#include <vector>
+
+#include "ReceiverRegistry.h"
+
 namespace OpenHome {
     namespace Net {
         class CpStack;
@@ -84,7 +88,7 @@ class ReceiverManager1;
 class ReceiverManager1Room  : private INonCopyable
 {
 public:
-	ReceiverManager1Room(IReceiverManager1Handler& aHandler, IRoom& aRoom);
+	ReceiverManager1Room(IReceiverManager1Handler& aHandler, ReceiverRegistry<ReceiverManager1Receiver>& aRegistry, IRoom& aRoom);
 	const Brx& Name() const;	
 	IRoom& Room() const;
     void AddRef();
@@ -108,12 +112,18 @@ public:
 	void Select(const ReceiverManager1Receiver& aReceiver);
 	TBool Selected(const ReceiverManager1Receiver& aReceiver);
 	~ReceiverManager1Room();
+private:
+	void Add(TUint aSourceIndex, Net::CpDevice* aSelectedDevice);
+	void Remove(ReceiverManager1Receiver& aReceiver);
 private:
 	IReceiverManager1Handler& iHandler;
+	ReceiverRegistry<ReceiverManager1Receiver>& iRegistry;
 	IRoom& iRoom;
 	ReceiverManager1Receiver* iSelected;
-	std::vector<ReceiverManager1Receiver*> iReceiverList;
 	TUint iRefCount;
+	std::vector<TBool> iFound;						// used by Changed
+	std::vector<TUint> iToAdd;						// used by Changed
+	std::vector<ReceiverManager1Receiver*> iToDelete;	// used by Changed
 };
 
 class ReceiverManager1 : public IHouseHandler, public IReceiverManager1Handler
@@ -146,6 +156,7 @@ private:
 
 private:
 	IReceiverManager1Handler& iHandler;
+	ReceiverRegistry<ReceiverManager1Receiver> iRegistry; // all receivers in the house, accessed on the topology thread
     House* iHouse;
 };
 
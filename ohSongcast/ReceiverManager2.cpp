@@ -3,6 +3,7 @@
 #include <OpenHome/Private/Ascii.h>
 #include <OpenHome/Private/Arch.h>
 #include <OpenHome/Private/Debug.h>
+#include <OpenHome/Net/Private/CpiStack.h>
 #include "../Debug.h"
 
 // Assumes only one Receiver per group (UPnP device)
@@ -15,37 +16,210 @@ using namespace OpenHome::Av;
 # pragma warning(disable:4355) // use of 'this' in ctor lists safe in this case
 #endif
 
-// ReceiverManager2Job
+// ReceiverManager2JobNode
 
-ReceiverManager2Job::ReceiverManager2Job(IReceiverManager2Handler& aHandler)
+ReceiverManager2JobNode::ReceiverManager2JobNode(const Brx& aKey)
+	: iKey(2166136261u)
+	, iPending(0)
+	, iQueued(false)
+	, iNext(0)
 {
-	iHandler = &aHandler;
-	iReceiver = 0;
+	// FNV-1a, so keys spread evenly over the workers
+
+	for (TUint i = 0; i < aKey.Bytes(); i++) {
+		iKey = (iKey ^ aKey[i]) * 16777619u;
+	}
 }
-	
-void ReceiverManager2Job::Set(ReceiverManager2Receiver& aReceiver, IReceiverManager2HandlerFunction aFunction)
+
+// ReceiverManager2JobWorker
+
+ReceiverManager2JobWorker::ReceiverManager2JobWorker(ReceiverManager2Jobs& aJobs)
+	: iJobs(aJobs)
+	, iReady("RM2J", 0)
+	, iHead(0)
+	, iTail(0)
+{
+	iThread = new ThreadFunctor("RM2T", MakeFunctor(*this, &ReceiverManager2JobWorker::Run), kPriorityNormal, kThreadStackBytes);
+	iThread->Start();
+}
+
+void ReceiverManager2JobWorker::Run()
+{
+	iJobs.Run(*this);
+}
+
+ReceiverManager2JobWorker::~ReceiverManager2JobWorker()
 {
-	iReceiver = &aReceiver;
-	iFunction = aFunction;
-	iReceiver->AddRef();
+	delete (iThread);
 }
 
-void ReceiverManager2Job::Execute()
+// ReceiverManager2Jobs
+
+ReceiverManager2Jobs::ReceiverManager2Jobs(IReceiverManager2JobHandler& aHandler, TUint aWorkerCount)
+	: iHandler(aHandler)
+	, iMutex("RM2J")
+	, iStopping(false)
+	, iScheduled(0)
+	, iCoalesced(0)
+	, iExecuted(0)
 {
-	if (iReceiver) {
-		(iHandler->*iFunction)(*iReceiver);
-		iReceiver->RemoveRef();
-		iReceiver = 0;
+	ASSERT(aWorkerCount > 0);
+
+	for (TUint i = 0; i < aWorkerCount; i++) {
+		iWorkers.push_back(new ReceiverManager2JobWorker(*this));
+	}
+}
+
+void ReceiverManager2Jobs::Schedule(ReceiverManager2JobNode& aNode, EJob aJob)
+{
+	iMutex.Wait();
+
+	iScheduled++;
+
+	TUint job = 1 << aJob;
+
+	if (aJob == eRemoved) {
+		// nothing but Added matters once a receiver has gone
+		TUint pending = aNode.iPending & ~(1 << eAdded);
+		while (pending) {
+			if (pending & 1) {
+				iCoalesced++;
+			}
+			pending >>= 1;
+		}
+		aNode.iPending &= (1 << eAdded);
+	}
+
+	if (aNode.iPending & job) {
+		iCoalesced++;
+	}
+
+	aNode.iPending |= job;
+
+	if (aNode.iQueued) {
+		iMutex.Signal();
+		return;
+	}
+
+	// queued now even if its earlier jobs are still being run, so receivers sharing a worker are
+	// run in the order of their first pending job
+
+	ReceiverManager2JobWorker& worker = *iWorkers[aNode.iKey % iWorkers.size()];
+
+	aNode.iQueued = true;
+	aNode.iNext = 0;
+
+	if (worker.iTail) {
+		worker.iTail->iNext = &aNode;
 	}
 	else {
-		THROW(ThreadKill);
+		worker.iHead = &aNode;
+	}
+
+	worker.iTail = &aNode;
+
+	iHandler.AddRef(aNode);
+
+	iMutex.Signal();
+
+	worker.iReady.Signal();
+}
+
+void ReceiverManager2Jobs::Stop()
+{
+	iMutex.Wait();
+	iStopping = true;
+	iMutex.Signal();
+
+	for (TUint i = 0; i < iWorkers.size(); i++) {
+		iWorkers[i]->iReady.Signal();
+	}
+
+	for (TUint i = 0; i < iWorkers.size(); i++) {
+		delete (iWorkers[i]); // workers run whatever is still queued before exiting
+	}
+
+	iWorkers.clear();
+}
+
+TUint ReceiverManager2Jobs::Scheduled() const
+{
+	AutoMutex mutex(iMutex);
+	return (iScheduled);
+}
+
+TUint ReceiverManager2Jobs::Coalesced() const
+{
+	AutoMutex mutex(iMutex);
+	return (iCoalesced);
+}
+
+TUint ReceiverManager2Jobs::Executed() const
+{
+	AutoMutex mutex(iMutex);
+	return (iExecuted);
+}
+
+void ReceiverManager2Jobs::Run(ReceiverManager2JobWorker& aWorker)
+{
+    LOG(kTopology, "ReceiverManager2Jobs::Run Started\n");
+
+	for (;;) {
+		aWorker.iReady.Wait();
+
+		iMutex.Wait();
+
+		ReceiverManager2JobNode* node = aWorker.iHead;
+
+		if (node == 0) {
+			// every node queued is matched by a signal, so an empty queue means stop
+			ASSERT(iStopping);
+			iMutex.Signal();
+			break;
+		}
+
+		aWorker.iHead = node->iNext;
+
+		if (aWorker.iHead == 0) {
+			aWorker.iTail = 0;
+		}
+
+		node->iQueued = false;
+
+		TUint pending = node->iPending;
+		node->iPending = 0;
+
+		iMutex.Signal();
+
+		TUint executed = 0;
+
+		for (TUint job = 0; job < kJobCount; job++) {
+			if (pending & (1 << job)) {
+				iHandler.Execute(*node, job);
+				executed++;
+			}
+		}
+
+		iMutex.Wait();
+		iExecuted += executed;
+		iMutex.Signal();
+
+		iHandler.RemoveRef(*node);
 	}
+
+    LOG(kTopology, "ReceiverManager2Jobs::Run Exiting\n");
+}
+
+ReceiverManager2Jobs::~ReceiverManager2Jobs()
+{
+	Stop();
 }
 
 // ReceiverManager2Receiver
 
-ReceiverManager2Receiver::ReceiverManager2Receiver(IReceiverManager2Handler& aHandler, ReceiverManager1Receiver& aReceiver)
-	: iHandler(aHandler)
+ReceiverManager2Receiver::ReceiverManager2Receiver(IReceiverManager2Handler& aHandler, ReceiverManager1Receiver& aReceiver, Environment& aEnv)
+	: ReceiverManager2JobNode(aReceiver.Device().Udn())
+	, iHandler(aHandler)
 	, iReceiver(aReceiver)
 	, iActive(false)
 	, iMutex("RM2R")
@@ -55,9 +229,15 @@ ReceiverManager2Receiver::ReceiverManager2Receiver(IReceiverManager2Handler& aHa
 	, iVolume(0)
 	, iMute(false)
 	, iVolumeLimit(0)
+	, iVolumeInFlight(false)
+	, iVolumeTargetSet(false)
+	, iVolumeTarget(0)
+	, iVolumeSent(0)
 {
 	iReceiver.AddRef();
 
+	iTimerVolume = new Timer(aEnv, MakeFunctor(*this, &ReceiverManager2Receiver::TimerVolumeExpired), "ReceiverManager2Volume");
+
     iFunctorStop = MakeFunctorAsync(*this, &ReceiverManager2Receiver::CallbackStop);
     iFunctorPlay = MakeFunctorAsync(*this, &ReceiverManager2Receiver::CallbackPlay);
     iFunctorSetSender = MakeFunctorAsync(*this, &ReceiverManager2Receiver::CallbackSetSender);
@@ -173,17 +353,73 @@ TUint ReceiverManager2Receiver::VolumeLimit() const
 
 void ReceiverManager2Receiver::SetVolume(TUint aValue)
 {
-	iReceiver.SetVolume(aValue);
+	iMutex.Wait();
+	SetVolumeTarget(aValue);
 }
 
 void ReceiverManager2Receiver::VolumeInc()
 {
-	iReceiver.VolumeInc();
+	iMutex.Wait();
+	TUint volume = iVolumeTargetSet ? iVolumeTarget : iVolume;
+	SetVolumeTarget(volume + 1);
 }
 
 void ReceiverManager2Receiver::VolumeDec()
 {
-	iReceiver.VolumeDec();
+	iMutex.Wait();
+	TUint volume = iVolumeTargetSet ? iVolumeTarget : iVolume;
+	SetVolumeTarget((volume > 0) ? volume - 1 : 0);
+}
+
+void ReceiverManager2Receiver::SetVolumeTarget(TUint aValue)
+{
+	if (iHasVolumeControl && aValue > iVolumeLimit) {
+		aValue = iVolumeLimit;
+	}
+
+	iVolumeTarget = aValue;
+	iVolumeTargetSet = true;
+
+	if (iVolumeInFlight) {
+		iMutex.Signal();
+		return;
+	}
+
+	if (aValue == iVolume) {
+		// already there, and the device would not report an unchanged volume
+		iVolumeTargetSet = false;
+		iMutex.Signal();
+		return;
+	}
+
+	iVolumeInFlight = true;
+	iVolumeSent = aValue;
+	iMutex.Signal();
+
+	iTimerVolume->FireIn(kVolumeTimeoutMs);
+	iReceiver.SetVolume(aValue);
+}
+
+// The device never reported the volume sent: give up on it and send the target if it has moved since
+
+void ReceiverManager2Receiver::TimerVolumeExpired()
+{
+	iMutex.Wait();
+
+	if (!iVolumeInFlight) {
+		iMutex.Signal();
+		return;
+	}
+
+	iVolumeInFlight = false;
+
+	if (!iVolumeTargetSet || iVolumeTarget == iVolumeSent) {
+		iVolumeTargetSet = false;
+		iMutex.Signal();
+		return;
+	}
+
+	SetVolumeTarget(iVolumeTarget);
 }
 
 void ReceiverManager2Receiver::SetMute(TBool aValue)
@@ -241,7 +477,7 @@ void ReceiverManager2Receiver::EventReceiverInitialEvent()
 	iServiceReceiver->PropertyMetadata(iMetadata);
 
     // this must be called before iActive is set to true to ensure that the ReceiverAdded event is
-    // added to the queue before all others
+    // scheduled before all others (ReceiverManager2Jobs also always runs Added first)
 	iHandler.ReceiverAdded(*this);
 
 	iMutex.Wait();
@@ -335,15 +571,34 @@ void ReceiverManager2Receiver::VolumeChanged()
 	iMutex.Wait();
 
 	iVolume = iReceiver.Volume();
-	
-	if (iActive) {
-		iMutex.Signal();
-		iHandler.ReceiverVolumeChanged(*this);
+
+	// the device has answered any outstanding SetVolume; send the target if it has moved on since
+
+	TBool send = false;
+
+	if (iVolumeInFlight) {
+		iVolumeInFlight = false;
+
+		if (iVolumeTargetSet && iVolumeTarget != iVolume) {
+			send = true;
+		}
+		else {
+			iVolumeTargetSet = false;
+		}
 	}
-	else
-	{
+
+	TBool active = iActive;
+
+	if (send) {
+		SetVolumeTarget(iVolumeTarget);
+	}
+	else {
 		iMutex.Signal();
 	}
+
+	if (active) {
+		iHandler.ReceiverVolumeChanged(*this);
+	}
 }
 
 void ReceiverManager2Receiver::MuteChanged()
@@ -382,12 +637,19 @@ void ReceiverManager2Receiver::VolumeLimitChanged()
 
 void ReceiverManager2Receiver::AddRef()
 {
+	iMutex.Wait();
 	iRefCount++;
+	iMutex.Signal();
 }
 
 void ReceiverManager2Receiver::RemoveRef()
 {
-	if (--iRefCount == 0) {
+	// references are dropped on job workers as well as topology and eventing threads
+	iMutex.Wait();
+	TUint refCount = --iRefCount;
+	iMutex.Signal();
+
+	if (refCount == 0) {
 		delete (this);
 	}
 }
@@ -404,6 +666,7 @@ void* ReceiverManager2Receiver::UserData() const
 
 ReceiverManager2Receiver::~ReceiverManager2Receiver()
 {
+	delete (iTimerVolume);
 	delete (iServiceReceiver);
 	iReceiver.RemoveRef();
 }
@@ -411,17 +674,11 @@ ReceiverManager2Receiver::~ReceiverManager2Receiver()
 // ReceiverManager
 
 ReceiverManager2::ReceiverManager2(Net::CpStack& aCpStack, IReceiverManager2Handler& aHandler)
-	: iFree(kMaxJobCount)
-	, iReady(kMaxJobCount)
+	: iHandler(aHandler)
+	, iEnv(aCpStack.Env())
+	, iJobs(*this, kWorkerCount)
 {
-	for (TUint i = 0; i < kMaxJobCount; i++) {
-		iFree.Write(new ReceiverManager2Job(aHandler));
-	}
-	
 	iReceiverManager = new ReceiverManager1(aCpStack, *this);
-
-	iThread = new ThreadFunctor("RM2T", MakeFunctor(*this, &ReceiverManager2::Run));
-	iThread->Start();
 }
 
 void ReceiverManager2::Refresh()
@@ -435,24 +692,16 @@ ReceiverManager2::~ReceiverManager2()
 
 	delete (iReceiverManager);
     
-	iReady.Write(iFree.Read()); // this null job causes the thread to complete
+	iJobs.Stop(); // delivers the removals queued above
 
-	delete (iThread);
-	
-    LOG(kTopology, "ReceiverManager2::~ReceiverManager2 deleted thread\n");
-
-	for (TUint i = 0; i < kMaxJobCount; i++) {
-		delete (iFree.Read());
-	}
-
-    LOG(kTopology, "ReceiverManager2::~ReceiverManager2 deleted jobs\n");
+    LOG(kTopology, "ReceiverManager2::~ReceiverManager2 stopped jobs (%d scheduled, %d coalesced, %d executed)\n", iJobs.Scheduled(), iJobs.Coalesced(), iJobs.Executed());
 }
 
 // IReceiverManager1Handler
 
 void ReceiverManager2::ReceiverAdded(ReceiverManager1Receiver& aReceiver)
 {
-	ReceiverManager2Receiver* receiver = new ReceiverManager2Receiver(*this, aReceiver);
+	ReceiverManager2Receiver* receiver = new ReceiverManager2Receiver(*this, aReceiver, iEnv);
 	aReceiver.SetUserData(receiver);
 }
 
@@ -508,9 +757,7 @@ void ReceiverManager2::ReceiverAdded(ReceiverManager2Receiver& aReceiver)
     LOG(kTrace, aReceiver.Group());
     LOG(kTrace, "\n");
 
-	ReceiverManager2Job* job = iFree.Read();
-	job->Set(aReceiver, &IReceiverManager2Handler::ReceiverAdded);
-	iReady.Write(job);
+	iJobs.Schedule(aReceiver, ReceiverManager2Jobs::eAdded);
 }
 
 void ReceiverManager2::ReceiverChanged(ReceiverManager2Receiver& aReceiver)
@@ -521,9 +768,7 @@ void ReceiverManager2::ReceiverChanged(ReceiverManager2Receiver& aReceiver)
     LOG(kTrace, aReceiver.Group());
     LOG(kTrace, "\n");
 
-	ReceiverManager2Job* job = iFree.Read();
-	job->Set(aReceiver, &IReceiverManager2Handler::ReceiverChanged);
-	iReady.Write(job);
+	iJobs.Schedule(aReceiver, ReceiverManager2Jobs::eChanged);
 }
 
 void ReceiverManager2::ReceiverRemoved(ReceiverManager2Receiver& aReceiver)
@@ -534,9 +779,7 @@ void ReceiverManager2::ReceiverRemoved(ReceiverManager2Receiver& aReceiver)
     LOG(kTrace, aReceiver.Group());
     LOG(kTrace, "\n");
 
-	ReceiverManager2Job* job = iFree.Read();
-	job->Set(aReceiver, &IReceiverManager2Handler::ReceiverRemoved);
-	iReady.Write(job);
+	iJobs.Schedule(aReceiver, ReceiverManager2Jobs::eRemoved);
 }
 
 void ReceiverManager2::ReceiverVolumeControlChanged(ReceiverManager2Receiver& aReceiver)
@@ -549,9 +792,7 @@ void ReceiverManager2::ReceiverVolumeControlChanged(ReceiverManager2Receiver& aR
     LOG(kTopology, aReceiver.HasVolumeControl() ? Brn("Yes") : Brn("No"));
     LOG(kTopology, "\n");
 
-	ReceiverManager2Job* job = iFree.Read();
-	job->Set(aReceiver, &IReceiverManager2Handler::ReceiverVolumeControlChanged);
-	iReady.Write(job);
+	iJobs.Schedule(aReceiver, ReceiverManager2Jobs::eVolumeControlChanged);
 }
 
 void ReceiverManager2::ReceiverVolumeChanged(ReceiverManager2Receiver& aReceiver)
@@ -562,9 +803,7 @@ void ReceiverManager2::ReceiverVolumeChanged(ReceiverManager2Receiver& aReceiver
     LOG(kTopology, aReceiver.Group());
     LOG(kTopology, "\n");
 
-	ReceiverManager2Job* job = iFree.Read();
-	job->Set(aReceiver, &IReceiverManager2Handler::ReceiverVolumeChanged);
-	iReady.Write(job);
+	iJobs.Schedule(aReceiver, ReceiverManager2Jobs::eVolumeChanged);
 }
 
 void ReceiverManager2::ReceiverMuteChanged(ReceiverManager2Receiver& aReceiver)
@@ -575,9 +814,7 @@ void ReceiverManager2::ReceiverMuteChanged(ReceiverManager2Receiver& aReceiver)
     LOG(kTopology, aReceiver.Group());
     LOG(kTopology, "\n");
 
-	ReceiverManager2Job* job = iFree.Read();
-	job->Set(aReceiver, &IReceiverManager2Handler::ReceiverMuteChanged);
-	iReady.Write(job);
+	iJobs.Schedule(aReceiver, ReceiverManager2Jobs::eMuteChanged);
 }
 
 void ReceiverManager2::ReceiverVolumeLimitChanged(ReceiverManager2Receiver& aReceiver)
@@ -588,34 +825,33 @@ void ReceiverManager2::ReceiverVolumeLimitChanged(ReceiverManager2Receiver& aRec
     LOG(kTopology, aReceiver.Group());
     LOG(kTopology, "\n");
 
-	ReceiverManager2Job* job = iFree.Read();
-	job->Set(aReceiver, &IReceiverManager2Handler::ReceiverVolumeLimitChanged);
-	iReady.Write(job);
+	iJobs.Schedule(aReceiver, ReceiverManager2Jobs::eVolumeLimitChanged);
 }
 
 
-void ReceiverManager2::Run()
-{
-    LOG(kTopology, "ReceiverManager2::Run Started\n");
+// IReceiverManager2JobHandler
 
-    for (;;)
-    {
-	    LOG(kTopology, "ReceiverManager2::Run wait for job\n");
+void ReceiverManager2::Execute(ReceiverManager2JobNode& aNode, TUint aJob)
+{
+	static const IReceiverManager2HandlerFunction kFunctions[ReceiverManager2Jobs::kJobCount] = {
+		&IReceiverManager2Handler::ReceiverAdded,
+		&IReceiverManager2Handler::ReceiverVolumeControlChanged,
+		&IReceiverManager2Handler::ReceiverChanged,
+		&IReceiverManager2Handler::ReceiverVolumeChanged,
+		&IReceiverManager2Handler::ReceiverMuteChanged,
+		&IReceiverManager2Handler::ReceiverVolumeLimitChanged,
+		&IReceiverManager2Handler::ReceiverRemoved,
+	};
 
-    	ReceiverManager2Job* job = iReady.Read();
-    	
-	    LOG(kTopology, "ReceiverManager2::Run execute job\n");
+	(iHandler.*kFunctions[aJob])(static_cast<ReceiverManager2Receiver&>(aNode));
+}
 
-    	try {
-	    	job->Execute();
-	    	iFree.Write(job);
-	    }
-	    catch (ThreadKill)
-	    {
-	    	iFree.Write(job);
-	    	break;
-	    }
-    }
+void ReceiverManager2::AddRef(ReceiverManager2JobNode& aNode)
+{
+	static_cast<ReceiverManager2Receiver&>(aNode).AddRef();
+}
 
-    LOG(kTopology, "ReceiverManager2::Run Exiting\n");
+void ReceiverManager2::RemoveRef(ReceiverManager2JobNode& aNode)
+{
+	static_cast<ReceiverManager2Receiver&>(aNode).RemoveRef();
 }
@@ -6,10 +6,12 @@
 #include <OpenHome/Private/Timer.h>
 #include <OpenHome/Exception.h>
 #include <OpenHome/Functor.h>
-#include <OpenHome/Private/Fifo.h>
+#include <OpenHome/Private/Thread.h>
 #include <OpenHome/Net/Core/CpDevice.h>
 #include <OpenHome/Net/Core/CpAvOpenhomeOrgReceiver1.h>
 
+#include <vector>
+
 #include "ReceiverManager1.h"
 
 namespace OpenHome {
@@ -35,25 +37,114 @@ public:
 
 typedef void (IReceiverManager2Handler::*IReceiverManager2HandlerFunction)(ReceiverManager2Receiver&);
 
-class ReceiverManager2Job
+// ReceiverManager2JobNode holds the per receiver state of ReceiverManager2Jobs
+
+class ReceiverManager2JobNode
+{
+	friend class ReceiverManager2Jobs;
+
+public:
+	ReceiverManager2JobNode(const Brx& aKey); // nodes with the same key are run by the same worker
+
+private:
+	TUint iKey;                         // hash of the key, which picks the worker
+	TUint iPending;                     // bitmask of ReceiverManager2Jobs::EJob not yet run
+	TBool iQueued;                      // in the ready queue
+	ReceiverManager2JobNode* iNext;     // ready queue link
+};
+
+class IReceiverManager2JobHandler
+{
+public:
+	virtual void Execute(ReceiverManager2JobNode& aNode, TUint aJob) = 0;
+	virtual void AddRef(ReceiverManager2JobNode& aNode) = 0;    // held from queueing until its jobs have run
+	virtual void RemoveRef(ReceiverManager2JobNode& aNode) = 0;
+	virtual ~IReceiverManager2JobHandler() {}
+};
+
+class ReceiverManager2Jobs;
+
+// ReceiverManager2JobWorker is one thread of ReceiverManager2Jobs and the ready queue it runs
+
+class ReceiverManager2JobWorker
+{
+	friend class ReceiverManager2Jobs;
+
+	static const TUint kThreadStackBytes = 64 * 1024;
+
+private:
+	ReceiverManager2JobWorker(ReceiverManager2Jobs& aJobs);
+	void Run();
+	~ReceiverManager2JobWorker();
+
+private:
+	ReceiverManager2Jobs& iJobs;
+	Semaphore iReady;
+	ReceiverManager2JobNode* iHead;     // [ReceiverManager2Jobs::iMutex]
+	ReceiverManager2JobNode* iTail;     // [ReceiverManager2Jobs::iMutex]
+	ThreadFunctor* iThread;
+};
+
+// ReceiverManager2Jobs runs receiver jobs on a pool of worker threads, each receiver on the worker
+// its key hashes to. Scheduling never blocks: it sets a bit in the receiver's pending mask and, if
+// the receiver is not already queued, links it onto the back of its worker's ready queue. Jobs of
+// the same kind that have not yet run therefore coalesce (handlers read the receiver's current
+// state, so only the latest change matters). A receiver's pending jobs run in EJob order, so Added
+// precedes and Removed follows everything else. Receivers with the same key run one at a time in
+// the order their first pending job was scheduled, so keyed by udn a receiver removed before
+// another for the same device is added is reported in that order. Jobs for receivers on different
+// workers run concurrently.
+
+class ReceiverManager2Jobs
 {
+	friend class ReceiverManager2JobWorker;
+
+public:
+	enum EJob {
+		eAdded,
+		eVolumeControlChanged,
+		eChanged,
+		eVolumeChanged,
+		eMuteChanged,
+		eVolumeLimitChanged,
+		eRemoved,
+		kJobCount
+	};
+
 public:
-	ReceiverManager2Job(IReceiverManager2Handler& aHandler);
-    virtual ~ReceiverManager2Job() {}
-	void Set(ReceiverManager2Receiver& aReceiver, IReceiverManager2HandlerFunction aFunction);
-    virtual void Execute();
+	ReceiverManager2Jobs(IReceiverManager2JobHandler& aHandler, TUint aWorkerCount);
+	void Schedule(ReceiverManager2JobNode& aNode, EJob aJob);
+	void Stop(); // runs any outstanding jobs then joins the workers
+	TUint Scheduled() const;
+	TUint Coalesced() const;
+	TUint Executed() const;
+	~ReceiverManager2Jobs();
 
 private:
-	IReceiverManager2Handler* iHandler;
-	ReceiverManager2Receiver* iReceiver;
-	IReceiverManager2HandlerFunction iFunction;
+	void Run(ReceiverManager2JobWorker& aWorker);
+
+private:
+	IReceiverManager2JobHandler& iHandler;
+	mutable Mutex iMutex;
+	TBool iStopping;
+	std::vector<ReceiverManager2JobWorker*> iWorkers;
+	TUint iScheduled;
+	TUint iCoalesced;
+	TUint iExecuted;
 };
 
+// Volume commands are coalesced into a target: at most one SetVolume is outstanding on the device,
+// and commands made while it is outstanding only move the target. The outstanding action completes
+// when the device reports its volume (or after kVolumeTimeoutMs), at which point the target is sent
+// if the device is not already there. Inc and Dec step the target, not the device's volume.
+// Volume() is always the value last reported by the device.
 
-class ReceiverManager2Receiver
+class ReceiverManager2Receiver : public ReceiverManager2JobNode
 {
+	static const TUint kVolumeTimeoutMs = 1000;
+
 public:
-	ReceiverManager2Receiver(IReceiverManager2Handler& aHandler, ReceiverManager1Receiver& aReceiver);
+	ReceiverManager2Receiver(IReceiverManager2Handler& aHandler, ReceiverManager1Receiver& aReceiver, Environment& aEnv);
 	Net::CpDevice& Device() const;
 	const Brx& Room() const;
 	const Brx& Group() const;
@@ -99,6 +190,10 @@ public:
 
 	~ReceiverManager2Receiver();
 
+private:
+	void SetVolumeTarget(TUint aValue); // with iMutex held, releases it
+	void TimerVolumeExpired();
+
 private:
 	IReceiverManager2Handler& iHandler;
 	ReceiverManager1Receiver& iReceiver;
@@ -117,11 +212,18 @@ private:
 	TUint iVolume;
 	TBool iMute;
 	TUint iVolumeLimit;
+	Timer* iTimerVolume;
+	TBool iVolumeInFlight;    // a SetVolume has been sent and not yet confirmed
+	TBool iVolumeTargetSet;   // iVolumeTarget is still to be reached
+	TUint iVolumeTarget;
+	TUint iVolumeSent;
 };
 
-class ReceiverManager2 : public IReceiverManager1Handler, public IReceiverManager2Handler
+// Handler callbacks are made on ReceiverManager2Jobs worker threads, so may be concurrent for different devices
+
+class ReceiverManager2 : public IReceiverManager1Handler, public IReceiverManager2Handler, public IReceiverManager2JobHandler
 {
-	static const TUint kMaxJobCount = 20;
+	static const TUint kWorkerCount = 4;
 
 public:
 	ReceiverManager2(Net::CpStack& aCpStack, IReceiverManager2Handler& aHandler);
@@ -147,13 +249,16 @@ private:
 	virtual void ReceiverMuteChanged(ReceiverManager2Receiver& aReceiver);
 	virtual void ReceiverVolumeLimitChanged(ReceiverManager2Receiver& aReceiver);
 
-	void Run();
+	// IReceiverManager2JobHandler
+	virtual void Execute(ReceiverManager2JobNode& aNode, TUint aJob);
+	virtual void AddRef(ReceiverManager2JobNode& aNode);
+	virtual void RemoveRef(ReceiverManager2JobNode& aNode);
 
 private:
-	Fifo<ReceiverManager2Job*> iFree;
-	Fifo<ReceiverManager2Job*> iReady;
+	IReceiverManager2Handler& iHandler;
+	Environment& iEnv;
+	ReceiverManager2Jobs iJobs;
     ReceiverManager1* iReceiverManager;
-	ThreadFunctor* iThread;
 };
 
 
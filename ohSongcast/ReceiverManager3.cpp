@@ -22,6 +22,7 @@ ReceiverManager3Receiver::ReceiverManager3Receiver(IReceiverManager3Handler& aHa
 	: iHandler(aHandler)
 	, iReceiver(aReceiver)
 	, iManager(aManager)
+	, iMutex("RM3R")
 	, iRefCount(1)
 	, iUserData(0)
 {
@@ -144,12 +145,19 @@ void* ReceiverManager3Receiver::UserData() const
 
 void ReceiverManager3Receiver::AddRef()
 {
+	iMutex.Wait();
     iRefCount++;
+	iMutex.Signal();
 }
 
 void ReceiverManager3Receiver::RemoveRef()
 {
-	if (--iRefCount == 0) {
+	// references are also taken by ReceiverManager3::Find and Receivers on client threads
+	iMutex.Wait();
+	TUint refCount = --iRefCount;
+	iMutex.Signal();
+
+	if (refCount == 0) {
 		delete (this);
     }
 }
@@ -201,6 +209,7 @@ ReceiverManager3::ReceiverManager3(Net::CpStack& aCpStack, IReceiverManager3Hand
 	: iHandler(aHandler)
 	, iUri(aUri)
 	, iMetadata(aMetadata)
+	, iMutex("RM3M")
 {
 	iReceiverManager = new ReceiverManager2(aCpStack, *this);
 }
@@ -215,6 +224,32 @@ void ReceiverManager3::SetMetadata(const Brx& aMetadata)
 	iMetadata.Replace(aMetadata);
 }
 
+ReceiverManager3Receiver* ReceiverManager3::Find(const Brx& aUdn)
+{
+	AutoMutex mutex(iMutex);
+
+	ReceiverManager3Receiver* receiver = iRegistry.Find(aUdn);
+
+	if (receiver) {
+		receiver->AddRef();
+	}
+
+	return (receiver);
+}
+
+void ReceiverManager3::Receivers(std::vector<ReceiverManager3Receiver*>& aReceivers)
+{
+	AutoMutex mutex(iMutex);
+
+	TUint count = iRegistry.Count();
+
+	for (TUint i = 0; i < count; i++) {
+		ReceiverManager3Receiver& receiver = iRegistry.At(i);
+		receiver.AddRef();
+		aReceivers.push_back(&receiver);
+	}
+}
+
 ReceiverManager3Receiver::EStatus ReceiverManager3::Status(ReceiverManager2Receiver& aReceiver)
 {
     if (!aReceiver.Selected()) {
@@ -295,6 +330,13 @@ void ReceiverManager3::ReceiverAdded(ReceiverManager2Receiver& aReceiver)
 
 	ReceiverManager3Receiver* receiver = new ReceiverManager3Receiver(iHandler, aReceiver, *this);
 	aReceiver.SetUserData(receiver);
+
+	// callbacks for different devices arrive on different ReceiverManager2 workers, and Find and
+	// Receivers read the registry on client threads
+
+	iMutex.Wait();
+	iRegistry.Add(receiver->Room(), receiver->Udn(), *receiver);
+	iMutex.Signal();
 }
 
 void ReceiverManager3::ReceiverChanged(ReceiverManager2Receiver& aReceiver)
@@ -322,6 +364,11 @@ void ReceiverManager3::ReceiverRemoved(ReceiverManager2Receiver& aReceiver)
 	ReceiverManager3Receiver* receiver = (ReceiverManager3Receiver*)(aReceiver.UserData());
 	ASSERT(receiver);
 	ASSERT(receiver->IsAttachedTo(aReceiver));
+
+	iMutex.Wait();
+	iRegistry.Remove(receiver->Room(), receiver->Udn(), *receiver);
+	iMutex.Signal();
+
 	receiver->Removed();
 }
 
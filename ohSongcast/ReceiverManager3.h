@@ -6,8 +6,12 @@
 #include <OpenHome/Private/Timer.h>
 #include <OpenHome/Exception.h>
 #include <OpenHome/Functor.h>
+#include <OpenHome/Private/Thread.h>
+
+#include <vector>
 
 #include "ReceiverManager2.h"
+#include "ReceiverRegistry.h"
 
 namespace OpenHome {
     namespace Net {
@@ -90,6 +94,7 @@ private:
 	ReceiverManager2Receiver& iReceiver;
 	ReceiverManager3& iManager;
 	EStatus iStatus;
+	Mutex iMutex;
     TUint iRefCount;
 	void* iUserData;
 };
@@ -107,6 +112,8 @@ public:
 	ReceiverManager3(Net::CpStack& aCpStack, IReceiverManager3Handler& aHandler, const Brx& aUri, const Brx& aMetadata);
 	void SetMetadata(const Brx& aMetadata);
     void Refresh();
+	ReceiverManager3Receiver* Find(const Brx& aUdn); // returned with a reference added, or 0
+	void Receivers(std::vector<ReceiverManager3Receiver*>& aReceivers); // appends, ordered by room then UDN, each with a reference added
     virtual ~ReceiverManager3();
 
 private:
@@ -132,6 +139,8 @@ private:
 	IReceiverManager3Handler& iHandler;
 	Bws<kMaxUriBytes> iUri;
 	Bws<kMaxMetadataBytes> iMetadata;
+	Mutex iMutex;
+	ReceiverRegistry<ReceiverManager3Receiver> iRegistry;
 	ReceiverManager2* iReceiverManager;
 };
 
@@ -0,0 +1,205 @@
+#ifndef HEADER_RECEIVER_REGISTRY
+#define HEADER_RECEIVER_REGISTRY
+
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Buffer.h>
+
+#include <vector>
+#include <map>
+#include <algorithm>
+
+namespace OpenHome {
+namespace Av {
+
+// ReceiverRegistry indexes receivers by UDN and by room.
+//
+// The ordered view (Count/At) is sorted by room then UDN, so it does not depend on the order in
+// which receivers were discovered, and the receivers of one room are contiguous within it
+// (RoomFirst/RoomCount). UDN lookups go through a map.
+//
+// Keys are not copied: the room and UDN buffers passed to Add must remain valid until the entry
+// is removed. Receivers hold references on their room and device, so their own names qualify.
+//
+// A device can transiently appear in two rooms while it moves; Find(aUdn) then returns the most
+// recently added entry. Not thread safe: owners serialise access.
+
+template<class T>
+class ReceiverRegistry
+{
+	class Entry
+	{
+	public:
+		Entry(const Brx& aRoom, const Brx& aUdn, T* aReceiver) : iRoom(aRoom), iUdn(aUdn), iReceiver(aReceiver) {}
+		TBool operator<(const Entry& aOther) const;
+
+	public:
+		Brn iRoom;
+		Brn iUdn;
+		T* iReceiver;
+	};
+
+	typedef typename std::vector<Entry>::iterator Iterator;
+	typedef typename std::vector<Entry>::const_iterator ConstIterator;
+	typedef typename std::multimap<Brn, T*, BufferCmp>::iterator UdnIterator;
+	typedef typename std::multimap<Brn, T*, BufferCmp>::const_iterator ConstUdnIterator;
+
+public:
+	ReceiverRegistry() {}
+	TBool Add(const Brx& aRoom, const Brx& aUdn, T& aReceiver);       // false if the room already has this UDN
+	TBool Remove(const Brx& aRoom, const Brx& aUdn, T& aReceiver);    // false if not present
+	T* Find(const Brx& aUdn) const;
+	T* Find(const Brx& aRoom, const Brx& aUdn) const;
+	TUint IndexOf(const Brx& aRoom, const Brx& aUdn) const;          // Count() if not present
+	TUint Count() const;
+	T& At(TUint aIndex) const;
+	TUint RoomFirst(const Brx& aRoom) const;
+	TUint RoomCount(const Brx& aRoom) const;
+
+private:
+	ConstIterator Lower(const Brx& aRoom, const Brx& aUdn) const;
+
+private:
+	std::vector<Entry> iEntries;
+	std::multimap<Brn, T*, BufferCmp> iUdns;     // keyed on each entry's own UDN buffer
+};
+
+// ReceiverRegistry::Entry
+
+template<class T>
+TBool ReceiverRegistry<T>::Entry::operator<(const Entry& aOther) const
+{
+	BufferCmp cmp;
+
+	if (cmp(iRoom, aOther.iRoom)) {
+		return (true);
+	}
+
+	if (cmp(aOther.iRoom, iRoom)) {
+		return (false);
+	}
+
+	return (cmp(iUdn, aOther.iUdn));
+}
+
+// ReceiverRegistry
+
+template<class T>
+typename ReceiverRegistry<T>::ConstIterator ReceiverRegistry<T>::Lower(const Brx& aRoom, const Brx& aUdn) const
+{
+	return (std::lower_bound(iEntries.begin(), iEntries.end(), Entry(aRoom, aUdn, 0)));
+}
+
+template<class T>
+TBool ReceiverRegistry<T>::Add(const Brx& aRoom, const Brx& aUdn, T& aReceiver)
+{
+	Entry entry(aRoom, aUdn, &aReceiver);
+
+	Iterator it = std::lower_bound(iEntries.begin(), iEntries.end(), entry);
+
+	if (it != iEntries.end() && it->iRoom == aRoom && it->iUdn == aUdn) {
+		return (false);
+	}
+
+	iEntries.insert(it, entry);
+	iUdns.insert(std::pair<Brn, T*>(Brn(aUdn), &aReceiver)); // after any existing entries for this UDN
+
+	return (true);
+}
+
+template<class T>
+TBool ReceiverRegistry<T>::Remove(const Brx& aRoom, const Brx& aUdn, T& aReceiver)
+{
+	Iterator it = std::lower_bound(iEntries.begin(), iEntries.end(), Entry(aRoom, aUdn, 0));
+
+	if (it == iEntries.end() || it->iReceiver != &aReceiver) {
+		return (false);
+	}
+
+	iEntries.erase(it);
+
+	std::pair<UdnIterator, UdnIterator> range = iUdns.equal_range(Brn(aUdn));
+
+	for (UdnIterator udn = range.first; udn != range.second; udn++) {
+		if (udn->second == &aReceiver) {
+			iUdns.erase(udn);
+			break;
+		}
+	}
+
+	return (true);
+}
+
+template<class T>
+T* ReceiverRegistry<T>::Find(const Brx& aUdn) const
+{
+	std::pair<ConstUdnIterator, ConstUdnIterator> range = iUdns.equal_range(Brn(aUdn));
+
+	if (range.first == range.second) {
+		return (0);
+	}
+
+	return ((--range.second)->second);
+}
+
+template<class T>
+T* ReceiverRegistry<T>::Find(const Brx& aRoom, const Brx& aUdn) const
+{
+	ConstIterator it = Lower(aRoom, aUdn);
+
+	if (it != iEntries.end() && it->iRoom == aRoom && it->iUdn == aUdn) {
+		return (it->iReceiver);
+	}
+
+	return (0);
+}
+
+template<class T>
+TUint ReceiverRegistry<T>::IndexOf(const Brx& aRoom, const Brx& aUdn) const
+{
+	ConstIterator it = Lower(aRoom, aUdn);
+
+	if (it != iEntries.end() && it->iRoom == aRoom && it->iUdn == aUdn) {
+		return ((TUint)(it - iEntries.begin()));
+	}
+
+	return (Count());
+}
+
+template<class T>
+TUint ReceiverRegistry<T>::Count() const
+{
+	return ((TUint)iEntries.size());
+}
+
+template<class T>
+T& ReceiverRegistry<T>::At(TUint aIndex) const
+{
+	ASSERT(aIndex < iEntries.size());
+	return (*iEntries[aIndex].iReceiver);
+}
+
+template<class T>
+TUint ReceiverRegistry<T>::RoomFirst(const Brx& aRoom) const
+{
+	return ((TUint)(Lower(aRoom, Brx::Empty()) - iEntries.begin()));
+}
+
+template<class T>
+TUint ReceiverRegistry<T>::RoomCount(const Brx& aRoom) const
+{
+	ConstIterator it = Lower(aRoom, Brx::Empty());
+
+	TUint count = 0;
+
+	while (it != iEntries.end() && it->iRoom == aRoom) {
+		count++;
+		it++;
+	}
+
+	return (count);
+}
+
+} // namespace Av
+} // namespace OpenHome
+
+#endif // HEADER_RECEIVER_REGISTRY
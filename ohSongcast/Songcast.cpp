@@ -4,6 +4,8 @@
 
 #include <OpenHome/Private/Debug.h>
 #include <OpenHome/Private/Ascii.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Os.h>
 #include "../Debug.h"
 
 #include <algorithm>
@@ -100,6 +102,36 @@ void STDCALL SongcastRefreshReceivers(THandle aSongcast)
 	((Songcast*)aSongcast)->RefreshReceivers();
 }
 
+void STDCALL SongcastSetReceiverBatchCallback(THandle aSongcast, ReceiverBatchCallback aCallback, void* aPtr, uint32_t aWindowMs)
+{
+	((Songcast*)aSongcast)->SetReceiverBatchCallback(aCallback, aPtr, aWindowMs);
+}
+
+uint32_t STDCALL SongcastReceiversSnapshot(THandle aSongcast, ReceiverSnapshot* aReceivers, uint32_t aMaxCount)
+{
+	return (((Songcast*)aSongcast)->ReceiversSnapshot(aReceivers, aMaxCount));
+}
+
+uint32_t STDCALL SongcastStartupPhaseCount(THandle aSongcast)
+{
+	return (((Songcast*)aSongcast)->Startup().Count());
+}
+
+const char* STDCALL SongcastStartupPhaseName(THandle aSongcast, uint32_t aIndex)
+{
+	return (((Songcast*)aSongcast)->Startup().Name(aIndex));
+}
+
+uint32_t STDCALL SongcastStartupPhaseStartUs(THandle aSongcast, uint32_t aIndex)
+{
+	return (((Songcast*)aSongcast)->Startup().StartUs(aIndex));
+}
+
+uint32_t STDCALL SongcastStartupPhaseUs(THandle aSongcast, uint32_t aIndex)
+{
+	return (((Songcast*)aSongcast)->Startup().DurationUs(aIndex));
+}
+
 void STDCALL SongcastDestroy(THandle aSongcast)
 {
 	delete ((Songcast*)aSongcast);
@@ -229,6 +261,7 @@ Receiver::Receiver(ReceiverManager3Receiver& aReceiver)
 	, iRoom(iReceiver.Room())
 	, iGroup(iReceiver.Group())
 	, iName(iReceiver.Name())
+	, iMutex("SCRX")
 	, iRefCount(1)
 {
 	iReceiver.AddRef();
@@ -322,12 +355,18 @@ void Receiver::Standby()
 
 void Receiver::AddRef()
 {
+	iMutex.Wait();
 	iRefCount++;
+	iMutex.Signal();
 }
 
 void Receiver::RemoveRef()
 {
-	if (--iRefCount == 0) {
+	iMutex.Wait();
+	TBool dead = (--iRefCount == 0);
+	iMutex.Signal();
+
+	if (dead) {
 		delete (this);
 	}
 }
@@ -337,6 +376,218 @@ Receiver::~Receiver()
 	iReceiver.RemoveRef();
 }
 
+// ReceiverBatcher
+
+ReceiverBatcher::ReceiverBatcher(IReceiverBatchSource& aSource)
+	: iSource(aSource)
+	, iMutex("SCBM")
+	, iReady("SCBR", 0)
+	, iCallback(0)
+	, iPtr(0)
+	, iWindowMs(0)
+	, iStopping(false)
+	, iBusy(false)
+	, iClearing(false)
+	, iClearWaiters(0)
+	, iCleared("SCBC", 0)
+	, iChanges(0)
+	, iCallbacks(0)
+{
+	iThread = new ThreadFunctor("SCBT", MakeFunctor(*this, &ReceiverBatcher::Run), kPriorityNormal, kThreadStackBytes);
+	iThread->Start();
+}
+
+void ReceiverBatcher::SetCallback(ReceiverBatchCallback aCallback, void* aPtr, TUint aWindowMs)
+{
+	iMutex.Wait();
+
+	iWindowMs = aWindowMs;
+
+	if (aCallback != 0 || iCallback == 0 || iStopping || (iPending.size() == 0 && !iBusy)) {
+		iCallback = aCallback;
+		iPtr = aPtr;
+		ClearedLocked();
+		iMutex.Signal();
+		return;
+	}
+
+	// changes already batched must reach the client ahead of any ReceiverCallback, so the batcher
+	// keeps the callback until it has delivered them (see Deliver)
+
+	iClearing = true;
+
+	// the batch being delivered, if any, is the caller's own when called from a batch callback
+
+	TBool wait = (Thread::Current() != iThread);
+
+	if (wait) {
+		iClearWaiters++;
+	}
+
+	iMutex.Signal();
+
+	if (wait) {
+		iCleared.Wait();
+	}
+}
+
+void ReceiverBatcher::ClearedLocked()
+{
+	iClearing = false;
+
+	while (iClearWaiters > 0) {
+		iCleared.Signal();
+		iClearWaiters--;
+	}
+}
+
+TBool ReceiverBatcher::Changed(THandle aReceiver, ECallbackType aType)
+{
+	AutoMutex mutex(iMutex);
+
+	if (iCallback == 0) {
+		return (false);
+	}
+
+	iChanges++;
+
+	std::map<THandle, TUint>::iterator it = iIndex.find(aReceiver);
+
+	if (it != iIndex.end()) {
+		iPending[it->second].iChanges |= (1 << aType);
+		return (true);
+	}
+
+	// the batch keeps the receiver alive until it has been delivered
+
+	iSource.AddRef(aReceiver);
+
+	iIndex[aReceiver] = (TUint)iPending.size();
+	iPending.push_back(Entry(aReceiver, 1 << aType));
+
+	if (iPending.size() == 1) {
+		iReady.Signal();
+	}
+
+	return (true);
+}
+
+TUint ReceiverBatcher::Changes() const
+{
+	AutoMutex mutex(iMutex);
+	return (iChanges);
+}
+
+TUint ReceiverBatcher::Callbacks() const
+{
+	AutoMutex mutex(iMutex);
+	return (iCallbacks);
+}
+
+void ReceiverBatcher::Stop()
+{
+	iMutex.Wait();
+
+	if (iStopping) {
+		iMutex.Signal();
+		return;
+	}
+
+	iStopping = true;
+	iMutex.Signal();
+
+	iReady.Signal();
+
+	delete (iThread);
+	iThread = 0;
+}
+
+void ReceiverBatcher::Run()
+{
+	for (;;) {
+		iReady.Wait();
+
+		iMutex.Wait();
+		TBool stopping = iStopping;
+		TUint window = iClearing ? 0 : iWindowMs;
+		iMutex.Signal();
+
+		if (!stopping && window > 0) {
+			Thread::Sleep(window);
+		}
+
+		if (!Deliver()) {
+			break;
+		}
+	}
+}
+
+// Deliver the pending batch, returning false once stopping
+
+TBool ReceiverBatcher::Deliver()
+{
+	// iDelivering and iPending trade buffers, so neither is reallocated once both have grown
+
+	std::vector<Entry>& batch = iDelivering;
+
+	iMutex.Wait();
+	batch.swap(iPending);
+	iIndex.clear();
+	ReceiverBatchCallback callback = iCallback;
+	void* ptr = iPtr;
+	TBool stopping = iStopping;
+	iBusy = true;
+	iMutex.Signal();
+
+	// iSnapshots is only used on this thread
+
+	iSnapshots.resize(batch.size());
+
+	for (TUint i = 0; i < batch.size(); i++) {
+		ReceiverSnapshot& snapshot = iSnapshots[i];
+		iSource.Snapshot(batch[i].iReceiver, snapshot);
+		snapshot.iReceiver = batch[i].iReceiver;
+		snapshot.iChanges = batch[i].iChanges;
+	}
+
+	if (batch.size() > 0 && callback != 0) {
+		(*callback)(ptr, &iSnapshots[0], (uint32_t)batch.size());
+
+		iMutex.Wait();
+		iCallbacks++;
+		iMutex.Signal();
+	}
+
+	for (TUint i = 0; i < batch.size(); i++) {
+		iSource.RemoveRef(batch[i].iReceiver);
+	}
+
+	batch.clear();
+
+	iMutex.Wait();
+
+	iBusy = false;
+
+	// changes made while this batch was delivered are in the next one, so a callback being
+	// cleared is only cleared once no batch is left (or, when stopping, none will be delivered)
+
+	if (iClearing && (iPending.size() == 0 || iStopping)) {
+		iCallback = 0;
+		iPtr = 0;
+		ClearedLocked();
+	}
+
+	iMutex.Signal();
+
+	return (!stopping);
+}
+
+ReceiverBatcher::~ReceiverBatcher()
+{
+	Stop();
+	ASSERT(iPending.size() == 0);
+}
+
 // Subnet
 
 Subnet::Subnet(NetworkAdapter& aAdapter)
@@ -426,6 +677,64 @@ Subnet::~Subnet()
 	}
 }
     
+// SongcastStartup
+
+SongcastStartup::SongcastStartup(Environment& aEnv)
+	: iEnv(aEnv)
+	, iMutex("SCSU")
+	, iCount(0)
+{
+	iCreatedUs = Now();
+}
+
+TUint64 SongcastStartup::Now() const
+{
+	return (OsTimeInUs(iEnv.OsCtx()));
+}
+
+void SongcastStartup::Completed(const TChar* aName, TUint64 aStartUs)
+{
+	TUint64 now = Now();
+
+	AutoMutex mutex(iMutex);
+
+	ASSERT(iCount < kMaxPhases);
+
+	iName[iCount] = aName;
+	iStartUs[iCount] = (TUint)(aStartUs - iCreatedUs);
+	iDurationUs[iCount] = (TUint)(now - aStartUs);
+	iCount++;
+
+	LOG(kMedia, "Songcast startup: %s took %d us\n", aName, iDurationUs[iCount - 1]);
+}
+
+TUint SongcastStartup::Count() const
+{
+	AutoMutex mutex(iMutex);
+	return (iCount);
+}
+
+const TChar* SongcastStartup::Name(TUint aIndex) const
+{
+	AutoMutex mutex(iMutex);
+	ASSERT(aIndex < iCount);
+	return (iName[aIndex]);
+}
+
+TUint SongcastStartup::StartUs(TUint aIndex) const
+{
+	AutoMutex mutex(iMutex);
+	ASSERT(aIndex < iCount);
+	return (iStartUs[aIndex]);
+}
+
+TUint SongcastStartup::DurationUs(TUint aIndex) const
+{
+	AutoMutex mutex(iMutex);
+	ASSERT(aIndex < iCount);
+	return (iDurationUs[aIndex]);
+}
+
 // Songcast
 
 Songcast::Songcast(TIpAddress aSubnet, TUint aChannel, TUint aTtl, TUint aLatency, TBool aMulticast, TBool aEnabled, TUint aPreset, ReceiverCallback aReceiverCallback, void* aReceiverPtr, SubnetCallback aSubnetCallback, void* aSubnetPtr, ConfigurationChangedCallback aConfigurationChangedCallback, void* aConfigurationChangedPtr, MessageCallback aFatalErrorCallback, void* aFatalErrorPtr, MessageCallback aLogOutputCallback, void* aLogOutputPtr, const Brx& aComputer, IOhmSenderDriver* aDriver, const char* aManufacturer, const char* aManufacturerUrl, const char* aModelUrl, const Brx& aImage, const Brx& aMimeType)
@@ -450,6 +759,9 @@ Songcast::Songcast(TIpAddress aSubnet, TUint aChannel, TUint aTtl, TUint aLatenc
 	, iAdapter(0)
 	, iSender(0)
     , iDriver(aDriver)
+	, iReceiverManager(0)
+	, iStartup(0)
+	, iStartupThread(0)
 {
 	//Debug::SetLevel(Debug::kMedia);
 
@@ -500,17 +812,28 @@ Songcast::Songcast(TIpAddress aSubnet, TUint aChannel, TUint aTtl, TUint aLatenc
 	Debug::SetLevel(Debug::kTrace);
 
 	initParams->SetSubnetListChangedListener(callback);
+	initParams->SetNumActionInvokerThreads(kActionInvokerThreads);
 
     // create the OhNet library
     iLibrary = new Library(initParams);
 
     // it is now ok to create the mutex
     iMutex = new Mutex("SCRD");
+    iMutexSubnet = new Mutex("SCSN");
+
+	iBatcher = new ReceiverBatcher(*this);
+
+	iStartup = new SongcastStartup(iLibrary->Env());
 
-	CpStack* cpStack;
-    DvStack* dvStack;
-    iLibrary->StartCombined(iSubnet, cpStack, dvStack);
+	// the device and sender come first so that audio can stream as soon as this returns;
+	// the control point stack and receiver discovery follow on iStartupThread
 
+	TUint64 start = iStartup->Now();
+	iLibrary->SetCurrentSubnet(iSubnet);
+    DvStack* dvStack = iLibrary->StartDv();
+	iStartup->Completed("dv stack", start);
+
+	start = iStartup->Now();
 	iDevice = new DvDeviceStandard(*dvStack, udn);
     
 	iDevice->SetAttribute("Upnp.Domain", "av.openhome.org");
@@ -525,16 +848,76 @@ Songcast::Songcast(TIpAddress aSubnet, TUint aChannel, TUint aTtl, TUint aLatenc
     iDevice->SetAttribute("Upnp.ModelUrl", (TChar*)aModelUrl);
     iDevice->SetAttribute("Upnp.SerialNumber", "");
     iDevice->SetAttribute("Upnp.Upc", "");
+	iStartup->Completed("device", start);
 
+	start = iStartup->Now();
 	SubnetListChanged();
+	iStartup->Completed("subnets", start);
 
+	start = iStartup->Now();
 	Environment& env = iLibrary->Env();
     iSender = new OhmSender(env, *iDevice, *iDriver, name, iChannel, iAdapter, iTtl, iLatency, iMulticast, iEnabled, aImage, aMimeType, iPreset);
 	//iNetworkMonitor = new NetworkMonitor(env, *iDevice, name);
 	iDevice->SetEnabled();
-	iReceiverManager = new ReceiverManager3(*cpStack, *this, iSender->SenderUri(), iSender->SenderMetadata());
+	iStartup->Completed("sender", start);
+
+	iStartupThread = new ThreadFunctor("SCST", MakeFunctor(*this, &Songcast::StartReceiverManager), kPriorityNormal, kStartupThreadStackBytes);
+	iStartupThread->Start();
+}
+
+void Songcast::StartReceiverManager()
+{
+	iMutex->Wait();
+	TIpAddress subnet = iSubnet;
+	TBool multicast = iMulticast;
+	TBool closing = iClosing;
+	iMutex->Signal();
+
+	if (closing) {
+		return;
+	}
+
+	TUint64 start = iStartup->Now();
+	CpStack* cpStack = iLibrary->StartCp(subnet);
+	iStartup->Completed("cp stack", start);
+
+	// StartCp makes the subnet it was given current, undoing any SetSubnet made meanwhile
+
+	iMutexSubnet->Wait();
+
+	iMutex->Wait();
+	TIpAddress current = iSubnet;
+	iMutex->Signal();
+
+	if (current != subnet) {
+		iLibrary->SetCurrentSubnet(current);
+	}
+
+	iMutexSubnet->Signal();
+
+	start = iStartup->Now();
+	ReceiverManager3* manager = new ReceiverManager3(*cpStack, *this, iSender->SenderUri(), iSender->SenderMetadata());
+	iStartup->Completed("receiver manager", start);
+
+	iMutex->Wait();
+	iReceiverManager = manager;
+	TBool changed = (multicast != iMulticast);
+	iMutex->Signal();
+
+	// SetMulticast could not update metadata the manager was created with
+
+	if (changed) {
+		manager->SetMetadata(iSender->SenderMetadata());
+	}
 }
 
+ReceiverManager3* Songcast::AcquireReceiverManager()
+{
+	iMutex->Wait();
+	ReceiverManager3* manager = iReceiverManager;
+	iMutex->Signal();
+	return (manager);
+}
 
 void Songcast::FatalErrorHandler(const char* aMessage)
 {
@@ -762,10 +1145,13 @@ TUint Songcast::GetPreset()
 
 void Songcast::SetSubnet(TIpAddress aValue)
 {
+	iMutexSubnet->Wait();
+
 	iMutex->Wait();
 
 	if (iSubnet == aValue || iClosing) {
 	    iMutex->Signal();
+	    iMutexSubnet->Signal();
 		return;
 	}
 
@@ -773,7 +1159,9 @@ void Songcast::SetSubnet(TIpAddress aValue)
 
 	iMutex->Signal();
 
-	iLibrary->SetCurrentSubnet(iSubnet);
+	iLibrary->SetCurrentSubnet(aValue);
+
+	iMutexSubnet->Signal();
 
 	ASSERT(UpdateAdapter());
 
@@ -849,7 +1237,11 @@ void Songcast::SetMulticast(TBool aValue)
 
 	iSender->SetMulticast(aValue);
 
-	iReceiverManager->SetMetadata(iSender->SenderMetadata());
+	ReceiverManager3* manager = AcquireReceiverManager();
+
+	if (manager != 0) {
+		manager->SetMetadata(iSender->SenderMetadata());
+	}
 
 	(*iConfigurationChangedCallback)(iConfigurationChangedPtr, this);
 }
@@ -900,9 +1292,71 @@ void Songcast::SetMetatext(const TChar* aValue)
 	iSender->SetMetatext(Brn(aValue));
 }
 
+const SongcastStartup& Songcast::Startup() const
+{
+	return (*iStartup);
+}
+
 void Songcast::RefreshReceivers()
 {
-	iReceiverManager->Refresh();
+	ReceiverManager3* manager = AcquireReceiverManager();
+
+	if (manager != 0) {
+		manager->Refresh();
+	}
+}
+
+void Songcast::SetReceiverBatchCallback(ReceiverBatchCallback aCallback, void* aPtr, TUint aWindowMs)
+{
+	iBatcher->SetCallback(aCallback, aPtr, aWindowMs);
+}
+
+TUint Songcast::ReceiversSnapshot(ReceiverSnapshot* aReceivers, TUint aMaxCount)
+{
+	std::vector<ReceiverManager3Receiver*> receivers;
+
+	ReceiverManager3* manager = AcquireReceiverManager();
+
+	if (manager != 0) {
+		manager->Receivers(receivers);
+	}
+
+	std::vector<Receiver*> found;
+
+	// user data is cleared under iMutex before the Receiver loses its owning reference
+
+	iMutex->Wait();
+
+	for (TUint i = 0; i < receivers.size(); i++) {
+		Receiver* receiver = (Receiver*)(receivers[i]->UserData());
+
+		if (receiver != 0) {
+			receiver->AddRef();
+			found.push_back(receiver);
+		}
+	}
+
+	iMutex->Signal();
+
+	for (TUint i = 0; i < receivers.size(); i++) {
+		receivers[i]->RemoveRef();
+	}
+
+	TUint count = (TUint)found.size();
+
+	for (TUint i = 0; i < count; i++) {
+		if (i < aMaxCount) {
+			ReceiverSnapshot& snapshot = aReceivers[i];
+			Snapshot((THandle)found[i], snapshot);
+			snapshot.iReceiver = (THandle)found[i];
+			snapshot.iChanges = 0;
+		}
+		else {
+			found[i]->RemoveRef();
+		}
+	}
+
+	return (count);
 }
 
 Songcast::~Songcast()
@@ -915,9 +1369,15 @@ Songcast::~Songcast()
 
     LOG(kMedia, "Songcast::~Songcast registered closing\n");
 
+	delete (iStartupThread);
+    LOG(kMedia, "Songcast::~Songcast startup complete\n");
+
 	delete (iReceiverManager);
     LOG(kMedia, "Songcast::~Songcast receiver manager destroyed\n");
 
+	delete (iBatcher);
+    LOG(kMedia, "Songcast::~Songcast receiver batcher destroyed\n");
+
 	//delete (iNetworkMonitor);
 	//LOG(kMedia, "Songcast::~Songcast network monitor destroyed\n");
 
@@ -939,6 +1399,8 @@ Songcast::~Songcast()
 	}
     LOG(kMedia, "Songcast::~Songcast subnets destroyed\n");
 
+    delete iStartup;
+    delete iMutexSubnet;
     delete iMutex;
     delete iLibrary;
 
@@ -950,22 +1412,27 @@ Songcast::~Songcast()
 void Songcast::ReceiverAdded(ReceiverManager3Receiver& aReceiver)
 {
 	Receiver* receiver = new Receiver(aReceiver);
+	iMutex->Wait();
 	aReceiver.SetUserData(receiver);
-	(*iReceiverCallback)(iReceiverPtr, eAdded, (THandle)receiver);
+	iMutex->Signal();
+	Notify(*receiver, eAdded);
 }
 
 void Songcast::ReceiverChanged(ReceiverManager3Receiver& aReceiver)
 {
 	Receiver* receiver = (Receiver*)(aReceiver.UserData());
 	ASSERT(receiver);
-	(*iReceiverCallback)(iReceiverPtr, eChanged, (THandle)receiver);
+	Notify(*receiver, eChanged);
 }
 
 void Songcast::ReceiverRemoved(ReceiverManager3Receiver& aReceiver)
 {
 	Receiver* receiver = (Receiver*)(aReceiver.UserData());
 	ASSERT(receiver);
-	(*iReceiverCallback)(iReceiverPtr, eRemoved, (THandle)receiver);
+	iMutex->Wait();
+	aReceiver.SetUserData(0);
+	iMutex->Signal();
+	Notify(*receiver, eRemoved);
 	receiver->RemoveRef();
 }
 
@@ -973,26 +1440,55 @@ void Songcast::ReceiverVolumeControlChanged(ReceiverManager3Receiver& aReceiver)
 {
 	Receiver* receiver = (Receiver*)(aReceiver.UserData());
 	ASSERT(receiver);
-	(*iReceiverCallback)(iReceiverPtr, eVolumeControlChanged, (THandle)receiver);
+	Notify(*receiver, eVolumeControlChanged);
 }
 
 void Songcast::ReceiverVolumeChanged(ReceiverManager3Receiver& aReceiver)
 {
 	Receiver* receiver = (Receiver*)(aReceiver.UserData());
 	ASSERT(receiver);
-	(*iReceiverCallback)(iReceiverPtr, eVolumeChanged, (THandle)receiver);
+	Notify(*receiver, eVolumeChanged);
 }
 
 void Songcast::ReceiverMuteChanged(ReceiverManager3Receiver& aReceiver)
 {
 	Receiver* receiver = (Receiver*)(aReceiver.UserData());
 	ASSERT(receiver);
-	(*iReceiverCallback)(iReceiverPtr, eMuteChanged, (THandle)receiver);
+	Notify(*receiver, eMuteChanged);
 }
 
 void Songcast::ReceiverVolumeLimitChanged(ReceiverManager3Receiver& aReceiver)
 {
 	Receiver* receiver = (Receiver*)(aReceiver.UserData());
 	ASSERT(receiver);
-	(*iReceiverCallback)(iReceiverPtr, eVolumeLimitChanged, (THandle)receiver);
+	Notify(*receiver, eVolumeLimitChanged);
+}
+
+void Songcast::Notify(Receiver& aReceiver, ECallbackType aType)
+{
+	if (!iBatcher->Changed((THandle)&aReceiver, aType)) {
+		(*iReceiverCallback)(iReceiverPtr, aType, (THandle)&aReceiver);
+	}
+}
+
+// IReceiverBatchSource
+
+void Songcast::Snapshot(THandle aReceiver, ReceiverSnapshot& aSnapshot)
+{
+	Receiver* receiver = (Receiver*)aReceiver;
+	aSnapshot.iStatus = receiver->Status();
+	aSnapshot.iHasVolumeControl = receiver->HasVolumeControl() ? 1 : 0;
+	aSnapshot.iVolume = receiver->Volume();
+	aSnapshot.iMute = receiver->Mute() ? 1 : 0;
+	aSnapshot.iVolumeLimit = receiver->VolumeLimit();
+}
+
+void Songcast::AddRef(THandle aReceiver)
+{
+	((Receiver*)aReceiver)->AddRef();
+}
+
+void Songcast::RemoveRef(THandle aReceiver)
+{
+	((Receiver*)aReceiver)->RemoveRef();
 }
@@ -42,6 +42,11 @@ namespace OpenHome.Songcast
         void ConfigurationChanged(IConfiguration aConfiguration);
     }
 
+    // Called on threads of ohSongcast's, one at a time for the receivers of one device but possibly
+    // concurrently for different devices, with a receiver's Added first and its Removed last. A
+    // device that moves room is a new IReceiver with the same Udn, possibly added before the old
+    // one is removed, so receivers are matched by reference rather than by Udn.
+
     public interface IReceiverHandler
     {
         void ReceiverAdded(IReceiver aReceiver);
@@ -81,6 +86,26 @@ namespace OpenHome.Songcast
         uint IpAddress { get; }
     }
 
+    public class ReceiverState
+    {
+        internal ReceiverState(IReceiver aReceiver, EReceiverStatus aStatus, bool aHasVolumeControl, uint aVolume, bool aMute, uint aVolumeLimit)
+        {
+            Receiver = aReceiver;
+            Status = aStatus;
+            HasVolumeControl = aHasVolumeControl;
+            Volume = aVolume;
+            Mute = aMute;
+            VolumeLimit = aVolumeLimit;
+        }
+
+        public IReceiver Receiver { get; private set; }
+        public EReceiverStatus Status { get; private set; }
+        public bool HasVolumeControl { get; private set; }
+        public uint Volume { get; private set; }
+        public bool Mute { get; private set; }
+        public uint VolumeLimit { get; private set; }
+    }
+
     internal class Receiver : IReceiver, IDisposable
     {
         [DllImport("ohSongcast")]
@@ -361,7 +386,20 @@ namespace OpenHome.Songcast
             eVolumeLimitChanged
         }
 
+        [StructLayout(LayoutKind.Sequential)]
+        private struct ReceiverSnapshot
+        {
+            public IntPtr iReceiver;
+            public uint iChanges;
+            public uint iStatus;
+            public uint iHasVolumeControl;
+            public uint iVolume;
+            public uint iMute;
+            public uint iVolumeLimit;
+        }
+
         private delegate void DelegateReceiverCallback(IntPtr aPtr, ECallbackType aType, IntPtr aReceiver);
+        private unsafe delegate void DelegateReceiverBatchCallback(IntPtr aPtr, ReceiverSnapshot* aReceivers, uint aCount);
         private delegate void DelegateSubnetCallback(IntPtr aPtr, ECallbackType aType, IntPtr aSubnet);
         private delegate void DelegateConfigurationChangedCallback(IntPtr aPtr, IntPtr aSongcast);
         private unsafe delegate void DelegateMessageCallback(IntPtr aPtr, char* aMessage);
@@ -405,7 +443,13 @@ namespace OpenHome.Songcast
         [DllImport("ohSongcast")]
         static extern void SongcastRefreshReceivers(IntPtr aHandle);
         [DllImport("ohSongcast")]
+        static extern void SongcastSetReceiverBatchCallback(IntPtr aHandle, DelegateReceiverBatchCallback aCallback, IntPtr aPtr, uint aWindowMs);
+        [DllImport("ohSongcast")]
+        static extern uint SongcastReceiversSnapshot(IntPtr aHandle, [Out] ReceiverSnapshot[] aReceivers, uint aMaxCount);
+        [DllImport("ohSongcast")]
         static extern void SongcastDestroy(IntPtr aHandle);
+        [DllImport("ohSongcast")]
+        static extern void ReceiverRemoveRef(IntPtr aHandle);
 
         public unsafe Songcast(string aDomain, uint aSubnet, uint aChannel, uint aTtl, uint aLatency, bool aMulticast, bool aEnabled, uint aPreset, IReceiverHandler aReceiverHandler, ISubnetHandler aSubnetHandler, IConfigurationChangedHandler aConfigurationChangedHandler, IMessageHandler aLogOutputHandler, string aManufacturer, string aManufacturerUrl, string aModelUrl, byte[] aImage, string aMimeType)
         {
@@ -414,11 +458,12 @@ namespace OpenHome.Songcast
             iConfigurationChangedHandler = aConfigurationChangedHandler;
             iLogOutputHandler = aLogOutputHandler;
             iReceiverCallback = new DelegateReceiverCallback(ReceiverCallback);
+            iReceiverBatchCallback = new DelegateReceiverBatchCallback(ReceiverBatchCallback);
             iSubnetCallback = new DelegateSubnetCallback(SubnetCallback);
             iConfigurationChangedCallback = new DelegateConfigurationChangedCallback(ConfigurationChangedCallback);
             iFatalErrorCallback = new DelegateMessageCallback(FatalErrorCallback);
             iLogOutputCallback = new DelegateMessageCallback(LogOutputCallback);
-            iReceiverList = new List<Receiver>();
+            iReceivers = new Dictionary<IntPtr, Receiver>();
             iSubnetList = new List<Subnet>();
 
             iHandle = SongcastCreate(aDomain, aSubnet, aChannel, aTtl, aLatency, aMulticast, aEnabled, aPreset, iReceiverCallback, IntPtr.Zero, iSubnetCallback, IntPtr.Zero, iConfigurationChangedCallback, IntPtr.Zero, iFatalErrorCallback, IntPtr.Zero, iLogOutputCallback, IntPtr.Zero, aManufacturer, aManufacturerUrl, aModelUrl, aImage, aImage.Length, aMimeType);
@@ -457,84 +502,130 @@ namespace OpenHome.Songcast
             }
         }
 
+        // Changes coalesced into one batch entry are reported in the order they would have arrived in
+
+        private unsafe void ReceiverBatchCallback(IntPtr aPtr, ReceiverSnapshot* aReceivers, uint aCount)
+        {
+            for (uint i = 0; i < aCount; i++)
+            {
+                IntPtr receiver = aReceivers[i].iReceiver;
+                uint changes = aReceivers[i].iChanges;
+
+                if (Has(changes, ECallbackType.eAdded))
+                {
+                    ReceiverAdded(receiver);
+                }
+                if (Has(changes, ECallbackType.eChanged))
+                {
+                    ReceiverChanged(receiver);
+                }
+                if (Has(changes, ECallbackType.eVolumeControlChanged))
+                {
+                    ReceiverVolumeControlChanged(receiver);
+                }
+                if (Has(changes, ECallbackType.eVolumeChanged))
+                {
+                    ReceiverVolumeChanged(receiver);
+                }
+                if (Has(changes, ECallbackType.eMuteChanged))
+                {
+                    ReceiverMuteChanged(receiver);
+                }
+                if (Has(changes, ECallbackType.eVolumeLimitChanged))
+                {
+                    ReceiverVolumeLimitChanged(receiver);
+                }
+                if (Has(changes, ECallbackType.eRemoved))
+                {
+                    ReceiverRemoved(receiver);
+                }
+            }
+        }
+
+        private static bool Has(uint aChanges, ECallbackType aType)
+        {
+            return ((aChanges & (1u << (int)aType)) != 0);
+        }
+
+        // Receiver callbacks for different devices arrive on different threads, so the receiver table is locked
+
+        private Receiver FindReceiver(IntPtr aReceiver)
+        {
+            lock (iReceivers)
+            {
+                Receiver receiver;
+                iReceivers.TryGetValue(aReceiver, out receiver);
+                return (receiver);
+            }
+        }
+
         private void ReceiverAdded(IntPtr aReceiver)
         {
             Receiver receiver = new Receiver(aReceiver);
-            iReceiverList.Add(receiver);
+            lock (iReceivers)
+            {
+                iReceivers[aReceiver] = receiver;
+            }
             iReceiverHandler.ReceiverAdded(receiver);
         }
 
         private void ReceiverChanged(IntPtr aReceiver)
         {
-            foreach (Receiver receiver in iReceiverList)
+            Receiver receiver = FindReceiver(aReceiver);
+            if (receiver != null)
             {
-                if (receiver.Owns(aReceiver))
-                {
-                    iReceiverHandler.ReceiverChanged(receiver);
-                    return;
-                }
+                iReceiverHandler.ReceiverChanged(receiver);
             }
         }
 
         private void ReceiverRemoved(IntPtr aReceiver)
         {
-            foreach (Receiver receiver in iReceiverList)
+            Receiver receiver;
+            lock (iReceivers)
             {
-                if (receiver.Owns(aReceiver))
+                if (!iReceivers.TryGetValue(aReceiver, out receiver))
                 {
-                    iReceiverHandler.ReceiverRemoved(receiver);
-                    receiver.Dispose();
-                    iReceiverList.Remove(receiver);
                     return;
                 }
+                iReceivers.Remove(aReceiver);
             }
+            iReceiverHandler.ReceiverRemoved(receiver);
+            receiver.Dispose();
         }
 
         private void ReceiverVolumeControlChanged(IntPtr aReceiver)
         {
-            foreach (Receiver receiver in iReceiverList)
+            Receiver receiver = FindReceiver(aReceiver);
+            if (receiver != null)
             {
-                if (receiver.Owns(aReceiver))
-                {
-                    iReceiverHandler.ReceiverVolumeControlChanged(receiver);
-                    return;
-                }
+                iReceiverHandler.ReceiverVolumeControlChanged(receiver);
             }
         }
 
         private void ReceiverVolumeChanged(IntPtr aReceiver)
         {
-            foreach (Receiver receiver in iReceiverList)
+            Receiver receiver = FindReceiver(aReceiver);
+            if (receiver != null)
             {
-                if (receiver.Owns(aReceiver))
-                {
-                    iReceiverHandler.ReceiverVolumeChanged(receiver);
-                    return;
-                }
+                iReceiverHandler.ReceiverVolumeChanged(receiver);
             }
         }
 
         private void ReceiverMuteChanged(IntPtr aReceiver)
         {
-            foreach (Receiver receiver in iReceiverList)
+            Receiver receiver = FindReceiver(aReceiver);
+            if (receiver != null)
             {
-                if (receiver.Owns(aReceiver))
-                {
-                    iReceiverHandler.ReceiverMuteChanged(receiver);
-                    return;
-                }
+                iReceiverHandler.ReceiverMuteChanged(receiver);
             }
         }
 
         private void ReceiverVolumeLimitChanged(IntPtr aReceiver)
         {
-            foreach (Receiver receiver in iReceiverList)
+            Receiver receiver = FindReceiver(aReceiver);
+            if (receiver != null)
             {
-                if (receiver.Owns(aReceiver))
-                {
-                    iReceiverHandler.ReceiverVolumeLimitChanged(receiver);
-                    return;
-                }
+                iReceiverHandler.ReceiverVolumeLimitChanged(receiver);
             }
         }
 
@@ -696,6 +787,38 @@ namespace OpenHome.Songcast
             SongcastRefreshReceivers(iHandle);
         }
 
+        // Coalesce receiver changes over aWindowMs and deliver them a batch at a time; 0 restores a callback per change
+
+        public void SetReceiverBatching(uint aWindowMs)
+        {
+            SongcastSetReceiverBatchCallback(iHandle, (aWindowMs == 0) ? null : iReceiverBatchCallback, IntPtr.Zero, aWindowMs);
+        }
+
+        // The state of every receiver already announced to the receiver handler, in one call
+
+        public IList<ReceiverState> ReceiversSnapshot()
+        {
+            uint count = SongcastReceiversSnapshot(iHandle, null, 0);
+            ReceiverSnapshot[] snapshots = new ReceiverSnapshot[count];
+            count = Math.Min(count, SongcastReceiversSnapshot(iHandle, snapshots, count));
+
+            List<ReceiverState> states = new List<ReceiverState>();
+
+            for (uint i = 0; i < count; i++)
+            {
+                Receiver receiver = FindReceiver(snapshots[i].iReceiver);
+
+                if (receiver != null)
+                {
+                    states.Add(new ReceiverState(receiver, (EReceiverStatus)snapshots[i].iStatus, snapshots[i].iHasVolumeControl != 0, snapshots[i].iVolume, snapshots[i].iMute != 0, snapshots[i].iVolumeLimit));
+                }
+
+                ReceiverRemoveRef(snapshots[i].iReceiver);
+            }
+
+            return (states);
+        }
+
         public void Dispose()
         {
             SongcastDestroy(iHandle);
@@ -706,9 +829,10 @@ namespace OpenHome.Songcast
         private IConfigurationChangedHandler iConfigurationChangedHandler;
         private IMessageHandler iLogOutputHandler;
         private IntPtr iHandle;
-        private List<Receiver> iReceiverList;
+        private Dictionary<IntPtr, Receiver> iReceivers;
         private List<Subnet> iSubnetList;
         private DelegateReceiverCallback iReceiverCallback;
+        private DelegateReceiverBatchCallback iReceiverBatchCallback;
         private DelegateSubnetCallback iSubnetCallback;
         private DelegateConfigurationChangedCallback iConfigurationChangedCallback;
         private DelegateMessageCallback iFatalErrorCallback;
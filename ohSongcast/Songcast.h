@@ -8,6 +8,9 @@
 //#include "../../ohNetmon/OpenHome/NetworkMonitor.h"
 #include "ReceiverManager3.h"
 
+#include <vector>
+#include <map>
+
 ////////////////////////////////////////////
 // Exported C interface
 
@@ -35,11 +38,49 @@ enum EReceiverStatus {
  * Callback which runs to notify a change in the networked receivers
  * @ingroup Callbacks
  *
+ * Callbacks for the receivers of one device are made one at a time, in order, but those for
+ * different devices may be made concurrently from different ohSongcast threads. A receiver's
+ * eAdded comes before any other callback for it and its eRemoved after all of them. A device
+ * that moves room is reported as a new receiver with the same udn, which may be added before
+ * the old one is removed, so clients should track receivers by handle rather than by udn.
+ *
  * @param[in] aPtr      Client-specified data
  * @param[in] aType     Type of change indicated
  * @param[in] aReceiver Receiver handle
  */
 typedef void (STDCALL *ReceiverCallback)(void* aPtr, ECallbackType aType, THandle aReceiver);
+
+/**
+ * State of a receiver, as delivered in batches and returned by SongcastReceiversSnapshot
+ *
+ * iChanges is a bitmask of (1 << ECallbackType) for the changes coalesced into a batch entry,
+ * and is 0 in a snapshot. If both eAdded and eRemoved are set the receiver came and went
+ * within one batch window.
+ */
+typedef struct {
+	THandle iReceiver;
+	uint32_t iChanges;
+	uint32_t iStatus;           // EReceiverStatus
+	uint32_t iHasVolumeControl;
+	uint32_t iVolume;
+	uint32_t iMute;
+	uint32_t iVolumeLimit;
+} ReceiverSnapshot;
+
+/**
+ * Callback which runs to notify a batch of changes in the networked receivers
+ * @ingroup Callbacks
+ *
+ * Each receiver appears at most once per batch. Receiver handles are valid for the duration of
+ * the callback; use ReceiverAddRef to keep one beyond it. Batches are delivered one at a time
+ * from a thread of their own.
+ *
+ * @param[in] aPtr       Client-specified data
+ * @param[in] aReceivers Changed receivers
+ * @param[in] aCount     Number of entries in aReceivers
+ */
+typedef void (STDCALL *ReceiverBatchCallback)(void* aPtr, const ReceiverSnapshot* aReceivers, uint32_t aCount);
+
 typedef void (STDCALL *SubnetCallback)(void* aPtr, ECallbackType aType, THandle aSubnet);
 typedef void (STDCALL *ConfigurationChangedCallback)(void* aPtr, THandle aSongcast);
 typedef void (STDCALL *MessageCallback)(void* aPtr, const char* aMessage);
@@ -67,6 +108,38 @@ DllExport void STDCALL SongcastSetMetatext(THandle aSongcast, const char* aValue
 
 DllExport void STDCALL SongcastRefreshReceivers(THandle aSongcast);
 
+/**
+ * Deliver receiver changes in batches rather than one ReceiverCallback per change
+ *
+ * Changes are coalesced per receiver for aWindowMs after the first change of a batch. While a
+ * batch callback is set the ReceiverCallback passed to SongcastCreate is not called for receiver
+ * changes. Pass a null callback to return to per change callbacks. Changes already batched are
+ * still delivered to the batch callback, ahead of any ReceiverCallback; unless called from within
+ * a batch callback, this waits until they have been.
+ */
+DllExport void STDCALL SongcastSetReceiverBatchCallback(THandle aSongcast, ReceiverBatchCallback aCallback, void* aPtr, uint32_t aWindowMs);
+
+/**
+ * Current state of all receivers, ordered by room
+ *
+ * Fills up to aMaxCount entries of aReceivers and returns the total number of receivers.
+ * Each handle returned has a reference added which the caller must release with ReceiverRemoveRef.
+ */
+DllExport uint32_t STDCALL SongcastReceiversSnapshot(THandle aSongcast, ReceiverSnapshot* aReceivers, uint32_t aMaxCount);
+
+/**
+ * Startup timings
+ *
+ * SongcastCreate returns once the sender is ready to stream; the control point stack and receiver
+ * discovery start in the background. Each completed startup phase is recorded with its start time,
+ * relative to the creation of the ohNet library, and its duration. Phases are listed in the order
+ * they completed, and the count grows until the background phases are done.
+ */
+DllExport uint32_t STDCALL SongcastStartupPhaseCount(THandle aSongcast);
+DllExport const char* STDCALL SongcastStartupPhaseName(THandle aSongcast, uint32_t aIndex);
+DllExport uint32_t STDCALL SongcastStartupPhaseStartUs(THandle aSongcast, uint32_t aIndex);
+DllExport uint32_t STDCALL SongcastStartupPhaseUs(THandle aSongcast, uint32_t aIndex);
+
 DllExport void STDCALL SongcastDestroy(THandle aSongcast);
 
 DllExport const char* STDCALL ReceiverUdn(THandle aReceiver);
@@ -142,6 +215,7 @@ private:
 	Brhz iRoom;
 	Brhz iGroup;
 	Brhz iName;
+	Mutex iMutex;
     TUint iRefCount;
 };
 
@@ -171,10 +245,101 @@ private:
 	TUint iRefCount;
 };
 
-class DllExportClass Songcast : public IReceiverManager3Handler
+class IReceiverBatchSource
+{
+public:
+	virtual void Snapshot(THandle aReceiver, ReceiverSnapshot& aSnapshot) = 0; // all but iReceiver and iChanges
+	virtual void AddRef(THandle aReceiver) = 0;
+	virtual void RemoveRef(THandle aReceiver) = 0;
+	virtual ~IReceiverBatchSource() {}
+};
+
+// ReceiverBatcher coalesces receiver changes and delivers them from its own thread.
+// The first change after a delivery starts a window of aWindowMs; changes to the same receiver
+// within the window merge into one entry, and the batch is delivered when the window closes.
+// Clearing the callback flushes: it stays set, batching any further changes, until everything
+// batched has been delivered, so no ReceiverCallback for a later change can overtake the batch.
+
+class ReceiverBatcher
+{
+	static const TUint kThreadStackBytes = 64 * 1024;
+
+public:
+	ReceiverBatcher(IReceiverBatchSource& aSource);
+	void SetCallback(ReceiverBatchCallback aCallback, void* aPtr, TUint aWindowMs); // clearing waits for the flush
+	TBool Changed(THandle aReceiver, ECallbackType aType); // false if no batch callback is set
+	TUint Changes() const;
+	TUint Callbacks() const;
+	void Stop(); // delivers anything outstanding
+	~ReceiverBatcher();
+
+private:
+	void Run();
+	TBool Deliver();
+	void ClearedLocked();
+
+private:
+	class Entry
+	{
+	public:
+		Entry(THandle aReceiver, TUint aChanges) : iReceiver(aReceiver), iChanges(aChanges) {}
+
+	public:
+		THandle iReceiver;
+		TUint iChanges;
+	};
+
+	IReceiverBatchSource& iSource;
+	mutable Mutex iMutex;
+	Semaphore iReady;
+	ReceiverBatchCallback iCallback;
+	void* iPtr;
+	TUint iWindowMs;
+	TBool iStopping;
+	TBool iBusy;                     // a batch is being delivered
+	TBool iClearing;                 // the callback is to be cleared once nothing batched is left
+	TUint iClearWaiters;
+	Semaphore iCleared;
+	std::vector<Entry> iPending;
+	std::map<THandle, TUint> iIndex; // receiver to position in iPending
+	std::vector<Entry> iDelivering; // the batch being delivered, only used on the batcher thread
+	std::vector<ReceiverSnapshot> iSnapshots;
+	TUint iChanges;
+	TUint iCallbacks;
+	ThreadFunctor* iThread;
+};
+
+// SongcastStartup records how long each phase of Songcast's startup took
+
+class SongcastStartup
+{
+	static const TUint kMaxPhases = 8;
+
+public:
+	SongcastStartup(Environment& aEnv);
+	TUint64 Now() const;
+	void Completed(const TChar* aName, TUint64 aStartUs); // aStartUs as returned by Now()
+	TUint Count() const;
+	const TChar* Name(TUint aIndex) const;
+	TUint StartUs(TUint aIndex) const;
+	TUint DurationUs(TUint aIndex) const;
+
+private:
+	Environment& iEnv;
+	mutable Mutex iMutex;
+	TUint64 iCreatedUs;
+	TUint iCount;
+	const TChar* iName[kMaxPhases];
+	TUint iStartUs[kMaxPhases];
+	TUint iDurationUs[kMaxPhases];
+};
+
+class DllExportClass Songcast : public IReceiverManager3Handler, public IReceiverBatchSource
 {
 public:
 	static const TUint kMaxUdnBytes = 200;
+	static const TUint kActionInvokerThreads = 8; // receiver volume actions run concurrently across a group
+	static const TUint kStartupThreadStackBytes = 64 * 1024;
 
 public:
     Songcast(TIpAddress aSubnet, TUint aChannel, TUint aTtl, TUint aLatency, TBool aMulticast, TBool aEnabled, TUint aPreset, ReceiverCallback aReceiverCallback, void* aReceiverPtr, SubnetCallback aSubnetCallback, void* aSubnetPtr, ConfigurationChangedCallback aConfigurationChangedCallback, void* aConfigurationChangedPtr, MessageCallback aFatalErrorCallback, void* aFatalErrorPtr, MessageCallback aLogOutputCallback, void* aLogOutputPtr, const Brx& aComputer, IOhmSenderDriver* aDriver, const char* aManufacturer, const char* aManufacturerUrl, const char* aModelUrl, const Brx& aImage, const Brx& aMimeType);
@@ -197,10 +362,15 @@ public:
     void SetTrack(const TChar* aUri, const TChar* aMetadata, TUint64 aSamplesTotal, TUint64 aSampleStart);
 	void SetMetatext(const TChar* aValue);
 	void RefreshReceivers();
+	void SetReceiverBatchCallback(ReceiverBatchCallback aCallback, void* aPtr, TUint aWindowMs);
+	TUint ReceiversSnapshot(ReceiverSnapshot* aReceivers, TUint aMaxCount);
+	const SongcastStartup& Startup() const;
 
 	virtual ~Songcast();
 
 private:
+	void StartReceiverManager();
+	ReceiverManager3* AcquireReceiverManager(); // 0 until discovery has started
 	void SubnetListChanged();
 	void FatalErrorHandler(const char* aMessage);
 	void LogOutputHandler(const char* aMessage);
@@ -215,6 +385,13 @@ private:
 	virtual void ReceiverMuteChanged(ReceiverManager3Receiver& aReceiver);
 	virtual void ReceiverVolumeLimitChanged(ReceiverManager3Receiver& aReceiver);
 
+	// IReceiverBatchSource
+	virtual void Snapshot(THandle aReceiver, ReceiverSnapshot& aSnapshot);
+	virtual void AddRef(THandle aReceiver);
+	virtual void RemoveRef(THandle aReceiver);
+
+	void Notify(Receiver& aReceiver, ECallbackType aType);
+
 private:
 	TIpAddress iSubnet;
 	TUint iChannel;
@@ -234,6 +411,7 @@ private:
     MessageCallback iLogOutputCallback;
     void* iLogOutputPtr;
 	Mutex* iMutex;
+	Mutex* iMutexSubnet; // orders the calls that set the library's current subnet
 	TBool iClosing;
 	TIpAddress iAdapter;
 	std::vector<Subnet*> iSubnetList;
@@ -241,7 +419,10 @@ private:
 	//Net::NetworkMonitor* iNetworkMonitor;
 	IOhmSenderDriver* iDriver;
 	Net::DvDeviceStandard* iDevice;
+	ReceiverBatcher* iBatcher;
 	ReceiverManager3* iReceiverManager;
+	SongcastStartup* iStartup;
+	ThreadFunctor* iStartupThread;
     OpenHome::Net::Library* iLibrary;
 };
 
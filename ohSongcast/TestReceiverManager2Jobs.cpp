@@ -0,0 +1,509 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Private/Ascii.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/Fifo.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Os.h>
+
+#include <vector>
+#include <stdio.h>
+
+#include "ReceiverManager2.h"
+
+
+#ifdef _WIN32
+#define CDECL __cdecl
+#else
+#define CDECL
+#endif
+
+// Simulates a large house to measure time-to-full-receiver-list through ReceiverManager2Jobs
+//
+// Producer threads (standing in for the topology and eventing threads) announce each receiver
+// with Added and VolumeControlChanged followed by a burst of state changes. The handler takes a
+// fixed time per callback (standing in for the client callback). Each run is compared against the
+// previous design: one thread fed by a blocking Fifo of 20 jobs.
+//
+// Receivers come in pairs with the same key, as a device that moves room is two receivers with the
+// same udn. The handler checks per receiver ordering, Added first and nothing after Removed, and
+// that no two callbacks for receivers with the same key are ever made at once.
+
+namespace OpenHome {
+namespace Av {
+
+class SimulatedReceiver : public ReceiverManager2JobNode
+{
+public:
+	SimulatedReceiver(const Brx& aKey, TUint aDevice);
+
+public:
+	TUint iDevice;
+	Mutex iMutex;
+	TUint iRefCount;
+	TBool iExecuting;
+	TBool iAdded;
+	TBool iRemoved;
+	TUint iCallbacks;
+};
+
+class SimulatedHouse : public IReceiverManager2JobHandler
+{
+public:
+	SimulatedHouse(Environment& aEnv, TUint aReceivers, TUint aCallbackUs);
+	void Reset();
+	void Callback(SimulatedReceiver& aReceiver, TUint aJob);
+	void WaitAllAdded();
+	void WaitAllRemoved();
+	TUint64 AddedUs() const {return (iAddedUs);}
+	TUint Callbacks() const {return (iCallbacks);}
+	TUint Errors() const {return (iErrors);}
+	SimulatedReceiver& Receiver(TUint aIndex) {return (*iReceivers[aIndex]);}
+	~SimulatedHouse();
+
+private:
+	// IReceiverManager2JobHandler
+	virtual void Execute(ReceiverManager2JobNode& aNode, TUint aJob);
+	virtual void AddRef(ReceiverManager2JobNode& aNode);
+	virtual void RemoveRef(ReceiverManager2JobNode& aNode);
+
+private:
+	Environment& iEnv;
+	TUint iCallbackUs;
+	std::vector<SimulatedReceiver*> iReceivers;
+	Mutex iMutex;
+	Semaphore iAllAdded;
+	Semaphore iAllRemoved;
+	TUint iAdded;
+	TUint iRemoved;
+	TUint iCallbacks;
+	TUint iErrors;
+	std::vector<TBool> iExecuting; // per device
+	TUint64 iStartUs;
+	TUint64 iAddedUs;
+};
+
+// ISimulatedJobs is the engine under test
+
+class ISimulatedJobs
+{
+public:
+	virtual void Schedule(SimulatedReceiver& aReceiver, ReceiverManager2Jobs::EJob aJob) = 0;
+	virtual ~ISimulatedJobs() {}
+};
+
+class SimulatedJobsPool : public ISimulatedJobs
+{
+public:
+	SimulatedJobsPool(SimulatedHouse& aHouse, TUint aWorkers) : iJobs(aHouse, aWorkers) {}
+	virtual void Schedule(SimulatedReceiver& aReceiver, ReceiverManager2Jobs::EJob aJob) {iJobs.Schedule(aReceiver, aJob);}
+	TUint Executed() const {return (iJobs.Executed());}
+	TUint Coalesced() const {return (iJobs.Coalesced());}
+	virtual ~SimulatedJobsPool() {iJobs.Stop();}
+
+private:
+	ReceiverManager2Jobs iJobs;
+};
+
+// The previous ReceiverManager2 design: a single thread and a Fifo of 20 jobs that blocks producers
+
+class SimulatedJobsFifo : public ISimulatedJobs
+{
+	static const TUint kMaxJobCount = 20;
+
+public:
+	SimulatedJobsFifo(SimulatedHouse& aHouse);
+	virtual void Schedule(SimulatedReceiver& aReceiver, ReceiverManager2Jobs::EJob aJob);
+	virtual ~SimulatedJobsFifo();
+
+private:
+	void Run();
+
+private:
+	struct Job
+	{
+		SimulatedReceiver* iReceiver;
+		TUint iJob;
+	};
+
+	SimulatedHouse& iHouse;
+	Fifo<Job> iReady;
+	ThreadFunctor* iThread;
+};
+
+class SimulatedProducer
+{
+public:
+	SimulatedProducer(SimulatedHouse& aHouse, ISimulatedJobs& aJobs, TUint aFirst, TUint aStep, TUint aCount, TUint aEvents);
+	~SimulatedProducer();
+
+private:
+	void Run();
+
+private:
+	SimulatedHouse& iHouse;
+	ISimulatedJobs& iJobs;
+	TUint iFirst;
+	TUint iStep;
+	TUint iCount;
+	TUint iEvents;
+	ThreadFunctor* iThread;
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+// SimulatedReceiver
+
+SimulatedReceiver::SimulatedReceiver(const Brx& aKey, TUint aDevice)
+	: ReceiverManager2JobNode(aKey)
+	, iDevice(aDevice)
+	, iMutex("SIMR")
+	, iRefCount(1)
+	, iExecuting(false)
+	, iAdded(false)
+	, iRemoved(false)
+	, iCallbacks(0)
+{
+}
+
+// SimulatedHouse
+
+SimulatedHouse::SimulatedHouse(Environment& aEnv, TUint aReceivers, TUint aCallbackUs)
+	: iEnv(aEnv)
+	, iCallbackUs(aCallbackUs)
+	, iMutex("SIMH")
+	, iAllAdded("SIMA", 0)
+	, iAllRemoved("SIMR", 0)
+{
+	for (TUint i = 0; i < aReceivers; i++) {
+		TUint device = i / 2;
+		Bws<32> key("device ");
+		Ascii::AppendDec(key, device);
+		iReceivers.push_back(new SimulatedReceiver(key, device));
+	}
+
+	iExecuting.resize((aReceivers + 1) / 2);
+
+	Reset();
+}
+
+void SimulatedHouse::Reset()
+{
+	iAdded = 0;
+	iRemoved = 0;
+	iCallbacks = 0;
+	iErrors = 0;
+	iAddedUs = 0;
+	iStartUs = OsTimeInUs(iEnv.OsCtx());
+
+	for (TUint i = 0; i < iExecuting.size(); i++) {
+		iExecuting[i] = false;
+	}
+
+	for (TUint i = 0; i < iReceivers.size(); i++) {
+		iReceivers[i]->iAdded = false;
+		iReceivers[i]->iRemoved = false;
+		iReceivers[i]->iCallbacks = 0;
+	}
+}
+
+void SimulatedHouse::Callback(SimulatedReceiver& aReceiver, TUint aJob)
+{
+	TBool error = false;
+
+	iMutex.Wait();
+	if (iExecuting[aReceiver.iDevice]) {
+		error = true;
+	}
+	iExecuting[aReceiver.iDevice] = true;
+	iMutex.Signal();
+
+	aReceiver.iMutex.Wait();
+
+	if (aReceiver.iExecuting || aReceiver.iRemoved) {
+		error = true;
+	}
+
+	if (aJob == ReceiverManager2Jobs::eAdded) {
+		if (aReceiver.iAdded) {
+			error = true;
+		}
+		aReceiver.iAdded = true;
+	}
+	else if (!aReceiver.iAdded) {
+		error = true;
+	}
+
+	aReceiver.iExecuting = true;
+	aReceiver.iCallbacks++;
+
+	aReceiver.iMutex.Signal();
+
+	// the client callback
+
+	if (iCallbackUs >= 1000) {
+		Thread::Sleep(iCallbackUs / 1000);
+	}
+	else {
+		TUint64 until = OsTimeInUs(iEnv.OsCtx()) + iCallbackUs;
+		while (OsTimeInUs(iEnv.OsCtx()) < until) {
+		}
+	}
+
+	aReceiver.iMutex.Wait();
+	aReceiver.iExecuting = false;
+	if (aJob == ReceiverManager2Jobs::eRemoved) {
+		aReceiver.iRemoved = true;
+	}
+	aReceiver.iMutex.Signal();
+
+	iMutex.Wait();
+
+	iExecuting[aReceiver.iDevice] = false;
+	iCallbacks++;
+
+	if (error) {
+		iErrors++;
+	}
+
+	if (aJob == ReceiverManager2Jobs::eAdded && ++iAdded == iReceivers.size()) {
+		iAddedUs = OsTimeInUs(iEnv.OsCtx()) - iStartUs;
+		iAllAdded.Signal();
+	}
+
+	if (aJob == ReceiverManager2Jobs::eRemoved && ++iRemoved == iReceivers.size()) {
+		iAllRemoved.Signal();
+	}
+
+	iMutex.Signal();
+}
+
+void SimulatedHouse::WaitAllAdded()
+{
+	iAllAdded.Wait();
+}
+
+void SimulatedHouse::WaitAllRemoved()
+{
+	iAllRemoved.Wait();
+}
+
+void SimulatedHouse::Execute(ReceiverManager2JobNode& aNode, TUint aJob)
+{
+	Callback(static_cast<SimulatedReceiver&>(aNode), aJob);
+}
+
+void SimulatedHouse::AddRef(ReceiverManager2JobNode& aNode)
+{
+	SimulatedReceiver& receiver = static_cast<SimulatedReceiver&>(aNode);
+	receiver.iMutex.Wait();
+	receiver.iRefCount++;
+	receiver.iMutex.Signal();
+}
+
+void SimulatedHouse::RemoveRef(ReceiverManager2JobNode& aNode)
+{
+	SimulatedReceiver& receiver = static_cast<SimulatedReceiver&>(aNode);
+	receiver.iMutex.Wait();
+	receiver.iRefCount--;
+	receiver.iMutex.Signal();
+}
+
+SimulatedHouse::~SimulatedHouse()
+{
+	for (TUint i = 0; i < iReceivers.size(); i++) {
+		ASSERT(iReceivers[i]->iRefCount == 1);
+		delete (iReceivers[i]);
+	}
+}
+
+// SimulatedJobsFifo
+
+SimulatedJobsFifo::SimulatedJobsFifo(SimulatedHouse& aHouse)
+	: iHouse(aHouse)
+	, iReady(kMaxJobCount)
+{
+	iThread = new ThreadFunctor("SIMF", MakeFunctor(*this, &SimulatedJobsFifo::Run));
+	iThread->Start();
+}
+
+void SimulatedJobsFifo::Schedule(SimulatedReceiver& aReceiver, ReceiverManager2Jobs::EJob aJob)
+{
+	Job job;
+	job.iReceiver = &aReceiver;
+	job.iJob = aJob;
+	iReady.Write(job);
+}
+
+void SimulatedJobsFifo::Run()
+{
+	for (;;) {
+		Job job = iReady.Read();
+
+		if (job.iReceiver == 0) {
+			break;
+		}
+
+		iHouse.Callback(*job.iReceiver, job.iJob);
+	}
+}
+
+SimulatedJobsFifo::~SimulatedJobsFifo()
+{
+	Job job;
+	job.iReceiver = 0;
+	job.iJob = 0;
+	iReady.Write(job);
+	delete (iThread);
+}
+
+// SimulatedProducer
+
+SimulatedProducer::SimulatedProducer(SimulatedHouse& aHouse, ISimulatedJobs& aJobs, TUint aFirst, TUint aStep, TUint aCount, TUint aEvents)
+	: iHouse(aHouse)
+	, iJobs(aJobs)
+	, iFirst(aFirst)
+	, iStep(aStep)
+	, iCount(aCount)
+	, iEvents(aEvents)
+{
+	iThread = new ThreadFunctor("SIMP", MakeFunctor(*this, &SimulatedProducer::Run));
+	iThread->Start();
+}
+
+void SimulatedProducer::Run()
+{
+	static const ReceiverManager2Jobs::EJob kEvents[] = {
+		ReceiverManager2Jobs::eChanged,
+		ReceiverManager2Jobs::eVolumeChanged,
+		ReceiverManager2Jobs::eChanged,
+		ReceiverManager2Jobs::eMuteChanged,
+	};
+
+	for (TUint i = iFirst; i < iCount; i += iStep) {
+		SimulatedReceiver& receiver = iHouse.Receiver(i);
+		iJobs.Schedule(receiver, ReceiverManager2Jobs::eAdded);
+		iJobs.Schedule(receiver, ReceiverManager2Jobs::eVolumeControlChanged);
+		for (TUint j = 0; j < iEvents; j++) {
+			iJobs.Schedule(receiver, kEvents[j % (sizeof(kEvents) / sizeof(kEvents[0]))]);
+		}
+	}
+}
+
+SimulatedProducer::~SimulatedProducer()
+{
+	delete (iThread);
+}
+
+static void RunHouse(Environment& aEnv, SimulatedHouse& aHouse, ISimulatedJobs& aJobs, TUint aReceivers, TUint aEvents, TUint aProducers, const TChar* aName)
+{
+	aHouse.Reset();
+
+	TUint64 start = OsTimeInUs(aEnv.OsCtx());
+
+	std::vector<SimulatedProducer*> producers;
+
+	for (TUint i = 0; i < aProducers; i++) {
+		producers.push_back(new SimulatedProducer(aHouse, aJobs, i, aProducers, aReceivers, aEvents));
+	}
+
+	for (TUint i = 0; i < aProducers; i++) {
+		delete (producers[i]); // joins
+	}
+
+	TUint64 produced = OsTimeInUs(aEnv.OsCtx()) - start;
+
+	aHouse.WaitAllAdded();
+
+	for (TUint i = 0; i < aReceivers; i++) {
+		aJobs.Schedule(aHouse.Receiver(i), ReceiverManager2Jobs::eRemoved);
+	}
+
+	aHouse.WaitAllRemoved();
+
+	TUint64 total = OsTimeInUs(aEnv.OsCtx()) - start;
+
+	printf("%-20s producers done %6d ms, full receiver list %6d ms, all removed %6d ms, callbacks %7d, ordering errors %d\n",
+		aName,
+		(TUint)(produced / 1000),
+		(TUint)(aHouse.AddedUs() / 1000),
+		(TUint)(total / 1000),
+		aHouse.Callbacks(),
+		aHouse.Errors());
+}
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+	InitialisationParams* initParams = InitialisationParams::Create();
+
+    OptionParser parser;
+    OptionUint optionReceivers("-n", "--receivers", 200, "Number of simulated receivers");
+    parser.AddOption(&optionReceivers);
+    OptionUint optionEvents("-e", "--events", 20, "Number of state change events per receiver");
+    parser.AddOption(&optionEvents);
+    OptionUint optionCallback("-c", "--callback", 1000, "Time taken by each handler callback in us");
+    parser.AddOption(&optionCallback);
+    OptionUint optionWorkers("-w", "--workers", 4, "Number of job workers");
+    parser.AddOption(&optionWorkers);
+    OptionUint optionProducers("-p", "--producers", 4, "Number of producer threads");
+    parser.AddOption(&optionProducers);
+    if (!parser.Parse(aArgc, aArgv)) {
+        return (1);
+    }
+
+    Library* lib = new Library(initParams);
+
+	Environment& env = lib->Env();
+
+	TUint receivers = optionReceivers.Value();
+	TUint events = optionEvents.Value();
+	TUint producers = optionProducers.Value();
+	TUint workers = optionWorkers.Value();
+
+	if (receivers == 0 || producers == 0 || workers == 0) {
+		printf("receivers, producers and workers must be non-zero\n");
+		delete lib;
+		return (1);
+	}
+
+	printf("%d receivers, %d events each, %d us per callback, %d producers\n", receivers, events, optionCallback.Value(), producers);
+
+	SimulatedHouse* house = new SimulatedHouse(env, receivers, optionCallback.Value());
+
+	{
+		SimulatedJobsFifo jobs(*house);
+		RunHouse(env, *house, jobs, receivers, events, producers, "fifo (1 thread)");
+	}
+
+	{
+		SimulatedJobsPool jobs(*house, 1);
+		RunHouse(env, *house, jobs, receivers, events, producers, "coalesced (1 worker)");
+		printf("%-20s coalesced %d, executed %d\n", "", jobs.Coalesced(), jobs.Executed());
+	}
+
+	{
+		Bws<32> name("coalesced (");
+		Ascii::AppendDec(name, workers);
+		name.Append(" workers)");
+		Brhz label(name);
+
+		SimulatedJobsPool jobs(*house, workers);
+		RunHouse(env, *house, jobs, receivers, events, producers, label.CString());
+		printf("%-20s coalesced %d, executed %d\n", "", jobs.Coalesced(), jobs.Executed());
+	}
+
+	delete (house);
+
+	delete lib;
+
+	return (0);
+}
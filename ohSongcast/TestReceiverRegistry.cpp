@@ -0,0 +1,326 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Private/Ascii.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Os.h>
+
+#include <vector>
+#include <stdio.h>
+
+#include "ReceiverRegistry.h"
+
+
+#ifdef _WIN32
+#define CDECL __cdecl
+#else
+#define CDECL
+#endif
+
+// Measures the cost of applying a room's source list to the receivers already known for the house
+//
+// A house of N receivers is spread across rooms of up to 16 receivers, plus one large room holding
+// the rest. Each update changes one source in the large room (one receiver goes, another arrives)
+// and is applied twice: by the nested scans ReceiverManager1Room::Changed used to do over an
+// unsorted list, and through ReceiverRegistry as it does now.
+
+namespace OpenHome {
+namespace Av {
+
+class SimulatedReceiver
+{
+public:
+	SimulatedReceiver(const Brx& aRoom, const Brx& aUdn, TUint aSourceIndex) : iRoom(aRoom), iUdn(aUdn), iSourceIndex(aSourceIndex) {}
+	const Brx& Room() const {return (iRoom);}
+	const Brx& Udn() const {return (iUdn);}
+
+public:
+	Bws<32> iRoom;
+	Bws<32> iUdn;
+	TUint iSourceIndex;
+};
+
+class SimulatedSource
+{
+public:
+	SimulatedSource(const Brx& aUdn) : iUdn(aUdn) {}
+
+public:
+	Bws<32> iUdn;
+};
+
+class SimulatedHouse
+{
+	static const TUint kRoomSize = 16;
+
+public:
+	SimulatedHouse(TUint aReceivers);
+	const Brx& LargeRoom() const {return (iLargeRoom);}
+	const std::vector<SimulatedSource*>& LargeRoomSources() const {return (iSources);}
+	void Change(TUint aUpdate);
+	void Populate(std::vector<SimulatedReceiver*>& aList, ReceiverRegistry<SimulatedReceiver>& aRegistry) const;
+	~SimulatedHouse();
+
+private:
+	Bws<32> iLargeRoom;
+	std::vector<SimulatedReceiver*> iOthers;
+	std::vector<SimulatedSource*> iSources;
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+static void MakeUdn(Bwx& aUdn, TUint aIndex)
+{
+	aUdn.Replace("uuid:4c494e4e-0026-0f21-");
+	Ascii::AppendDec(aUdn, aIndex);
+}
+
+// SimulatedHouse
+
+SimulatedHouse::SimulatedHouse(TUint aReceivers)
+	: iLargeRoom("Large Room")
+{
+	TUint others = aReceivers / 2;
+
+	for (TUint i = 0; i < others; i++) {
+		Bws<32> room("Room ");
+		Ascii::AppendDec(room, i / kRoomSize);
+		Bws<32> udn;
+		MakeUdn(udn, i);
+		iOthers.push_back(new SimulatedReceiver(room, udn, i % kRoomSize));
+	}
+
+	for (TUint i = others; i < aReceivers; i++) {
+		Bws<32> udn;
+		MakeUdn(udn, i);
+		iSources.push_back(new SimulatedSource(udn));
+	}
+}
+
+void SimulatedHouse::Change(TUint aUpdate)
+{
+	// replace one source with a device not yet seen
+
+	TUint index = aUpdate % iSources.size();
+	MakeUdn(iSources[index]->iUdn, 1000000 + aUpdate);
+}
+
+void SimulatedHouse::Populate(std::vector<SimulatedReceiver*>& aList, ReceiverRegistry<SimulatedReceiver>& aRegistry) const
+{
+	for (TUint i = 0; i < iOthers.size(); i++) {
+		SimulatedReceiver* receiver = new SimulatedReceiver(iOthers[i]->iRoom, iOthers[i]->iUdn, iOthers[i]->iSourceIndex);
+		aList.push_back(receiver);
+		aRegistry.Add(receiver->Room(), receiver->Udn(), *receiver);
+	}
+
+	for (TUint i = 0; i < iSources.size(); i++) {
+		SimulatedReceiver* receiver = new SimulatedReceiver(iLargeRoom, iSources[i]->iUdn, i);
+		aList.push_back(receiver);
+		aRegistry.Add(receiver->Room(), receiver->Udn(), *receiver);
+	}
+}
+
+SimulatedHouse::~SimulatedHouse()
+{
+	for (TUint i = 0; i < iOthers.size(); i++) {
+		delete (iOthers[i]);
+	}
+
+	for (TUint i = 0; i < iSources.size(); i++) {
+		delete (iSources[i]);
+	}
+}
+
+// The previous ReceiverManager1Room::Changed: an unsorted list and nested scans
+
+static TUint UpdateScan(const SimulatedHouse& aHouse, std::vector<SimulatedReceiver*>& aList)
+{
+	const std::vector<SimulatedSource*>& sources = aHouse.LargeRoomSources();
+
+	std::vector<SimulatedReceiver*> toadd;
+	std::vector<SimulatedReceiver*> todelete;
+
+	for (TUint i = 0; i < sources.size(); i++) {
+		toadd.push_back(new SimulatedReceiver(aHouse.LargeRoom(), sources[i]->iUdn, i));
+	}
+
+	std::vector<SimulatedReceiver*>::iterator it = aList.begin();
+
+	while (it != aList.end()) {
+		SimulatedReceiver* receiver = *it;
+
+		if (receiver->Room() == aHouse.LargeRoom()) {
+			TBool found = false;
+
+			std::vector<SimulatedReceiver*>::iterator it2 = toadd.begin();
+
+			while (it2 != toadd.end()) {
+				SimulatedReceiver* candidate = *it2;
+				if (candidate->Udn() == receiver->Udn()) {
+					receiver->iSourceIndex = candidate->iSourceIndex;
+					delete (candidate);
+					toadd.erase(it2);
+					found = true;
+					break;
+				}
+				it2++;
+			}
+
+			if (!found) {
+				todelete.push_back(receiver);
+			}
+		}
+
+		it++;
+	}
+
+	for (it = todelete.begin(); it != todelete.end(); it++) {
+		std::vector<SimulatedReceiver*>::iterator it2 = aList.begin();
+
+		while (it2 != aList.end()) {
+			if (*it == *it2) {
+				delete (*it);
+				aList.erase(it2);
+				break;
+			}
+			it2++;
+		}
+	}
+
+	for (it = toadd.begin(); it != toadd.end(); it++) {
+		aList.push_back(*it);
+	}
+
+	return ((TUint)(todelete.size() + toadd.size()));
+}
+
+// ReceiverManager1Room::Changed now
+
+static TUint UpdateRegistry(const SimulatedHouse& aHouse, ReceiverRegistry<SimulatedReceiver>& aRegistry)
+{
+	const std::vector<SimulatedSource*>& sources = aHouse.LargeRoomSources();
+
+	TUint first = aRegistry.RoomFirst(aHouse.LargeRoom());
+	TUint existing = aRegistry.RoomCount(aHouse.LargeRoom());
+
+	std::vector<TBool> found(existing, false);
+	std::vector<TUint> toadd;
+
+	for (TUint i = 0; i < sources.size(); i++) {
+		TUint index = aRegistry.IndexOf(aHouse.LargeRoom(), sources[i]->iUdn);
+
+		if (index == aRegistry.Count()) {
+			toadd.push_back(i);
+		}
+		else if (!found[index - first]) {
+			found[index - first] = true;
+			aRegistry.At(index).iSourceIndex = i;
+		}
+	}
+
+	std::vector<SimulatedReceiver*> todelete;
+
+	for (TUint i = 0; i < existing; i++) {
+		if (!found[i]) {
+			todelete.push_back(&aRegistry.At(first + i));
+		}
+	}
+
+	for (TUint i = 0; i < todelete.size(); i++) {
+		aRegistry.Remove(todelete[i]->Room(), todelete[i]->Udn(), *todelete[i]);
+		delete (todelete[i]);
+	}
+
+	for (TUint i = 0; i < toadd.size(); i++) {
+		SimulatedReceiver* receiver = new SimulatedReceiver(aHouse.LargeRoom(), sources[toadd[i]]->iUdn, toadd[i]);
+		aRegistry.Add(receiver->Room(), receiver->Udn(), *receiver);
+	}
+
+	return ((TUint)(todelete.size() + toadd.size()));
+}
+
+static void Run(Environment& aEnv, TUint aReceivers, TUint aUpdates)
+{
+	SimulatedHouse house(aReceivers);
+
+	std::vector<SimulatedReceiver*> list;
+	ReceiverRegistry<SimulatedReceiver> unused;
+	house.Populate(list, unused);
+
+	std::vector<SimulatedReceiver*> owned;
+	ReceiverRegistry<SimulatedReceiver> registry;
+	house.Populate(owned, registry);
+
+	TUint64 scanUs = 0;
+	TUint64 registryUs = 0;
+	TUint scanChanges = 0;
+	TUint registryChanges = 0;
+
+	for (TUint i = 0; i < aUpdates; i++) {
+		house.Change(i);
+
+		TUint64 start = OsTimeInUs(aEnv.OsCtx());
+		scanChanges += UpdateScan(house, list);
+		TUint64 middle = OsTimeInUs(aEnv.OsCtx());
+		registryChanges += UpdateRegistry(house, registry);
+		TUint64 end = OsTimeInUs(aEnv.OsCtx());
+
+		scanUs += middle - start;
+		registryUs += end - middle;
+	}
+
+	ASSERT(scanChanges == registryChanges);
+	ASSERT(registry.Count() == aReceivers);
+
+	printf("%6d receivers: scan %8.2f us/update, registry %8.2f us/update, %d changes\n",
+		aReceivers,
+		(double)scanUs / aUpdates,
+		(double)registryUs / aUpdates,
+		registryChanges);
+
+	for (TUint i = 0; i < list.size(); i++) {
+		delete (list[i]);
+	}
+
+	// what remains in the registry replaced the originals as they were removed
+
+	for (TUint i = 0; i < registry.Count(); i++) {
+		delete (&registry.At(i));
+	}
+}
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+	InitialisationParams* initParams = InitialisationParams::Create();
+
+    OptionParser parser;
+    OptionUint optionUpdates("-u", "--updates", 1000, "Number of room updates per house size");
+    parser.AddOption(&optionUpdates);
+    if (!parser.Parse(aArgc, aArgv)) {
+        return (1);
+    }
+
+    Library* lib = new Library(initParams);
+
+	TUint updates = optionUpdates.Value();
+
+	if (updates == 0) {
+		updates = 1;
+	}
+
+	Run(lib->Env(), 10, updates);
+	Run(lib->Env(), 100, updates);
+	Run(lib->Env(), 1000, updates);
+
+	delete lib;
+
+	return (0);
+}
@@ -0,0 +1,322 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Os.h>
+
+#include <vector>
+#include <stdio.h>
+
+#include "Songcast.h"
+
+#ifdef _WIN32
+#define CDECL __cdecl
+#else
+#define CDECL
+#endif
+
+// Counts the receiver callbacks crossing the Songcast C API for a simulated house
+//
+// The house goes through three phases, driven in real time the way the receiver managers would:
+//
+//   startup  every receiver is added, connects and reports its volume state
+//   drag     the volume of a group of receivers is dragged, one event per receiver per slider step
+//   close    every receiver is removed
+//
+// Each phase is run once with per change callbacks and once for each batch window given.
+
+namespace OpenHome {
+namespace Av {
+
+class SimulatedHouse : public IReceiverBatchSource
+{
+public:
+	SimulatedHouse(TUint aReceivers);
+	TUint Receivers() const {return ((TUint)iVolumes.size());}
+	void SetVolume(TUint aReceiver, TUint aValue);
+	THandle Handle(TUint aReceiver) const {return ((THandle)(&iVolumes[aReceiver]));}
+	TUint References() const;
+
+	// IReceiverBatchSource
+	virtual void Snapshot(THandle aReceiver, ReceiverSnapshot& aSnapshot);
+	virtual void AddRef(THandle aReceiver);
+	virtual void RemoveRef(THandle aReceiver);
+
+private:
+	mutable Mutex iMutex;
+	std::vector<TUint> iVolumes;
+	TUint iReferences;
+};
+
+class CallbackCounter
+{
+public:
+	CallbackCounter(ReceiverBatcher& aBatcher);
+	void Notify(THandle aReceiver, ECallbackType aType);
+	void Clear();
+	TUint Callbacks() const;
+	TUint Entries() const;
+	TUint LargestBatch() const;
+
+	static void STDCALL Batch(void* aPtr, const ReceiverSnapshot* aReceivers, uint32_t aCount);
+
+private:
+	ReceiverBatcher& iBatcher;
+	mutable Mutex iMutex;
+	TUint iCallbacks;
+	TUint iEntries;
+	TUint iLargestBatch;
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+// SimulatedHouse
+
+SimulatedHouse::SimulatedHouse(TUint aReceivers)
+	: iMutex("SIMH")
+	, iVolumes(aReceivers, 0)
+	, iReferences(0)
+{
+}
+
+void SimulatedHouse::SetVolume(TUint aReceiver, TUint aValue)
+{
+	AutoMutex mutex(iMutex);
+	iVolumes[aReceiver] = aValue;
+}
+
+TUint SimulatedHouse::References() const
+{
+	AutoMutex mutex(iMutex);
+	return (iReferences);
+}
+
+void SimulatedHouse::Snapshot(THandle aReceiver, ReceiverSnapshot& aSnapshot)
+{
+	AutoMutex mutex(iMutex);
+	aSnapshot.iStatus = eConnected;
+	aSnapshot.iHasVolumeControl = 1;
+	aSnapshot.iVolume = *((TUint*)aReceiver);
+	aSnapshot.iMute = 0;
+	aSnapshot.iVolumeLimit = 100;
+}
+
+void SimulatedHouse::AddRef(THandle /*aReceiver*/)
+{
+	AutoMutex mutex(iMutex);
+	iReferences++;
+}
+
+void SimulatedHouse::RemoveRef(THandle /*aReceiver*/)
+{
+	AutoMutex mutex(iMutex);
+	ASSERT(iReferences > 0);
+	iReferences--;
+}
+
+// CallbackCounter
+
+CallbackCounter::CallbackCounter(ReceiverBatcher& aBatcher)
+	: iBatcher(aBatcher)
+	, iMutex("CBCT")
+	, iCallbacks(0)
+	, iEntries(0)
+	, iLargestBatch(0)
+{
+}
+
+// as Songcast::Notify does
+
+void CallbackCounter::Notify(THandle aReceiver, ECallbackType aType)
+{
+	if (!iBatcher.Changed(aReceiver, aType)) {
+		AutoMutex mutex(iMutex);
+		iCallbacks++;
+		iEntries++;
+	}
+}
+
+void CallbackCounter::Clear()
+{
+	AutoMutex mutex(iMutex);
+	iCallbacks = 0;
+	iEntries = 0;
+	iLargestBatch = 0;
+}
+
+TUint CallbackCounter::Callbacks() const
+{
+	AutoMutex mutex(iMutex);
+	return (iCallbacks);
+}
+
+TUint CallbackCounter::Entries() const
+{
+	AutoMutex mutex(iMutex);
+	return (iEntries);
+}
+
+TUint CallbackCounter::LargestBatch() const
+{
+	AutoMutex mutex(iMutex);
+	return (iLargestBatch);
+}
+
+void STDCALL CallbackCounter::Batch(void* aPtr, const ReceiverSnapshot* /*aReceivers*/, uint32_t aCount)
+{
+	CallbackCounter* counter = (CallbackCounter*)aPtr;
+	AutoMutex mutex(counter->iMutex);
+	counter->iCallbacks++;
+	counter->iEntries += aCount;
+	if (aCount > counter->iLargestBatch) {
+		counter->iLargestBatch = aCount;
+	}
+}
+
+static void Startup(SimulatedHouse& aHouse, CallbackCounter& aCounter, TUint aDurationMs)
+{
+	TUint receivers = aHouse.Receivers();
+
+	for (TUint i = 0; i < receivers; i++) {
+		THandle handle = aHouse.Handle(i);
+
+		aCounter.Notify(handle, eAdded);
+		aCounter.Notify(handle, eChanged); // connecting
+		aCounter.Notify(handle, eChanged); // connected
+		aCounter.Notify(handle, eVolumeControlChanged);
+		aCounter.Notify(handle, eVolumeChanged);
+		aCounter.Notify(handle, eMuteChanged);
+		aCounter.Notify(handle, eVolumeLimitChanged);
+
+		Thread::Sleep(aDurationMs / receivers);
+	}
+}
+
+static void Drag(SimulatedHouse& aHouse, CallbackCounter& aCounter, TUint aDragged, TUint aDurationMs, TUint aStepMs)
+{
+	TUint steps = aDurationMs / aStepMs;
+
+	for (TUint step = 0; step < steps; step++) {
+		for (TUint i = 0; i < aDragged; i++) {
+			aHouse.SetVolume(i, step % 100);
+			aCounter.Notify(aHouse.Handle(i), eVolumeChanged);
+		}
+
+		Thread::Sleep(aStepMs);
+	}
+}
+
+static void Close(SimulatedHouse& aHouse, CallbackCounter& aCounter)
+{
+	for (TUint i = 0; i < aHouse.Receivers(); i++) {
+		aCounter.Notify(aHouse.Handle(i), eRemoved);
+	}
+}
+
+static void Report(const TChar* aPhase, TUint aWindowMs, TUint aChanges, CallbackCounter& aCounter)
+{
+	if (aWindowMs == 0) {
+		printf("%-8s per change  %6d changes %6d callbacks\n", aPhase, aChanges, aCounter.Callbacks());
+	}
+	else {
+		printf("%-8s %4d ms      %6d changes %6d callbacks %6d entries, largest batch %d\n", aPhase, aWindowMs, aChanges, aCounter.Callbacks(), aCounter.Entries(), aCounter.LargestBatch());
+	}
+
+	aCounter.Clear();
+}
+
+static void Run(TUint aReceivers, TUint aWindowMs, TUint aStartupMs, TUint aDragged, TUint aDragMs, TUint aStepMs)
+{
+	SimulatedHouse house(aReceivers);
+	ReceiverBatcher batcher(house);
+	CallbackCounter counter(batcher);
+
+	if (aWindowMs > 0) {
+		batcher.SetCallback(CallbackCounter::Batch, &counter, aWindowMs);
+	}
+
+	// each phase is given time for its last batch to be delivered before it is reported
+
+	Startup(house, counter, aStartupMs);
+	Thread::Sleep(aWindowMs * 2 + 10);
+	TUint changes = aReceivers * 7;
+	Report("startup", aWindowMs, changes, counter);
+
+	Drag(house, counter, aDragged, aDragMs, aStepMs);
+	Thread::Sleep(aWindowMs * 2 + 10);
+	changes = aDragged * (aDragMs / aStepMs);
+	Report("drag", aWindowMs, changes, counter);
+
+	Close(house, counter);
+	batcher.Stop();
+	changes = aReceivers;
+	Report("close", aWindowMs, changes, counter);
+
+	ASSERT(house.References() == 0);
+}
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+	InitialisationParams* initParams = InitialisationParams::Create();
+
+    OptionParser parser;
+    OptionUint optionReceivers("-n", "--receivers", 200, "Number of receivers in the house");
+    OptionUint optionWindow("-w", "--window", 0, "Batch window in ms (0 runs 10, 50 and 100 ms)");
+    OptionUint optionStartup("-s", "--startup", 2000, "Time in ms over which the receivers appear");
+    OptionUint optionDragged("-g", "--dragged", 20, "Number of receivers whose volume is dragged");
+    OptionUint optionDrag("-d", "--drag", 2000, "Duration of the volume drag in ms");
+    OptionUint optionStep("-t", "--step", 20, "Interval between volume steps in ms");
+    parser.AddOption(&optionReceivers);
+    parser.AddOption(&optionWindow);
+    parser.AddOption(&optionStartup);
+    parser.AddOption(&optionDragged);
+    parser.AddOption(&optionDrag);
+    parser.AddOption(&optionStep);
+    if (!parser.Parse(aArgc, aArgv)) {
+        return (1);
+    }
+
+    Library* lib = new Library(initParams);
+
+	TUint receivers = optionReceivers.Value();
+	TUint dragged = optionDragged.Value();
+	TUint step = optionStep.Value();
+
+	if (receivers == 0) {
+		receivers = 1;
+	}
+
+	if (dragged > receivers) {
+		dragged = receivers;
+	}
+
+	if (step == 0) {
+		step = 1;
+	}
+
+	printf("%d receivers, %d dragged\n", receivers, dragged);
+
+	Run(receivers, 0, optionStartup.Value(), dragged, optionDrag.Value(), step);
+
+	if (optionWindow.Value() > 0) {
+		Run(receivers, optionWindow.Value(), optionStartup.Value(), dragged, optionDrag.Value(), step);
+	}
+	else {
+		Run(receivers, 10, optionStartup.Value(), dragged, optionDrag.Value(), step);
+		Run(receivers, 50, optionStartup.Value(), dragged, optionDrag.Value(), step);
+		Run(receivers, 100, optionStartup.Value(), dragged, optionDrag.Value(), step);
+	}
+
+	delete lib;
+
+	return (0);
+}
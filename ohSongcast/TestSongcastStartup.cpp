@@ -0,0 +1,128 @@
+#include <OpenHome/OhNetTypes.h>
+#include <OpenHome/Net/Core/OhNet.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Os.h>
+
+#include <vector>
+#include <stdio.h>
+
+#include "Icon.h"
+#include "Songcast.h"
+
+#ifdef _WIN32
+#define CDECL __cdecl
+#else
+#define CDECL
+#endif
+
+// Reports how long Songcast takes to start
+//
+// SongcastCreate returns once the sender can stream; discovery starts in the background. This
+// reports the time until SongcastCreate returns, the time until the background phases are done,
+// the time to the first receiver found, and each startup phase as Songcast recorded it.
+
+using namespace OpenHome;
+using namespace OpenHome::Net;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+static const TUint kStartupPhases = 6; // dv stack, device, subnets, sender, cp stack, receiver manager
+
+static Environment* gEnv = 0;
+static TUint64 gCreateUs = 0;
+static TUint64 gFirstReceiverUs = 0;
+
+void STDCALL receiverFound(void* /* aPtr */, ECallbackType aType, THandle /* aReceiver */)
+{
+	if (aType == eAdded && gFirstReceiverUs == 0) {
+		gFirstReceiverUs = OsTimeInUs(gEnv->OsCtx()) - gCreateUs;
+	}
+}
+
+void STDCALL subnetIgnored(void* /* aPtr */, ECallbackType /* aType */, THandle /* aSubnet */)
+{
+}
+
+void STDCALL configurationIgnored(void* /* aPtr */, THandle /* aSongcast */)
+{
+}
+
+int CDECL main(int aArgc, char* aArgv[])
+{
+    OptionParser parser;
+    OptionUint optionAdapter("-a", "--adapter", 0, "[adapter] index of network adapter to use");
+    parser.AddOption(&optionAdapter);
+    OptionUint optionWait("-w", "--wait", 5000, "Time in ms to wait for the first receiver");
+    parser.AddOption(&optionWait);
+
+    if (!parser.Parse(aArgc, aArgv)) {
+        return 1;
+    }
+
+    InitialisationParams* initParams = InitialisationParams::Create();
+
+	Library* lib = new Library(initParams);
+
+	gEnv = &lib->Env();
+
+    std::vector<NetworkAdapter*>* subnetList = lib->CreateSubnetList();
+    TIpAddress subnet = (*subnetList)[optionAdapter.Value()]->Subnet();
+    Library::DestroySubnetList(subnetList);
+
+	gCreateUs = OsTimeInUs(gEnv->OsCtx());
+
+	THandle songcast = SongcastCreate("av.openhome.org", subnet, 0, 4, 100, false, true, 99, receiverFound, 0, subnetIgnored, 0, configurationIgnored, 0, NULL, 0, NULL, 0, "OpenHome", "http://www.openhome.org", "http://www.openhome.org", icon_png, icon_png_len, "image/png");
+
+	TUint64 createdUs = OsTimeInUs(gEnv->OsCtx()) - gCreateUs;
+
+	if (songcast == 0) {
+		printf("Songcast error\n");
+        delete lib;
+		return(1);
+	}
+
+	TUint64 backgroundUs = 0;
+
+	for (TUint waited = 0; waited < 30000; waited += 10) {
+		if (SongcastStartupPhaseCount(songcast) >= kStartupPhases) {
+			backgroundUs = OsTimeInUs(gEnv->OsCtx()) - gCreateUs;
+			break;
+		}
+		Thread::Sleep(10);
+	}
+
+	for (TUint waited = 0; waited < optionWait.Value() && gFirstReceiverUs == 0; waited += 10) {
+		Thread::Sleep(10);
+	}
+
+	printf("SongcastCreate returned after   %8d us\n", (TUint)createdUs);
+	printf("Background startup complete at  %8d us\n", (TUint)backgroundUs);
+
+	if (gFirstReceiverUs != 0) {
+		printf("First receiver found at         %8d us\n", (TUint)gFirstReceiverUs);
+	}
+	else {
+		printf("No receiver found within %d ms\n", optionWait.Value());
+	}
+
+	printf("\n%-20s %10s %10s\n", "phase", "start us", "took us");
+
+	TUint phases = SongcastStartupPhaseCount(songcast);
+
+	for (TUint i = 0; i < phases; i++) {
+		printf("%-20s %10d %10d\n", SongcastStartupPhaseName(songcast, i), SongcastStartupPhaseStartUs(songcast, i), SongcastStartupPhaseUs(songcast, i));
+	}
+
+	TUint64 destroyUs = OsTimeInUs(gEnv->OsCtx());
+	SongcastDestroy(songcast);
+	destroyUs = OsTimeInUs(gEnv->OsCtx()) - destroyUs;
+
+	printf("\nSongcastDestroy took            %8d us\n", (TUint)destroyUs);
+
+    delete lib;
+
+    return (0);
+}
@@ -603,6 +603,22 @@ void OhmSenderDriverWindows::Resend(const Brx& aFrames)
     DeviceIoControl(iHandle, IOCTL_KS_PROPERTY, &prop, sizeof(KSPROPERTY), ptr, bytes, &returned, 0);
 }
 
+// the audio history is kept by the kernel driver, which offers no fast start
+
+void OhmSenderDriverWindows::FastStart()
+{
+}
+
+// the kernel driver sends to one endpoint, so offers no hybrid delivery
+
+void OhmSenderDriverWindows::AddUnicast(const Endpoint& /*aEndpoint*/)
+{
+}
+
+void OhmSenderDriverWindows::RemoveUnicast(const Endpoint& /*aEndpoint*/)
+{
+}
+
 ULONG STDCALL OhmSenderDriverWindows::AddRef()
 {
     return (InterlockedIncrement(&iRefCount));
@@ -54,6 +54,9 @@ private:
 	virtual void SetLatency(TUint aValue);
 	virtual void SetTrackPosition(TUint64 aSampleStart, TUint64 aSamplesTotal);
 	virtual void Resend(const Brx& aFrames);
+	virtual void FastStart();
+	virtual void AddUnicast(const Endpoint& aEndpoint);
+	virtual void RemoveUnicast(const Endpoint& aEndpoint);
 
 	// IMMNotificationClient
     ULONG STDCALL AddRef();